@@ -4,6 +4,7 @@
 
 #include "hash-funcs.h"
 #include "path-util.h"
+#include "wyhash.h"
 
 void string_hash_func(const void *p, struct siphash *state) {
         siphash24_compress(p, strlen(p) + 1, state);
@@ -18,6 +19,16 @@ const struct hash_ops string_hash_ops = {
         .compare = string_compare_func
 };
 
+uint64_t string_fast_hash_func(const void *p, uint64_t seed) {
+        return wyhash(p, strlen(p), seed);
+}
+
+const struct hash_ops trusted_string_hash_ops = {
+        .hash = string_hash_func,
+        .compare = string_compare_func,
+        .fast_hash = string_fast_hash_func
+};
+
 void path_hash_func(const void *p, struct siphash *state) {
         const char *q = p;
         size_t n;
@@ -79,6 +90,16 @@ const struct hash_ops trivial_hash_ops = {
         .compare = trivial_compare_func
 };
 
+uint64_t trivial_fast_hash_func(const void *p, uint64_t seed) {
+        return wyhash64((uintptr_t) p, seed);
+}
+
+const struct hash_ops trusted_trivial_hash_ops = {
+        .hash = trivial_hash_func,
+        .compare = trivial_compare_func,
+        .fast_hash = trivial_fast_hash_func
+};
+
 void uint64_hash_func(const void *p, struct siphash *state) {
         siphash24_compress(p, sizeof(uint64_t), state);
 }
@@ -95,6 +116,18 @@ const struct hash_ops uint64_hash_ops = {
         .compare = uint64_compare_func
 };
 
+uint64_t uint64_fast_hash_func(const void *p, uint64_t seed) {
+        /* Cookies and the like are sequential, hence can't be used as their own hash: they'd fill up
+         * neighbouring buckets. A single multiplication spreads them just fine. */
+        return wyhash64(*(const uint64_t*) p, seed);
+}
+
+const struct hash_ops trusted_uint64_hash_ops = {
+        .hash = uint64_hash_func,
+        .compare = uint64_compare_func,
+        .fast_hash = uint64_fast_hash_func
+};
+
 #if SIZEOF_DEV_T != 8
 void devt_hash_func(const void *p, struct siphash *state) {
         siphash24_compress(p, sizeof(dev_t), state);
@@ -5,17 +5,25 @@
 #include "siphash24.h"
 
 typedef void (*hash_func_t)(const void *p, struct siphash *state);
+typedef uint64_t (*fast_hash_func_t)(const void *p, uint64_t seed);
 typedef int (*compare_func_t)(const void *a, const void *b);
 
 struct hash_ops {
         hash_func_t hash;
         compare_func_t compare;
+
+        /* If set, used instead of 'hash'. Cheaper, but not collision resistant, hence only for hash tables
+         * whose keys we choose ourselves, never for anything a peer sent us. */
+        fast_hash_func_t fast_hash;
 };
 
 void string_hash_func(const void *p, struct siphash *state);
 int string_compare_func(const void *a, const void *b) _pure_;
 extern const struct hash_ops string_hash_ops;
 
+uint64_t string_fast_hash_func(const void *p, uint64_t seed) _pure_;
+extern const struct hash_ops trusted_string_hash_ops;
+
 void path_hash_func(const void *p, struct siphash *state);
 int path_compare_func(const void *a, const void *b) _pure_;
 extern const struct hash_ops path_hash_ops;
@@ -26,12 +34,18 @@ void trivial_hash_func(const void *p, struct siphash *state);
 int trivial_compare_func(const void *a, const void *b) _const_;
 extern const struct hash_ops trivial_hash_ops;
 
+uint64_t trivial_fast_hash_func(const void *p, uint64_t seed) _const_;
+extern const struct hash_ops trusted_trivial_hash_ops;
+
 /* 32bit values we can always just embed in the pointer itself, but in order to support 32bit archs we need store 64bit
  * values indirectly, since they don't fit in a pointer. */
 void uint64_hash_func(const void *p, struct siphash *state);
 int uint64_compare_func(const void *a, const void *b) _pure_;
 extern const struct hash_ops uint64_hash_ops;
 
+uint64_t uint64_fast_hash_func(const void *p, uint64_t seed) _pure_;
+extern const struct hash_ops trusted_uint64_hash_ops;
+
 /* On some archs dev_t is 32bit, and on others 64bit. And sometimes it's 64bit on 32bit archs, and sometimes 32bit on
  * 64bit archs. Yuck! */
 #if SIZEOF_DEV_T != 8
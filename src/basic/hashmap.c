@@ -10,12 +10,17 @@
 #include "process-util.h"
 #include "random-util.h"
 #include "set.h"
+#include "unaligned.h"
 
 #if ENABLE_DEBUG_HASHMAP
 #include <pthread.h>
 #include "list.h"
 #endif
 
+#if ENABLE_SWISS_HASHMAP && defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 /*
  * Implementation of hashmaps.
  * Addressing: open
@@ -58,6 +63,27 @@
  * - Short summary of random vs. linear probing, and tombstones vs. backward shift.
  */
 
+/*
+ * Alternatively, when built with ENABLE_SWISS_HASHMAP:
+ * Collision resolution: none, entries stay where they were put
+ *   - buckets are organized in groups of 16. Instead of a DIB, each bucket
+ *     has a control byte that is either "empty", "deleted" or holds 7 bits
+ *     of the entry's hash. A lookup compares all control bytes of a group
+ *     at once (with SSE2 if available), and only looks at the keys of the
+ *     matching buckets.
+ * Probe sequence: linear, group by group
+ *   - a lookup stops at the first group with an empty bucket.
+ * Deletion: tombstones
+ *   - unless the group still has an empty bucket, in which case no probe
+ *     sequence can have passed it. Tombstones are cleaned up by rehashing
+ *     in place when they make up too much of the table.
+ *
+ * References:
+ * Swiss Tables Design Notes.
+ * https://abseil.io/about/design/swisstables
+ * - The design of Abseil's flat_hash_map, which this follows.
+ */
+
 /*
  * XXX Ideas for improvement:
  * For unordered hashmaps, randomize iteration order, similarly to Perl:
@@ -66,7 +92,11 @@
 
 /* INV_KEEP_FREE = 1 / (1 - max_load_factor)
  * e.g. 1 / (1 - 0.8) = 5 ... keep one fifth of the buckets free. */
+#if ENABLE_SWISS_HASHMAP
+#define INV_KEEP_FREE            8U
+#else
 #define INV_KEEP_FREE            5U
+#endif
 
 /* Fields common to entries of all hashmap/set types */
 struct hashmap_base_entry {
@@ -119,6 +149,20 @@ typedef uint8_t dib_raw_t;
 
 #define DIB_FREE UINT_MAX
 
+#if ENABLE_SWISS_HASHMAP
+/* Control bytes, used in place of DIBs. A full bucket stores the low 7 bits of its entry's hash. */
+typedef uint8_t ctrl_t;
+#define CTRL_EMPTY       ((ctrl_t)0x80U)      /* a free bucket */
+#define CTRL_REHASH      ((ctrl_t)0xfdU)      /* entry yet to be rehashed during in-place resize */
+#define CTRL_DELETED     ((ctrl_t)0xfeU)      /* a free bucket that probe sequences must pass */
+#define CTRL_INIT        ((char)CTRL_EMPTY)   /* a byte to memset a control byte store with when initializing */
+#define CTRL_IS_FULL(c)  (((c) & 0x80U) == 0)
+
+#define GROUP_SIZE 16U
+
+assert_cc(sizeof(ctrl_t) == sizeof(dib_raw_t));
+#endif
+
 #if ENABLE_DEBUG_HASHMAP
 struct hashmap_debug_info {
         LIST_FIELDS(struct hashmap_debug_info, debug_list);
@@ -162,6 +206,9 @@ struct _packed_ indirect_storage {
         unsigned idx_lowest_entry;         /* Index below which all buckets are free.
                                               Makes "while(hashmap_steal_first())" loops
                                               O(n) instead of O(n^2) for unordered hashmaps. */
+#if ENABLE_SWISS_HASHMAP
+        unsigned n_deleted;                /* number of CTRL_DELETED buckets */
+#endif
         uint8_t  _pad[3];                  /* padding for the whole HashmapBase */
         /* The bitfields in HashmapBase complete the alignment of the whole thing. */
 };
@@ -299,13 +346,22 @@ static unsigned base_bucket_hash(HashmapBase *h, const void *p) {
         struct siphash state;
         uint64_t hash;
 
-        siphash24_init(&state, hash_key(h));
+        if (h->hash_ops->fast_hash)
+                hash = h->hash_ops->fast_hash(p, unaligned_read_le64(hash_key(h)));
+        else {
+                siphash24_init(&state, hash_key(h));
 
-        h->hash_ops->hash(p, &state);
+                h->hash_ops->hash(p, &state);
 
-        hash = siphash24_finalize(&state);
+                hash = siphash24_finalize(&state);
+        }
 
+#if ENABLE_SWISS_HASHMAP
+        /* Not an index, see hash_group() and hash_ctrl() */
+        return (unsigned) hash;
+#else
         return (unsigned) (hash % n_buckets(h));
+#endif
 }
 #define bucket_hash(h, p) base_bucket_hash(HASHMAP_BASE(h), p)
 
@@ -361,6 +417,69 @@ static struct hashmap_base_entry *bucket_at_virtual(HashmapBase *h, struct swap_
         assert_not_reached("Invalid index");
 }
 
+#if ENABLE_SWISS_HASHMAP
+static ctrl_t *ctrl_ptr(HashmapBase *h) {
+        return (ctrl_t*)
+                ((uint8_t*) storage_ptr(h) + hashmap_type_info[h->type].entry_size * n_buckets(h));
+}
+
+static unsigned n_groups(HashmapBase *h) {
+        assert(h->has_indirect);
+        return n_buckets(h) / GROUP_SIZE;
+}
+
+static unsigned hash_group(HashmapBase *h, unsigned hash) {
+        return (hash >> 7) % n_groups(h);
+}
+
+static ctrl_t hash_ctrl(unsigned hash) {
+        return hash & 0x7fU;
+}
+
+/* Returns a bit mask of the buckets in the group whose control byte is c */
+static unsigned group_match(const ctrl_t *group, ctrl_t c) {
+#ifdef __SSE2__
+        __m128i v = _mm_loadu_si128((const __m128i*) group);
+
+        return (unsigned) _mm_movemask_epi8(_mm_cmpeq_epi8(v, _mm_set1_epi8((char) c)));
+#else
+        unsigned i, m = 0;
+
+        for (i = 0; i < GROUP_SIZE; i++)
+                if (group[i] == c)
+                        m |= 1U << i;
+
+        return m;
+#endif
+}
+
+/* Returns a bit mask of the buckets in the group which are not full */
+static unsigned group_match_free(const ctrl_t *group) {
+#ifdef __SSE2__
+        return (unsigned) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) group));
+#else
+        unsigned i, m = 0;
+
+        for (i = 0; i < GROUP_SIZE; i++)
+                if (!CTRL_IS_FULL(group[i]))
+                        m |= 1U << i;
+
+        return m;
+#endif
+}
+
+static unsigned skip_free_buckets(HashmapBase *h, unsigned idx) {
+        ctrl_t *ctrl;
+
+        ctrl = ctrl_ptr(h);
+
+        for ( ; idx < n_buckets(h); idx++)
+                if (CTRL_IS_FULL(ctrl[idx]))
+                        return idx;
+
+        return IDX_NIL;
+}
+#else
 static dib_raw_t *dib_raw_ptr(HashmapBase *h) {
         return (dib_raw_t*)
                 ((uint8_t*) storage_ptr(h) + hashmap_type_info[h->type].entry_size * n_buckets(h));
@@ -414,6 +533,7 @@ static void bucket_mark_free(HashmapBase *h, unsigned idx) {
         memzero(bucket_at(h, idx), hashmap_type_info[h->type].entry_size);
         bucket_set_dib(h, idx, DIB_FREE);
 }
+#endif
 
 static void bucket_move_entry(HashmapBase *h, struct swap_entries *swap,
                               unsigned from, unsigned to) {
@@ -451,9 +571,11 @@ static void bucket_move_entry(HashmapBase *h, struct swap_entries *swap,
         }
 }
 
+#if !ENABLE_SWISS_HASHMAP
 static unsigned next_idx(HashmapBase *h, unsigned idx) {
         return (idx + 1U) % n_buckets(h);
 }
+#endif
 
 static unsigned prev_idx(HashmapBase *h, unsigned idx) {
         return (n_buckets(h) + idx - 1U) % n_buckets(h);
@@ -474,6 +596,57 @@ static void *entry_value(HashmapBase *h, struct hashmap_base_entry *e) {
         }
 }
 
+static void unlink_ordered_entry(HashmapBase *h, unsigned idx) {
+        OrderedHashmap *lh;
+        struct ordered_hashmap_entry *le;
+
+        if (h->type != HASHMAP_TYPE_ORDERED)
+                return;
+
+        lh = (OrderedHashmap*) h;
+        le = ordered_bucket_at(lh, idx);
+
+        if (le->iterate_next != IDX_NIL)
+                ordered_bucket_at(lh, le->iterate_next)->iterate_previous = le->iterate_previous;
+        else
+                lh->iterate_list_tail = le->iterate_previous;
+
+        if (le->iterate_previous != IDX_NIL)
+                ordered_bucket_at(lh, le->iterate_previous)->iterate_next = le->iterate_next;
+        else
+                lh->iterate_list_head = le->iterate_next;
+}
+
+#if ENABLE_SWISS_HASHMAP
+static void base_remove_entry(HashmapBase *h, unsigned idx) {
+        ctrl_t *ctrl;
+
+        ctrl = ctrl_ptr(h);
+        assert(CTRL_IS_FULL(ctrl[idx]));
+
+#if ENABLE_DEBUG_HASHMAP
+        h->debug.rem_count++;
+        h->debug.last_rem_idx = idx;
+#endif
+
+        unlink_ordered_entry(h, idx);
+
+        memzero(bucket_at(h, idx), hashmap_type_info[h->type].entry_size);
+
+        /* Direct storage is always scanned in full. In indirect storage, a group with an empty bucket ends
+         * every probe sequence reaching it, so none can have passed it, and no tombstone is needed. */
+        if (!h->has_indirect ||
+            group_match(ctrl + idx / GROUP_SIZE * GROUP_SIZE, CTRL_EMPTY) != 0)
+                ctrl[idx] = CTRL_EMPTY;
+        else {
+                ctrl[idx] = CTRL_DELETED;
+                h->indirect.n_deleted++;
+        }
+
+        n_entries_dec(h);
+        base_set_dirty(h);
+}
+#else
 static void base_remove_entry(HashmapBase *h, unsigned idx) {
         unsigned left, right, prev, dib;
         dib_raw_t raw_dib, *dibs;
@@ -499,20 +672,7 @@ static void base_remove_entry(HashmapBase *h, unsigned idx) {
                 assert(left != right);
         }
 
-        if (h->type == HASHMAP_TYPE_ORDERED) {
-                OrderedHashmap *lh = (OrderedHashmap*) h;
-                struct ordered_hashmap_entry *le = ordered_bucket_at(lh, idx);
-
-                if (le->iterate_next != IDX_NIL)
-                        ordered_bucket_at(lh, le->iterate_next)->iterate_previous = le->iterate_previous;
-                else
-                        lh->iterate_list_tail = le->iterate_previous;
-
-                if (le->iterate_previous != IDX_NIL)
-                        ordered_bucket_at(lh, le->iterate_previous)->iterate_next = le->iterate_next;
-                else
-                        lh->iterate_list_head = le->iterate_next;
-        }
+        unlink_ordered_entry(h, idx);
 
         /* Now shift all buckets in the interval (left, right) one step backwards */
         for (prev = left, left = next_idx(h, left); left != right;
@@ -527,6 +687,7 @@ static void base_remove_entry(HashmapBase *h, unsigned idx) {
         n_entries_dec(h);
         base_set_dirty(h);
 }
+#endif
 #define remove_entry(h, idx) base_remove_entry(HASHMAP_BASE(h), idx)
 
 static unsigned hashmap_iterate_in_insertion_order(OrderedHashmap *h, Iterator *i) {
@@ -702,7 +863,11 @@ static void reset_direct_storage(HashmapBase *h) {
         assert(!h->has_indirect);
 
         p = mempset(h->direct.storage, 0, hi->entry_size * hi->n_direct_buckets);
+#if ENABLE_SWISS_HASHMAP
+        memset(p, CTRL_INIT, sizeof(ctrl_t) * hi->n_direct_buckets);
+#else
         memset(p, DIB_RAW_INIT, sizeof(dib_raw_t) * hi->n_direct_buckets);
+#endif
 }
 
 static struct HashmapBase *hashmap_base_new(const struct hash_ops *hash_ops, enum HashmapType type HASHMAP_DEBUG_PARAMS) {
@@ -874,6 +1039,59 @@ void hashmap_clear_free_free(Hashmap *h) {
 
 static int resize_buckets(HashmapBase *h, unsigned entries_add);
 
+#if ENABLE_SWISS_HASHMAP
+/*
+ * Finds the first bucket in the probe sequence of 'hash' that is not full.
+ * During in-place resize, this may be a bucket with an entry yet to be rehashed.
+ */
+static unsigned find_free_bucket(HashmapBase *h, unsigned hash) {
+        ctrl_t *ctrl;
+        unsigned idx, g, m;
+
+        ctrl = ctrl_ptr(h);
+
+        if (!h->has_indirect) {
+                for (idx = 0; idx < n_buckets(h); idx++)
+                        if (!CTRL_IS_FULL(ctrl[idx]))
+                                return idx;
+
+                assert_not_reached("Direct storage is full");
+        }
+
+        /* The load factor guarantees that there is a free bucket somewhere */
+        for (g = hash_group(h, hash); ; g = (g + 1) % n_groups(h)) {
+                m = group_match_free(ctrl + g * GROUP_SIZE);
+                if (m != 0)
+                        return g * GROUP_SIZE + __builtin_ctz(m);
+        }
+}
+
+/*
+ * Puts the entry in swap slot IDX_PUT into the first free bucket of its probe sequence.
+ */
+static void hashmap_put_swiss(HashmapBase *h, unsigned hash, struct swap_entries *swap) {
+        ctrl_t *ctrl;
+        unsigned idx;
+
+#if ENABLE_DEBUG_HASHMAP
+        h->debug.put_count++;
+#endif
+
+        ctrl = ctrl_ptr(h);
+        idx = find_free_bucket(h, hash);
+
+        if (h->has_indirect) {
+                if (ctrl[idx] == CTRL_DELETED)
+                        h->indirect.n_deleted--;
+
+                if (h->indirect.idx_lowest_entry > idx)
+                        h->indirect.idx_lowest_entry = idx;
+        }
+
+        ctrl[idx] = hash_ctrl(hash);
+        bucket_move_entry(h, swap, IDX_PUT, idx);
+}
+#else
 /*
  * Finds an empty bucket to put an entry into, starting the scan at 'idx'.
  * Performs Robin Hood swaps as it goes. The entry to put must be placed
@@ -930,6 +1148,7 @@ static bool hashmap_put_robin_hood(HashmapBase *h, unsigned idx,
                 idx = next_idx(h, idx);
         }
 }
+#endif
 
 /*
  * Puts an entry into a hashmap, boldly - no check whether key already exists.
@@ -937,6 +1156,7 @@ static bool hashmap_put_robin_hood(HashmapBase *h, unsigned idx,
  * in swap slot IDX_PUT.
  * Caller must ensure: the key does not exist yet in the hashmap.
  *                     that resize is not needed if !may_resize.
+ * With ENABLE_SWISS_HASHMAP, 'idx' is the hash as returned by bucket_hash().
  * Returns: 1 if entry was put successfully.
  *          -ENOMEM if may_resize==true and resize failed with -ENOMEM.
  *          Cannot return -ENOMEM if !may_resize.
@@ -946,7 +1166,9 @@ static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
         struct ordered_hashmap_entry *new_entry;
         int r;
 
+#if !ENABLE_SWISS_HASHMAP
         assert(idx < n_buckets(h));
+#endif
 
         new_entry = bucket_at_swap(swap, IDX_PUT);
 
@@ -978,7 +1200,11 @@ static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
                         lh->iterate_list_head = IDX_PUT;
         }
 
+#if ENABLE_SWISS_HASHMAP
+        hashmap_put_swiss(h, idx, swap);
+#else
         assert_se(hashmap_put_robin_hood(h, idx, swap) == false);
+#endif
 
         n_entries_inc(h);
 #if ENABLE_DEBUG_HASHMAP
@@ -992,6 +1218,209 @@ static int hashmap_base_put_boldly(HashmapBase *h, unsigned idx,
 #define hashmap_put_boldly(h, idx, swap, may_resize) \
         hashmap_base_put_boldly(HASHMAP_BASE(h), idx, swap, may_resize)
 
+#if ENABLE_SWISS_HASHMAP
+/*
+ * Puts all entries marked CTRL_REHASH into the first free bucket of their probe
+ * sequence. If that bucket is marked CTRL_REHASH itself, the two entries trade
+ * places, and the displaced one is rehashed next.
+ */
+static void rehash_marked_buckets(HashmapBase *h) {
+        struct swap_entries swap;
+        ctrl_t *ctrl;
+        unsigned idx, hash, target, n_rehashed = 0;
+
+        assert(h->has_indirect);
+
+        ctrl = ctrl_ptr(h);
+
+        for (idx = 0; idx < n_buckets(h); idx++)
+                while (ctrl[idx] == CTRL_REHASH) {
+                        hash = bucket_hash(h, bucket_at(h, idx)->key);
+                        target = find_free_bucket(h, hash);
+                        n_rehashed++;
+
+                        if (target == idx) {
+                                ctrl[idx] = hash_ctrl(hash);
+                                break;
+                        }
+
+                        if (ctrl[target] == CTRL_REHASH) {
+                                bucket_move_entry(h, &swap, target, IDX_TMP);
+                                bucket_move_entry(h, &swap, idx, target);
+                                bucket_move_entry(h, &swap, IDX_TMP, idx);
+                        } else {
+                                assert(ctrl[target] == CTRL_EMPTY);
+
+                                bucket_move_entry(h, &swap, idx, target);
+                                /* bucket_move_entry does not clear the source */
+                                memzero(bucket_at(h, idx), hashmap_type_info[h->type].entry_size);
+                                ctrl[idx] = CTRL_EMPTY;
+                        }
+
+                        ctrl[target] = hash_ctrl(hash);
+                }
+
+        assert(n_rehashed == n_entries(h));
+
+        h->indirect.n_deleted = 0;
+        h->indirect.idx_lowest_entry = 0;
+}
+
+/*
+ * Returns 0 if resize is not needed.
+ *         1 if successfully resized, or rehashed in place to get rid of tombstones.
+ *         -ENOMEM on allocation failure.
+ */
+static int resize_buckets(HashmapBase *h, unsigned entries_add) {
+        void *new_storage;
+        ctrl_t *old_ctrl, *new_ctrl;
+        const struct hashmap_type_info *hi;
+        unsigned idx, old_n_buckets, new_n_buckets, new_n_entries;
+        uint8_t new_shift;
+
+        assert(h);
+
+        hi = &hashmap_type_info[h->type];
+        new_n_entries = n_entries(h) + entries_add;
+
+        /* overflow? */
+        if (_unlikely_(new_n_entries < entries_add))
+                return -ENOMEM;
+
+        /* For direct storage we allow 100% load, because it's tiny. */
+        if (!h->has_indirect && new_n_entries <= hi->n_direct_buckets)
+                return 0;
+
+        old_n_buckets = n_buckets(h);
+
+        /* Tombstones count against the load factor, as probe sequences have to pass them */
+        if (h->has_indirect &&
+            new_n_entries + h->indirect.n_deleted <= old_n_buckets - old_n_buckets / INV_KEEP_FREE)
+                return 0;
+
+        /*
+         * Load factor = n/m = 1 - (1/INV_KEEP_FREE).
+         * From it follows: m = n + n/(INV_KEEP_FREE - 1)
+         */
+        new_n_buckets = new_n_entries + new_n_entries / (INV_KEEP_FREE - 1);
+        /* overflow? */
+        if (_unlikely_(new_n_buckets < new_n_entries))
+                return -ENOMEM;
+
+        /* Only whole groups */
+        if (_unlikely_(new_n_buckets > UINT_MAX - GROUP_SIZE))
+                return -ENOMEM;
+        new_n_buckets = ALIGN_TO(new_n_buckets, GROUP_SIZE);
+
+        if (_unlikely_(new_n_buckets > UINT_MAX / (hi->entry_size + sizeof(ctrl_t))))
+                return -ENOMEM;
+
+        if (h->has_indirect && new_n_buckets <= old_n_buckets) {
+                /* There is enough room, it's just taken up by tombstones. Get rid of them. */
+                new_ctrl = ctrl_ptr(h);
+                for (idx = 0; idx < old_n_buckets; idx++)
+                        new_ctrl[idx] = CTRL_IS_FULL(new_ctrl[idx]) ? CTRL_REHASH : CTRL_EMPTY;
+
+                rehash_marked_buckets(h);
+                return 1;
+        }
+
+        new_shift = log2u_round_up(MAX(
+                        new_n_buckets * (hi->entry_size + sizeof(ctrl_t)),
+                        2 * sizeof(struct direct_storage)));
+
+        /* Realloc storage (buckets and control bytes). */
+        new_storage = realloc(h->has_indirect ? h->indirect.storage : NULL,
+                              1U << new_shift);
+        if (!new_storage)
+                return -ENOMEM;
+
+        /* Must upgrade direct to indirect storage. */
+        if (!h->has_indirect) {
+                memcpy(new_storage, h->direct.storage,
+                       old_n_buckets * (hi->entry_size + sizeof(ctrl_t)));
+                h->indirect.n_entries = h->n_direct_entries;
+                h->indirect.idx_lowest_entry = 0;
+                h->n_direct_entries = 0;
+        }
+
+        /* Get a new hash key. If we've just upgraded to indirect storage,
+         * allow reusing a previously generated key. It's still a different key
+         * from the shared one that we used for direct storage. */
+        get_hash_key(h->indirect.hash_key, !h->has_indirect);
+
+        h->has_indirect = true;
+        h->indirect.storage = new_storage;
+        h->indirect.n_buckets = (1U << new_shift) /
+                                (hi->entry_size + sizeof(ctrl_t)) / GROUP_SIZE * GROUP_SIZE;
+
+        old_ctrl = (ctrl_t*)((uint8_t*) new_storage + hi->entry_size * old_n_buckets);
+        new_ctrl = ctrl_ptr(h);
+
+        /*
+         * Move the control bytes to the new place, marking all used buckets for
+         * rehashing, and dropping tombstones. The new place starts behind the old
+         * one, but because of the rounding to whole groups the two may overlap,
+         * hence go backwards.
+         */
+        for (idx = old_n_buckets; idx > 0; idx--)
+                new_ctrl[idx - 1] = CTRL_IS_FULL(old_ctrl[idx - 1]) ? CTRL_REHASH : CTRL_EMPTY;
+
+        /* Zero the area of newly added entries (including the old control byte area) */
+        memzero(bucket_at(h, old_n_buckets),
+               (n_buckets(h) - old_n_buckets) * hi->entry_size);
+
+        /* The upper part of the new control byte array needs initialization */
+        memset(&new_ctrl[old_n_buckets], CTRL_INIT,
+               (n_buckets(h) - old_n_buckets) * sizeof(ctrl_t));
+
+        rehash_marked_buckets(h);
+
+        return 1;
+}
+
+/*
+ * Finds an entry with a matching key
+ * Returns: index of the found entry, or IDX_NIL if not found.
+ */
+static unsigned base_bucket_scan(HashmapBase *h, unsigned hash, const void *key) {
+        struct hashmap_base_entry *e;
+        ctrl_t *ctrl, c;
+        unsigned idx, g, n, m;
+
+        ctrl = ctrl_ptr(h);
+        c = hash_ctrl(hash);
+
+        if (!h->has_indirect) {
+                for (idx = 0; idx < n_buckets(h); idx++) {
+                        if (ctrl[idx] != c)
+                                continue;
+
+                        e = bucket_at(h, idx);
+                        if (h->hash_ops->compare(e->key, key) == 0)
+                                return idx;
+                }
+
+                return IDX_NIL;
+        }
+
+        for (g = hash_group(h, hash), n = 0; n < n_groups(h); g = (g + 1) % n_groups(h), n++) {
+                const ctrl_t *group = ctrl + g * GROUP_SIZE;
+
+                for (m = group_match(group, c); m != 0; m &= m - 1) {
+                        idx = g * GROUP_SIZE + __builtin_ctz(m);
+                        e = bucket_at(h, idx);
+                        if (h->hash_ops->compare(e->key, key) == 0)
+                                return idx;
+                }
+
+                if (group_match(group, CTRL_EMPTY) != 0)
+                        return IDX_NIL;
+        }
+
+        return IDX_NIL;
+}
+#else
 /*
  * Returns 0 if resize is not needed.
  *         1 if successfully resized.
@@ -1159,6 +1588,7 @@ static unsigned base_bucket_scan(HashmapBase *h, unsigned idx, const void *key)
                 idx = next_idx(h, idx);
         }
 }
+#endif
 #define bucket_scan(h, idx, key) base_bucket_scan(HASHMAP_BASE(h), idx, key)
 
 int hashmap_put(Hashmap *h, const void *key, void *value) {
@@ -3,6 +3,9 @@
 
 /* Missing glibc definitions to access certain kernel APIs */
 
+#include <errno.h>
+#include <sys/syscall.h>
+#include <sys/types.h>
 #include <unistd.h>
 
 #if HAVE_AUDIT
@@ -70,6 +73,21 @@
 #define TASK_COMM_LEN 16
 #endif
 
+#if HAVE_PIDFD_OPEN
+#include <sys/pidfd.h>
+#else
+static inline int missing_pidfd_open(pid_t pid, unsigned flags) {
+#  ifdef __NR_pidfd_open
+        return syscall(__NR_pidfd_open, pid, flags);
+#  else
+        errno = ENOSYS;
+        return -1;
+#  endif
+}
+
+#  define pidfd_open missing_pidfd_open
+#endif
+
 #ifdef __FreeBSD__
 #define ENOMEDIUM       (INT_MAX - 1)
 #define ENOPKG          (INT_MAX - 2)
@@ -8,6 +8,12 @@
 #endif
 #include <stdint.h>
 
+static inline uint32_t unaligned_read_le32(const void *_u) {
+        const struct __attribute__((packed, may_alias)) { uint32_t x; } *u = _u;
+
+        return le32toh(u->x);
+}
+
 static inline uint64_t unaligned_read_le64(const void *_u) {
         const struct __attribute__((packed, may_alias)) { uint64_t x; } *u = _u;
 
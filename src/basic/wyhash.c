@@ -0,0 +1,83 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+/*
+ * Follows wyhash (final version 4) by Wang Yi, which is in the public domain:
+ * https://github.com/wangyi-fudan/wyhash
+ *
+ * The multiply-and-fold step is the same; the three lane loop for long inputs is left out, since the keys
+ * hashed here are rarely longer than a D-Bus object path.
+ */
+
+#include "unaligned.h"
+#include "wyhash.h"
+
+#define WYHASH_P0 UINT64_C(0xa0761d6478bd642f)
+#define WYHASH_P1 UINT64_C(0xe7037ed1a0b428db)
+
+/* 64x64 → 128 bit multiplication, returning the low half in *a and the high half in *b */
+static void wymum(uint64_t *a, uint64_t *b) {
+#ifdef __SIZEOF_INT128__
+        __uint128_t r = (__uint128_t) *a * *b;
+
+        *a = (uint64_t) r;
+        *b = (uint64_t) (r >> 64);
+#else
+        uint64_t ha = *a >> 32, hb = *b >> 32, la = (uint32_t) *a, lb = (uint32_t) *b, hi, lo;
+        uint64_t rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb, t = rl + (rm0 << 32), c = t < rl;
+
+        lo = t + (rm1 << 32);
+        c += lo < t;
+        hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+
+        *a = lo;
+        *b = hi;
+#endif
+}
+
+static uint64_t wymix(uint64_t a, uint64_t b) {
+        wymum(&a, &b);
+        return a ^ b;
+}
+
+static uint64_t wyr3(const uint8_t *p, size_t k) {
+        return ((uint64_t) p[0] << 16) | ((uint64_t) p[k >> 1] << 8) | p[k - 1];
+}
+
+uint64_t wyhash(const void *data, size_t size, uint64_t seed) {
+        const uint8_t *p = data;
+        uint64_t a, b;
+        size_t i = size;
+
+        seed ^= wymix(seed ^ WYHASH_P0, WYHASH_P1);
+
+        if (_likely_(size <= 16)) {
+                if (_likely_(size >= 4)) {
+                        a = ((uint64_t) unaligned_read_le32(p) << 32) | unaligned_read_le32(p + ((size >> 3) << 2));
+                        b = ((uint64_t) unaligned_read_le32(p + size - 4) << 32) | unaligned_read_le32(p + size - 4 - ((size >> 3) << 2));
+                } else if (_likely_(size > 0)) {
+                        a = wyr3(p, size);
+                        b = 0;
+                } else
+                        a = b = 0;
+        } else {
+                for (; i > 16; i -= 16, p += 16)
+                        seed = wymix(unaligned_read_le64(p) ^ WYHASH_P1, unaligned_read_le64(p + 8) ^ seed);
+
+                a = unaligned_read_le64(p + i - 16);
+                b = unaligned_read_le64(p + i - 8);
+        }
+
+        a ^= WYHASH_P1;
+        b ^= seed;
+        wymum(&a, &b);
+
+        return wymix(a ^ WYHASH_P0 ^ size, b ^ WYHASH_P1);
+}
+
+uint64_t wyhash64(uint64_t a, uint64_t b) {
+        a ^= WYHASH_P0;
+        b ^= WYHASH_P1;
+        wymum(&a, &b);
+
+        return wymix(a ^ WYHASH_P0, b ^ WYHASH_P1);
+}
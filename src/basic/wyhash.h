@@ -0,0 +1,14 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "macro.h"
+
+/* A fast, seeded, non-cryptographic hash function. It spreads keys well, but unlike siphash24 it makes no
+ * attempt at being collision resistant against anyone who knows the seed, or who can observe the effects of
+ * collisions for long enough. Only use it for keys an attacker cannot choose. */
+
+uint64_t wyhash(const void *data, size_t size, uint64_t seed) _pure_;
+uint64_t wyhash64(uint64_t a, uint64_t b) _const_;
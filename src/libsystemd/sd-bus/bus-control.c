@@ -7,8 +7,10 @@
 
 #include "alloc-util.h"
 #include "bus-control.h"
+#include "bus-creds.h"
 #include "bus-internal.h"
 #include "bus-message.h"
+#include "bus-slot.h"
 #include "process-util.h"
 #include "string-util.h"
 #include "strv.h"
@@ -416,16 +418,464 @@ _public_ int sd_bus_list_names(sd_bus *bus, char ***acquired, char ***activatabl
         return 0;
 }
 
+/* The credentials the bus driver can tell us about a name */
+#define NAME_OWNER_MASK (SD_BUS_CREDS_UNIQUE_NAME|SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID|SD_BUS_CREDS_SELINUX_CONTEXT)
+
+struct name_owner {
+        char *name;
+        uint64_t mask; /* what we asked the driver for */
+        uint64_t have; /* what it told us */
+
+        char *unique_name;
+        pid_t pid;
+        uid_t euid;
+        char *label;
+};
+
+static void name_owner_done(struct name_owner *o) {
+        assert(o);
+
+        o->name = mfree(o->name);
+        o->unique_name = mfree(o->unique_name);
+        o->label = mfree(o->label);
+}
+
+static struct name_owner* name_owner_free(struct name_owner *o) {
+        if (!o)
+                return NULL;
+
+        name_owner_done(o);
+        return mfree(o);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct name_owner*, name_owner_free);
+
+static int driver_call_new(sd_bus *bus, const char *member, const char *name, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        int r;
+
+        assert(bus);
+        assert(member);
+        assert(name);
+        assert(ret);
+
+        r = sd_bus_message_new_method_call(
+                        bus,
+                        &m,
+                        "org.freedesktop.DBus",
+                        "/org/freedesktop/DBus",
+                        "org.freedesktop.DBus",
+                        member);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(m, "s", name);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(m);
+        return 0;
+}
+
+static int name_owner_set_label(struct name_owner *o, sd_bus_message *reply) {
+        const void *p = NULL;
+        size_t sz = 0;
+        int r;
+
+        assert(o);
+        assert(reply);
+
+        r = sd_bus_message_read_array(reply, 'y', &p, &sz);
+        if (r < 0)
+                return r;
+
+        free(o->label);
+        o->label = strndup(p, sz);
+        if (!o->label)
+                return -ENOMEM;
+
+        o->have |= SD_BUS_CREDS_SELINUX_CONTEXT;
+        return 0;
+}
+
+static int name_owner_parse_credentials(struct name_owner *o, uint64_t want, sd_bus_message *reply) {
+        int r;
+
+        assert(o);
+        assert(reply);
+
+        r = sd_bus_message_enter_container(reply, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        for (;;) {
+                const char *m;
+
+                r = sd_bus_message_enter_container(reply, 'e', "sv");
+                if (r < 0)
+                        return r;
+                if (r == 0)
+                        break;
+
+                r = sd_bus_message_read(reply, "s", &m);
+                if (r < 0)
+                        return r;
+
+                if ((want & SD_BUS_CREDS_EUID) && streq(m, "UnixUserID")) {
+                        uint32_t u;
+
+                        r = sd_bus_message_read(reply, "v", "u", &u);
+                        if (r < 0)
+                                return r;
+
+                        o->euid = u;
+                        o->have |= SD_BUS_CREDS_EUID;
+
+                } else if ((want & SD_BUS_CREDS_PID) && streq(m, "ProcessID")) {
+                        uint32_t p;
+
+                        r = sd_bus_message_read(reply, "v", "u", &p);
+                        if (r < 0)
+                                return r;
+
+                        o->pid = p;
+                        o->have |= SD_BUS_CREDS_PID;
+
+                } else if ((want & SD_BUS_CREDS_SELINUX_CONTEXT) && streq(m, "LinuxSecurityLabel")) {
+
+                        r = sd_bus_message_enter_container(reply, 'v', "ay");
+                        if (r < 0)
+                                return r;
+
+                        r = name_owner_set_label(o, reply);
+                        if (r < 0)
+                                return r;
+
+                        r = sd_bus_message_exit_container(reply);
+                        if (r < 0)
+                                return r;
+                } else {
+                        r = sd_bus_message_skip(reply, "v");
+                        if (r < 0)
+                                return r;
+                }
+
+                r = sd_bus_message_exit_container(reply);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_exit_container(reply);
+        if (r < 0)
+                return r;
+
+        if ((want & SD_BUS_CREDS_PID) && !(o->have & SD_BUS_CREDS_PID))
+                return -EPROTO;
+
+        return 0;
+}
+
+/* Asks the bus driver for the fields in the mask. All calls are sent at once, so that this costs a single
+ * round trip, or two if the driver does not know GetConnectionCredentials(). Once the unique name is known
+ * the credentials are asked for by it, so that they cannot come from a different owner of the name. */
+static int name_owner_query(sd_bus *bus, struct name_owner *o, uint64_t want) {
+        enum {
+                CALL_NAME_OWNER,
+                CALL_CREDENTIALS,
+                CALL_PROCESS_ID,
+                CALL_USER,
+                CALL_SECURITY_CONTEXT,
+                _CALL_MAX,
+        };
+        static const char *const members[_CALL_MAX] = {
+                [CALL_NAME_OWNER] = "GetNameOwner",
+                [CALL_CREDENTIALS] = "GetConnectionCredentials",
+                [CALL_PROCESS_ID] = "GetConnectionUnixProcessID",
+                [CALL_USER] = "GetConnectionUnixUser",
+                [CALL_SECURITY_CONTEXT] = "GetConnectionSELinuxSecurityContext",
+        };
+        sd_bus_message *calls[_CALL_MAX] = {}, *replies[_CALL_MAX] = {};
+        sd_bus_error errors[_CALL_MAX] = {};
+        int results[_CALL_MAX] = {}, index[_CALL_MAX];
+        bool separate;
+        unsigned n = 0, k, round;
+        int r;
+
+        assert(bus);
+        assert(o);
+
+        /* When we need more than one of the credentials, then use GetConnectionCredentials(), and only fall
+         * back to the individual calls if the driver doesn't know it */
+        separate = __builtin_popcountll(want & (SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID|SD_BUS_CREDS_SELINUX_CONTEXT)) <= 1;
+
+        for (round = 0; round < 2; round++) {
+                const char *target = (o->have & SD_BUS_CREDS_UNIQUE_NAME) ? o->unique_name : o->name;
+                bool call[_CALL_MAX] = {
+                        [CALL_NAME_OWNER] = round == 0 && (want & SD_BUS_CREDS_UNIQUE_NAME),
+                        [CALL_CREDENTIALS] = !separate,
+                        [CALL_PROCESS_ID] = separate && (want & SD_BUS_CREDS_PID),
+                        [CALL_USER] = separate && (want & SD_BUS_CREDS_EUID),
+                        [CALL_SECURITY_CONTEXT] = separate && (want & SD_BUS_CREDS_SELINUX_CONTEXT),
+                };
+
+                n = 0;
+                for (k = 0; k < _CALL_MAX; k++) {
+                        index[k] = -1;
+
+                        if (!call[k])
+                                continue;
+
+                        r = driver_call_new(bus, members[k], k == CALL_NAME_OWNER ? o->name : target, &calls[n]);
+                        if (r < 0)
+                                goto finish;
+
+                        index[k] = n++;
+                }
+
+                r = bus_call_many(bus, calls, n, errors, replies, results);
+                if (r < 0)
+                        goto finish;
+
+                if (index[CALL_NAME_OWNER] >= 0) {
+                        const char *unique;
+
+                        k = index[CALL_NAME_OWNER];
+                        r = results[k];
+                        if (r < 0)
+                                goto finish;
+
+                        r = sd_bus_message_read(replies[k], "s", &unique);
+                        if (r < 0)
+                                goto finish;
+
+                        r = free_and_strdup(&o->unique_name, unique);
+                        if (r < 0)
+                                goto finish;
+
+                        o->have |= SD_BUS_CREDS_UNIQUE_NAME;
+                }
+
+                if (index[CALL_CREDENTIALS] >= 0) {
+                        k = index[CALL_CREDENTIALS];
+                        r = results[k];
+                        if (r < 0) {
+                                if (!sd_bus_error_has_name(&errors[k], SD_BUS_ERROR_UNKNOWN_METHOD))
+                                        goto finish;
+
+                                /* If we got an unknown method error, fall back to the individual calls... */
+                                separate = true;
+                        } else {
+                                r = name_owner_parse_credentials(o, want, replies[k]);
+                                if (r < 0)
+                                        goto finish;
+                        }
+                }
+
+                if (index[CALL_PROCESS_ID] >= 0) {
+                        uint32_t u;
+
+                        k = index[CALL_PROCESS_ID];
+                        r = results[k];
+                        if (r < 0)
+                                goto finish;
+
+                        r = sd_bus_message_read(replies[k], "u", &u);
+                        if (r < 0)
+                                goto finish;
+
+                        o->pid = u;
+                        o->have |= SD_BUS_CREDS_PID;
+                }
+
+                if (index[CALL_USER] >= 0) {
+                        uint32_t u;
+
+                        k = index[CALL_USER];
+                        r = results[k];
+                        if (r < 0)
+                                goto finish;
+
+                        r = sd_bus_message_read(replies[k], "u", &u);
+                        if (r < 0)
+                                goto finish;
+
+                        o->euid = u;
+                        o->have |= SD_BUS_CREDS_EUID;
+                }
+
+                if (index[CALL_SECURITY_CONTEXT] >= 0) {
+                        k = index[CALL_SECURITY_CONTEXT];
+                        r = results[k];
+                        if (r < 0) {
+                                if (!sd_bus_error_has_name(&errors[k], "org.freedesktop.DBus.Error.SELinuxSecurityContextUnknown"))
+                                        goto finish;
+
+                                /* no data is fine */
+                        } else {
+                                r = name_owner_set_label(o, replies[k]);
+                                if (r < 0)
+                                        goto finish;
+                        }
+                }
+
+                for (k = 0; k < n; k++) {
+                        calls[k] = sd_bus_message_unref(calls[k]);
+                        replies[k] = sd_bus_message_unref(replies[k]);
+                        sd_bus_error_free(&errors[k]);
+                }
+
+                /* Done, unless we have to retry with the individual calls */
+                if (!separate || index[CALL_CREDENTIALS] < 0)
+                        break;
+        }
+
+        o->mask |= want;
+        r = 0;
+
+finish:
+        for (k = 0; k < _CALL_MAX; k++) {
+                sd_bus_message_unref(calls[k]);
+                sd_bus_message_unref(replies[k]);
+                sd_bus_error_free(&errors[k]);
+        }
+
+        return r;
+}
+
+static void name_owner_invalidate(sd_bus *bus, sd_bus_message *m) {
+        const char *name, *old_owner, *new_owner;
+        struct name_owner *o;
+
+        assert(bus);
+        assert(m);
+
+        if (sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner) < 0)
+                return;
+
+        o = hashmap_get(bus->name_owners, name);
+        if (!o)
+                return;
+
+        /* If we already looked up the new owner, there's nothing to forget */
+        if ((o->have & SD_BUS_CREDS_UNIQUE_NAME) && streq(o->unique_name, new_owner))
+                return;
+
+        name_owner_free(hashmap_remove(bus->name_owners, name));
+}
+
+static int name_owner_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        sd_bus *bus = userdata;
+
+        assert(m);
+        assert(bus);
+
+        name_owner_invalidate(bus, m);
+        return 0;
+}
+
+static int name_owner_cache_acquire(sd_bus *bus, const char *name, uint64_t want, struct name_owner **ret) {
+        _cleanup_(name_owner_freep) struct name_owner *n = NULL;
+        struct name_owner *o;
+        int r;
+
+        assert(bus);
+        assert(name);
+        assert(ret);
+
+        if (!bus->name_owner_slot) {
+                r = sd_bus_add_match_async(
+                                bus,
+                                &bus->name_owner_slot,
+                                "type='signal',"
+                                "sender='org.freedesktop.DBus',"
+                                "path='/org/freedesktop/DBus',"
+                                "interface='org.freedesktop.DBus',"
+                                "member='NameOwnerChanged'",
+                                name_owner_changed,
+                                NULL,
+                                bus);
+                if (r < 0)
+                        return r;
+
+                /* Let the bus own the slot, we only keep a weak reference to it */
+                (void) sd_bus_slot_set_floating(bus->name_owner_slot, true);
+                sd_bus_slot_unref(bus->name_owner_slot);
+        }
+
+        o = hashmap_get(bus->name_owners, name);
+        if (o) {
+                if ((o->mask & want) != want) {
+                        r = name_owner_query(bus, o, want & ~o->mask);
+                        if (r < 0) {
+                                name_owner_free(hashmap_remove(bus->name_owners, name));
+                                return r;
+                        }
+                }
+
+                *ret = o;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&bus->name_owners, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        n = new0(struct name_owner, 1);
+        if (!n)
+                return -ENOMEM;
+
+        n->name = strdup(name);
+        if (!n->name)
+                return -ENOMEM;
+
+        r = name_owner_query(bus, n, want);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(bus->name_owners, n->name, n);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(n);
+        return 0;
+}
+
+void bus_name_owner_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        bus->name_owners = hashmap_free_with_destructor(bus->name_owners, name_owner_free);
+}
+
+void bus_name_owner_cache_queued(sd_bus *bus, sd_bus_message *m) {
+        assert(bus);
+        assert(m);
+
+        /* Called for every message put into the read queue. A NameOwnerChanged signal already tells us which
+         * entry is outdated when it is read, hence apply it right-away rather than answering from stale data
+         * until it is dispatched. */
+
+        if (hashmap_isempty(bus->name_owners))
+                return;
+
+        if (!sd_bus_message_is_signal(m, "org.freedesktop.DBus", "NameOwnerChanged") ||
+            !streq_ptr(m->sender, "org.freedesktop.DBus"))
+                return;
+
+        name_owner_invalidate(bus, m);
+        (void) sd_bus_message_rewind(m, true);
+}
+
 _public_ int sd_bus_get_name_creds(
                 sd_bus *bus,
                 const char *name,
                 uint64_t mask,
                 sd_bus_creds **creds) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply_unique = NULL, *reply = NULL;
         _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL;
-        const char *unique = NULL;
-        pid_t pid = 0;
+        _cleanup_(name_owner_done) struct name_owner stack = {};
+        struct name_owner *o;
+        bool need_pid;
+        uint64_t want = 0;
         int r;
 
         assert_return(bus, -EINVAL);
@@ -455,254 +905,67 @@ _public_ int sd_bus_get_name_creds(
 
         /* Only query the owner if the caller wants to know it or if
          * the caller just wants to check whether a name exists */
-        if ((mask & SD_BUS_CREDS_UNIQUE_NAME) || mask == 0) {
-                r = sd_bus_call_method(
-                                bus,
-                                "org.freedesktop.DBus",
-                                "/org/freedesktop/DBus",
-                                "org.freedesktop.DBus",
-                                "GetNameOwner",
-                                NULL,
-                                &reply_unique,
-                                "s",
-                                name);
+        if ((mask & SD_BUS_CREDS_UNIQUE_NAME) || mask == 0)
+                want |= SD_BUS_CREDS_UNIQUE_NAME;
+
+        need_pid = (mask & SD_BUS_CREDS_PID) ||
+                ((mask & SD_BUS_CREDS_AUGMENT) &&
+                 (mask & (SD_BUS_CREDS_UID|SD_BUS_CREDS_SUID|SD_BUS_CREDS_FSUID|
+                          SD_BUS_CREDS_GID|SD_BUS_CREDS_EGID|SD_BUS_CREDS_SGID|SD_BUS_CREDS_FSGID|
+                          SD_BUS_CREDS_SUPPLEMENTARY_GIDS|
+                          SD_BUS_CREDS_COMM|SD_BUS_CREDS_EXE|SD_BUS_CREDS_CMDLINE|
+                          SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_OWNER_UID|
+                          SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS|
+                          SD_BUS_CREDS_SELINUX_CONTEXT|
+                          SD_BUS_CREDS_AUDIT_SESSION_ID|SD_BUS_CREDS_AUDIT_LOGIN_UID)));
+        if (need_pid)
+                want |= SD_BUS_CREDS_PID;
+        want |= mask & (SD_BUS_CREDS_EUID|SD_BUS_CREDS_SELINUX_CONTEXT);
+
+        if (bus->name_owner_cache) {
+                r = name_owner_cache_acquire(bus, name, want, &o);
                 if (r < 0)
                         return r;
+        } else {
+                stack.name = strdup(name);
+                if (!stack.name)
+                        return -ENOMEM;
 
-                r = sd_bus_message_read(reply_unique, "s", &unique);
+                r = name_owner_query(bus, &stack, want);
                 if (r < 0)
                         return r;
+
+                o = &stack;
         }
 
         if (mask != 0) {
-                _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-                bool need_pid, need_uid, need_selinux, need_separate_calls;
+                uint64_t have = o->have & mask;
+
                 c = bus_creds_new();
                 if (!c)
                         return -ENOMEM;
 
-                if ((mask & SD_BUS_CREDS_UNIQUE_NAME) && unique) {
-                        c->unique_name = strdup(unique);
+                if (have & SD_BUS_CREDS_UNIQUE_NAME) {
+                        c->unique_name = strdup(o->unique_name);
                         if (!c->unique_name)
                                 return -ENOMEM;
-
-                        c->mask |= SD_BUS_CREDS_UNIQUE_NAME;
                 }
 
-                need_pid = (mask & SD_BUS_CREDS_PID) ||
-                        ((mask & SD_BUS_CREDS_AUGMENT) &&
-                         (mask & (SD_BUS_CREDS_UID|SD_BUS_CREDS_SUID|SD_BUS_CREDS_FSUID|
-                                  SD_BUS_CREDS_GID|SD_BUS_CREDS_EGID|SD_BUS_CREDS_SGID|SD_BUS_CREDS_FSGID|
-                                  SD_BUS_CREDS_SUPPLEMENTARY_GIDS|
-                                  SD_BUS_CREDS_COMM|SD_BUS_CREDS_EXE|SD_BUS_CREDS_CMDLINE|
-                                  SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT|SD_BUS_CREDS_SLICE|SD_BUS_CREDS_SESSION|SD_BUS_CREDS_OWNER_UID|
-                                  SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|SD_BUS_CREDS_BOUNDING_CAPS|
-                                  SD_BUS_CREDS_SELINUX_CONTEXT|
-                                  SD_BUS_CREDS_AUDIT_SESSION_ID|SD_BUS_CREDS_AUDIT_LOGIN_UID)));
-                need_uid = mask & SD_BUS_CREDS_EUID;
-                need_selinux = mask & SD_BUS_CREDS_SELINUX_CONTEXT;
-
-                if (need_pid + need_uid + need_selinux > 1) {
-
-                        /* If we need more than one of the credentials, then use GetConnectionCredentials() */
-
-                        r = sd_bus_call_method(
-                                        bus,
-                                        "org.freedesktop.DBus",
-                                        "/org/freedesktop/DBus",
-                                        "org.freedesktop.DBus",
-                                        "GetConnectionCredentials",
-                                        &error,
-                                        &reply,
-                                        "s",
-                                        unique ?: name);
-
-                        if (r < 0) {
-
-                                if (!sd_bus_error_has_name(&error, SD_BUS_ERROR_UNKNOWN_METHOD))
-                                        return r;
-
-                                /* If we got an unknown method error, fall back to the invidual calls... */
-                                need_separate_calls = true;
-                                sd_bus_error_free(&error);
-
-                        } else {
-                                need_separate_calls = false;
-
-                                r = sd_bus_message_enter_container(reply, 'a', "{sv}");
-                                if (r < 0)
-                                        return r;
-
-                                for (;;) {
-                                        const char *m;
-
-                                        r = sd_bus_message_enter_container(reply, 'e', "sv");
-                                        if (r < 0)
-                                                return r;
-                                        if (r == 0)
-                                                break;
-
-                                        r = sd_bus_message_read(reply, "s", &m);
-                                        if (r < 0)
-                                                return r;
-
-                                        if (need_uid && streq(m, "UnixUserID")) {
-                                                uint32_t u;
-
-                                                r = sd_bus_message_read(reply, "v", "u", &u);
-                                                if (r < 0)
-                                                        return r;
-
-                                                c->euid = u;
-                                                c->mask |= SD_BUS_CREDS_EUID;
-
-                                        } else if (need_pid && streq(m, "ProcessID")) {
-                                                uint32_t p;
-
-                                                r = sd_bus_message_read(reply, "v", "u", &p);
-                                                if (r < 0)
-                                                        return r;
-
-                                                pid = p;
-                                                if (mask & SD_BUS_CREDS_PID) {
-                                                        c->pid = p;
-                                                        c->mask |= SD_BUS_CREDS_PID;
-                                                }
-
-                                        } else if (need_selinux && streq(m, "LinuxSecurityLabel")) {
-                                                const void *p = NULL;
-                                                size_t sz = 0;
-
-                                                r = sd_bus_message_enter_container(reply, 'v', "ay");
-                                                if (r < 0)
-                                                        return r;
-
-                                                r = sd_bus_message_read_array(reply, 'y', &p, &sz);
-                                                if (r < 0)
-                                                        return r;
-
-                                                free(c->label);
-                                                c->label = strndup(p, sz);
-                                                if (!c->label)
-                                                        return -ENOMEM;
-
-                                                c->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
-
-                                                r = sd_bus_message_exit_container(reply);
-                                                if (r < 0)
-                                                        return r;
-                                        } else {
-                                                r = sd_bus_message_skip(reply, "v");
-                                                if (r < 0)
-                                                        return r;
-                                        }
-
-                                        r = sd_bus_message_exit_container(reply);
-                                        if (r < 0)
-                                                return r;
-                                }
-
-                                r = sd_bus_message_exit_container(reply);
-                                if (r < 0)
-                                        return r;
-
-                                if (need_pid && pid == 0)
-                                        return -EPROTO;
-                        }
-
-                } else /* When we only need a single field, then let's use separate calls */
-                        need_separate_calls = true;
-
-                if (need_separate_calls) {
-                        if (need_pid) {
-                                uint32_t u;
-
-                                r = sd_bus_call_method(
-                                                bus,
-                                                "org.freedesktop.DBus",
-                                                "/org/freedesktop/DBus",
-                                                "org.freedesktop.DBus",
-                                                "GetConnectionUnixProcessID",
-                                                NULL,
-                                                &reply,
-                                                "s",
-                                                unique ?: name);
-                                if (r < 0)
-                                        return r;
-
-                                r = sd_bus_message_read(reply, "u", &u);
-                                if (r < 0)
-                                        return r;
-
-                                pid = u;
-                                if (mask & SD_BUS_CREDS_PID) {
-                                        c->pid = u;
-                                        c->mask |= SD_BUS_CREDS_PID;
-                                }
+                if (have & SD_BUS_CREDS_PID)
+                        c->pid = o->pid;
 
-                                reply = sd_bus_message_unref(reply);
-                        }
-
-                        if (need_uid) {
-                                uint32_t u;
-
-                                r = sd_bus_call_method(
-                                                bus,
-                                                "org.freedesktop.DBus",
-                                                "/org/freedesktop/DBus",
-                                                "org.freedesktop.DBus",
-                                                "GetConnectionUnixUser",
-                                                NULL,
-                                                &reply,
-                                                "s",
-                                                unique ? unique : name);
-                                if (r < 0)
-                                        return r;
-
-                                r = sd_bus_message_read(reply, "u", &u);
-                                if (r < 0)
-                                        return r;
-
-                                c->euid = u;
-                                c->mask |= SD_BUS_CREDS_EUID;
-
-                                reply = sd_bus_message_unref(reply);
-                        }
+                if (have & SD_BUS_CREDS_EUID)
+                        c->euid = o->euid;
 
-                        if (need_selinux) {
-                                const void *p = NULL;
-                                size_t sz = 0;
-
-                                r = sd_bus_call_method(
-                                                bus,
-                                                "org.freedesktop.DBus",
-                                                "/org/freedesktop/DBus",
-                                                "org.freedesktop.DBus",
-                                                "GetConnectionSELinuxSecurityContext",
-                                                &error,
-                                                &reply,
-                                                "s",
-                                                unique ? unique : name);
-                                if (r < 0) {
-                                        if (!sd_bus_error_has_name(&error, "org.freedesktop.DBus.Error.SELinuxSecurityContextUnknown"))
-                                                return r;
-
-                                        /* no data is fine */
-                                } else {
-                                        r = sd_bus_message_read_array(reply, 'y', &p, &sz);
-                                        if (r < 0)
-                                                return r;
-
-                                        c->label = strndup(p, sz);
-                                        if (!c->label)
-                                                return -ENOMEM;
-
-                                        c->mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
-                                }
-                        }
+                if (have & SD_BUS_CREDS_SELINUX_CONTEXT) {
+                        c->label = strdup(o->label);
+                        if (!c->label)
+                                return -ENOMEM;
                 }
 
-                r = bus_creds_add_more(c, mask, pid, 0);
+                c->mask |= have;
+
+                r = bus_creds_add_more_cached(bus, c, mask, (o->have & SD_BUS_CREDS_PID) ? o->pid : 0, 0);
                 if (r < 0)
                         return r;
         }
@@ -777,7 +1040,7 @@ _public_ int sd_bus_get_owner_creds(sd_bus *bus, uint64_t mask, sd_bus_creds **r
                 c->mask |= SD_BUS_CREDS_SUPPLEMENTARY_GIDS;
         }
 
-        r = bus_creds_add_more(c, mask, pid, 0);
+        r = bus_creds_add_more_cached(bus, c, mask, pid, 0);
         if (r < 0)
                 return r;
 
@@ -831,7 +1094,7 @@ int bus_add_match_internal_async(
 
         e = append_eavesdrop(bus, match);
 
-        return sd_bus_call_method_async(
+        return bus_call_method_async_internal(
                         bus,
                         ret_slot,
                         "org.freedesktop.DBus",
@@ -860,7 +1123,7 @@ int bus_remove_match_internal(
 
         /* Fire and forget */
 
-        return sd_bus_call_method_async(
+        return bus_call_method_async_internal(
                         bus,
                         NULL,
                         "org.freedesktop.DBus",
@@ -918,3 +1181,29 @@ _public_ int sd_bus_get_name_machine_id(sd_bus *bus, const char *name, sd_id128_
 
         return sd_id128_from_string(mid, machine);
 }
+
+_public_ int sd_bus_set_name_owner_cache(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->name_owner_cache = b;
+        if (b)
+                return 0;
+
+        bus_name_owner_cache_flush(bus);
+
+        if (bus->name_owner_slot) {
+                bus_slot_disconnect(bus->name_owner_slot, true);
+                bus->name_owner_slot = NULL;
+        }
+
+        return 0;
+}
+
+_public_ int sd_bus_get_name_owner_cache(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+
+        return bus->name_owner_cache;
+}
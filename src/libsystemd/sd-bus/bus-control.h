@@ -7,3 +7,6 @@ int bus_add_match_internal(sd_bus *bus, const char *match);
 int bus_add_match_internal_async(sd_bus *bus, sd_bus_slot **ret, const char *match, sd_bus_message_handler_t callback, void *userdata);
 
 int bus_remove_match_internal(sd_bus *bus, const char *match);
+
+void bus_name_owner_cache_flush(sd_bus *bus);
+void bus_name_owner_cache_queued(sd_bus *bus, sd_bus_message *m);
@@ -41,7 +41,7 @@ _public_ int sd_bus_emit_signal(
         return sd_bus_send(bus, m, NULL);
 }
 
-_public_ int sd_bus_call_method_async(
+static int bus_call_method_asyncv(
                 sd_bus *bus,
                 sd_bus_slot **slot,
                 const char *destination,
@@ -50,15 +50,13 @@ _public_ int sd_bus_call_method_async(
                 const char *member,
                 sd_bus_message_handler_t callback,
                 void *userdata,
-                const char *types, ...) {
+                bool throttle,
+                const char *types,
+                va_list ap) {
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         int r;
 
-        assert_return(bus, -EINVAL);
-        assert_return(bus = bus_resolve(bus), -ENOPKG);
-        assert_return(!bus_pid_changed(bus), -ECHILD);
-
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
@@ -67,16 +65,60 @@ _public_ int sd_bus_call_method_async(
                 return r;
 
         if (!isempty(types)) {
-                va_list ap;
-
-                va_start(ap, types);
                 r = sd_bus_message_appendv(m, types, ap);
-                va_end(ap);
                 if (r < 0)
                         return r;
         }
 
-        return sd_bus_call_async(bus, slot, m, callback, userdata, 0);
+        return bus_call_async_internal(bus, slot, m, callback, userdata, 0, throttle);
+}
+
+_public_ int sd_bus_call_method_async(
+                sd_bus *bus,
+                sd_bus_slot **slot,
+                const char *destination,
+                const char *path,
+                const char *interface,
+                const char *member,
+                sd_bus_message_handler_t callback,
+                void *userdata,
+                const char *types, ...) {
+
+        va_list ap;
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        va_start(ap, types);
+        r = bus_call_method_asyncv(bus, slot, destination, path, interface, member, callback, userdata, true, types, ap);
+        va_end(ap);
+
+        return r;
+}
+
+int bus_call_method_async_internal(
+                sd_bus *bus,
+                sd_bus_slot **slot,
+                const char *destination,
+                const char *path,
+                const char *interface,
+                const char *member,
+                sd_bus_message_handler_t callback,
+                void *userdata,
+                const char *types, ...) {
+
+        va_list ap;
+        int r;
+
+        assert(bus);
+
+        va_start(ap, types);
+        r = bus_call_method_asyncv(bus, slot, destination, path, interface, member, callback, userdata, false, types, ap);
+        va_end(ap);
+
+        return r;
 }
 
 _public_ int sd_bus_call_method(
@@ -527,7 +569,7 @@ _public_ int sd_bus_query_sender_creds(sd_bus_message *call, uint64_t mask, sd_b
                         return sd_bus_get_owner_creds(call->bus, mask, creds);
         }
 
-        return bus_creds_extend_by_pid(c, mask, creds);
+        return bus_creds_extend_by_pid(call->bus, c, mask, creds);
 }
 
 _public_ int sd_bus_query_sender_privilege(sd_bus_message *call, int capability) {
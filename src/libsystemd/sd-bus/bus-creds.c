@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <poll.h>
 #include <stdlib.h>
 
 #if HAVE_LIBCAP
@@ -9,6 +10,7 @@
 #include "alloc-util.h"
 #include "audit-util.h"
 #include "bus-creds.h"
+#include "bus-internal.h"
 #include "bus-label.h"
 #include "bus-message.h"
 #include "def.h"
@@ -103,6 +105,9 @@ _public_ sd_bus_creds *sd_bus_creds_unref(sd_bus_creds *c) {
 
                         c->well_known_names = strv_free(c->well_known_names);
 
+                        if (c->lazy != 0)
+                                safe_close(c->lazy_pidfd);
+
                         bus_creds_done(c);
 
                         free(c);
@@ -120,13 +125,16 @@ _public_ sd_bus_creds *sd_bus_creds_unref(sd_bus_creds *c) {
 _public_ uint64_t sd_bus_creds_get_mask(const sd_bus_creds *c) {
         assert_return(c, 0);
 
-        return c->mask;
+        /* Fields that were requested lazily are included without reading them. Should reading them fail
+         * later on, the accessors below return -ESRCH or -ENODATA for them. */
+        return c->mask | c->lazy;
 }
 
 _public_ uint64_t sd_bus_creds_get_augmented_mask(const sd_bus_creds *c) {
         assert_return(c, 0);
 
-        return c->augmented;
+        /* Lazily requested fields always come from /proc */
+        return c->augmented | c->lazy;
 }
 
 sd_bus_creds* bus_creds_new(void) {
@@ -174,9 +182,15 @@ _public_ int sd_bus_creds_new_from_pid(sd_bus_creds **ret, pid_t pid, uint64_t m
 }
 
 _public_ int sd_bus_creds_get_uid(sd_bus_creds *c, uid_t *uid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(uid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_UID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_UID))
                 return -ENODATA;
 
@@ -185,9 +199,15 @@ _public_ int sd_bus_creds_get_uid(sd_bus_creds *c, uid_t *uid) {
 }
 
 _public_ int sd_bus_creds_get_euid(sd_bus_creds *c, uid_t *euid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(euid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_EUID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_EUID))
                 return -ENODATA;
 
@@ -196,9 +216,15 @@ _public_ int sd_bus_creds_get_euid(sd_bus_creds *c, uid_t *euid) {
 }
 
 _public_ int sd_bus_creds_get_suid(sd_bus_creds *c, uid_t *suid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(suid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_SUID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_SUID))
                 return -ENODATA;
 
@@ -207,9 +233,15 @@ _public_ int sd_bus_creds_get_suid(sd_bus_creds *c, uid_t *suid) {
 }
 
 _public_ int sd_bus_creds_get_fsuid(sd_bus_creds *c, uid_t *fsuid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(fsuid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_FSUID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_FSUID))
                 return -ENODATA;
 
@@ -218,9 +250,15 @@ _public_ int sd_bus_creds_get_fsuid(sd_bus_creds *c, uid_t *fsuid) {
 }
 
 _public_ int sd_bus_creds_get_gid(sd_bus_creds *c, gid_t *gid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(gid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_GID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_GID))
                 return -ENODATA;
 
@@ -229,9 +267,15 @@ _public_ int sd_bus_creds_get_gid(sd_bus_creds *c, gid_t *gid) {
 }
 
 _public_ int sd_bus_creds_get_egid(sd_bus_creds *c, gid_t *egid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(egid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_EGID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_EGID))
                 return -ENODATA;
 
@@ -240,9 +284,15 @@ _public_ int sd_bus_creds_get_egid(sd_bus_creds *c, gid_t *egid) {
 }
 
 _public_ int sd_bus_creds_get_sgid(sd_bus_creds *c, gid_t *sgid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(sgid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_SGID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_SGID))
                 return -ENODATA;
 
@@ -251,9 +301,15 @@ _public_ int sd_bus_creds_get_sgid(sd_bus_creds *c, gid_t *sgid) {
 }
 
 _public_ int sd_bus_creds_get_fsgid(sd_bus_creds *c, gid_t *fsgid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(fsgid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_FSGID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_FSGID))
                 return -ENODATA;
 
@@ -262,9 +318,15 @@ _public_ int sd_bus_creds_get_fsgid(sd_bus_creds *c, gid_t *fsgid) {
 }
 
 _public_ int sd_bus_creds_get_supplementary_gids(sd_bus_creds *c, const gid_t **gids) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(gids, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_SUPPLEMENTARY_GIDS);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_SUPPLEMENTARY_GIDS))
                 return -ENODATA;
 
@@ -285,9 +347,15 @@ _public_ int sd_bus_creds_get_pid(sd_bus_creds *c, pid_t *pid) {
 }
 
 _public_ int sd_bus_creds_get_ppid(sd_bus_creds *c, pid_t *ppid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ppid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_PPID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_PPID))
                 return -ENODATA;
 
@@ -314,8 +382,14 @@ _public_ int sd_bus_creds_get_tid(sd_bus_creds *c, pid_t *tid) {
 }
 
 _public_ int sd_bus_creds_get_selinux_context(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_SELINUX_CONTEXT);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_SELINUX_CONTEXT))
                 return -ENODATA;
 
@@ -325,9 +399,15 @@ _public_ int sd_bus_creds_get_selinux_context(sd_bus_creds *c, const char **ret)
 }
 
 _public_ int sd_bus_creds_get_comm(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_COMM);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_COMM))
                 return -ENODATA;
 
@@ -337,9 +417,15 @@ _public_ int sd_bus_creds_get_comm(sd_bus_creds *c, const char **ret) {
 }
 
 _public_ int sd_bus_creds_get_tid_comm(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_TID_COMM);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_TID_COMM))
                 return -ENODATA;
 
@@ -349,9 +435,15 @@ _public_ int sd_bus_creds_get_tid_comm(sd_bus_creds *c, const char **ret) {
 }
 
 _public_ int sd_bus_creds_get_exe(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_EXE);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_EXE))
                 return -ENODATA;
 
@@ -399,8 +491,14 @@ _public_ int sd_bus_creds_get_owner_uid(sd_bus_creds *c, uid_t *uid) {
 }
 
 _public_ int sd_bus_creds_get_cmdline(sd_bus_creds *c, char ***cmdline) {
+        int r;
+
         assert_return(c, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_CMDLINE);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_CMDLINE))
                 return -ENODATA;
 
@@ -418,9 +516,15 @@ _public_ int sd_bus_creds_get_cmdline(sd_bus_creds *c, char ***cmdline) {
 }
 
 _public_ int sd_bus_creds_get_audit_session_id(sd_bus_creds *c, uint32_t *sessionid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(sessionid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_AUDIT_SESSION_ID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_AUDIT_SESSION_ID))
                 return -ENODATA;
 
@@ -432,9 +536,15 @@ _public_ int sd_bus_creds_get_audit_session_id(sd_bus_creds *c, uint32_t *sessio
 }
 
 _public_ int sd_bus_creds_get_audit_login_uid(sd_bus_creds *c, uid_t *uid) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(uid, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_AUDIT_LOGIN_UID);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_AUDIT_LOGIN_UID))
                 return -ENODATA;
 
@@ -446,9 +556,15 @@ _public_ int sd_bus_creds_get_audit_login_uid(sd_bus_creds *c, uid_t *uid) {
 }
 
 _public_ int sd_bus_creds_get_tty(sd_bus_creds *c, const char **ret) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(ret, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_TTY);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_TTY))
                 return -ENODATA;
 
@@ -545,9 +661,15 @@ static int has_cap(sd_bus_creds *c, size_t offset, int capability) {
 }
 
 _public_ int sd_bus_creds_has_effective_cap(sd_bus_creds *c, int capability) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(capability >= 0, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_EFFECTIVE_CAPS);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_EFFECTIVE_CAPS))
                 return -ENODATA;
 
@@ -555,9 +677,15 @@ _public_ int sd_bus_creds_has_effective_cap(sd_bus_creds *c, int capability) {
 }
 
 _public_ int sd_bus_creds_has_permitted_cap(sd_bus_creds *c, int capability) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(capability >= 0, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_PERMITTED_CAPS);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_PERMITTED_CAPS))
                 return -ENODATA;
 
@@ -565,9 +693,15 @@ _public_ int sd_bus_creds_has_permitted_cap(sd_bus_creds *c, int capability) {
 }
 
 _public_ int sd_bus_creds_has_inheritable_cap(sd_bus_creds *c, int capability) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(capability >= 0, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_INHERITABLE_CAPS);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_INHERITABLE_CAPS))
                 return -ENODATA;
 
@@ -575,9 +709,15 @@ _public_ int sd_bus_creds_has_inheritable_cap(sd_bus_creds *c, int capability) {
 }
 
 _public_ int sd_bus_creds_has_bounding_cap(sd_bus_creds *c, int capability) {
+        int r;
+
         assert_return(c, -EINVAL);
         assert_return(capability >= 0, -EINVAL);
 
+        r = bus_creds_resolve(c, SD_BUS_CREDS_BOUNDING_CAPS);
+        if (r < 0)
+                return r;
+
         if (!(c->mask & SD_BUS_CREDS_BOUNDING_CAPS))
                 return -ENODATA;
 
@@ -974,31 +1114,117 @@ int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid) {
         if (tid > 0 && tid != pid && !pid_is_unwaited(tid))
                 return -ESRCH;
 
-        c->augmented = missing & c->mask;
+        c->augmented |= missing & c->mask;
 
         return 0;
 }
 
-int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
-        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *n = NULL;
-        int r;
+/* Fields that come from the same /proc file are read together */
+#define CREDS_STATUS_MASK                                               \
+        (SD_BUS_CREDS_PPID|                                             \
+         SD_BUS_CREDS_UID|SD_BUS_CREDS_EUID|SD_BUS_CREDS_SUID|SD_BUS_CREDS_FSUID| \
+         SD_BUS_CREDS_GID|SD_BUS_CREDS_EGID|SD_BUS_CREDS_SGID|SD_BUS_CREDS_FSGID| \
+         SD_BUS_CREDS_SUPPLEMENTARY_GIDS|                               \
+         SD_BUS_CREDS_EFFECTIVE_CAPS|SD_BUS_CREDS_INHERITABLE_CAPS|     \
+         SD_BUS_CREDS_PERMITTED_CAPS|SD_BUS_CREDS_BOUNDING_CAPS)
+#define CREDS_AUDIT_MASK                                                \
+        (SD_BUS_CREDS_AUDIT_SESSION_ID|SD_BUS_CREDS_AUDIT_LOGIN_UID)
+
+/* Fields that may be read from /proc only once a getter asks for them */
+#define CREDS_LAZY_MASK                                                 \
+        (CREDS_STATUS_MASK|CREDS_AUDIT_MASK|                            \
+         SD_BUS_CREDS_COMM|SD_BUS_CREDS_TID_COMM|SD_BUS_CREDS_EXE|      \
+         SD_BUS_CREDS_CMDLINE|SD_BUS_CREDS_SELINUX_CONTEXT|SD_BUS_CREDS_TTY)
+
+static bool pidfd_exited(int fd) {
+        struct pollfd p = {
+                .fd = fd,
+                .events = POLLIN,
+        };
+
+        /* A pidfd becomes readable once the process it refers to has exited. Since the pidfd pins the
+         * process, its pid cannot have been recycled as long as this says no. */
+        return poll(&p, 1, 0) != 0;
+}
+
+static int creds_defer(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid, uint64_t *ret_deferred) {
+        uint64_t lazy;
+        int fd;
 
         assert(c);
-        assert(ret);
+        assert(c->allocated);
+        assert(pid > 0);
+        assert(ret_deferred);
 
-        if ((mask & ~c->mask) == 0 || (!(mask & SD_BUS_CREDS_AUGMENT))) {
-                /* There's already all data we need, or augmentation
-                 * wasn't turned on. */
+        /* Records the pid, and the tid, so that the fields in the mask can be read when first needed. This
+         * requires a pidfd, so that we can tell later whether the pid still refers to the same process. */
 
-                *ret = sd_bus_creds_ref(c);
+        lazy = mask & ~c->mask & CREDS_LAZY_MASK;
+        if (tid <= 0 && !(c->mask & SD_BUS_CREDS_TID))
+                lazy &= ~SD_BUS_CREDS_TID_COMM;
+        if (lazy == 0 || c->lazy != 0) {
+                *ret_deferred = 0;
                 return 0;
         }
 
-        n = bus_creds_new();
-        if (!n)
-                return -ENOMEM;
+        fd = pidfd_open(pid, 0);
+        if (fd < 0)
+                return -errno;
 
-        /* Copy the original data over */
+        c->pid = pid;
+        c->mask |= SD_BUS_CREDS_PID;
+
+        if (tid > 0) {
+                c->tid = tid;
+                c->mask |= SD_BUS_CREDS_TID;
+        }
+
+        c->lazy = lazy;
+        c->lazy_pidfd = fd;
+
+        *ret_deferred = lazy;
+        return 0;
+}
+
+int bus_creds_resolve(sd_bus_creds *c, uint64_t mask) {
+        uint64_t want, seen;
+        int r;
+
+        assert(c);
+
+        want = c->lazy & mask;
+        if (want == 0)
+                return 0;
+
+        if (want & CREDS_STATUS_MASK)
+                want |= c->lazy & CREDS_STATUS_MASK;
+        if (want & CREDS_AUDIT_MASK)
+                want |= c->lazy & CREDS_AUDIT_MASK;
+
+        c->lazy &= ~want;
+
+        seen = c->mask;
+        r = bus_creds_add_more(c, want | SD_BUS_CREDS_AUGMENT, 0, 0);
+        if (r >= 0 && pidfd_exited(c->lazy_pidfd))
+                r = -ESRCH;
+        if (r < 0) {
+                /* Whatever we got might describe another process by now, hence don't expose it */
+                c->mask &= seen | ~want;
+                c->augmented &= c->mask;
+        }
+
+        if (c->lazy == 0)
+                c->lazy_pidfd = safe_close(c->lazy_pidfd);
+
+        return r;
+}
+
+static int creds_copy_fields(sd_bus_creds *n, sd_bus_creds *c, uint64_t mask) {
+        assert(n);
+        assert(c);
+
+        /* Copies the fields selected by the mask over, skipping what the destination already has */
+        mask &= ~n->mask;
 
         if (c->mask & mask & SD_BUS_CREDS_PID) {
                 n->pid = c->pid;
@@ -1199,11 +1425,39 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
                 n->mask |= SD_BUS_CREDS_DESCRIPTION;
         }
 
+        return 0;
+}
+
+int bus_creds_extend_by_pid(sd_bus *bus, sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *n = NULL;
+        int r;
+
+        assert(c);
+        assert(ret);
+
+        if ((mask & ~c->mask) == 0 || (!(mask & SD_BUS_CREDS_AUGMENT))) {
+                /* There's already all data we need, or augmentation
+                 * wasn't turned on. */
+
+                *ret = sd_bus_creds_ref(c);
+                return 0;
+        }
+
+        n = bus_creds_new();
+        if (!n)
+                return -ENOMEM;
+
+        /* Copy the original data over */
+
+        r = creds_copy_fields(n, c, mask);
+        if (r < 0)
+                return r;
+
         n->augmented = c->augmented & n->mask;
 
         /* Get more data */
 
-        r = bus_creds_add_more(n, mask, 0, 0);
+        r = bus_creds_add_more_cached(bus, n, mask, 0, 0);
         if (r < 0)
                 return r;
 
@@ -1211,3 +1465,249 @@ int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret)
 
         return 0;
 }
+
+/* Fields that are read from /proc/PID/ and hence can be shared between all messages of the same process.
+ * Thread specific and bus specific fields are not cached, and neither is the cgroup data, which is never
+ * read from /proc here anyway. */
+#define CREDS_CACHE_MASK                                                \
+        (_SD_BUS_CREDS_ALL & ~(SD_BUS_CREDS_PID|SD_BUS_CREDS_TID|SD_BUS_CREDS_TID_COMM| \
+                               SD_BUS_CREDS_CGROUP|SD_BUS_CREDS_UNIT|SD_BUS_CREDS_USER_UNIT| \
+                               SD_BUS_CREDS_SLICE|SD_BUS_CREDS_USER_SLICE|SD_BUS_CREDS_SESSION| \
+                               SD_BUS_CREDS_OWNER_UID|SD_BUS_CREDS_UNIQUE_NAME| \
+                               SD_BUS_CREDS_WELL_KNOWN_NAMES|SD_BUS_CREDS_DESCRIPTION))
+
+/* Every entry pins a pidfd, hence keep the number bounded */
+#define CREDS_CACHE_MAX 256U
+
+struct creds_cache_entry {
+        pid_t pid;
+        int pidfd;
+        uint64_t tried; /* fields we attempted to read, some of which might have been inaccessible */
+        sd_bus_creds *creds;
+};
+
+static struct creds_cache_entry* creds_cache_entry_free(struct creds_cache_entry *e) {
+        if (!e)
+                return NULL;
+
+        safe_close(e->pidfd);
+        sd_bus_creds_unref(e->creds);
+        return mfree(e);
+}
+
+static void creds_cache_remove(sd_bus *bus, struct creds_cache_entry *e) {
+        assert(bus);
+        assert(e);
+
+        hashmap_remove(bus->creds_cache, INT_TO_PTR(e->pid));
+        creds_cache_entry_free(e);
+}
+
+static bool creds_cache_entry_alive(struct creds_cache_entry *e) {
+        assert(e);
+
+        return !pidfd_exited(e->pidfd);
+}
+
+static void creds_cache_make_room(sd_bus *bus) {
+        struct creds_cache_entry *e;
+        Iterator i;
+
+        assert(bus);
+
+        if (hashmap_size(bus->creds_cache) < CREDS_CACHE_MAX)
+                return;
+
+        HASHMAP_FOREACH(e, bus->creds_cache, i)
+                if (!creds_cache_entry_alive(e))
+                        creds_cache_remove(bus, e);
+
+        if (hashmap_size(bus->creds_cache) < CREDS_CACHE_MAX)
+                return;
+
+        creds_cache_entry_free(hashmap_steal_first(bus->creds_cache));
+}
+
+static int creds_cache_acquire(sd_bus *bus, pid_t pid, uint64_t mask, struct creds_cache_entry **ret) {
+        _cleanup_close_ int pidfd = -1;
+        struct creds_cache_entry *e;
+        int r;
+
+        assert(bus);
+        assert(pid > 0);
+        assert(ret);
+
+        e = hashmap_get(bus->creds_cache, INT_TO_PTR(pid));
+        if (e && !creds_cache_entry_alive(e)) {
+                creds_cache_remove(bus, e);
+                e = NULL;
+        }
+
+        if (e && (e->tried & mask) == mask) {
+                bus->creds_cache_hits++;
+                *ret = e;
+                return 0;
+        }
+
+        bus->creds_cache_misses++;
+
+        if (!e) {
+                /* Open the pidfd before reading anything, so that we know the data belongs to it */
+                pidfd = pidfd_open(pid, 0);
+                if (pidfd < 0)
+                        return -errno;
+
+                r = hashmap_ensure_allocated(&bus->creds_cache, &trivial_hash_ops);
+                if (r < 0)
+                        return r;
+
+                creds_cache_make_room(bus);
+
+                e = new0(struct creds_cache_entry, 1);
+                if (!e)
+                        return -ENOMEM;
+
+                e->pid = pid;
+                e->pidfd = pidfd;
+                pidfd = -1;
+
+                e->creds = bus_creds_new();
+                if (!e->creds) {
+                        creds_cache_entry_free(e);
+                        return -ENOMEM;
+                }
+
+                r = hashmap_put(bus->creds_cache, INT_TO_PTR(pid), e);
+                if (r < 0) {
+                        creds_cache_entry_free(e);
+                        return r;
+                }
+        }
+
+        r = bus_creds_add_more(e->creds, mask | SD_BUS_CREDS_AUGMENT, pid, 0);
+        if (r >= 0 && !creds_cache_entry_alive(e))
+                r = -ESRCH;
+        if (r < 0) {
+                creds_cache_remove(bus, e);
+                return r;
+        }
+
+        e->tried |= mask;
+
+        *ret = e;
+        return 0;
+}
+
+int bus_creds_add_more_cached(sd_bus *bus, sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid) {
+        struct creds_cache_entry *e;
+        uint64_t want;
+        int r;
+
+        assert(c);
+
+        if (!bus || !(mask & SD_BUS_CREDS_AUGMENT))
+                return bus_creds_add_more(c, mask, pid, tid);
+
+        if (pid <= 0 && (c->mask & SD_BUS_CREDS_PID))
+                pid = c->pid;
+        if (pid <= 0)
+                return bus_creds_add_more(c, mask, pid, tid);
+
+        /* Cached lookups do not touch /proc either, hence deferring only pays off without the cache */
+        if (bus->creds_lazy && !bus->creds_cache_enabled) {
+                uint64_t deferred;
+
+                r = creds_defer(c, mask, pid, tid, &deferred);
+                if (r == -ESRCH)
+                        return r;
+                if (r < 0) {
+                        log_debug_errno(r, "Failed to defer reading credentials of " PID_FMT ", reading them directly: %m", pid);
+                        deferred = 0;
+                }
+
+                return bus_creds_add_more(c, mask & ~deferred, pid, tid);
+        }
+
+        if (!bus->creds_cache_enabled)
+                return bus_creds_add_more(c, mask, pid, tid);
+
+        want = mask & ~c->mask & CREDS_CACHE_MASK;
+        if (want == 0)
+                return bus_creds_add_more(c, mask, pid, tid);
+
+        r = creds_cache_acquire(bus, pid, want, &e);
+        if (r == -ESRCH)
+                return r;
+        if (r < 0) {
+                /* No pidfd support or out of file descriptors? Then read the data directly. */
+                log_debug_errno(r, "Failed to look up credentials of " PID_FMT " in cache, reading them directly: %m", pid);
+                return bus_creds_add_more(c, mask, pid, tid);
+        }
+
+        r = creds_copy_fields(c, e->creds, want);
+        if (r < 0)
+                return r;
+
+        c->augmented |= e->creds->augmented & want;
+
+        /* Whatever the cache could not provide, such as thread data, is read directly. Fields the cache
+         * tried already aren't tried again, they were inaccessible a moment ago. */
+        mask &= ~e->tried;
+        if ((mask & ~(c->mask|SD_BUS_CREDS_AUGMENT)) == 0)
+                return 0;
+
+        return bus_creds_add_more(c, mask, pid, tid);
+}
+
+void bus_creds_cache_flush(sd_bus *bus) {
+        assert(bus);
+
+        bus->creds_cache = hashmap_free_with_destructor(bus->creds_cache, creds_cache_entry_free);
+}
+
+_public_ int sd_bus_set_creds_cache(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->creds_cache_enabled = b;
+        if (!b)
+                bus_creds_cache_flush(bus);
+
+        return 0;
+}
+
+_public_ int sd_bus_get_creds_cache(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+
+        return bus->creds_cache_enabled;
+}
+
+_public_ int sd_bus_get_creds_cache_stats(sd_bus *bus, uint64_t *ret_hits, uint64_t *ret_misses) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+
+        if (ret_hits)
+                *ret_hits = bus->creds_cache_hits;
+        if (ret_misses)
+                *ret_misses = bus->creds_cache_misses;
+
+        return 0;
+}
+
+_public_ int sd_bus_set_creds_lazy(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->creds_lazy = b;
+        return 0;
+}
+
+_public_ int sd_bus_get_creds_lazy(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+
+        return bus->creds_lazy;
+}
@@ -61,6 +61,11 @@ struct sd_bus_creds {
         char *cgroup_root;
 
         char *description, *unescaped_description;
+
+        /* Fields requested with augmentation that are read from /proc only when first asked for. The
+         * pidfd tells us whether the pid still refers to the same process by then. */
+        uint64_t lazy;
+        int lazy_pidfd;
 };
 
 sd_bus_creds* bus_creds_new(void);
@@ -68,5 +73,9 @@ sd_bus_creds* bus_creds_new(void);
 void bus_creds_done(sd_bus_creds *c);
 
 int bus_creds_add_more(sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid);
+int bus_creds_add_more_cached(sd_bus *bus, sd_bus_creds *c, uint64_t mask, pid_t pid, pid_t tid);
+int bus_creds_resolve(sd_bus_creds *c, uint64_t mask);
+
+int bus_creds_extend_by_pid(sd_bus *bus, sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret);
 
-int bus_creds_extend_by_pid(sd_bus_creds *c, uint64_t mask, sd_bus_creds **ret);
+void bus_creds_cache_flush(sd_bus *bus);
@@ -3,6 +3,7 @@
 #include <sys/time.h>
 
 #include "alloc-util.h"
+#include "bus-creds.h"
 #include "bus-dump.h"
 #include "bus-internal.h"
 #include "bus-message.h"
@@ -334,6 +335,9 @@ int bus_creds_dump(sd_bus_creds *c, FILE *f, bool terse) {
 
         assert(c);
 
+        /* The fields are checked directly below, hence read what was requested lazily first */
+        (void) bus_creds_resolve(c, _SD_BUS_CREDS_ALL);
+
         if (!f)
                 f = stdout;
 
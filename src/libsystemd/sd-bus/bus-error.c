@@ -1,6 +1,7 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
 #include <errno.h>
+#include <pthread.h>
 #include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
@@ -12,6 +13,7 @@
 #include "alloc-util.h"
 #include "bus-error.h"
 #include "errno-list.h"
+#include "hashmap.h"
 #include "string-util.h"
 #include "util.h"
 
@@ -78,23 +80,20 @@ extern const sd_bus_error_map __stop_BUS_ERROR_MAP[];
  * NULL terminated array */
 static const sd_bus_error_map **additional_error_maps = NULL;
 
-static int bus_error_name_to_errno(const char *name) {
+/* Index over all of the above, from error name to map entry. It is built on first use and replaced whenever
+ * a map is added. Errors may be translated from any thread, hence it is built under a lock and published
+ * atomically. Readers use it without taking the lock, so a replaced index is never freed, but kept in
+ * retired_error_name_indexes. Maps are only added a handful of times per process. */
+static Hashmap *error_name_index = NULL;
+static Hashmap **retired_error_name_indexes = NULL;
+static size_t n_retired_error_name_indexes = 0;
+static pthread_mutex_t error_name_index_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+/* Calls f() for every registered map entry, in lookup order, until it returns non-zero */
+static int error_maps_foreach(int (*f)(const sd_bus_error_map *m, void *userdata), void *userdata) {
         const sd_bus_error_map **map, *m;
-        const char *p;
         int r;
 
-        if (!name)
-                return EINVAL;
-
-        p = startswith(name, "System.Error.");
-        if (p) {
-                r = errno_from_name(p);
-                if (r < 0)
-                        return EIO;
-
-                return r;
-        }
-
         if (additional_error_maps)
                 for (map = additional_error_maps; *map; map++)
                         for (m = *map;; m++) {
@@ -102,8 +101,9 @@ static int bus_error_name_to_errno(const char *name) {
                                 if (m->code == BUS_ERROR_MAP_END_MARKER)
                                         break;
 
-                                if (streq(m->name, name))
-                                        return m->code;
+                                r = f(m, userdata);
+                                if (r != 0)
+                                        return r;
                         }
 
         m = __start_BUS_ERROR_MAP;
@@ -120,14 +120,84 @@ static int bus_error_name_to_errno(const char *name) {
                         continue;
                 }
 
-                if (streq(m->name, name))
-                        return m->code;
+                r = f(m, userdata);
+                if (r != 0)
+                        return r;
 
                 m++;
         }
 #endif
 
-        return EIO;
+        return 0;
+}
+
+static int error_name_index_add(const sd_bus_error_map *m, void *userdata) {
+        int r;
+
+        /* The first entry for a name wins, later duplicates are shadowed by it */
+        r = hashmap_put(userdata, m->name, (void*) m);
+        if (r == -EEXIST)
+                return 0;
+
+        return r < 0 ? r : 0;
+}
+
+static Hashmap *error_name_index_get(void) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        Hashmap *index;
+
+        index = __atomic_load_n(&error_name_index, __ATOMIC_ACQUIRE);
+        if (index)
+                return index;
+
+        assert_se(pthread_mutex_lock(&error_name_index_mutex) == 0);
+
+        index = error_name_index;
+        if (!index) {
+                /* All keys are names from our own maps, a peer only gets to look them up */
+                h = hashmap_new(&trusted_string_hash_ops);
+                if (h && error_maps_foreach(error_name_index_add, h) >= 0) {
+                        index = TAKE_PTR(h);
+                        __atomic_store_n(&error_name_index, index, __ATOMIC_RELEASE);
+                }
+        }
+
+        assert_se(pthread_mutex_unlock(&error_name_index_mutex) == 0);
+
+        return index;
+}
+
+static int error_name_match(const sd_bus_error_map *m, void *userdata) {
+        return streq(m->name, userdata) ? m->code : 0;
+}
+
+static int bus_error_name_to_errno(const char *name) {
+        const sd_bus_error_map *m;
+        Hashmap *index;
+        const char *p;
+        int r;
+
+        if (!name)
+                return EINVAL;
+
+        p = startswith(name, "System.Error.");
+        if (p) {
+                r = errno_from_name(p);
+                if (r < 0)
+                        return EIO;
+
+                return r;
+        }
+
+        index = error_name_index_get();
+        if (index) {
+                m = hashmap_get(index, name);
+                return m ? m->code : EIO;
+        }
+
+        /* Couldn't build the index, fall back to searching the maps directly */
+        r = error_maps_foreach(error_name_match, (void*) name);
+        return r > 0 ? r : EIO;
 }
 
 static sd_bus_error errno_to_bus_error_const(int error) {
@@ -608,18 +678,25 @@ static bool map_ok(const sd_bus_error_map *map) {
         return true;
 }
 
-_public_ int sd_bus_error_add_map(const sd_bus_error_map *map) {
+static int error_maps_add(const sd_bus_error_map *map) {
         const sd_bus_error_map **maps = NULL;
+        Hashmap **retired;
         unsigned n = 0;
 
-        assert_return(map, -EINVAL);
-        assert_return(map_ok(map), -EINVAL);
-
         if (additional_error_maps)
                 for (; additional_error_maps[n] != NULL; n++)
                         if (additional_error_maps[n] == map)
                                 return 0;
 
+        /* Make room for retiring the current index first, so that nothing needs undoing later */
+        if (error_name_index) {
+                retired = reallocarray(retired_error_name_indexes, n_retired_error_name_indexes + 1, sizeof(Hashmap*));
+                if (!retired)
+                        return -ENOMEM;
+
+                retired_error_name_indexes = retired;
+        }
+
         maps = reallocarray(additional_error_maps, n + 2, sizeof(struct sd_bus_error_map*));
         if (!maps)
                 return -ENOMEM;
@@ -628,5 +705,26 @@ _public_ int sd_bus_error_add_map(const sd_bus_error_map *map) {
         maps[n+1] = NULL;
 
         additional_error_maps = maps;
+
+        /* The new map may shadow names from the ELF section, hence the index is rebuilt from scratch on
+         * next use. Readers may still be looking at the old one. */
+        if (error_name_index) {
+                retired_error_name_indexes[n_retired_error_name_indexes++] = error_name_index;
+                __atomic_store_n(&error_name_index, NULL, __ATOMIC_RELEASE);
+        }
+
         return 1;
 }
+
+_public_ int sd_bus_error_add_map(const sd_bus_error_map *map) {
+        int r;
+
+        assert_return(map, -EINVAL);
+        assert_return(map_ok(map), -EINVAL);
+
+        assert_se(pthread_mutex_lock(&error_name_index_mutex) == 0);
+        r = error_maps_add(map);
+        assert_se(pthread_mutex_unlock(&error_name_index_mutex) == 0);
+
+        return r;
+}
@@ -48,6 +48,8 @@ struct match_callback {
 struct node {
         char *path;
         struct node *parent;
+        Hashmap *children; /* direct children, keyed by their last path component */
+        Hashmap *interfaces; /* first node_vtable of each interface, keyed by interface name */
         LIST_HEAD(struct node, child);
         LIST_FIELDS(struct node, siblings);
 
@@ -55,6 +57,19 @@ struct node {
         LIST_HEAD(struct node_vtable, vtables);
         LIST_HEAD(struct node_enumerator, enumerators);
         LIST_HEAD(struct node_object_manager, object_managers);
+
+        /* The last Introspect() reply generated for exactly this path, valid until the specified time */
+        char *introspection;
+        usec_t introspection_until;
+
+        /* The value of sd_bus.nodes_generation when something was last attached to or detached from this node.
+         * Data cached for an object stays valid as long as neither its node nor any of its ancestors changed
+         * since the data was generated. */
+        uint64_t modified;
+
+        /* Serialized GetManagedObjects() dict entries of the objects below this object manager, by object
+         * path, dropped whenever the object announces a change */
+        Hashmap *managed_objects;
 };
 
 struct node_callback {
@@ -84,6 +99,31 @@ struct node_object_manager {
         LIST_FIELDS(struct node_object_manager, object_managers);
 };
 
+struct vtable_member {
+        const char *interface;
+        const char *member;
+        struct node_vtable *parent;
+        unsigned last_iteration;
+        const sd_bus_vtable *vtable;
+        sd_bus_latency *latency; /* methods only, allocated on the first timed call */
+};
+
+/* The methods or properties of a single vtable, compiled into a perfect hash table when the vtable is registered:
+ * a member name is hashed once, its bucket yields a displacement, and the displacement yields the one slot the
+ * member can be in. */
+struct vtable_member_table {
+        struct vtable_member *members;
+        unsigned n_members;
+
+        struct vtable_member **slots;
+        unsigned slot_mask;
+
+        uint32_t *displacements;
+        unsigned n_buckets;
+
+        uint64_t seed;
+};
+
 struct node_vtable {
         struct node *node;
 
@@ -92,18 +132,31 @@ struct node_vtable {
         const sd_bus_vtable *vtable;
         sd_bus_object_find_t find;
 
+        struct vtable_member_table methods;
+        struct vtable_member_table properties;
+
         unsigned last_iteration;
 
         LIST_FIELDS(struct node_vtable, vtables);
 };
 
-struct vtable_member {
-        const char *path;
-        const char *interface;
-        const char *member;
-        struct node_vtable *parent;
-        unsigned last_iteration;
-        const sd_bus_vtable *vtable;
+struct properties_changed_interface {
+        char *interface;
+        bool all_properties; /* if true, 'names' is ignored and all EMITS_CHANGE/EMITS_INVALIDATION properties are sent */
+        char **names;
+
+        LIST_FIELDS(struct properties_changed_interface, interfaces);
+};
+
+/* PropertiesChanged signals queued for an object in deferred mode. After the signals are sent the object is kept
+ * around until the rate limit interval passed, to remember when the last ones went out. */
+struct properties_changed_object {
+        char *path;
+        usec_t last_emitted;
+        usec_t deadline;
+        unsigned prioq_idx;
+
+        LIST_HEAD(struct properties_changed_interface, interfaces);
 };
 
 typedef enum BusSlotType {
@@ -135,6 +188,9 @@ struct sd_bus_slot {
         bool match_added:1;
         char *description;
 
+        /* How long the callbacks took, allocated on the first call once timing is enabled on the bus */
+        sd_bus_latency *latency;
+
         LIST_FIELDS(sd_bus_slot, slots);
 
         union {
@@ -209,6 +265,17 @@ struct sd_bus {
         bool connected_signal:1;
         bool close_on_exit:1;
         bool send_null_byte:1;
+        bool defer_properties_changed:1;
+        bool creds_cache_enabled:1;
+        bool creds_lazy:1;
+        bool name_owner_cache:1;
+        bool trusted_wire:1;
+        bool cork:1;
+        bool auto_cork:1;
+        bool auto_corked:1;
+        bool write_blocked:1;
+        bool write_drained:1;
+        bool slot_latency:1;
 
         int use_memfd;
 
@@ -218,11 +285,28 @@ struct sd_bus {
         sd_bus_message **rqueue;
         unsigned rqueue_size;
         size_t rqueue_allocated;
+        unsigned rqueue_changed; /* lowest index changed since bus_wait_for_reply() last looked */
+        size_t rqueue_bytes, rqueue_bytes_high, rqueue_bytes_max;
+        size_t rqueue_shed_size, rqueue_shed_bytes;
+        uint64_t rqueue_n_shed;
+
+        sd_bus_shed_handler_t shed_callback;
+        void *shed_userdata;
 
         sd_bus_message **wqueue;
         unsigned wqueue_size;
         size_t windex;
         size_t wqueue_allocated;
+        size_t wqueue_bytes, wqueue_bytes_high, wqueue_bytes_max;
+        size_t wqueue_watermark_low, wqueue_watermark_high;
+        usec_t wqueue_deadline_next;
+        uint64_t wqueue_n_expired;
+
+        /* Messages created on or received from this bus start out with these priorities */
+        int64_t message_type_priority[_SD_BUS_MESSAGE_TYPE_MAX];
+
+        sd_bus_write_drained_handler_t write_drained_callback;
+        void *write_drained_userdata;
 
         uint64_t cookie;
 
@@ -235,8 +319,6 @@ struct sd_bus {
         LIST_HEAD(struct filter_callback, filter_callbacks);
 
         Hashmap *nodes;
-        Hashmap *vtable_methods;
-        Hashmap *vtable_properties;
 
         union sockaddr_union sockaddr;
         socklen_t sockaddr_size;
@@ -298,6 +380,37 @@ struct sd_bus {
 
         /* zero means use value specified by $SYSTEMD_BUS_TIMEOUT= environment variable or built-in default */
         usec_t method_call_timeout;
+
+        /* How long Introspect() replies that depend on node enumerators or object find callbacks may be reused,
+         * zero means they are generated anew for every call */
+        usec_t introspection_cache_ttl;
+
+        /* Counts modifications of the node tree, see node.modified */
+        uint64_t nodes_generation;
+
+        /* Values of SD_BUS_VTABLE_PROPERTY_CACHED properties, by object path */
+        Hashmap *property_cache;
+
+        /* Deferred PropertiesChanged signals, by object path and ordered by when they may be sent */
+        Hashmap *properties_changed;
+        Prioq *properties_changed_prioq;
+        usec_t properties_changed_interval;
+
+        /* Credentials read from /proc, by pid, each entry validated by a pidfd */
+        Hashmap *creds_cache;
+        uint64_t creds_cache_hits;
+        uint64_t creds_cache_misses;
+
+        /* Counters only, the queue peaks and other numbers kept elsewhere are filled in on request */
+        sd_bus_stats stats;
+
+        /* Callbacks that run for longer than this are reported, USEC_INFINITY if nobody wants to know */
+        usec_t slow_callback_usec;
+        sd_bus_slow_callback_handler_t slow_callback;
+        void *slow_callback_userdata;
+
+        Hashmap *name_owners;
+        sd_bus_slot *name_owner_slot;
 };
 
 /* For method calls we time-out at 25s, like in the D-Bus reference implementation */
@@ -310,6 +423,14 @@ struct sd_bus {
 #define BUS_WQUEUE_MAX (192*1024)
 #define BUS_RQUEUE_MAX (192*1024)
 
+/* Default byte budgets of the queues. A single message is always accepted into an empty queue, whatever its
+ * size, so that a message larger than the budget can't wedge the connection. */
+#define BUS_WQUEUE_SIZE_MAX (256*1024*1024)
+#define BUS_RQUEUE_SIZE_MAX (256*1024*1024)
+
+/* A corked write queue is written out anyway once it holds this many bytes */
+#define BUS_CORK_SIZE_MAX (64*1024)
+
 #define BUS_MESSAGE_SIZE_MAX (128*1024*1024)
 #define BUS_AUTH_SIZE_MAX (64*1024)
 
@@ -345,7 +466,17 @@ int bus_next_address(sd_bus *bus);
 
 int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m);
 
-int bus_rqueue_make_room(sd_bus *bus);
+int bus_rqueue_make_room(sd_bus *bus, uint8_t type, size_t size);
+void bus_rqueue_append(sd_bus *bus, sd_bus_message *m);
+bool bus_rqueue_may_shed(sd_bus *bus, uint8_t type);
+int bus_rqueue_shed(sd_bus *bus, sd_bus_message *m, bool full);
+
+/* Unless throttle is set these aren't held back by the write watermark, for what the library sends on its own
+ * behalf */
+int bus_send_internal(sd_bus *bus, sd_bus_message *m, uint64_t *cookie, usec_t deadline, bool throttle);
+int bus_call_async_internal(sd_bus *bus, sd_bus_slot **slot, sd_bus_message *m, sd_bus_message_handler_t callback, void *userdata, uint64_t usec, bool throttle);
+int bus_call_method_async_internal(sd_bus *bus, sd_bus_slot **slot, const char *destination, const char *path, const char *interface, const char *member, sd_bus_message_handler_t callback, void *userdata, const char *types, ...);
+int bus_call_many(sd_bus *bus, sd_bus_message **m, size_t n, sd_bus_error *errors, sd_bus_message **replies, int *results);
 
 bool bus_pid_changed(sd_bus *bus);
 
@@ -0,0 +1,144 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "sd-bus.h"
+
+#include "bus-internal.h"
+#include "bus-slot.h"
+#include "string-util.h"
+
+/* Exports what sd_bus_set_slot_latency() collected, so that it can be looked at with busctl on a running
+ * service. Only slots that were called at least once while timing was on are listed. Methods of a vtable
+ * get a row each, with the member filled in, and the row of the vtable slot itself covers its property
+ * callbacks and find callback. Floating reply slots go away right after their callback ran, so they hardly
+ * ever show up here. */
+
+#define BUS_LATENCY_INTERFACE "org.basu.Debug.Latency1"
+
+static const char* const slot_kind_table[] = {
+        [BUS_REPLY_CALLBACK] = "reply",
+        [BUS_FILTER_CALLBACK] = "filter",
+        [BUS_MATCH_CALLBACK] = "match",
+        [BUS_NODE_CALLBACK] = "object",
+        [BUS_NODE_VTABLE] = "vtable",
+};
+
+static int append_latency(sd_bus_message *reply, sd_bus_slot *slot, const char *member, const sd_bus_latency *l) {
+        const char *description = NULL, *path = NULL, *interface = NULL;
+        int r;
+
+        (void) sd_bus_slot_get_description(slot, &description);
+
+        if (slot->type == BUS_NODE_CALLBACK && slot->node_callback.node)
+                path = slot->node_callback.node->path;
+        else if (slot->type == BUS_NODE_VTABLE) {
+                if (slot->node_vtable.node)
+                        path = slot->node_vtable.node->path;
+                interface = slot->node_vtable.interface;
+        }
+
+        r = sd_bus_message_open_container(reply, 'r', "sssssttttat");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append(reply, "ssssstttt",
+                                  slot_kind_table[slot->type],
+                                  strempty(description),
+                                  strempty(path),
+                                  strempty(interface),
+                                  strempty(member),
+                                  l->calls,
+                                  l->errors,
+                                  l->usec_total,
+                                  l->usec_max);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_append_array(reply, 't', l->buckets, sizeof(l->buckets));
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_close_container(reply);
+}
+
+static int append_slot(sd_bus_message *reply, sd_bus_slot *slot) {
+        unsigned i;
+        int r;
+
+        if (slot->latency) {
+                r = append_latency(reply, slot, NULL, slot->latency);
+                if (r < 0)
+                        return r;
+        }
+
+        if (slot->type != BUS_NODE_VTABLE)
+                return 0;
+
+        for (i = 0; i < slot->node_vtable.methods.n_members; i++) {
+                struct vtable_member *v = slot->node_vtable.methods.members + i;
+
+                if (!v->latency)
+                        continue;
+
+                r = append_latency(reply, slot, v->member, v->latency);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int method_get_latency(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        sd_bus_slot *slot;
+        int r;
+
+        r = sd_bus_message_new_method_return(m, &reply);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(reply, 'a', "(sssssttttat)");
+        if (r < 0)
+                return r;
+
+        LIST_FOREACH(slots, slot, bus->slots) {
+                if (slot->type < 0 || (size_t) slot->type >= ELEMENTSOF(slot_kind_table) || !slot_kind_table[slot->type])
+                        continue;
+
+                r = append_slot(reply, slot);
+                if (r < 0)
+                        return r;
+        }
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        return sd_bus_send(bus, reply, NULL);
+}
+
+static int method_reset_latency(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        sd_bus_slot *slot;
+
+        LIST_FOREACH(slots, slot, bus->slots)
+                (void) sd_bus_slot_reset_latency(slot);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable latency_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("GetLatency", NULL, "a(sssssttttat)", method_get_latency, 0),
+        SD_BUS_METHOD("ResetLatency", NULL, NULL, method_reset_latency, 0),
+        SD_BUS_VTABLE_END
+};
+
+_public_ int sd_bus_add_latency_object(sd_bus *bus, sd_bus_slot **slot, const char *path) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(object_path_is_valid(path), -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        return sd_bus_add_object_vtable(bus, slot, path, BUS_LATENCY_INTERFACE, latency_vtable, NULL);
+}
@@ -3,6 +3,8 @@
 #include "alloc-util.h"
 #include "bus-internal.h"
 #include "bus-message.h"
+#include "bus-probe.h"
+#include "bus-slot.h"
 #include "hexdecoct.h"
 #include "string-util.h"
 #include "strv.h"
@@ -296,14 +298,20 @@ int bus_match_run(
                 if (node->leaf.callback->callback) {
                         _cleanup_(sd_bus_error_free) sd_bus_error error_buffer = SD_BUS_ERROR_NULL;
                         sd_bus_slot *slot;
+                        usec_t begin;
 
                         slot = container_of(node->leaf.callback, sd_bus_slot, match_callback);
                         if (bus) {
                                 bus->current_slot = sd_bus_slot_ref(slot);
                                 bus->current_handler = node->leaf.callback->callback;
                                 bus->current_userdata = slot->userdata;
+                                bus->stats.match_callbacks++;
                         }
+                        BUS_PROBE_MESSAGE(dispatch_match, m);
+                        begin = bus_slot_latency_begin(bus);
                         r = node->leaf.callback->callback(m, slot->userdata, &error_buffer);
+                        bus_slot_latency_end(bus, slot, m, begin, r);
+                        BUS_PROBE_HANDLER_RETURN(m, r);
                         if (bus) {
                                 bus->current_userdata = NULL;
                                 bus->current_handler = NULL;
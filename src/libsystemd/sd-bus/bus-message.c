@@ -10,6 +10,7 @@
 #include "bus-gvariant.h"
 #include "bus-internal.h"
 #include "bus-message.h"
+#include "bus-probe.h"
 #include "bus-signature.h"
 #include "bus-type.h"
 #include "fd-util.h"
@@ -83,6 +84,72 @@ static struct bus_container *message_get_last_container(sd_bus_message *m) {
         return m->containers + m->n_containers - 1;
 }
 
+static const struct bus_signature *container_get_signature(struct bus_container *c) {
+        assert(c);
+
+        /* Containers get theirs when they are opened or entered. The signature of the root container however
+         * is only complete once the message is sealed, hence it's looked up the first time it's needed. */
+        if (!c->looked_up_signature) {
+                c->interned = bus_signature_lookup(c->signature);
+                c->looked_up_signature = true;
+        }
+
+        return c->interned;
+}
+
+/* Returns the length of the complete type at offset i of a signature, and optionally its gvariant alignment
+ * and size. Taken from the interned signature if we have one, otherwise parsed on the spot. */
+static int signature_element_info(
+                const struct bus_signature *sig,
+                const char *s,
+                size_t i,
+                size_t *ret_length,
+                int *ret_alignment,
+                int *ret_size) {
+
+        size_t n;
+        int r;
+
+        assert(ret_length);
+
+        if (sig && i < sig->length) {
+                if (sig->element_length[i] == 0)
+                        return -EINVAL;
+
+                *ret_length = sig->element_length[i];
+                if (ret_alignment)
+                        *ret_alignment = sig->element_alignment[i];
+                if (ret_size)
+                        *ret_size = sig->element_size[i];
+                return 0;
+        }
+
+        r = signature_element_length(s + i, &n);
+        if (r < 0)
+                return r;
+
+        if (ret_alignment || ret_size) {
+                char t[n+1];
+
+                memcpy(t, s + i, n);
+                t[n] = 0;
+
+                if (ret_alignment)
+                        *ret_alignment = bus_gvariant_get_alignment(t);
+                if (ret_size)
+                        *ret_size = bus_gvariant_get_size(t);
+        }
+
+        *ret_length = n;
+        return 0;
+}
+
+static int container_element_length(struct bus_container *c, size_t i, size_t *l) {
+        assert(c);
+
+        return signature_element_info(container_get_signature(c), c->signature, i, l, NULL, NULL);
+}
+
 static void message_free_last_container(sd_bus_message *m) {
         struct bus_container *c;
 
@@ -511,7 +578,13 @@ int bus_message_from_header(
                 m->creds.mask |= SD_BUS_CREDS_SELINUX_CONTEXT;
         }
 
+        m->trusted_wire = bus->trusted_wire;
+
+        if (h->type < _SD_BUS_MESSAGE_TYPE_MAX)
+                m->priority = bus->message_type_priority[h->type];
+
         m->bus = sd_bus_ref(bus);
+        bus->stats.messages_allocated++;
         *ret = TAKE_PTR(m);
 
         return 0;
@@ -591,6 +664,8 @@ _public_ int sd_bus_message_new(
         t->allow_fds = bus->can_fds || !IN_SET(bus->state, BUS_HELLO, BUS_RUNNING);
         t->root_container.need_offsets = BUS_MESSAGE_IS_GVARIANT(t);
         t->bus = sd_bus_ref(bus);
+        t->priority = bus->message_type_priority[type];
+        bus->stats.messages_allocated++;
 
         if (bus->allow_interactive_authorization)
                 t->header->flags |= BUS_MESSAGE_ALLOW_INTERACTIVE_AUTHORIZATION;
@@ -1640,6 +1715,7 @@ static int bus_message_open_array(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const struct bus_signature *sig,
                 uint32_t **array_size,
                 size_t *begin,
                 bool *need_offsets) {
@@ -1654,7 +1730,7 @@ static int bus_message_open_array(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_single(contents, true))
+        if (sig ? !sig->single : !signature_is_single(contents, true))
                 return -EINVAL;
 
         if (c->signature && c->signature[c->index]) {
@@ -1686,7 +1762,7 @@ static int bus_message_open_array(
         }
 
         if (BUS_MESSAGE_IS_GVARIANT(m)) {
-                alignment = bus_gvariant_get_alignment(contents);
+                alignment = sig ? sig->gvariant_alignment : bus_gvariant_get_alignment(contents);
                 if (alignment < 0)
                         return alignment;
 
@@ -1694,7 +1770,7 @@ static int bus_message_open_array(
                 if (!message_extend_body(m, alignment, 0, false, false))
                         return -ENOMEM;
 
-                r = bus_gvariant_is_fixed_size(contents);
+                r = sig ? sig->gvariant_size >= 0 : bus_gvariant_is_fixed_size(contents);
                 if (r < 0)
                         return r;
 
@@ -1738,13 +1814,14 @@ static int bus_message_open_array(
 static int bus_message_open_variant(
                 sd_bus_message *m,
                 struct bus_container *c,
-                const char *contents) {
+                const char *contents,
+                const struct bus_signature *sig) {
 
         assert(m);
         assert(c);
         assert(contents);
 
-        if (!signature_is_single(contents, false))
+        if (sig ? !sig->single_strict : !signature_is_single(contents, false))
                 return -EINVAL;
 
         if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
@@ -1797,6 +1874,7 @@ static int bus_message_open_struct(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const struct bus_signature *sig,
                 size_t *begin,
                 bool *need_offsets) {
 
@@ -1809,13 +1887,13 @@ static int bus_message_open_struct(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_valid(contents, false))
+        if (sig ? !sig->valid_strict : !signature_is_valid(contents, false))
                 return -EINVAL;
 
         if (c->signature && c->signature[c->index]) {
                 size_t l;
 
-                l = strlen(contents);
+                l = sig ? sig->length : strlen(contents);
 
                 if (c->signature[c->index] != SD_BUS_TYPE_STRUCT_BEGIN ||
                     !startswith(c->signature + c->index + 1, contents) ||
@@ -1841,14 +1919,14 @@ static int bus_message_open_struct(
         if (BUS_MESSAGE_IS_GVARIANT(m)) {
                 int alignment;
 
-                alignment = bus_gvariant_get_alignment(contents);
+                alignment = sig ? sig->gvariant_alignment : bus_gvariant_get_alignment(contents);
                 if (alignment < 0)
                         return alignment;
 
                 if (!message_extend_body(m, alignment, 0, false, false))
                         return -ENOMEM;
 
-                r = bus_gvariant_is_fixed_size(contents);
+                r = sig ? sig->gvariant_size >= 0 : bus_gvariant_is_fixed_size(contents);
                 if (r < 0)
                         return r;
 
@@ -1870,6 +1948,7 @@ static int bus_message_open_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const struct bus_signature *sig,
                 size_t *begin,
                 bool *need_offsets) {
 
@@ -1881,7 +1960,7 @@ static int bus_message_open_dict_entry(
         assert(begin);
         assert(need_offsets);
 
-        if (!signature_is_pair(contents))
+        if (sig ? !sig->pair : !signature_is_pair(contents))
                 return -EINVAL;
 
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
@@ -1890,7 +1969,7 @@ static int bus_message_open_dict_entry(
         if (c->signature && c->signature[c->index]) {
                 size_t l;
 
-                l = strlen(contents);
+                l = sig ? sig->length : strlen(contents);
 
                 if (c->signature[c->index] != SD_BUS_TYPE_DICT_ENTRY_BEGIN ||
                     !startswith(c->signature + c->index + 1, contents) ||
@@ -1902,14 +1981,14 @@ static int bus_message_open_dict_entry(
         if (BUS_MESSAGE_IS_GVARIANT(m)) {
                 int alignment;
 
-                alignment = bus_gvariant_get_alignment(contents);
+                alignment = sig ? sig->gvariant_alignment : bus_gvariant_get_alignment(contents);
                 if (alignment < 0)
                         return alignment;
 
                 if (!message_extend_body(m, alignment, 0, false, false))
                         return -ENOMEM;
 
-                r = bus_gvariant_is_fixed_size(contents);
+                r = sig ? sig->gvariant_size >= 0 : bus_gvariant_is_fixed_size(contents);
                 if (r < 0)
                         return r;
 
@@ -1932,6 +2011,7 @@ _public_ int sd_bus_message_open_container(
         struct bus_container *c;
         uint32_t *array_size = NULL;
         _cleanup_free_ char *signature = NULL;
+        const struct bus_signature *sig;
         size_t before, begin = 0;
         bool need_offsets = false;
         int r;
@@ -1955,19 +2035,22 @@ _public_ int sd_bus_message_open_container(
                 return -ENOMEM;
         }
 
+        /* NULL if the contents weren't interned, in which case they are parsed below */
+        sig = bus_signature_lookup(contents);
+
         /* Save old index in the parent container, in case we have to
          * abort this container */
         c->saved_index = c->index;
         before = m->body_size;
 
         if (type == SD_BUS_TYPE_ARRAY)
-                r = bus_message_open_array(m, c, contents, &array_size, &begin, &need_offsets);
+                r = bus_message_open_array(m, c, contents, sig, &array_size, &begin, &need_offsets);
         else if (type == SD_BUS_TYPE_VARIANT)
-                r = bus_message_open_variant(m, c, contents);
+                r = bus_message_open_variant(m, c, contents, sig);
         else if (type == SD_BUS_TYPE_STRUCT)
-                r = bus_message_open_struct(m, c, contents, &begin, &need_offsets);
+                r = bus_message_open_struct(m, c, contents, sig, &begin, &need_offsets);
         else if (type == SD_BUS_TYPE_DICT_ENTRY)
-                r = bus_message_open_dict_entry(m, c, contents, &begin, &need_offsets);
+                r = bus_message_open_dict_entry(m, c, contents, sig, &begin, &need_offsets);
         else
                 r = -EINVAL;
         if (r < 0)
@@ -1977,6 +2060,8 @@ _public_ int sd_bus_message_open_container(
         m->containers[m->n_containers++] = (struct bus_container) {
                 .enclosing = type,
                 .signature = TAKE_PTR(signature),
+                .interned = sig,
+                .looked_up_signature = true,
                 .array_size = array_size,
                 .before = before,
                 .begin = begin,
@@ -2747,6 +2832,170 @@ _public_ int sd_bus_message_append_strv(sd_bus_message *m, char **l) {
         return sd_bus_message_close_container(m);
 }
 
+int bus_message_append_dict_entries_raw(sd_bus_message *m, const char *contents, const void *p, size_t sz) {
+        struct bus_container *c;
+        size_t l;
+        void *a;
+
+        assert(m);
+        assert(contents);
+        assert(p || sz == 0);
+
+        /* Appends dict entries that have been marshalled before (see bus_message_copy_body()) to the array that
+         * is currently open. The data must start on an 8 byte boundary, and must not reference any fds. */
+
+        if (m->sealed)
+                return -EPERM;
+        if (m->poisoned)
+                return -ESTALE;
+        if (BUS_MESSAGE_IS_GVARIANT(m))
+                return -EOPNOTSUPP;
+
+        c = message_get_last_container(m);
+        if (c->enclosing != SD_BUS_TYPE_ARRAY || !c->signature)
+                return -ENXIO;
+
+        l = strlen(contents);
+        if (c->signature[c->index] != SD_BUS_TYPE_DICT_ENTRY_BEGIN ||
+            !startswith(c->signature + c->index + 1, contents) ||
+            c->signature[c->index + 1 + l] != SD_BUS_TYPE_DICT_ENTRY_END)
+                return -ENXIO;
+
+        if (sz == 0)
+                return 0;
+
+        a = message_extend_body(m, 8, sz, false, false);
+        if (!a)
+                return -ENOMEM;
+
+        memcpy(a, p, sz);
+        return 0;
+}
+
+int bus_message_copy_body(sd_bus_message *m, size_t begin, size_t end, void **ret) {
+        _cleanup_free_ uint8_t *buf = NULL;
+        struct bus_body_part *part;
+        size_t offset = 0, i;
+
+        assert(m);
+        assert(begin <= end);
+        assert(end <= m->body_size);
+        assert(ret);
+
+        /* Copies a range of the (not yet sealed) body out of the message, for use with
+         * bus_message_append_dict_entries_raw() later on */
+
+        if (BUS_MESSAGE_IS_GVARIANT(m))
+                return -EOPNOTSUPP;
+
+        buf = malloc(MAX(end - begin, 1U));
+        if (!buf)
+                return -ENOMEM;
+
+        MESSAGE_FOREACH_PART(part, i, m) {
+                size_t from, to;
+
+                if (offset >= end)
+                        break;
+
+                from = MAX(begin, offset);
+                to = MIN(end, offset + part->size);
+
+                if (from < to) {
+                        if (part->is_zero)
+                                memzero(buf + from - begin, to - from);
+                        else if (part->data)
+                                memcpy(buf + from - begin, (uint8_t*) part->data + from - offset, to - from);
+                        else
+                                return -EOPNOTSUPP;
+                }
+
+                offset += part->size;
+        }
+
+        *ret = TAKE_PTR(buf);
+        return 0;
+}
+
+unsigned bus_message_get_raw_phase(sd_bus_message *m, const char *types) {
+        size_t align = 1;
+        const char *t;
+
+        assert(m);
+        assert(types);
+
+        /* Returns the offset at which the next values of the specified types would start, modulo the largest
+         * alignment used within them. Marshalled values may be copied to any position of the same phase with
+         * bus_message_append_raw(). */
+
+        for (t = types; *t; t++) {
+                if (IN_SET(*t, SD_BUS_TYPE_STRUCT_END, SD_BUS_TYPE_DICT_ENTRY_END))
+                        continue;
+
+                /* The contents of a variant may need anything */
+                if (*t == SD_BUS_TYPE_VARIANT) {
+                        align = 8;
+                        break;
+                }
+
+                align = MAX(align, (size_t) bus_type_get_alignment(*t));
+        }
+
+        return ALIGN_TO(m->body_size, bus_type_get_alignment(types[0])) % align;
+}
+
+int bus_message_append_raw(sd_bus_message *m, const char *types, const void *p, size_t sz) {
+        struct bus_container *c;
+        void *a;
+
+        assert(m);
+        assert(types);
+        assert(p);
+        assert(sz > 0);
+
+        /* Appends complete values of the specified types that have been marshalled before at a position of the
+         * same phase (see bus_message_get_raw_phase()). The data must not reference any fds. */
+
+        if (m->sealed)
+                return -EPERM;
+        if (m->poisoned)
+                return -ESTALE;
+        if (BUS_MESSAGE_IS_GVARIANT(m))
+                return -EOPNOTSUPP;
+
+        c = message_get_last_container(m);
+
+        if (c->signature && c->signature[c->index]) {
+                /* Container signature is already set */
+
+                if (!startswith(c->signature + c->index, types))
+                        return -ENXIO;
+        } else {
+                char *e;
+
+                /* Maybe we can append to the signature? But only if this is the top-level container */
+                if (c->enclosing != 0)
+                        return -ENXIO;
+
+                e = strextend(&c->signature, types, NULL);
+                if (!e) {
+                        m->poisoned = true;
+                        return -ENOMEM;
+                }
+        }
+
+        a = message_extend_body(m, bus_type_get_alignment(types[0]), sz, false, false);
+        if (!a)
+                return -ENOMEM;
+
+        memcpy(a, p, sz);
+
+        if (c->enclosing != SD_BUS_TYPE_ARRAY)
+                c->index += strlen(types);
+
+        return 0;
+}
+
 static int bus_message_close_header(sd_bus_message *m) {
 
         assert(m);
@@ -2908,6 +3157,8 @@ _public_ int sd_bus_message_seal(sd_bus_message *m, uint64_t cookie, uint64_t ti
 
         m->sealed = true;
 
+        BUS_PROBE_MESSAGE(message_sealed, m);
+
         return 0;
 }
 
@@ -3093,9 +3344,12 @@ static int container_next_item(sd_bus_message *m, struct bus_container *c, size_
                 return 0;
 
         if (c->enclosing == SD_BUS_TYPE_ARRAY) {
+                const struct bus_signature *sig;
                 int sz;
 
-                sz = bus_gvariant_get_size(c->signature);
+                sig = container_get_signature(c);
+
+                sz = sig ? sig->gvariant_size : bus_gvariant_get_size(c->signature);
                 if (sz < 0) {
                         int alignment;
 
@@ -3104,7 +3358,7 @@ static int container_next_item(sd_bus_message *m, struct bus_container *c, size_
 
                         /* Variable-size array */
 
-                        alignment = bus_gvariant_get_alignment(c->signature);
+                        alignment = sig ? sig->gvariant_alignment : bus_gvariant_get_alignment(c->signature);
                         assert(alignment > 0);
 
                         *rindex = ALIGN_TO(c->offsets[c->offset_index], alignment);
@@ -3130,20 +3384,13 @@ static int container_next_item(sd_bus_message *m, struct bus_container *c, size_
                 if (c->offset_index+1 >= c->n_offsets)
                         goto end;
 
-                r = signature_element_length(c->signature + c->index, &n);
+                r = container_element_length(c, c->index, &n);
                 if (r < 0)
                         return r;
 
-                r = signature_element_length(c->signature + c->index + n, &j);
+                r = signature_element_info(container_get_signature(c), c->signature, c->index + n, &j, &alignment, NULL);
                 if (r < 0)
                         return r;
-                else {
-                        char t[j+1];
-                        memcpy(t, c->signature + c->index + n, j);
-                        t[j] = 0;
-
-                        alignment = bus_gvariant_get_alignment(t);
-                }
 
                 assert(alignment > 0);
 
@@ -3225,7 +3472,11 @@ static bool validate_nul(const char *s, size_t l) {
         return true;
 }
 
-static bool validate_string(const char *s, size_t l) {
+static bool validate_string(sd_bus_message *m, const char *s, size_t l) {
+
+        /* On a trusted wire we only make sure not to read past the end of the string */
+        if (m->trusted_wire)
+                return s[l] == 0;
 
         if (!validate_nul(s, l))
                 return false;
@@ -3249,7 +3500,25 @@ static bool validate_signature(const char *s, size_t l) {
         return true;
 }
 
-static bool validate_object_path(const char *s, size_t l) {
+/* On a trusted wire the characters of an object path aren't looked at, but the object tree lookup still
+ * relies on the path being absolute and on it having no empty components. */
+static bool object_path_is_sane(const char *p) {
+        size_t l;
+
+        if (p[0] != '/')
+                return false;
+
+        l = strlen(p);
+        if (l > 1 && p[l-1] == '/')
+                return false;
+
+        return !strstr(p, "//");
+}
+
+static bool validate_object_path(sd_bus_message *m, const char *s, size_t l) {
+
+        if (m->trusted_wire)
+                return s[l] == 0 && object_path_is_sane(s);
 
         if (!validate_nul(s, l))
                 return false;
@@ -3298,9 +3567,9 @@ _public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
                                 return r;
 
                         if (type == SD_BUS_TYPE_STRING)
-                                ok = validate_string(q, c->item_size-1);
+                                ok = validate_string(m, q, c->item_size-1);
                         else if (type == SD_BUS_TYPE_OBJECT_PATH)
-                                ok = validate_object_path(q, c->item_size-1);
+                                ok = validate_object_path(m, q, c->item_size-1);
                         else
                                 ok = validate_signature(q, c->item_size-1);
 
@@ -3396,9 +3665,9 @@ _public_ int sd_bus_message_read_basic(sd_bus_message *m, char type, void *p) {
                                 return r;
 
                         if (type == SD_BUS_TYPE_OBJECT_PATH)
-                                ok = validate_object_path(q, l);
+                                ok = validate_object_path(m, q, l);
                         else
-                                ok = validate_string(q, l);
+                                ok = validate_string(m, q, l);
                         if (!ok)
                                 return -EBADMSG;
 
@@ -3501,6 +3770,7 @@ static int bus_message_enter_array(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const struct bus_signature *sig,
                 uint32_t **array_size,
                 size_t *item_size,
                 size_t **offsets,
@@ -3518,7 +3788,7 @@ static int bus_message_enter_array(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_single(contents, true))
+        if (sig ? !sig->single : !signature_is_single(contents, true))
                 return -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
@@ -3560,14 +3830,15 @@ static int bus_message_enter_array(
                 *offsets = NULL;
                 *n_offsets = 0;
 
-        } else if (bus_gvariant_is_fixed_size(contents)) {
+        } else if (sig ? sig->gvariant_size >= 0 : bus_gvariant_is_fixed_size(contents)) {
 
                 /* gvariant: fixed length array */
-                *item_size = bus_gvariant_get_size(contents);
+                *item_size = sig ? sig->gvariant_size : bus_gvariant_get_size(contents);
                 *offsets = NULL;
                 *n_offsets = 0;
 
         } else {
+                const struct bus_signature *parent;
                 size_t where, previous = 0, framing, sz;
                 int alignment;
                 unsigned i;
@@ -3597,7 +3868,8 @@ static int bus_message_enter_array(
                 if (!*offsets)
                         return -ENOMEM;
 
-                alignment = bus_gvariant_get_alignment(c->signature);
+                parent = container_get_signature(c);
+                alignment = parent ? parent->gvariant_alignment : bus_gvariant_get_alignment(c->signature);
                 assert(alignment > 0);
 
                 for (i = 0; i < *n_offsets; i++) {
@@ -3630,6 +3902,7 @@ static int bus_message_enter_variant(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const struct bus_signature *sig,
                 size_t *item_size) {
 
         size_t rindex;
@@ -3642,7 +3915,7 @@ static int bus_message_enter_variant(
         assert(contents);
         assert(item_size);
 
-        if (!signature_is_single(contents, false))
+        if (sig ? !sig->single_strict : !signature_is_single(contents, false))
                 return -EINVAL;
 
         if (*contents == SD_BUS_TYPE_DICT_ENTRY_BEGIN)
@@ -3708,6 +3981,7 @@ static int bus_message_enter_variant(
 static int build_struct_offsets(
                 sd_bus_message *m,
                 const char *signature,
+                const struct bus_signature *sig,
                 size_t size,
                 size_t *item_size,
                 size_t **offsets,
@@ -3753,22 +4027,13 @@ static int build_struct_offsets(
         p = signature;
         while (*p != 0) {
                 size_t n;
+                int k;
 
-                r = signature_element_length(p, &n);
+                r = signature_element_info(sig, signature, p - signature, &n, NULL, &k);
                 if (r < 0)
                         return r;
-                else {
-                        char t[n+1];
-
-                        memcpy(t, p, n);
-                        t[n] = 0;
-
-                        r = bus_gvariant_is_fixed_size(t);
-                }
 
-                if (r < 0)
-                        return r;
-                if (r == 0 && p[n] != 0) /* except the last item */
+                if (k < 0 && p[n] != 0) /* except the last item */
                         n_variable++;
                 n_total++;
 
@@ -3796,24 +4061,17 @@ static int build_struct_offsets(
         previous = m->rindex;
         while (*p != 0) {
                 size_t n, offset;
-                int k;
+                int align, k;
 
-                r = signature_element_length(p, &n);
+                r = signature_element_info(sig, signature, p - signature, &n, &align, &k);
                 if (r < 0)
                         return r;
                 else {
-                        char t[n+1];
-
-                        memcpy(t, p, n);
-                        t[n] = 0;
-
-                        size_t align = bus_gvariant_get_alignment(t);
                         assert(align > 0);
 
                         /* The possible start of this member after including alignment */
                         size_t start = ALIGN_TO(previous, align);
 
-                        k = bus_gvariant_get_size(t);
                         if (k < 0) {
                                 size_t x;
 
@@ -3831,8 +4089,8 @@ static int build_struct_offsets(
 
                                 offset = m->rindex + x;
                                 if (offset < start) {
-                                        log_debug("For type %s with alignment %zu, message specifies offset %zu which is smaller than previous end %zu + alignment = %zu",
-                                                  t, align, offset, previous, start);
+                                        log_debug("For type %.*s with alignment %i, message specifies offset %zu which is smaller than previous end %zu + alignment = %zu",
+                                                  (int) n, p, align, offset, previous, start);
                                         return -EBADMSG;
                                 }
                         } else
@@ -3855,6 +4113,7 @@ static int enter_struct_or_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const struct bus_signature *sig,
                 size_t *item_size,
                 size_t **offsets,
                 size_t *n_offsets) {
@@ -3877,7 +4136,7 @@ static int enter_struct_or_dict_entry(
 
         } else
                 /* gvariant with contents */
-                return build_struct_offsets(m, contents, c->item_size, item_size, offsets, n_offsets);
+                return build_struct_offsets(m, contents, sig, c->item_size, item_size, offsets, n_offsets);
 
         return 0;
 }
@@ -3886,6 +4145,7 @@ static int bus_message_enter_struct(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const struct bus_signature *sig,
                 size_t *item_size,
                 size_t **offsets,
                 size_t *n_offsets) {
@@ -3900,20 +4160,20 @@ static int bus_message_enter_struct(
         assert(offsets);
         assert(n_offsets);
 
-        if (!signature_is_valid(contents, false))
+        if (sig ? !sig->valid_strict : !signature_is_valid(contents, false))
                 return -EINVAL;
 
         if (!c->signature || c->signature[c->index] == 0)
                 return -ENXIO;
 
-        l = strlen(contents);
+        l = sig ? sig->length : strlen(contents);
 
         if (c->signature[c->index] != SD_BUS_TYPE_STRUCT_BEGIN ||
             !startswith(c->signature + c->index + 1, contents) ||
             c->signature[c->index + 1 + l] != SD_BUS_TYPE_STRUCT_END)
                 return -ENXIO;
 
-        r = enter_struct_or_dict_entry(m, c, contents, item_size, offsets, n_offsets);
+        r = enter_struct_or_dict_entry(m, c, contents, sig, item_size, offsets, n_offsets);
         if (r < 0)
                 return r;
 
@@ -3927,6 +4187,7 @@ static int bus_message_enter_dict_entry(
                 sd_bus_message *m,
                 struct bus_container *c,
                 const char *contents,
+                const struct bus_signature *sig,
                 size_t *item_size,
                 size_t **offsets,
                 size_t *n_offsets) {
@@ -3938,7 +4199,7 @@ static int bus_message_enter_dict_entry(
         assert(c);
         assert(contents);
 
-        if (!signature_is_pair(contents))
+        if (sig ? !sig->pair : !signature_is_pair(contents))
                 return -EINVAL;
 
         if (c->enclosing != SD_BUS_TYPE_ARRAY)
@@ -3947,14 +4208,14 @@ static int bus_message_enter_dict_entry(
         if (!c->signature || c->signature[c->index] == 0)
                 return 0;
 
-        l = strlen(contents);
+        l = sig ? sig->length : strlen(contents);
 
         if (c->signature[c->index] != SD_BUS_TYPE_DICT_ENTRY_BEGIN ||
             !startswith(c->signature + c->index + 1, contents) ||
             c->signature[c->index + 1 + l] != SD_BUS_TYPE_DICT_ENTRY_END)
                 return -ENXIO;
 
-        r = enter_struct_or_dict_entry(m, c, contents, item_size, offsets, n_offsets);
+        r = enter_struct_or_dict_entry(m, c, contents, sig, item_size, offsets, n_offsets);
         if (r < 0)
                 return r;
 
@@ -3967,6 +4228,7 @@ static int bus_message_enter_dict_entry(
 _public_ int sd_bus_message_enter_container(sd_bus_message *m,
                                             char type,
                                             const char *contents) {
+        const struct bus_signature *sig;
         struct bus_container *c;
         uint32_t *array_size = NULL;
         _cleanup_free_ char *signature = NULL;
@@ -4032,17 +4294,20 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         if (!signature)
                 return -ENOMEM;
 
+        /* NULL if the contents weren't interned, in which case they are parsed below */
+        sig = bus_signature_lookup(contents);
+
         c->saved_index = c->index;
         before = m->rindex;
 
         if (type == SD_BUS_TYPE_ARRAY)
-                r = bus_message_enter_array(m, c, contents, &array_size, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_array(m, c, contents, sig, &array_size, &item_size, &offsets, &n_offsets);
         else if (type == SD_BUS_TYPE_VARIANT)
-                r = bus_message_enter_variant(m, c, contents, &item_size);
+                r = bus_message_enter_variant(m, c, contents, sig, &item_size);
         else if (type == SD_BUS_TYPE_STRUCT)
-                r = bus_message_enter_struct(m, c, contents, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_struct(m, c, contents, sig, &item_size, &offsets, &n_offsets);
         else if (type == SD_BUS_TYPE_DICT_ENTRY)
-                r = bus_message_enter_dict_entry(m, c, contents, &item_size, &offsets, &n_offsets);
+                r = bus_message_enter_dict_entry(m, c, contents, sig, &item_size, &offsets, &n_offsets);
         else
                 r = -EINVAL;
         if (r <= 0)
@@ -4059,6 +4324,8 @@ _public_ int sd_bus_message_enter_container(sd_bus_message *m,
         m->containers[m->n_containers++] = (struct bus_container) {
                  .enclosing = type,
                  .signature = TAKE_PTR(signature),
+                 .interned = sig,
+                 .looked_up_signature = true,
 
                  .before = before,
                  .begin = m->rindex,
@@ -4162,7 +4429,7 @@ _public_ int sd_bus_message_peek_type(sd_bus_message *m, char *type, const char
                 if (contents) {
                         size_t l;
 
-                        r = signature_element_length(c->signature+c->index+1, &l);
+                        r = container_element_length(c, c->index + 1, &l);
                         if (r < 0)
                                 return r;
 
@@ -4188,7 +4455,7 @@ _public_ int sd_bus_message_peek_type(sd_bus_message *m, char *type, const char
                 if (contents) {
                         size_t l;
 
-                        r = signature_element_length(c->signature+c->index, &l);
+                        r = container_element_length(c, c->index, &l);
                         if (r < 0)
                                 return r;
 
@@ -4539,7 +4806,7 @@ _public_ int sd_bus_message_skip(sd_bus_message *m, const char *types) {
 
                 c = message_get_last_container(m);
 
-                r = signature_element_length(c->signature + c->index, &l);
+                r = container_element_length(c, c->index, &l);
                 if (r < 0)
                         return r;
 
@@ -4849,14 +5116,17 @@ static int message_peek_field_string(
                         return r;
         }
 
-        if (validate) {
+        if (validate && !m->trusted_wire) {
                 if (!validate_nul(q, l))
                         return -EBADMSG;
 
                 if (!validate(q))
                         return -EBADMSG;
         } else {
-                if (!validate_string(q, l))
+                if (!validate_string(m, q, l))
+                        return -EBADMSG;
+
+                if (validate == object_path_is_valid && !object_path_is_sane(q))
                         return -EBADMSG;
         }
 
@@ -5409,6 +5679,7 @@ int bus_message_parse_fields(sd_bus_message *m) {
                 r = build_struct_offsets(
                                 m,
                                 m->root_container.signature,
+                                container_get_signature(&m->root_container),
                                 m->user_body_size,
                                 &m->root_container.item_size,
                                 &m->root_container.offsets,
@@ -5806,6 +6077,9 @@ int bus_message_remarshal(sd_bus *bus, sd_bus_message **m) {
         if (r < 0)
                 return r;
 
+        n->priority = (*m)->priority;
+        n->deadline = (*m)->deadline;
+
         timeout = (*m)->timeout;
         if (timeout == 0 && !((*m)->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED)) {
                 r = sd_bus_get_method_call_timeout(bus, &timeout);
@@ -19,11 +19,15 @@
 struct bus_container {
         char enclosing;
         bool need_offsets:1;
+        bool looked_up_signature:1;
 
         /* Indexes into the signature  string */
         unsigned index, saved_index;
         char *signature;
 
+        /* The signature from the intern table, once looked up. NULL if it isn't in there. */
+        const struct bus_signature *interned;
+
         size_t before, begin, end;
 
         /* dbus1: pointer to the array size value, if this is a value */
@@ -80,6 +84,7 @@ struct sd_bus_message {
         bool free_header:1;
         bool free_fds:1;
         bool poisoned:1;
+        bool trusted_wire:1;
 
         /* The first and last bytes of the message */
         struct bus_header *header;
@@ -121,6 +126,11 @@ struct sd_bus_message {
 
         usec_t timeout;
 
+        /* While queued for writing: when the caller stops waiting for the reply to this call, or 0 if nobody
+         * waits with a timeout. Like reply callback timeouts this is relative until the bus is running, and
+         * CLOCK_MONOTONIC afterwards. Reset once the message leaves the write queue. */
+        usec_t deadline;
+
         size_t header_offsets[_BUS_MESSAGE_HEADER_MAX];
         unsigned n_header_offsets;
 };
@@ -178,6 +188,11 @@ static inline bool BUS_MESSAGE_IS_GVARIANT(sd_bus_message *m) {
 int bus_message_get_blob(sd_bus_message *m, void **buffer, size_t *sz);
 int bus_message_read_strv_extend(sd_bus_message *m, char ***l);
 
+int bus_message_append_dict_entries_raw(sd_bus_message *m, const char *contents, const void *p, size_t sz);
+int bus_message_copy_body(sd_bus_message *m, size_t begin, size_t end, void **ret);
+unsigned bus_message_get_raw_phase(sd_bus_message *m, const char *types);
+int bus_message_append_raw(sd_bus_message *m, const char *types, const void *p, size_t sz);
+
 int bus_message_from_header(
                 sd_bus *bus,
                 void *header,
@@ -9,6 +9,7 @@
 #include "bus-introspect.h"
 #include "bus-message.h"
 #include "bus-objects.h"
+#include "bus-probe.h"
 #include "bus-signature.h"
 #include "bus-slot.h"
 #include "bus-type.h"
@@ -16,6 +17,347 @@
 #include "strv.h"
 #include "missing.h"
 
+static const char *node_label(const struct node *n) {
+        assert(n);
+        assert(n->parent);
+
+        return strrchr(n->path, '/') + 1;
+}
+
+static struct node *bus_node_find_closest(sd_bus *bus, const char *path) {
+        struct node *n, *child;
+        char *t, *p, *e;
+
+        assert(bus);
+        assert(path);
+
+        /* Descends the node tree one path component at a time and returns the deepest node whose path
+         * equals @path or is a prefix of it. The exact node (if any) and all fallback candidates for @path
+         * are then reachable by following the ->parent pointers, ordered from the longest prefix to the
+         * root. Returns NULL if no nodes are registered at all. */
+
+        n = hashmap_get(bus->nodes, "/");
+        if (!n)
+                return NULL;
+
+        t = strdupa(path);
+
+        for (p = t + 1; *p; p = *e ? e + 1 : e) {
+                char c;
+
+                e = strchrnul(p, '/');
+                c = *e;
+                *e = 0;
+                child = hashmap_get(n->children, p);
+                *e = c;
+
+                if (!child)
+                        break;
+
+                n = child;
+        }
+
+        return n;
+}
+
+/* The state of the node tree that data cached for an object was derived from */
+struct node_stamp {
+        uint64_t generation;
+        size_t closest; /* length of the path of the closest node, SIZE_MAX if there was none */
+};
+
+static void node_stamp_get(sd_bus *bus, const char *path, struct node_stamp *ret) {
+        struct node *n;
+
+        assert(bus);
+        assert(path);
+        assert(ret);
+
+        n = bus_node_find_closest(bus, path);
+
+        *ret = (struct node_stamp) {
+                .generation = bus->nodes_generation,
+                .closest = n ? strlen(n->path) : SIZE_MAX,
+        };
+}
+
+static bool node_stamp_valid(sd_bus *bus, const char *path, const struct node_stamp *stamp) {
+        struct node *n;
+
+        assert(bus);
+        assert(path);
+        assert(stamp);
+
+        /* Returns true if nothing was attached to or detached from the node of @path or any of its fallback
+         * candidates since the stamp was taken. A node that went away in the meantime takes its modification
+         * with it, but then the closest node is a different one. */
+
+        n = bus_node_find_closest(bus, path);
+        if ((n ? strlen(n->path) : SIZE_MAX) != stamp->closest)
+                return false;
+
+        for (; n; n = n->parent)
+                if (n->modified > stamp->generation)
+                        return false;
+
+        return true;
+}
+
+/* How many hash seeds to try for a given table size before doubling the number of slots */
+#define VTABLE_MEMBER_TABLE_SEEDS_MAX 16U
+
+/* Displacements are stored as two 16bit halves, which limits the number of slots */
+#define VTABLE_MEMBER_TABLE_SLOTS_MAX 0x10000U
+
+struct vtable_member_key {
+        uint64_t hash;
+        unsigned bucket;
+        unsigned bucket_size;
+        unsigned index;
+};
+
+static uint64_t vtable_member_hash(const char *member, uint64_t seed) {
+        uint64_t h = UINT64_C(0xcbf29ce484222325) ^ seed;
+
+        /* FNV-1a with the murmur3 finalizer. The keys are the member names the local process registered, and every
+         * lookup is verified with a string comparison, hence there's no need for a keyed hash function here. */
+
+        for (; *member; member++) {
+                h ^= (uint8_t) *member;
+                h *= UINT64_C(0x100000001b3);
+        }
+
+        h ^= h >> 33;
+        h *= UINT64_C(0xff51afd7ed558ccd);
+        h ^= h >> 33;
+        h *= UINT64_C(0xc4ceb9fe1a85ec53);
+        h ^= h >> 33;
+
+        return h;
+}
+
+static unsigned vtable_member_bucket(const struct vtable_member_table *t, uint64_t h) {
+        return (uint32_t) (h >> 32) % t->n_buckets;
+}
+
+static unsigned vtable_member_slot(const struct vtable_member_table *t, uint64_t h, uint32_t d) {
+        uint32_t f1 = (uint32_t) h, f2 = (uint32_t) (h >> 32) | 1;
+
+        return (f1 + (d & 0xFFFF) * f2 + (d >> 16)) & t->slot_mask;
+}
+
+static struct vtable_member *vtable_member_table_get(const struct vtable_member_table *t, const char *member) {
+        struct vtable_member *m;
+        uint64_t h;
+
+        assert(t);
+        assert(member);
+
+        if (t->n_members == 0)
+                return NULL;
+
+        h = vtable_member_hash(member, t->seed);
+        m = t->slots[vtable_member_slot(t, h, t->displacements[vtable_member_bucket(t, h)])];
+        if (!m || !streq(m->member, member))
+                return NULL;
+
+        return m;
+}
+
+static int vtable_member_key_compare(const void *a, const void *b) {
+        const struct vtable_member_key *x = a, *y = b;
+
+        /* Place the largest buckets first, they are the hardest to fit */
+        if (x->bucket_size != y->bucket_size)
+                return x->bucket_size > y->bucket_size ? -1 : 1;
+
+        return CMP(x->bucket, y->bucket);
+}
+
+static bool vtable_member_table_place(
+                struct vtable_member_table *t,
+                const struct vtable_member_key *keys,
+                unsigned n_keys,
+                uint32_t d) {
+
+        unsigned i;
+
+        /* Tries to put all members of one bucket into free slots using displacement d, and backs out again if
+         * that doesn't work out. */
+
+        for (i = 0; i < n_keys; i++) {
+                struct vtable_member **slot;
+
+                slot = t->slots + vtable_member_slot(t, keys[i].hash, d);
+                if (*slot)
+                        break;
+
+                *slot = t->members + keys[i].index;
+        }
+
+        if (i >= n_keys)
+                return true;
+
+        while (i > 0) {
+                i--;
+                t->slots[vtable_member_slot(t, keys[i].hash, d)] = NULL;
+        }
+
+        return false;
+}
+
+static int vtable_member_table_try(struct vtable_member_table *t, struct vtable_member_key *keys, unsigned *sizes) {
+        unsigned n_slots = t->slot_mask + 1, i, j, k;
+
+        memzero(sizes, t->n_buckets * sizeof(unsigned));
+        memzero(t->slots, n_slots * sizeof(struct vtable_member*));
+
+        for (i = 0; i < t->n_members; i++) {
+                keys[i].hash = vtable_member_hash(t->members[i].member, t->seed);
+                keys[i].bucket = vtable_member_bucket(t, keys[i].hash);
+                keys[i].index = i;
+                sizes[keys[i].bucket]++;
+        }
+
+        for (i = 0; i < t->n_members; i++)
+                keys[i].bucket_size = sizes[keys[i].bucket];
+
+        qsort(keys, t->n_members, sizeof(struct vtable_member_key), vtable_member_key_compare);
+
+        for (i = 0; i < t->n_members; i = j) {
+                uint64_t d;
+
+                for (j = i + 1; j < t->n_members && keys[j].bucket == keys[i].bucket; j++)
+                        for (k = i; k < j; k++)
+                                if (keys[k].hash == keys[j].hash &&
+                                    streq(t->members[keys[k].index].member, t->members[keys[j].index].member))
+                                        return -EEXIST;
+
+                for (d = 0;; d++) {
+                        uint32_t displacement;
+
+                        if (d >= (uint64_t) n_slots * n_slots)
+                                return 0;
+
+                        displacement = (uint32_t) (d % n_slots) | (uint32_t) (d / n_slots) << 16;
+                        if (vtable_member_table_place(t, keys + i, j - i, displacement)) {
+                                t->displacements[keys[i].bucket] = displacement;
+                                break;
+                        }
+                }
+        }
+
+        return 1;
+}
+
+static int vtable_member_table_compile(struct vtable_member_table *t) {
+        _cleanup_free_ struct vtable_member_key *keys = NULL;
+        _cleanup_free_ unsigned *sizes = NULL;
+        unsigned n_slots;
+        int r;
+
+        assert(t);
+
+        /* Builds a perfect hash table (hash and displace) for the members collected in t->members: every member is
+         * hashed into one of n_members/4 buckets, and each bucket gets a displacement assigned that moves all its
+         * members into slots nobody else uses yet. Returns -EEXIST if a member name is used twice. */
+
+        if (t->n_members == 0)
+                return 0;
+        if (t->n_members > VTABLE_MEMBER_TABLE_SLOTS_MAX)
+                return -E2BIG;
+
+        t->n_buckets = DIV_ROUND_UP(t->n_members, 4U);
+
+        keys = new(struct vtable_member_key, t->n_members);
+        sizes = new(unsigned, t->n_buckets);
+        t->displacements = new(uint32_t, t->n_buckets);
+        if (!keys || !sizes || !t->displacements)
+                return -ENOMEM;
+
+        for (n_slots = 1; n_slots < t->n_members; n_slots <<= 1)
+                ;
+
+        for (; n_slots <= VTABLE_MEMBER_TABLE_SLOTS_MAX; n_slots <<= 1) {
+                free(t->slots);
+                t->slots = new(struct vtable_member*, n_slots);
+                if (!t->slots)
+                        return -ENOMEM;
+
+                t->slot_mask = n_slots - 1;
+
+                for (t->seed = 0; t->seed < VTABLE_MEMBER_TABLE_SEEDS_MAX; t->seed++) {
+                        r = vtable_member_table_try(t, keys, sizes);
+                        if (r < 0)
+                                return r;
+                        if (r > 0)
+                                return 0;
+                }
+        }
+
+        return -ENOSPC;
+}
+
+static void vtable_member_table_done(struct vtable_member_table *t) {
+        unsigned i;
+
+        assert(t);
+
+        for (i = 0; i < t->n_members; i++)
+                free(t->members[i].latency);
+
+        t->members = mfree(t->members);
+        t->slots = mfree(t->slots);
+        t->displacements = mfree(t->displacements);
+        t->n_members = t->n_buckets = t->slot_mask = 0;
+}
+
+static struct vtable_member *node_find_member(struct node *n, const char *interface, const char *member, bool property) {
+        struct node_vtable *c;
+
+        assert(n);
+        assert(interface);
+        assert(member);
+
+        /* All vtables registered for the same interface on a node are adjacent in n->vtables, and n->interfaces
+         * points to the first of them. */
+
+        for (c = hashmap_get(n->interfaces, interface); c && streq(c->interface, interface); c = c->vtables_next) {
+                struct vtable_member *v;
+
+                v = vtable_member_table_get(property ? &c->properties : &c->methods, member);
+                if (v)
+                        return v;
+        }
+
+        return NULL;
+}
+
+struct vtable_member *bus_node_vtable_find_method(struct node_vtable *c, const char *member) {
+        assert(c);
+        assert(member);
+
+        return vtable_member_table_get(&c->methods, member);
+}
+
+void bus_node_vtable_done(struct node_vtable *c) {
+        assert(c);
+
+        if (c->node && c->interface && hashmap_get(c->node->interfaces, c->interface) == c) {
+                struct node_vtable *next = c->vtables_next;
+
+                assert_se(hashmap_remove(c->node->interfaces, c->interface) == c);
+
+                /* Hand the interface over to the next vtable implementing it, if there is one. This cannot fail, as
+                 * the hashmap never shrinks and we just freed up an entry. */
+                if (next && streq(next->interface, c->interface))
+                        assert_se(hashmap_put(c->node->interfaces, next->interface, next) > 0);
+        }
+
+        vtable_member_table_done(&c->methods);
+        vtable_member_table_done(&c->properties);
+}
+
 static int node_vtable_get_userdata(
                 sd_bus *bus,
                 const char *path,
@@ -25,6 +367,7 @@ static int node_vtable_get_userdata(
 
         sd_bus_slot *s;
         void *u, *found_u;
+        usec_t begin;
         int r;
 
         assert(bus);
@@ -36,7 +379,9 @@ static int node_vtable_get_userdata(
         if (c->find) {
                 bus->current_slot = sd_bus_slot_ref(s);
                 bus->current_userdata = u;
+                begin = bus_slot_latency_begin(bus);
                 r = c->find(bus, path, c->interface, u, &found_u, error);
+                bus_slot_latency_end(bus, s, bus->current_message, begin, r);
                 bus->current_userdata = NULL;
                 bus->current_slot = sd_bus_slot_unref(s);
 
@@ -109,6 +454,7 @@ static int add_enumerated_to_set(
         LIST_FOREACH(enumerators, c, first) {
                 char **children = NULL, **k;
                 sd_bus_slot *slot;
+                usec_t begin;
 
                 if (bus->nodes_modified)
                         return 0;
@@ -117,7 +463,9 @@ static int add_enumerated_to_set(
 
                 bus->current_slot = sd_bus_slot_ref(slot);
                 bus->current_userdata = slot->userdata;
+                begin = bus_slot_latency_begin(bus);
                 r = c->callback(bus, prefix, slot->userdata, &children, error);
+                bus_slot_latency_end(bus, slot, bus->current_message, begin, r);
                 bus->current_userdata = NULL;
                 bus->current_slot = sd_bus_slot_unref(slot);
 
@@ -259,6 +607,7 @@ static int node_callbacks_run(
         LIST_FOREACH(callbacks, c, first) {
                 _cleanup_(sd_bus_error_free) sd_bus_error error_buffer = SD_BUS_ERROR_NULL;
                 sd_bus_slot *slot;
+                usec_t begin;
 
                 if (bus->nodes_modified)
                         return 0;
@@ -282,7 +631,12 @@ static int node_callbacks_run(
                 bus->current_slot = sd_bus_slot_ref(slot);
                 bus->current_handler = c->callback;
                 bus->current_userdata = slot->userdata;
+                bus->stats.method_dispatches++;
+                BUS_PROBE_MESSAGE(dispatch_object, m);
+                begin = bus_slot_latency_begin(bus);
                 r = c->callback(m, slot->userdata, &error_buffer);
+                bus_slot_latency_end(bus, slot, m, begin, r);
+                BUS_PROBE_HANDLER_RETURN(m, r);
                 bus->current_userdata = NULL;
                 bus->current_handler = NULL;
                 bus->current_slot = sd_bus_slot_unref(slot);
@@ -400,13 +754,19 @@ static int method_callbacks_run(
 
         if (c->vtable->x.method.handler) {
                 sd_bus_slot *slot;
+                usec_t begin;
 
                 slot = container_of(c->parent, sd_bus_slot, node_vtable);
 
                 bus->current_slot = sd_bus_slot_ref(slot);
                 bus->current_handler = c->vtable->x.method.handler;
                 bus->current_userdata = u;
+                bus->stats.method_dispatches++;
+                BUS_PROBE_MESSAGE(dispatch_object, m);
+                begin = bus_slot_latency_begin(bus);
                 r = c->vtable->x.method.handler(m, u, &error);
+                bus_latency_end(bus, slot, &c->latency, m, begin, r);
+                BUS_PROBE_HANDLER_RETURN(m, r);
                 bus->current_userdata = NULL;
                 bus->current_handler = NULL;
                 bus->current_slot = sd_bus_slot_unref(slot);
@@ -434,6 +794,7 @@ static int invoke_property_get(
                 sd_bus_error *error) {
 
         const void *p;
+        usec_t begin;
         int r;
 
         assert(bus);
@@ -448,7 +809,9 @@ static int invoke_property_get(
 
                 bus->current_slot = sd_bus_slot_ref(slot);
                 bus->current_userdata = userdata;
+                begin = bus_slot_latency_begin(bus);
                 r = v->x.property.get(bus, path, interface, property, reply, userdata, error);
+                bus_slot_latency_end(bus, slot, bus->current_message, begin, r);
                 bus->current_userdata = NULL;
                 bus->current_slot = sd_bus_slot_unref(slot);
 
@@ -487,115 +850,527 @@ static int invoke_property_get(
         return sd_bus_message_append_basic(reply, v->x.property.signature[0], p);
 }
 
-static int invoke_property_set(
-                sd_bus *bus,
-                sd_bus_slot *slot,
-                const sd_bus_vtable *v,
-                const char *path,
-                const char *interface,
-                const char *property,
-                sd_bus_message *value,
-                void *userdata,
-                sd_bus_error *error) {
-
-        int r;
+/* The values of a property flagged SD_BUS_VTABLE_PROPERTY_CACHED, as marshalled by its getter. Since a value is
+ * only valid at positions of the same alignment phase in a message, up to one copy per phase is kept. */
+struct cached_property_value {
+        size_t size;
+        uint8_t data[];
+};
 
-        assert(bus);
-        assert(slot);
-        assert(v);
-        assert(path);
-        assert(interface);
-        assert(property);
-        assert(value);
+struct cached_property {
+        char *key; /* "interface member" */
+        struct cached_property_value *values[8];
+};
 
-        if (v->x.property.set) {
+struct cached_object {
+        char *path;
+        struct node_stamp stamp;
+        Hashmap *properties;
+};
 
-                bus->current_slot = sd_bus_slot_ref(slot);
-                bus->current_userdata = userdata;
-                r = v->x.property.set(bus, path, interface, property, value, userdata, error);
-                bus->current_userdata = NULL;
-                bus->current_slot = sd_bus_slot_unref(slot);
+static struct cached_property *cached_property_free(struct cached_property *p) {
+        size_t i;
 
-                if (r < 0)
-                        return r;
-                if (sd_bus_error_is_set(error))
-                        return -sd_bus_error_get_errno(error);
-                return r;
-        }
+        if (!p)
+                return NULL;
 
-        /*  Automatic handling if no callback is defined. */
+        for (i = 0; i < ELEMENTSOF(p->values); i++)
+                free(p->values[i]);
 
-        assert(signature_is_single(v->x.property.signature, false));
-        assert(bus_type_is_basic(v->x.property.signature[0]));
+        free(p->key);
+        return mfree(p);
+}
 
-        switch (v->x.property.signature[0]) {
+static struct cached_object *cached_object_free(struct cached_object *o) {
+        struct cached_property *p;
 
-        case SD_BUS_TYPE_STRING:
-        case SD_BUS_TYPE_OBJECT_PATH:
-        case SD_BUS_TYPE_SIGNATURE: {
-                const char *p;
-                char *n;
+        if (!o)
+                return NULL;
 
-                r = sd_bus_message_read_basic(value, v->x.property.signature[0], &p);
-                if (r < 0)
-                        return r;
+        while ((p = hashmap_steal_first(o->properties)))
+                cached_property_free(p);
 
-                n = strdup(p);
-                if (!n)
-                        return -ENOMEM;
+        hashmap_free(o->properties);
+        free(o->path);
+        return mfree(o);
+}
 
-                free(*(char**) userdata);
-                *(char**) userdata = n;
+static struct cached_property *property_cache_get(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                const char *member) {
 
-                break;
-        }
+        struct cached_object *o;
 
-        default:
-                r = sd_bus_message_read_basic(value, v->x.property.signature[0], userdata);
-                if (r < 0)
-                        return r;
+        o = hashmap_get(bus->property_cache, path);
+        if (!o)
+                return NULL;
 
-                break;
+        if (!node_stamp_valid(bus, path, &o->stamp)) {
+                /* A vtable was registered or removed for the object or one of its prefixes in the meantime */
+                hashmap_remove(bus->property_cache, o->path);
+                cached_object_free(o);
+                return NULL;
         }
 
-        return 1;
+        return hashmap_get(o->properties, strjoina(interface, " ", member));
 }
 
-static int property_get_set_callbacks_run(
+static int property_cache_put(
                 sd_bus *bus,
-                sd_bus_message *m,
-                struct vtable_member *c,
-                bool require_fallback,
-                bool is_get,
-                bool *found_object) {
+                const char *path,
+                const char *interface,
+                const char *member,
+                unsigned phase,
+                sd_bus_message *reply,
+                size_t begin) {
 
-        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
-        sd_bus_slot *slot;
-        void *u = NULL;
+        _cleanup_free_ void *data = NULL;
+        struct cached_property_value *value;
+        struct cached_property *p;
+        struct cached_object *o;
+        size_t size;
         int r;
 
-        assert(bus);
-        assert(m);
-        assert(c);
-        assert(found_object);
+        assert(phase < ELEMENTSOF(p->values));
+        assert(begin < reply->body_size);
 
-        if (require_fallback && !c->parent->is_fallback)
-                return 0;
+        size = reply->body_size - begin;
 
-        r = vtable_property_get_userdata(bus, m->path, c, &u, &error);
-        if (r <= 0)
-                return bus_maybe_reply_error(m, r, &error);
-        if (bus->nodes_modified)
+        r = bus_message_copy_body(reply, begin, reply->body_size, &data);
+        if (r == -EOPNOTSUPP)
                 return 0;
+        if (r < 0)
+                return r;
 
-        slot = container_of(c->parent, sd_bus_slot, node_vtable);
+        o = hashmap_get(bus->property_cache, path);
+        if (!o) {
+                r = hashmap_ensure_allocated(&bus->property_cache, &string_hash_ops);
+                if (r < 0)
+                        return r;
 
-        *found_object = true;
+                o = new0(struct cached_object, 1);
+                if (!o)
+                        return -ENOMEM;
 
-        r = sd_bus_message_new_method_return(m, &reply);
-        if (r < 0)
-                return r;
+                o->path = strdup(path);
+                if (!o->path) {
+                        free(o);
+                        return -ENOMEM;
+                }
+
+                node_stamp_get(bus, path, &o->stamp);
+
+                r = hashmap_put(bus->property_cache, o->path, o);
+                if (r < 0) {
+                        cached_object_free(o);
+                        return r;
+                }
+        }
+
+        p = hashmap_get(o->properties, strjoina(interface, " ", member));
+        if (!p) {
+                r = hashmap_ensure_allocated(&o->properties, &string_hash_ops);
+                if (r < 0)
+                        return r;
+
+                p = new0(struct cached_property, 1);
+                if (!p)
+                        return -ENOMEM;
+
+                p->key = strjoin(interface, " ", member);
+                if (!p->key) {
+                        free(p);
+                        return -ENOMEM;
+                }
+
+                r = hashmap_put(o->properties, p->key, p);
+                if (r < 0) {
+                        cached_property_free(p);
+                        return r;
+                }
+        }
+
+        value = malloc(offsetof(struct cached_property_value, data) + size);
+        if (!value)
+                return -ENOMEM;
+
+        value->size = size;
+        memcpy(value->data, data, size);
+
+        free_and_replace(p->values[phase], value);
+        return 0;
+}
+
+static void property_cache_drop(sd_bus *bus, const char *path, const char *interface, char **names) {
+        struct cached_property *p;
+        struct cached_object *o;
+        char **n;
+
+        assert(bus);
+        assert(path);
+
+        /* Forgets the cached values of the specified properties. If no names are specified, all properties of the
+         * interface are forgotten, and if no interface is specified either, all properties of the object. */
+
+        o = hashmap_get(bus->property_cache, path);
+        if (!o)
+                return;
+
+        if (!interface) {
+                hashmap_remove(bus->property_cache, o->path);
+                cached_object_free(o);
+                return;
+        }
+
+        if (names)
+                STRV_FOREACH(n, names)
+                        cached_property_free(hashmap_remove(o->properties, strjoina(interface, " ", *n)));
+        else {
+                const char *prefix = strjoina(interface, " ");
+                Iterator i;
+
+                HASHMAP_FOREACH(p, o->properties, i)
+                        if (startswith(p->key, prefix)) {
+                                hashmap_remove(o->properties, p->key);
+                                cached_property_free(p);
+                        }
+        }
+
+        if (hashmap_isempty(o->properties)) {
+                hashmap_remove(bus->property_cache, o->path);
+                cached_object_free(o);
+        }
+}
+
+static void property_cache_flush(sd_bus *bus) {
+        struct cached_object *o;
+
+        assert(bus);
+
+        while ((o = hashmap_steal_first(bus->property_cache)))
+                cached_object_free(o);
+}
+
+void bus_property_cache_free(sd_bus *bus) {
+        assert(bus);
+
+        property_cache_flush(bus);
+        bus->property_cache = hashmap_free(bus->property_cache);
+}
+
+static int vtable_append_property_value(
+                sd_bus *bus,
+                sd_bus_slot *slot,
+                const sd_bus_vtable *v,
+                const char *path,
+                const char *interface,
+                sd_bus_message *reply,
+                void *userdata,
+                sd_bus_error *error) {
+
+        const char *signature = v->x.property.signature;
+        struct cached_property *p = NULL;
+        size_t begin, n_fds;
+        unsigned phase = 0;
+        int r;
+
+        assert(bus);
+        assert(v);
+        assert(path);
+        assert(interface);
+        assert(reply);
+
+        /* Appends the property value as variant, either from the cache or by calling the getter */
+
+        r = sd_bus_message_open_container(reply, 'v', signature);
+        if (r < 0)
+                return r;
+
+        if (v->flags & SD_BUS_VTABLE_PROPERTY_CACHED && !BUS_MESSAGE_IS_GVARIANT(reply)) {
+                phase = bus_message_get_raw_phase(reply, signature);
+
+                p = property_cache_get(bus, path, interface, v->x.property.member);
+                if (p && p->values[phase]) {
+                        r = bus_message_append_raw(reply, signature, p->values[phase]->data, p->values[phase]->size);
+                        if (r < 0)
+                                return r;
+
+                        return sd_bus_message_close_container(reply);
+                }
+        }
+
+        begin = ALIGN_TO(reply->body_size, bus_type_get_alignment(signature[0]));
+        n_fds = reply->n_fds;
+
+        r = invoke_property_get(bus, slot, v, path, interface, v->x.property.member, reply, userdata, error);
+        if (r < 0)
+                return r;
+        if (bus->nodes_modified)
+                return 0;
+
+        r = sd_bus_message_close_container(reply);
+        if (r < 0)
+                return r;
+
+        /* Only remember complete values which don't reference any fds */
+        if (v->flags & SD_BUS_VTABLE_PROPERTY_CACHED && !BUS_MESSAGE_IS_GVARIANT(reply) &&
+            reply->n_fds == n_fds && reply->body_size > begin) {
+                r = property_cache_put(bus, path, interface, v->x.property.member, phase, reply, begin);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+static int invoke_property_set(
+                sd_bus *bus,
+                sd_bus_slot *slot,
+                const sd_bus_vtable *v,
+                const char *path,
+                const char *interface,
+                const char *property,
+                sd_bus_message *value,
+                void *userdata,
+                sd_bus_error *error) {
+
+        usec_t begin;
+        int r;
+
+        assert(bus);
+        assert(slot);
+        assert(v);
+        assert(path);
+        assert(interface);
+        assert(property);
+        assert(value);
+
+        if (v->x.property.set) {
+
+                bus->current_slot = sd_bus_slot_ref(slot);
+                bus->current_userdata = userdata;
+                begin = bus_slot_latency_begin(bus);
+                r = v->x.property.set(bus, path, interface, property, value, userdata, error);
+                bus_slot_latency_end(bus, slot, bus->current_message, begin, r);
+                bus->current_userdata = NULL;
+                bus->current_slot = sd_bus_slot_unref(slot);
+
+                if (r < 0)
+                        return r;
+                if (sd_bus_error_is_set(error))
+                        return -sd_bus_error_get_errno(error);
+                return r;
+        }
+
+        /*  Automatic handling if no callback is defined. */
+
+        assert(signature_is_single(v->x.property.signature, false));
+        assert(bus_type_is_basic(v->x.property.signature[0]));
+
+        switch (v->x.property.signature[0]) {
+
+        case SD_BUS_TYPE_STRING:
+        case SD_BUS_TYPE_OBJECT_PATH:
+        case SD_BUS_TYPE_SIGNATURE: {
+                const char *p;
+                char *n;
+
+                r = sd_bus_message_read_basic(value, v->x.property.signature[0], &p);
+                if (r < 0)
+                        return r;
+
+                n = strdup(p);
+                if (!n)
+                        return -ENOMEM;
+
+                free(*(char**) userdata);
+                *(char**) userdata = n;
+
+                break;
+        }
+
+        default:
+                r = sd_bus_message_read_basic(value, v->x.property.signature[0], userdata);
+                if (r < 0)
+                        return r;
+
+                break;
+        }
+
+        return 1;
+}
+
+struct managed_object_snapshot {
+        const char *path;
+        struct node_stamp stamp;
+        size_t size;
+        uint8_t data[];
+};
+
+static bool vtable_properties_announce_changes(const sd_bus_vtable *vtable) {
+        const sd_bus_vtable *v;
+
+        assert(vtable);
+
+        /* Returns true if every property GetManagedObjects() would include for this vtable is either constant or
+         * announces its changes, i.e. if a serialization of the vtable's properties stays valid until the next
+         * PropertiesChanged signal. */
+
+        if (vtable[0].flags & SD_BUS_VTABLE_HIDDEN)
+                return true;
+
+        for (v = vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
+                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                        continue;
+
+                if (v->flags & (SD_BUS_VTABLE_HIDDEN|SD_BUS_VTABLE_PROPERTY_EXPLICIT))
+                        continue;
+
+                if (!(v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION)))
+                        return false;
+        }
+
+        return true;
+}
+
+static struct managed_object_snapshot *managed_object_snapshot_get(sd_bus *bus, struct node *manager, const char *path) {
+        struct managed_object_snapshot *snapshot;
+
+        assert(bus);
+        assert(manager);
+        assert(path);
+
+        snapshot = hashmap_get(manager->managed_objects, path);
+        if (!snapshot)
+                return NULL;
+
+        if (node_stamp_valid(bus, path, &snapshot->stamp))
+                return snapshot;
+
+        /* A vtable was registered or removed for the object or one of its prefixes in the meantime */
+        hashmap_remove(manager->managed_objects, path);
+        return mfree(snapshot);
+}
+
+static int managed_object_snapshot_add(
+                sd_bus *bus,
+                struct node *manager,
+                sd_bus_message *reply,
+                const char *path,
+                size_t begin) {
+
+        _cleanup_free_ void *data = NULL;
+        struct managed_object_snapshot *snapshot;
+        size_t size, l;
+        int r;
+
+        assert(bus);
+        assert(manager);
+        assert(reply);
+        assert(path);
+
+        /* Remembers the dict entries GetManagedObjects() just serialized for this path into the reply, starting at
+         * 'begin', so that the next call can copy them instead of invoking all property getters again. Objects
+         * for which nothing was serialized are not remembered, they are cheap to look at again. */
+
+        if (reply->body_size <= begin)
+                return 0;
+
+        size = reply->body_size - begin;
+
+        r = bus_message_copy_body(reply, begin, reply->body_size, &data);
+        if (r == -EOPNOTSUPP)
+                return 0;
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(&manager->managed_objects, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        l = strlen(path);
+        snapshot = malloc(offsetof(struct managed_object_snapshot, data) + size + l + 1);
+        if (!snapshot)
+                return -ENOMEM;
+
+        node_stamp_get(bus, path, &snapshot->stamp);
+        snapshot->size = size;
+        memcpy(snapshot->data, data, size);
+        snapshot->path = memcpy(snapshot->data + size, path, l + 1);
+
+        r = hashmap_put(manager->managed_objects, snapshot->path, snapshot);
+        if (r < 0) {
+                free(snapshot);
+                return r;
+        }
+
+        return 0;
+}
+
+static void managed_object_snapshot_drop(sd_bus *bus, const char *path) {
+        struct node *n;
+
+        assert(bus);
+        assert(path);
+
+        /* The object may be listed by any object manager registered on one of its prefixes */
+
+        for (n = bus_node_find_closest(bus, path); n; n = n->parent)
+                free(hashmap_remove(n->managed_objects, path));
+}
+
+static void managed_object_snapshot_prune(struct node *manager, Set *s) {
+        struct managed_object_snapshot *snapshot;
+        Iterator i;
+
+        assert(manager);
+
+        /* Forgets the snapshots of objects the object manager doesn't list anymore */
+
+        HASHMAP_FOREACH(snapshot, manager->managed_objects, i)
+                if (!set_contains(s, snapshot->path)) {
+                        hashmap_remove(manager->managed_objects, snapshot->path);
+                        free(snapshot);
+                }
+}
+
+static int property_get_set_callbacks_run(
+                sd_bus *bus,
+                sd_bus_message *m,
+                struct vtable_member *c,
+                bool require_fallback,
+                bool is_get,
+                bool *found_object) {
+
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        sd_bus_slot *slot;
+        void *u = NULL;
+        int r;
+
+        assert(bus);
+        assert(m);
+        assert(c);
+        assert(found_object);
+
+        if (require_fallback && !c->parent->is_fallback)
+                return 0;
+
+        r = vtable_property_get_userdata(bus, m->path, c, &u, &error);
+        if (r <= 0)
+                return bus_maybe_reply_error(m, r, &error);
+        if (bus->nodes_modified)
+                return 0;
+
+        slot = container_of(c->parent, sd_bus_slot, node_vtable);
+
+        *found_object = true;
+
+        r = sd_bus_message_new_method_return(m, &reply);
+        if (r < 0)
+                return r;
 
         if (is_get) {
                 /* Note that we do not protect against reexecution
@@ -605,26 +1380,18 @@ static int property_get_set_callbacks_run(
                  * ultimately without side-effects or if they aren't
                  * then at least idempotent. */
 
-                r = sd_bus_message_open_container(reply, 'v', c->vtable->x.property.signature);
-                if (r < 0)
-                        return r;
-
                 /* Note that we do not do an access check here. Read
                  * access to properties is always unrestricted, since
                  * PropertiesChanged signals broadcast contents
                  * anyway. */
 
-                r = invoke_property_get(bus, slot, c->vtable, m->path, c->interface, c->member, reply, u, &error);
+                r = vtable_append_property_value(bus, slot, c->vtable, m->path, c->interface, reply, u, &error);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
                 if (bus->nodes_modified)
                         return 0;
 
-                r = sd_bus_message_close_container(reply);
-                if (r < 0)
-                        return r;
-
         } else {
                 const char *signature = NULL;
                 char type = 0;
@@ -659,6 +1426,9 @@ static int property_get_set_callbacks_run(
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
+                managed_object_snapshot_drop(bus, m->path);
+                property_cache_drop(bus, m->path, c->interface, STRV_MAKE(c->member));
+
                 if (bus->nodes_modified)
                         return 0;
 
@@ -700,13 +1470,9 @@ static int vtable_append_one_property(
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_open_container(reply, 'v', v->x.property.signature);
-        if (r < 0)
-                return r;
-
         slot = container_of(c, sd_bus_slot, node_vtable);
 
-        r = invoke_property_get(bus, slot, v, path, c->interface, v->x.property.member, reply, vtable_property_convert_userdata(v, userdata), error);
+        r = vtable_append_property_value(bus, slot, v, path, c->interface, reply, vtable_property_convert_userdata(v, userdata), error);
         if (r < 0)
                 return r;
         if (bus->nodes_modified)
@@ -716,10 +1482,6 @@ static int vtable_append_one_property(
         if (r < 0)
                 return r;
 
-        r = sd_bus_message_close_container(reply);
-        if (r < 0)
-                return r;
-
         return 0;
 }
 
@@ -901,7 +1663,7 @@ static int process_introspect(
         const char *previous_interface = NULL;
         struct introspect intro;
         struct node_vtable *c;
-        bool empty;
+        bool empty, dynamic;
         int r;
 
         assert(bus);
@@ -909,6 +1671,21 @@ static int process_introspect(
         assert(n);
         assert(found_object);
 
+        /* Replies for fallback paths are not cached, they are specific to the path asked for */
+        if (!require_fallback && n->introspection &&
+            (n->introspection_until == USEC_INFINITY || now(CLOCK_MONOTONIC) < n->introspection_until)) {
+                r = sd_bus_reply_method_return(m, "s", n->introspection);
+                if (r < 0)
+                        return r;
+
+                *found_object = true;
+                return 1;
+        }
+
+        /* Enumerators and find callbacks may return something different each time, only cache their results
+         * if a TTL has been configured */
+        dynamic = n->enumerators;
+
         r = get_child_nodes(bus, m->path, n, 0, &s, &error);
         if (r < 0)
                 return bus_maybe_reply_error(m, r, &error);
@@ -929,6 +1706,9 @@ static int process_introspect(
                 if (require_fallback && !c->is_fallback)
                         continue;
 
+                if (c->find)
+                        dynamic = true;
+
                 r = node_vtable_get_userdata(bus, m->path, c, NULL, &error);
                 if (r < 0) {
                         r = bus_maybe_reply_error(m, r, &error);
@@ -988,6 +1768,12 @@ static int process_introspect(
         if (r < 0)
                 goto finish;
 
+        if (!require_fallback && (!dynamic || bus->introspection_cache_ttl > 0)) {
+                free(n->introspection);
+                n->introspection = strdup(intro.introspection);
+                n->introspection_until = dynamic ? usec_add(now(CLOCK_MONOTONIC), bus->introspection_cache_ttl) : USEC_INFINITY;
+        }
+
         r = sd_bus_send(bus, reply, NULL);
         if (r < 0)
                 goto finish;
@@ -1002,33 +1788,35 @@ finish:
 static int object_manager_serialize_path(
                 sd_bus *bus,
                 sd_bus_message *reply,
-                const char *prefix,
+                struct node *n,
                 const char *path,
                 bool require_fallback,
+                bool *cacheable,
                 sd_bus_error *error) {
 
         const char *previous_interface = NULL;
         bool found_something = false;
         struct node_vtable *i;
-        struct node *n;
         int r;
 
         assert(bus);
         assert(reply);
-        assert(prefix);
+        assert(n);
         assert(path);
+        assert(cacheable);
         assert(error);
 
-        n = hashmap_get(bus->nodes, prefix);
-        if (!n)
-                return 0;
-
         LIST_FOREACH(vtables, i, n->vtables) {
                 void *u;
 
                 if (require_fallback && !i->is_fallback)
                         continue;
 
+                /* Whether the object exists and what it looks like is up to the find callback, which doesn't
+                 * tell us when its answer changes */
+                if (i->find)
+                        *cacheable = false;
+
                 r = node_vtable_get_userdata(bus, path, i, &u, error);
                 if (r < 0)
                         return r;
@@ -1107,6 +1895,9 @@ static int object_manager_serialize_path(
                 if (bus->nodes_modified)
                         return 0;
 
+                if (!vtable_properties_announce_changes(i->vtable))
+                        *cacheable = false;
+
                 previous_interface = i->interface;
         }
 
@@ -1137,27 +1928,22 @@ static int object_manager_serialize_path_and_fallbacks(
                 sd_bus *bus,
                 sd_bus_message *reply,
                 const char *path,
+                bool *cacheable,
                 sd_bus_error *error) {
 
-        char *prefix;
+        struct node *n;
         int r;
 
         assert(bus);
         assert(reply);
         assert(path);
+        assert(cacheable);
         assert(error);
 
-        /* First, add all vtables registered for this path */
-        r = object_manager_serialize_path(bus, reply, path, path, false, error);
-        if (r < 0)
-                return r;
-        if (bus->nodes_modified)
-                return 0;
-
-        /* Second, add fallback vtables registered for any of the prefixes */
-        prefix = alloca(strlen(path) + 1);
-        OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
-                r = object_manager_serialize_path(bus, reply, prefix, path, true, error);
+        /* First, add all vtables registered for this path, second, add fallback vtables registered for any
+         * of the prefixes */
+        for (n = bus_node_find_closest(bus, path); n; n = n->parent) {
+                r = object_manager_serialize_path(bus, reply, n, path, !streq(n->path, path), cacheable, error);
                 if (r < 0)
                         return r;
                 if (bus->nodes_modified)
@@ -1208,14 +1994,37 @@ static int process_get_managed_objects(
                 return r;
 
         SET_FOREACH(path, s, i) {
-                r = object_manager_serialize_path_and_fallbacks(bus, reply, path, &error);
+                struct managed_object_snapshot *snapshot;
+                bool cacheable = reply->n_fds == 0;
+                size_t begin;
+
+                snapshot = managed_object_snapshot_get(bus, n, path);
+                if (snapshot) {
+                        r = bus_message_append_dict_entries_raw(reply, "oa{sa{sv}}", snapshot->data, snapshot->size);
+                        if (r < 0)
+                                return r;
+
+                        continue;
+                }
+
+                begin = ALIGN_TO(reply->body_size, 8);
+
+                r = object_manager_serialize_path_and_fallbacks(bus, reply, path, &cacheable, &error);
                 if (r < 0)
                         return bus_maybe_reply_error(m, r, &error);
 
                 if (bus->nodes_modified)
                         return 0;
+
+                if (cacheable && reply->n_fds == 0) {
+                        r = managed_object_snapshot_add(bus, n, reply, path, begin);
+                        if (r < 0)
+                                return r;
+                }
         }
 
+        managed_object_snapshot_prune(n, s);
+
         r = sd_bus_message_close_container(reply);
         if (r < 0)
                 return r;
@@ -1230,23 +2039,18 @@ static int process_get_managed_objects(
 static int object_find_and_run(
                 sd_bus *bus,
                 sd_bus_message *m,
-                const char *p,
+                struct node *n,
                 bool require_fallback,
                 bool *found_object) {
 
-        struct node *n;
-        struct vtable_member vtable_key, *v;
+        struct vtable_member *v;
         int r;
 
         assert(bus);
         assert(m);
-        assert(p);
+        assert(n);
         assert(found_object);
 
-        n = hashmap_get(bus->nodes, p);
-        if (!n)
-                return 0;
-
         /* First, try object callbacks */
         r = node_callbacks_run(bus, m, n->callbacks, require_fallback, found_object);
         if (r != 0)
@@ -1258,11 +2062,7 @@ static int object_find_and_run(
                 return 0;
 
         /* Then, look for a known method */
-        vtable_key.path = (char*) p;
-        vtable_key.interface = m->interface;
-        vtable_key.member = m->member;
-
-        v = hashmap_get(bus->vtable_methods, &vtable_key);
+        v = node_find_member(n, m->interface, m->member, false);
         if (v) {
                 r = method_callbacks_run(bus, m, v, require_fallback, found_object);
                 if (r != 0)
@@ -1278,18 +2078,17 @@ static int object_find_and_run(
                 get = streq(m->member, "Get");
 
                 if (get || streq(m->member, "Set")) {
+                        const char *iface, *member;
 
                         r = sd_bus_message_rewind(m, true);
                         if (r < 0)
                                 return r;
 
-                        vtable_key.path = (char*) p;
-
-                        r = sd_bus_message_read(m, "ss", &vtable_key.interface, &vtable_key.member);
+                        r = sd_bus_message_read(m, "ss", &iface, &member);
                         if (r < 0)
                                 return sd_bus_reply_method_errorf(m, SD_BUS_ERROR_INVALID_ARGS, "Expected interface and member parameters");
 
-                        v = hashmap_get(bus->vtable_properties, &vtable_key);
+                        v = node_find_member(n, iface, member, true);
                         if (v) {
                                 r = property_get_set_callbacks_run(bus, m, v, require_fallback, get, found_object);
                                 if (r != 0)
@@ -1352,7 +2151,6 @@ static int object_find_and_run(
 
 int bus_process_object(sd_bus *bus, sd_bus_message *m) {
         int r;
-        size_t pl;
         bool found_object = false;
 
         assert(bus);
@@ -1374,25 +2172,21 @@ int bus_process_object(sd_bus *bus, sd_bus_message *m) {
         assert(m->path);
         assert(m->member);
 
-        pl = strlen(m->path);
         do {
-                char prefix[pl+1];
+                struct node *n;
 
                 bus->nodes_modified = false;
 
-                r = object_find_and_run(bus, m, m->path, false, &found_object);
-                if (r != 0)
-                        return r;
+                /* A single descent yields the exact node (if it exists) and all prefixes that might carry
+                 * fallbacks, ordered from the longest prefix to the root. */
+                for (n = bus_node_find_closest(bus, m->path); n; n = n->parent) {
 
-                /* Look for fallback prefixes */
-                OBJECT_PATH_FOREACH_PREFIX(prefix, m->path) {
+                        r = object_find_and_run(bus, m, n, !streq(n->path, m->path), &found_object);
+                        if (r != 0)
+                                return r;
 
                         if (bus->nodes_modified)
                                 break;
-
-                        r = object_find_and_run(bus, m, prefix, true, &found_object);
-                        if (r != 0)
-                                return r;
                 }
 
         } while (bus->nodes_modified);
@@ -1462,15 +2256,49 @@ static struct node *bus_node_allocate(sd_bus *bus, const char *path) {
         n->path = TAKE_PTR(s);
 
         r = hashmap_put(bus->nodes, n->path, n);
-        if (r < 0) {
-                free(n->path);
-                return mfree(n);
-        }
+        if (r < 0)
+                goto fail;
+
+        if (parent) {
+                r = hashmap_ensure_allocated(&parent->children, &string_hash_ops);
+                if (r < 0)
+                        goto fail_remove;
+
+                r = hashmap_put(parent->children, node_label(n), n);
+                if (r < 0)
+                        goto fail_remove;
 
-        if (parent)
                 LIST_PREPEND(siblings, parent->child, n);
+                parent->introspection = mfree(parent->introspection);
+        }
 
         return n;
+
+fail_remove:
+        hashmap_remove(bus->nodes, n->path);
+fail:
+        free(n->path);
+        free(n);
+        bus_node_gc(bus, parent);
+        return NULL;
+}
+
+void bus_node_modified(sd_bus *bus, struct node *n) {
+        assert(bus);
+        assert(n);
+
+        /* Called whenever something is attached to or detached from a node. Dispatching restarts, and the
+         * node's introspection data has to be regenerated. */
+
+        bus->nodes_modified = true;
+        n->introspection = mfree(n->introspection);
+
+        /* Registering or removing a vtable affects the objects below the node too, hence cached data is not
+         * dropped here but checked against the node tree when it is used, see node_stamp_valid() */
+        n->modified = ++bus->nodes_generation;
+
+        if (!n->object_managers)
+                n->managed_objects = hashmap_free_free(n->managed_objects);
 }
 
 void bus_node_gc(sd_bus *b, struct node *n) {
@@ -1486,11 +2314,20 @@ void bus_node_gc(sd_bus *b, struct node *n) {
             n->object_managers)
                 return;
 
+        managed_object_snapshot_drop(b, n->path);
+        property_cache_drop(b, n->path, NULL, NULL);
         assert_se(hashmap_remove(b->nodes, n->path) == n);
 
-        if (n->parent)
+        if (n->parent) {
+                assert_se(hashmap_remove(n->parent->children, node_label(n)) == n);
                 LIST_REMOVE(siblings, n->parent->child, n);
+                n->parent->introspection = mfree(n->parent->introspection);
+        }
 
+        hashmap_free(n->children);
+        hashmap_free(n->interfaces);
+        hashmap_free_free(n->managed_objects);
+        free(n->introspection);
         free(n->path);
         bus_node_gc(b, n->parent);
         free(n);
@@ -1502,18 +2339,7 @@ static int bus_find_parent_object_manager(sd_bus *bus, struct node **out, const
         assert(bus);
         assert(path);
 
-        n = hashmap_get(bus->nodes, path);
-        if (!n) {
-                char *prefix;
-
-                prefix = alloca(strlen(path) + 1);
-                OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
-                        n = hashmap_get(bus->nodes, prefix);
-                        if (n)
-                                break;
-                }
-        }
-
+        n = bus_node_find_closest(bus, path);
         while (n && !n->object_managers)
                 n = n->parent;
 
@@ -1555,7 +2381,7 @@ static int bus_add_object(
 
         s->node_callback.node = n;
         LIST_PREPEND(callbacks, n->callbacks, &s->node_callback);
-        bus->nodes_modified = true;
+        bus_node_modified(bus, n);
 
         if (slot)
                 *slot = s;
@@ -1581,47 +2407,14 @@ _public_ int sd_bus_add_object(
 
 _public_ int sd_bus_add_fallback(
                 sd_bus *bus,
-                sd_bus_slot **slot,
-                const char *prefix,
-                sd_bus_message_handler_t callback,
-                void *userdata) {
-
-        return bus_add_object(bus, slot, true, prefix, callback, userdata);
-}
-
-static void vtable_member_hash_func(const void *a, struct siphash *state) {
-        const struct vtable_member *m = a;
-
-        assert(m);
-
-        string_hash_func(m->path, state);
-        string_hash_func(m->interface, state);
-        string_hash_func(m->member, state);
-}
-
-static int vtable_member_compare_func(const void *a, const void *b) {
-        const struct vtable_member *x = a, *y = b;
-        int r;
-
-        assert(x);
-        assert(y);
-
-        r = strcmp(x->path, y->path);
-        if (r != 0)
-                return r;
-
-        r = strcmp(x->interface, y->interface);
-        if (r != 0)
-                return r;
+                sd_bus_slot **slot,
+                const char *prefix,
+                sd_bus_message_handler_t callback,
+                void *userdata) {
 
-        return strcmp(x->member, y->member);
+        return bus_add_object(bus, slot, true, prefix, callback, userdata);
 }
 
-static const struct hash_ops vtable_member_hash_ops = {
-        .hash = vtable_member_hash_func,
-        .compare = vtable_member_compare_func
-};
-
 static int add_object_vtable_internal(
                 sd_bus *bus,
                 sd_bus_slot **slot,
@@ -1634,6 +2427,7 @@ static int add_object_vtable_internal(
 
         sd_bus_slot *s = NULL;
         struct node_vtable *i, *existing = NULL;
+        unsigned n_methods = 0, n_properties = 0, k;
         const sd_bus_vtable *v;
         struct node *n;
         int r;
@@ -1651,14 +2445,6 @@ static int add_object_vtable_internal(
                       !streq(interface, "org.freedesktop.DBus.Peer") &&
                       !streq(interface, "org.freedesktop.DBus.ObjectManager"), -EINVAL);
 
-        r = hashmap_ensure_allocated(&bus->vtable_methods, &vtable_member_hash_ops);
-        if (r < 0)
-                return r;
-
-        r = hashmap_ensure_allocated(&bus->vtable_properties, &vtable_member_hash_ops);
-        if (r < 0)
-                return r;
-
         n = bus_node_allocate(bus, path);
         if (!n)
                 return -ENOMEM;
@@ -1696,6 +2482,28 @@ static int add_object_vtable_internal(
                 goto fail;
         }
 
+        for (v = s->node_vtable.vtable+1; v->type != _SD_BUS_VTABLE_END; v++)
+                if (v->type == _SD_BUS_VTABLE_METHOD)
+                        n_methods++;
+                else if (IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                        n_properties++;
+
+        if (n_methods > 0) {
+                s->node_vtable.methods.members = new0(struct vtable_member, n_methods);
+                if (!s->node_vtable.methods.members) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+
+        if (n_properties > 0) {
+                s->node_vtable.properties.members = new0(struct vtable_member, n_properties);
+                if (!s->node_vtable.properties.members) {
+                        r = -ENOMEM;
+                        goto fail;
+                }
+        }
+
         for (v = s->node_vtable.vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
 
                 switch (v->type) {
@@ -1707,28 +2515,20 @@ static int add_object_vtable_internal(
                             !signature_is_valid(strempty(v->x.method.signature), false) ||
                             !signature_is_valid(strempty(v->x.method.result), false) ||
                             !(v->x.method.handler || (isempty(v->x.method.signature) && isempty(v->x.method.result))) ||
-                            v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION)) {
+                            v->flags & (SD_BUS_VTABLE_PROPERTY_CONST|SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION|SD_BUS_VTABLE_PROPERTY_CACHED)) {
                                 r = -EINVAL;
                                 goto fail;
                         }
 
-                        m = new0(struct vtable_member, 1);
-                        if (!m) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
-
+                        m = s->node_vtable.methods.members + s->node_vtable.methods.n_members++;
                         m->parent = &s->node_vtable;
-                        m->path = n->path;
                         m->interface = s->node_vtable.interface;
                         m->member = v->x.method.member;
                         m->vtable = v;
 
-                        r = hashmap_put(bus->vtable_methods, m, m);
-                        if (r < 0) {
-                                free(m);
-                                goto fail;
-                        }
+                        /* Messages with these signatures are read and built all the time, hence intern them */
+                        (void) bus_signature_intern(strempty(v->x.method.signature));
+                        (void) bus_signature_intern(strempty(v->x.method.result));
 
                         break;
                 }
@@ -1760,23 +2560,13 @@ static int add_object_vtable_internal(
                                 goto fail;
                         }
 
-                        m = new0(struct vtable_member, 1);
-                        if (!m) {
-                                r = -ENOMEM;
-                                goto fail;
-                        }
-
+                        m = s->node_vtable.properties.members + s->node_vtable.properties.n_members++;
                         m->parent = &s->node_vtable;
-                        m->path = n->path;
                         m->interface = s->node_vtable.interface;
                         m->member = v->x.property.member;
                         m->vtable = v;
 
-                        r = hashmap_put(bus->vtable_properties, m, m);
-                        if (r < 0) {
-                                free(m);
-                                goto fail;
-                        }
+                        (void) bus_signature_intern(v->x.property.signature);
 
                         break;
                 }
@@ -1790,6 +2580,8 @@ static int add_object_vtable_internal(
                                 goto fail;
                         }
 
+                        (void) bus_signature_intern(strempty(v->x.signal.signature));
+
                         break;
 
                 default:
@@ -1798,9 +2590,40 @@ static int add_object_vtable_internal(
                 }
         }
 
+        r = vtable_member_table_compile(&s->node_vtable.methods);
+        if (r < 0)
+                goto fail;
+
+        r = vtable_member_table_compile(&s->node_vtable.properties);
+        if (r < 0)
+                goto fail;
+
+        if (existing) {
+                /* Member names need to be unique across all vtables implementing the same interface on a node */
+                for (k = 0; k < s->node_vtable.methods.n_members; k++)
+                        if (node_find_member(n, interface, s->node_vtable.methods.members[k].member, false)) {
+                                r = -EEXIST;
+                                goto fail;
+                        }
+
+                for (k = 0; k < s->node_vtable.properties.n_members; k++)
+                        if (node_find_member(n, interface, s->node_vtable.properties.members[k].member, true)) {
+                                r = -EEXIST;
+                                goto fail;
+                        }
+        } else {
+                r = hashmap_ensure_allocated(&n->interfaces, &string_hash_ops);
+                if (r < 0)
+                        goto fail;
+
+                r = hashmap_put(n->interfaces, s->node_vtable.interface, &s->node_vtable);
+                if (r < 0)
+                        goto fail;
+        }
+
         s->node_vtable.node = n;
         LIST_INSERT_AFTER(vtables, n->vtables, existing, &s->node_vtable);
-        bus->nodes_modified = true;
+        bus_node_modified(bus, n);
 
         if (slot)
                 *slot = s;
@@ -1868,7 +2691,7 @@ _public_ int sd_bus_add_node_enumerator(
 
         s->node_enumerator.node = n;
         LIST_PREPEND(enumerators, n->enumerators, &s->node_enumerator);
-        bus->nodes_modified = true;
+        bus_node_modified(bus, n);
 
         if (slot)
                 *slot = s;
@@ -1884,33 +2707,28 @@ fail:
 
 static int emit_properties_changed_on_interface(
                 sd_bus *bus,
-                const char *prefix,
+                struct node *n,
                 const char *path,
                 const char *interface,
                 bool require_fallback,
                 bool *found_interface,
-                char **names) {
+                char **names,
+                bool throttle) {
 
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         bool has_invalidating = false, has_changing = false;
-        struct vtable_member key = {};
         struct node_vtable *c;
-        struct node *n;
         char **property;
         void *u = NULL;
         int r;
 
         assert(bus);
-        assert(prefix);
+        assert(n);
         assert(path);
         assert(interface);
         assert(found_interface);
 
-        n = hashmap_get(bus->nodes, prefix);
-        if (!n)
-                return 0;
-
         r = sd_bus_message_new_signal(bus, &m, path, "org.freedesktop.DBus.Properties", "PropertiesChanged");
         if (r < 0)
                 return r;
@@ -1923,9 +2741,6 @@ static int emit_properties_changed_on_interface(
         if (r < 0)
                 return r;
 
-        key.path = prefix;
-        key.interface = interface;
-
         LIST_FOREACH(vtables, c, n->vtables) {
                 if (require_fallback && !c->is_fallback)
                         continue;
@@ -1953,8 +2768,7 @@ static int emit_properties_changed_on_interface(
 
                                 assert_return(member_name_is_valid(*property), -EINVAL);
 
-                                key.member = *property;
-                                v = hashmap_get(bus->vtable_properties, &key);
+                                v = node_find_member(n, interface, *property, true);
                                 if (!v)
                                         return -ENOENT;
 
@@ -1985,108 +2799,418 @@ static int emit_properties_changed_on_interface(
                 } else {
                         const sd_bus_vtable *v;
 
-                        /* If the caller specified no properties list
-                         * we include all properties that are marked
-                         * as changing in the message. */
+                        /* If the caller specified no properties list
+                         * we include all properties that are marked
+                         * as changing in the message. */
+
+                        for (v = c->vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
+                                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                                        continue;
+
+                                if (v->flags & SD_BUS_VTABLE_HIDDEN)
+                                        continue;
+
+                                if (v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION) {
+                                        has_invalidating = true;
+                                        continue;
+                                }
+
+                                if (!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE))
+                                        continue;
+
+                                has_changing = true;
+
+                                r = vtable_append_one_property(bus, m, m->path, c, v, u, &error);
+                                if (r < 0)
+                                        return r;
+                                if (bus->nodes_modified)
+                                        return 0;
+                        }
+                }
+        }
+
+        if (!has_invalidating && !has_changing)
+                return 0;
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_open_container(m, 'a', "s");
+        if (r < 0)
+                return r;
+
+        if (has_invalidating) {
+                LIST_FOREACH(vtables, c, n->vtables) {
+                        if (require_fallback && !c->is_fallback)
+                                continue;
+
+                        if (!streq(c->interface, interface))
+                                continue;
+
+                        r = node_vtable_get_userdata(bus, path, c, &u, &error);
+                        if (r < 0)
+                                return r;
+                        if (bus->nodes_modified)
+                                return 0;
+                        if (r == 0)
+                                continue;
+
+                        if (names) {
+                                STRV_FOREACH(property, names) {
+                                        struct vtable_member *v;
+
+                                        assert_se(v = node_find_member(n, interface, *property, true));
+                                        assert(c == v->parent);
+
+                                        if (!(v->vtable->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
+                                                continue;
+
+                                        r = sd_bus_message_append(m, "s", *property);
+                                        if (r < 0)
+                                                return r;
+                                }
+                        } else {
+                                const sd_bus_vtable *v;
+
+                                for (v = c->vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
+                                        if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
+                                                continue;
+
+                                        if (v->flags & SD_BUS_VTABLE_HIDDEN)
+                                                continue;
+
+                                        if (!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
+                                                continue;
+
+                                        r = sd_bus_message_append(m, "s", v->x.property.member);
+                                        if (r < 0)
+                                                return r;
+                                }
+                        }
+                }
+        }
+
+        r = sd_bus_message_close_container(m);
+        if (r < 0)
+                return r;
+
+        r = bus_send_internal(bus, m, NULL, 0, throttle);
+        if (r < 0)
+                return r;
+
+        return 1;
+}
+
+static int emit_properties_changed(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                char **names,
+                bool throttle) {
+
+        bool found_interface = false;
+        int r;
+
+        assert(bus);
+        assert(path);
+        assert(interface);
+
+        BUS_DONT_DESTROY(bus);
+
+        do {
+                struct node *n;
+
+                bus->nodes_modified = false;
+
+                for (n = bus_node_find_closest(bus, path); n; n = n->parent) {
+                        r = emit_properties_changed_on_interface(bus, n, path, interface, !streq(n->path, path), &found_interface, names, throttle);
+                        if (r != 0)
+                                return r;
+                        if (bus->nodes_modified)
+                                break;
+                }
+
+        } while (bus->nodes_modified);
+
+        return found_interface ? 0 : -ENOENT;
+}
+
+static int properties_changed_compare(const void *a, const void *b) {
+        const struct properties_changed_object *x = a, *y = b;
+
+        return CMP(x->deadline, y->deadline);
+}
+
+static struct properties_changed_object *properties_changed_object_free(struct properties_changed_object *o) {
+        struct properties_changed_interface *i;
+
+        if (!o)
+                return NULL;
+
+        while ((i = o->interfaces)) {
+                LIST_REMOVE(interfaces, o->interfaces, i);
+                free(i->interface);
+                strv_free(i->names);
+                free(i);
+        }
+
+        free(o->path);
+        return mfree(o);
+}
+
+static int properties_changed_object_link(sd_bus *bus, struct properties_changed_object *o) {
+        int r;
+
+        assert(bus);
+        assert(o);
+
+        r = hashmap_ensure_allocated(&bus->properties_changed, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        r = prioq_ensure_allocated(&bus->properties_changed_prioq, properties_changed_compare);
+        if (r < 0)
+                return r;
+
+        r = hashmap_put(bus->properties_changed, o->path, o);
+        if (r < 0)
+                return r;
+
+        r = prioq_put(bus->properties_changed_prioq, o, &o->prioq_idx);
+        if (r < 0) {
+                hashmap_remove(bus->properties_changed, o->path);
+                return r;
+        }
+
+        return 0;
+}
+
+static void properties_changed_object_unlink(sd_bus *bus, struct properties_changed_object *o) {
+        assert(bus);
+        assert(o);
+
+        hashmap_remove(bus->properties_changed, o->path);
+        prioq_remove(bus->properties_changed_prioq, o, &o->prioq_idx);
+}
+
+static int properties_changed_queue(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                char **names) {
+
+        struct properties_changed_interface *i, *last = NULL;
+        struct properties_changed_object *o;
+        char **n;
+        int r;
+
+        assert(bus);
+        assert(path);
+        assert(interface);
+
+        o = hashmap_get(bus->properties_changed, path);
+        if (!o) {
+                o = new0(struct properties_changed_object, 1);
+                if (!o)
+                        return -ENOMEM;
+
+                o->prioq_idx = PRIOQ_IDX_NULL;
+                o->deadline = bus->properties_changed_interval;
+
+                o->path = strdup(path);
+                if (!o->path) {
+                        free(o);
+                        return -ENOMEM;
+                }
+
+                r = properties_changed_object_link(bus, o);
+                if (r < 0) {
+                        properties_changed_object_free(o);
+                        return r;
+                }
+        }
+
+        LIST_FOREACH(interfaces, i, o->interfaces) {
+                if (streq(i->interface, interface))
+                        break;
+
+                last = i;
+        }
+
+        if (!i) {
+                i = new0(struct properties_changed_interface, 1);
+                if (!i)
+                        return -ENOMEM;
 
-                        for (v = c->vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
-                                if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
-                                        continue;
+                i->interface = strdup(interface);
+                if (!i->interface) {
+                        free(i);
+                        return -ENOMEM;
+                }
 
-                                if (v->flags & SD_BUS_VTABLE_HIDDEN)
-                                        continue;
+                /* Keep the interfaces in the order they were first changed in */
+                LIST_INSERT_AFTER(interfaces, o->interfaces, last, i);
+        }
 
-                                if (v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION) {
-                                        has_invalidating = true;
-                                        continue;
-                                }
+        if (i->all_properties)
+                return 0;
 
-                                if (!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE))
-                                        continue;
+        if (!names) {
+                i->all_properties = true;
+                i->names = strv_free(i->names);
+                return 0;
+        }
 
-                                has_changing = true;
+        STRV_FOREACH(n, names) {
+                if (strv_contains(i->names, *n))
+                        continue;
 
-                                r = vtable_append_one_property(bus, m, m->path, c, v, u, &error);
-                                if (r < 0)
-                                        return r;
-                                if (bus->nodes_modified)
-                                        return 0;
-                        }
-                }
+                r = strv_extend(&i->names, *n);
+                if (r < 0)
+                        return r;
         }
 
-        if (!has_invalidating && !has_changing)
+        return 0;
+}
+
+int bus_properties_changed_dispatch(sd_bus *bus, bool force) {
+        _cleanup_free_ struct properties_changed_object **due = NULL;
+        size_t n_due = 0, n_allocated = 0, k;
+        struct properties_changed_object *o;
+        usec_t n;
+        int r = 0;
+
+        assert(bus);
+
+        /* Sends the PropertiesChanged signals queued in deferred mode, either only for the objects whose rate
+         * limit interval passed, or for all of them. Returns > 0 if any signals were sent. */
+
+        o = prioq_peek(bus->properties_changed_prioq);
+        if (!o)
                 return 0;
 
-        r = sd_bus_message_close_container(m);
-        if (r < 0)
-                return r;
+        n = now(CLOCK_MONOTONIC);
+        if (!force && o->deadline > n)
+                return 0;
 
-        r = sd_bus_message_open_container(m, 'a', "s");
-        if (r < 0)
-                return r;
+        /* Take everything that is due out of the queue first, so that property getters may queue further changes
+         * while we emit */
+        while ((o = prioq_peek(bus->properties_changed_prioq))) {
+                if (!force && o->deadline > n)
+                        break;
 
-        if (has_invalidating) {
-                LIST_FOREACH(vtables, c, n->vtables) {
-                        if (require_fallback && !c->is_fallback)
-                                continue;
+                if (o->interfaces && !GREEDY_REALLOC(due, n_allocated, n_due + 1)) {
+                        r = -ENOMEM;
+                        break;
+                }
 
-                        if (!streq(c->interface, interface))
-                                continue;
+                properties_changed_object_unlink(bus, o);
 
-                        r = node_vtable_get_userdata(bus, path, c, &u, &error);
-                        if (r < 0)
-                                return r;
-                        if (bus->nodes_modified)
-                                return 0;
-                        if (r == 0)
-                                continue;
+                if (o->interfaces)
+                        due[n_due++] = o;
+                else
+                        /* Nothing queued, and the rate limit interval passed, hence forget the object */
+                        properties_changed_object_free(o);
+        }
 
-                        if (names) {
-                                STRV_FOREACH(property, names) {
-                                        struct vtable_member *v;
+        BUS_DONT_DESTROY(bus);
 
-                                        key.member = *property;
-                                        assert_se(v = hashmap_get(bus->vtable_properties, &key));
-                                        assert(c == v->parent);
+        for (k = 0; k < n_due; k++) {
+                struct properties_changed_interface *i;
+                struct properties_changed_object *existing;
 
-                                        if (!(v->vtable->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
-                                                continue;
+                o = due[k];
 
-                                        r = sd_bus_message_append(m, "s", *property);
-                                        if (r < 0)
-                                                return r;
-                                }
-                        } else {
-                                const sd_bus_vtable *v;
+                while ((i = o->interfaces)) {
+                        int q;
 
-                                for (v = c->vtable+1; v->type != _SD_BUS_VTABLE_END; v++) {
-                                        if (!IN_SET(v->type, _SD_BUS_VTABLE_PROPERTY, _SD_BUS_VTABLE_WRITABLE_PROPERTY))
-                                                continue;
+                        /* Changes were accepted already, hence they aren't held back by the write watermark */
+                        q = emit_properties_changed(bus, o->path, i->interface, i->all_properties ? NULL : i->names, false);
+                        if (q == -ENOMEM) {
+                                /* Keep this and everything after it queued, to be tried again later */
+                                if (r == 0)
+                                        r = q;
+                                break;
+                        }
+                        if (q < 0)
+                                log_debug_errno(q, "Failed to emit deferred PropertiesChanged signal for %s on %s, ignoring: %m",
+                                                i->interface, o->path);
+
+                        LIST_REMOVE(interfaces, o->interfaces, i);
+                        free(i->interface);
+                        strv_free(i->names);
+                        free(i);
+                }
 
-                                        if (v->flags & SD_BUS_VTABLE_HIDDEN)
-                                                continue;
+                if (o->interfaces) {
+                        existing = hashmap_get(bus->properties_changed, o->path);
+                        if (!existing) {
+                                if (properties_changed_object_link(bus, o) < 0)
+                                        properties_changed_object_free(o);
+                                continue;
+                        }
 
-                                        if (!(v->flags & SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION))
-                                                continue;
+                        /* The property getters queued another change for the object, hence merge into that */
+                        LIST_FOREACH(interfaces, i, o->interfaces)
+                                (void) properties_changed_queue(bus, o->path, i->interface, i->all_properties ? NULL : i->names);
 
-                                        r = sd_bus_message_append(m, "s", v->x.property.member);
-                                        if (r < 0)
-                                                return r;
-                                }
+                        properties_changed_object_free(o);
+                        continue;
+                }
+
+                if (bus->properties_changed_interval <= 0) {
+                        properties_changed_object_free(o);
+                        continue;
+                }
+
+                /* Remember when we sent the signals, so that the interval applies to the next change too. The
+                 * property getters might have queued another change in the meantime. */
+                existing = hashmap_get(bus->properties_changed, o->path);
+                if (existing) {
+                        prioq_remove(bus->properties_changed_prioq, existing, &existing->prioq_idx);
+                        existing->last_emitted = n;
+                        existing->deadline = usec_add(n, bus->properties_changed_interval);
+                        if (prioq_put(bus->properties_changed_prioq, existing, &existing->prioq_idx) < 0) {
+                                hashmap_remove(bus->properties_changed, existing->path);
+                                properties_changed_object_free(existing);
                         }
+
+                        properties_changed_object_free(o);
+                        continue;
                 }
+
+                o->last_emitted = n;
+                o->deadline = usec_add(n, bus->properties_changed_interval);
+                if (properties_changed_object_link(bus, o) < 0)
+                        properties_changed_object_free(o);
         }
 
-        r = sd_bus_message_close_container(m);
         if (r < 0)
                 return r;
 
-        r = sd_bus_send(bus, m, NULL);
-        if (r < 0)
-                return r;
+        return n_due > 0;
+}
 
-        return 1;
+usec_t bus_properties_changed_next(sd_bus *bus) {
+        struct properties_changed_object *o;
+
+        assert(bus);
+
+        o = prioq_peek(bus->properties_changed_prioq);
+        return o ? o->deadline : USEC_INFINITY;
+}
+
+void bus_properties_changed_discard(sd_bus *bus) {
+        struct properties_changed_object *o;
+
+        assert(bus);
+
+        while ((o = prioq_pop(bus->properties_changed_prioq)))
+                properties_changed_object_free(o);
+
+        bus->properties_changed_prioq = prioq_free(bus->properties_changed_prioq);
+        bus->properties_changed = hashmap_free(bus->properties_changed);
 }
 
 _public_ int sd_bus_emit_properties_changed_strv(
@@ -2095,8 +3219,6 @@ _public_ int sd_bus_emit_properties_changed_strv(
                 const char *interface,
                 char **names) {
 
-        bool found_interface = false;
-        char *prefix;
         int r;
 
         assert_return(bus, -EINVAL);
@@ -2115,29 +3237,22 @@ _public_ int sd_bus_emit_properties_changed_strv(
         if (names && names[0] == NULL)
                 return 0;
 
-        BUS_DONT_DESTROY(bus);
-
-        do {
-                bus->nodes_modified = false;
+        managed_object_snapshot_drop(bus, path);
+        property_cache_drop(bus, path, interface, names);
 
-                r = emit_properties_changed_on_interface(bus, path, path, interface, false, &found_interface, names);
-                if (r != 0)
+        /* In deferred mode changes are merged per object and interface, and sent from sd_bus_process() or
+         * sd_bus_flush() */
+        if (bus->defer_properties_changed) {
+                r = properties_changed_queue(bus, path, interface, names);
+                if (r != -ENOMEM)
                         return r;
-                if (bus->nodes_modified)
-                        continue;
-
-                prefix = alloca(strlen(path) + 1);
-                OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
-                        r = emit_properties_changed_on_interface(bus, prefix, path, interface, true, &found_interface, names);
-                        if (r != 0)
-                                return r;
-                        if (bus->nodes_modified)
-                                break;
-                }
 
-        } while (bus->nodes_modified);
+                /* Better send the signal right away than lose the change */
+                log_debug_errno(r, "Failed to queue PropertiesChanged signal for %s on %s, emitting it right away: %m",
+                                interface, path);
+        }
 
-        return found_interface ? 0 : -ENOENT;
+        return emit_properties_changed(bus, path, interface, names, true);
 }
 
 _public_ int sd_bus_emit_properties_changed(
@@ -2169,25 +3284,20 @@ static int object_added_append_all_prefix(
                 sd_bus *bus,
                 sd_bus_message *m,
                 Set *s,
-                const char *prefix,
+                struct node *n,
                 const char *path,
                 bool require_fallback) {
 
         const char *previous_interface = NULL;
         struct node_vtable *c;
-        struct node *n;
         int r;
 
         assert(bus);
         assert(m);
         assert(s);
-        assert(prefix);
+        assert(n);
         assert(path);
 
-        n = hashmap_get(bus->nodes, prefix);
-        if (!n)
-                return 0;
-
         LIST_FOREACH(vtables, c, n->vtables) {
                 _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
                 void *u = NULL;
@@ -2258,7 +3368,7 @@ static int object_added_append_all_prefix(
 
 static int object_added_append_all(sd_bus *bus, sd_bus_message *m, const char *path) {
         _cleanup_set_free_ Set *s = NULL;
-        char *prefix;
+        struct node *n;
         int r;
 
         assert(bus);
@@ -2297,15 +3407,8 @@ static int object_added_append_all(sd_bus *bus, sd_bus_message *m, const char *p
         if (r < 0)
                 return r;
 
-        r = object_added_append_all_prefix(bus, m, s, path, path, false);
-        if (r < 0)
-                return r;
-        if (bus->nodes_modified)
-                return 0;
-
-        prefix = alloca(strlen(path) + 1);
-        OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
-                r = object_added_append_all_prefix(bus, m, s, prefix, path, true);
+        for (n = bus_node_find_closest(bus, path); n; n = n->parent) {
+                r = object_added_append_all_prefix(bus, m, s, n, path, !streq(n->path, path));
                 if (r < 0)
                         return r;
                 if (bus->nodes_modified)
@@ -2339,6 +3442,10 @@ _public_ int sd_bus_emit_object_added(sd_bus *bus, const char *path) {
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
+        /* Whatever was cached for an earlier incarnation of the object is stale now */
+        property_cache_drop(bus, path, NULL, NULL);
+        managed_object_snapshot_drop(bus, path);
+
         r = bus_find_parent_object_manager(bus, &object_manager, path);
         if (r < 0)
                 return r;
@@ -2383,25 +3490,20 @@ static int object_removed_append_all_prefix(
                 sd_bus *bus,
                 sd_bus_message *m,
                 Set *s,
-                const char *prefix,
+                struct node *n,
                 const char *path,
                 bool require_fallback) {
 
         const char *previous_interface = NULL;
         struct node_vtable *c;
-        struct node *n;
         int r;
 
         assert(bus);
         assert(m);
         assert(s);
-        assert(prefix);
+        assert(n);
         assert(path);
 
-        n = hashmap_get(bus->nodes, prefix);
-        if (!n)
-                return 0;
-
         LIST_FOREACH(vtables, c, n->vtables) {
                 _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
                 void *u = NULL;
@@ -2442,7 +3544,7 @@ static int object_removed_append_all_prefix(
 
 static int object_removed_append_all(sd_bus *bus, sd_bus_message *m, const char *path) {
         _cleanup_set_free_ Set *s = NULL;
-        char *prefix;
+        struct node *n;
         int r;
 
         assert(bus);
@@ -2468,15 +3570,8 @@ static int object_removed_append_all(sd_bus *bus, sd_bus_message *m, const char
         if (r < 0)
                 return r;
 
-        r = object_removed_append_all_prefix(bus, m, s, path, path, false);
-        if (r < 0)
-                return r;
-        if (bus->nodes_modified)
-                return 0;
-
-        prefix = alloca(strlen(path) + 1);
-        OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
-                r = object_removed_append_all_prefix(bus, m, s, prefix, path, true);
+        for (n = bus_node_find_closest(bus, path); n; n = n->parent) {
+                r = object_removed_append_all_prefix(bus, m, s, n, path, !streq(n->path, path));
                 if (r < 0)
                         return r;
                 if (bus->nodes_modified)
@@ -2510,6 +3605,10 @@ _public_ int sd_bus_emit_object_removed(sd_bus *bus, const char *path) {
         if (!BUS_IS_OPEN(bus->state))
                 return -ENOTCONN;
 
+        /* Nothing cached for the object may be served to a later one on the same path */
+        property_cache_drop(bus, path, NULL, NULL);
+        managed_object_snapshot_drop(bus, path);
+
         r = bus_find_parent_object_manager(bus, &object_manager, path);
         if (r < 0)
                 return r;
@@ -2553,7 +3652,7 @@ _public_ int sd_bus_emit_object_removed(sd_bus *bus, const char *path) {
 static int interfaces_added_append_one_prefix(
                 sd_bus *bus,
                 sd_bus_message *m,
-                const char *prefix,
+                struct node *n,
                 const char *path,
                 const char *interface,
                 bool require_fallback) {
@@ -2561,20 +3660,15 @@ static int interfaces_added_append_one_prefix(
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         bool found_interface = false;
         struct node_vtable *c;
-        struct node *n;
         void *u = NULL;
         int r;
 
         assert(bus);
         assert(m);
-        assert(prefix);
+        assert(n);
         assert(path);
         assert(interface);
 
-        n = hashmap_get(bus->nodes, prefix);
-        if (!n)
-                return 0;
-
         LIST_FOREACH(vtables, c, n->vtables) {
                 if (require_fallback && !c->is_fallback)
                         continue;
@@ -2624,7 +3718,7 @@ static int interfaces_added_append_one(
                 const char *path,
                 const char *interface) {
 
-        char *prefix;
+        struct node *n;
         int r;
 
         assert(bus);
@@ -2632,15 +3726,8 @@ static int interfaces_added_append_one(
         assert(path);
         assert(interface);
 
-        r = interfaces_added_append_one_prefix(bus, m, path, path, interface, false);
-        if (r != 0)
-                return r;
-        if (bus->nodes_modified)
-                return 0;
-
-        prefix = alloca(strlen(path) + 1);
-        OBJECT_PATH_FOREACH_PREFIX(prefix, path) {
-                r = interfaces_added_append_one_prefix(bus, m, prefix, path, interface, true);
+        for (n = bus_node_find_closest(bus, path); n; n = n->parent) {
+                r = interfaces_added_append_one_prefix(bus, m, n, path, interface, !streq(n->path, path));
                 if (r != 0)
                         return r;
                 if (bus->nodes_modified)
@@ -2667,6 +3754,10 @@ _public_ int sd_bus_emit_interfaces_added_strv(sd_bus *bus, const char *path, ch
         if (strv_isempty(interfaces))
                 return 0;
 
+        STRV_FOREACH(i, interfaces)
+                property_cache_drop(bus, path, *i, NULL);
+        managed_object_snapshot_drop(bus, path);
+
         r = bus_find_parent_object_manager(bus, &object_manager, path);
         if (r < 0)
                 return r;
@@ -2741,6 +3832,7 @@ _public_ int sd_bus_emit_interfaces_added(sd_bus *bus, const char *path, const c
 _public_ int sd_bus_emit_interfaces_removed_strv(sd_bus *bus, const char *path, char **interfaces) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         struct node *object_manager;
+        char **i;
         int r;
 
         assert_return(bus, -EINVAL);
@@ -2754,6 +3846,10 @@ _public_ int sd_bus_emit_interfaces_removed_strv(sd_bus *bus, const char *path,
         if (strv_isempty(interfaces))
                 return 0;
 
+        STRV_FOREACH(i, interfaces)
+                property_cache_drop(bus, path, *i, NULL);
+        managed_object_snapshot_drop(bus, path);
+
         r = bus_find_parent_object_manager(bus, &object_manager, path);
         if (r < 0)
                 return r;
@@ -2813,7 +3909,7 @@ _public_ int sd_bus_add_object_manager(sd_bus *bus, sd_bus_slot **slot, const ch
 
         s->node_object_manager.node = n;
         LIST_PREPEND(object_managers, n->object_managers, &s->node_object_manager);
-        bus->nodes_modified = true;
+        bus_node_modified(bus, n);
 
         if (slot)
                 *slot = s;
@@ -2826,3 +3922,108 @@ fail:
 
         return r;
 }
+
+_public_ int sd_bus_set_introspection_cache_ttl(sd_bus *bus, uint64_t usec) {
+        struct node *n;
+        Iterator i;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->introspection_cache_ttl = usec;
+
+        /* Drop whatever has been cached under the old TTL */
+        HASHMAP_FOREACH(n, bus->nodes, i)
+                n->introspection = mfree(n->introspection);
+
+        return 0;
+}
+
+_public_ int sd_bus_get_introspection_cache_ttl(sd_bus *bus, uint64_t *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(ret, -EINVAL);
+
+        *ret = bus->introspection_cache_ttl;
+        return 0;
+}
+
+_public_ int sd_bus_set_properties_changed_deferred(sd_bus *bus, int b) {
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->defer_properties_changed = b;
+
+        /* Don't sit on anything queued so far when deferring is turned off */
+        if (!b && BUS_IS_OPEN(bus->state)) {
+                r = bus_properties_changed_dispatch(bus, true);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+_public_ int sd_bus_get_properties_changed_deferred(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+
+        return bus->defer_properties_changed;
+}
+
+_public_ int sd_bus_set_properties_changed_interval(sd_bus *bus, uint64_t usec) {
+        struct properties_changed_object *o;
+        Iterator i;
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->properties_changed_interval = usec;
+
+        /* Requeue everything according to the new interval */
+        HASHMAP_FOREACH(o, bus->properties_changed, i) {
+                prioq_remove(bus->properties_changed_prioq, o, &o->prioq_idx);
+
+                o->deadline = usec_add(o->last_emitted, usec);
+
+                r = prioq_put(bus->properties_changed_prioq, o, &o->prioq_idx);
+                if (r < 0)
+                        return r;
+        }
+
+        return 0;
+}
+
+_public_ int sd_bus_get_properties_changed_interval(sd_bus *bus, uint64_t *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(ret, -EINVAL);
+
+        *ret = bus->properties_changed_interval;
+        return 0;
+}
+
+_public_ int sd_bus_invalidate_cached_properties_strv(
+                sd_bus *bus,
+                const char *path,
+                const char *interface,
+                char **names) {
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(object_path_is_valid(path), -EINVAL);
+        assert_return(!interface || interface_name_is_valid(interface), -EINVAL);
+        assert_return(interface || !names, -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        property_cache_drop(bus, path, interface, names);
+        managed_object_snapshot_drop(bus, path);
+
+        return 0;
+}
@@ -5,3 +5,11 @@
 
 int bus_process_object(sd_bus *bus, sd_bus_message *m);
 void bus_node_gc(sd_bus *b, struct node *n);
+void bus_node_modified(sd_bus *bus, struct node *n);
+struct vtable_member *bus_node_vtable_find_method(struct node_vtable *c, const char *member);
+void bus_node_vtable_done(struct node_vtable *c);
+void bus_property_cache_free(sd_bus *bus);
+
+int bus_properties_changed_dispatch(sd_bus *bus, bool force);
+usec_t bus_properties_changed_next(sd_bus *bus);
+void bus_properties_changed_discard(sd_bus *bus);
@@ -0,0 +1,36 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+#pragma once
+
+#include "bus-message.h"
+
+/* Static probes for perf, bpftrace and SystemTap, all under the provider "basu". When built without
+ * sys/sdt.h they compile to nothing.
+ *
+ * Message probes carry the bus, the cookie, the reply cookie, the message type, the member (NULL for replies
+ * and errors) and the size of the message. Each dispatch_* probe is followed by handler_return on the same
+ * thread, carrying the bus, the cookie and the handler's return value. message_read fires as soon as a
+ * message is complete in the read buffer and carries only the bus and the size, message_parsed follows once
+ * it has been validated. */
+
+#if HAVE_USDT
+#include <sys/sdt.h>
+
+#define BUS_PROBE_MESSAGE(name, m)                                      \
+        DTRACE_PROBE6(basu, name,                                       \
+                      (m)->bus,                                         \
+                      BUS_MESSAGE_COOKIE(m),                            \
+                      (m)->reply_cookie,                                \
+                      (m)->header->type,                                \
+                      (m)->member,                                      \
+                      BUS_MESSAGE_SIZE(m))
+
+#define BUS_PROBE_HANDLER_RETURN(m, r)                                  \
+        DTRACE_PROBE3(basu, handler_return, (m)->bus, BUS_MESSAGE_COOKIE(m), r)
+
+#define BUS_PROBE_READ(bus, size)                                       \
+        DTRACE_PROBE2(basu, message_read, bus, size)
+#else
+#define BUS_PROBE_MESSAGE(name, m) do {} while (false)
+#define BUS_PROBE_HANDLER_RETURN(m, r) do {} while (false)
+#define BUS_PROBE_READ(bus, size) do {} while (false)
+#endif
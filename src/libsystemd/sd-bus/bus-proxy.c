@@ -0,0 +1,1087 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-signature.h"
+#include "bus-type.h"
+#include "hashmap.h"
+#include "string-util.h"
+#include "strv.h"
+
+/* A proxy mirrors the properties of one remote interface, or of a whole ObjectManager tree, in local
+ * memory. It fetches everything once with GetAll() or GetManagedObjects() and then follows
+ * PropertiesChanged, InterfacesAdded and InterfacesRemoved, so that reads never hit the bus. Each value
+ * is kept as a small sealed message holding just the variant, so that the usual message read API can be
+ * used on it. When talking to a bus, the owner of the destination name is followed as well: if it goes
+ * away everything is dropped, and if a new one shows up everything is fetched anew from it. */
+
+struct proxy_property {
+        char *name;
+        sd_bus_message *value; /* NULL while invalidated and being refetched */
+        sd_bus_slot *fetch;
+
+        sd_bus_proxy *proxy;
+        char *path;
+        char *interface;
+};
+
+struct proxy_interface {
+        char *name;
+        Hashmap *properties;
+};
+
+struct proxy_object {
+        char *path;
+        Hashmap *interfaces;
+};
+
+struct sd_bus_proxy {
+        unsigned n_ref;
+        sd_bus *bus;
+
+        char *destination;
+        char *path;
+        char *interface; /* NULL for ObjectManager trees */
+        char *owner;     /* unique name of the peer, once known */
+
+        sd_bus_proxy_handler_t handler;
+        void *userdata;
+
+        sd_bus_slot *match_properties_changed;
+        sd_bus_slot *match_interfaces_added;
+        sd_bus_slot *match_interfaces_removed;
+        sd_bus_slot *match_name_owner_changed;
+        sd_bus_slot *fetch;
+
+        Hashmap *objects;
+
+        int error;
+        bool ready:1;
+};
+
+static struct proxy_property* proxy_property_free(struct proxy_property *p) {
+        if (!p)
+                return NULL;
+
+        sd_bus_slot_unref(p->fetch);
+        sd_bus_message_unref(p->value);
+        free(p->name);
+        free(p->path);
+        free(p->interface);
+        return mfree(p);
+}
+
+static struct proxy_interface* proxy_interface_free(struct proxy_interface *i) {
+        if (!i)
+                return NULL;
+
+        hashmap_free_with_destructor(i->properties, proxy_property_free);
+        free(i->name);
+        return mfree(i);
+}
+
+DEFINE_TRIVIAL_CLEANUP_FUNC(struct proxy_interface*, proxy_interface_free);
+
+static struct proxy_object* proxy_object_free(struct proxy_object *o) {
+        if (!o)
+                return NULL;
+
+        hashmap_free_with_destructor(o->interfaces, proxy_interface_free);
+        free(o->path);
+        return mfree(o);
+}
+
+static void proxy_flush(sd_bus_proxy *p) {
+        assert(p);
+
+        p->objects = hashmap_free_with_destructor(p->objects, proxy_object_free);
+}
+
+static sd_bus_proxy* proxy_free(sd_bus_proxy *p) {
+        assert(p);
+
+        sd_bus_slot_unref(p->match_properties_changed);
+        sd_bus_slot_unref(p->match_interfaces_added);
+        sd_bus_slot_unref(p->match_interfaces_removed);
+        sd_bus_slot_unref(p->match_name_owner_changed);
+        sd_bus_slot_unref(p->fetch);
+
+        proxy_flush(p);
+
+        sd_bus_unref(p->bus);
+        free(p->destination);
+        free(p->path);
+        free(p->interface);
+        free(p->owner);
+        return mfree(p);
+}
+
+DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_bus_proxy, sd_bus_proxy, proxy_free);
+
+static void proxy_call_handler(sd_bus_proxy *p, const char *path, const char *interface, char **properties) {
+        int r;
+
+        assert(p);
+
+        if (!p->handler)
+                return;
+
+        r = p->handler(p, path, interface, properties, p->userdata);
+        if (r < 0)
+                log_debug_errno(r, "Proxy change handler for %s failed, ignoring: %m", strna(p->path));
+}
+
+static struct proxy_interface* proxy_find_interface(sd_bus_proxy *p, const char *path, const char *interface) {
+        struct proxy_object *o;
+
+        assert(p);
+
+        o = hashmap_get(p->objects, path);
+        if (!o)
+                return NULL;
+
+        return hashmap_get(o->interfaces, interface);
+}
+
+static int proxy_acquire_object(sd_bus_proxy *p, const char *path, struct proxy_object **ret) {
+        struct proxy_object *o;
+        int r;
+
+        assert(p);
+        assert(path);
+        assert(ret);
+
+        o = hashmap_get(p->objects, path);
+        if (o) {
+                *ret = o;
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&p->objects, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        o = new0(struct proxy_object, 1);
+        if (!o)
+                return -ENOMEM;
+
+        o->path = strdup(path);
+        if (!o->path) {
+                free(o);
+                return -ENOMEM;
+        }
+
+        r = hashmap_put(p->objects, o->path, o);
+        if (r < 0) {
+                proxy_object_free(o);
+                return r;
+        }
+
+        *ret = o;
+        return 1;
+}
+
+static void proxy_remove_object_if_empty(sd_bus_proxy *p, const char *path) {
+        struct proxy_object *o;
+
+        assert(p);
+
+        o = hashmap_get(p->objects, path);
+        if (!o || !hashmap_isempty(o->interfaces))
+                return;
+
+        hashmap_remove(p->objects, path);
+        proxy_object_free(o);
+}
+
+/* Copies the variant the message is currently positioned at into a standalone sealed message. */
+static int proxy_copy_value(sd_bus_proxy *p, sd_bus_message *m, sd_bus_message **ret) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *v = NULL;
+        int r;
+
+        assert(p);
+        assert(m);
+        assert(ret);
+
+        r = sd_bus_message_new(p->bus, &v, SD_BUS_MESSAGE_METHOD_RETURN);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_copy(v, m, false);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_seal(v, 0, 0);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(v);
+        return 0;
+}
+
+/* Stores the value the message is positioned at, replacing whatever was known before, including any
+ * refetch still in flight. */
+static int proxy_interface_set(
+                sd_bus_proxy *p,
+                struct proxy_interface *i,
+                const char *path,
+                const char *name,
+                sd_bus_message *m) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *v = NULL;
+        struct proxy_property *prop;
+        int r;
+
+        assert(p);
+        assert(i);
+        assert(name);
+        assert(m);
+
+        r = proxy_copy_value(p, m, &v);
+        if (r < 0)
+                return r;
+
+        prop = hashmap_get(i->properties, name);
+        if (prop) {
+                prop->fetch = sd_bus_slot_unref(prop->fetch);
+                sd_bus_message_unref(prop->value);
+                prop->value = TAKE_PTR(v);
+                return 0;
+        }
+
+        r = hashmap_ensure_allocated(&i->properties, &string_hash_ops);
+        if (r < 0)
+                return r;
+
+        prop = new0(struct proxy_property, 1);
+        if (!prop)
+                return -ENOMEM;
+
+        prop->proxy = p;
+        prop->name = strdup(name);
+        prop->path = strdup(path);
+        prop->interface = strdup(i->name);
+        if (!prop->name || !prop->path || !prop->interface) {
+                proxy_property_free(prop);
+                return -ENOMEM;
+        }
+
+        r = hashmap_put(i->properties, prop->name, prop);
+        if (r < 0) {
+                proxy_property_free(prop);
+                return r;
+        }
+
+        prop->value = TAKE_PTR(v);
+        return 0;
+}
+
+/* Reads an a{sv} array into the interface, optionally collecting the names seen. */
+static int proxy_interface_read(sd_bus_proxy *p, struct proxy_interface *i, const char *path, sd_bus_message *m, char ***names) {
+        int r;
+
+        assert(p);
+        assert(i);
+        assert(m);
+
+        r = sd_bus_message_enter_container(m, 'a', "{sv}");
+        if (r < 0)
+                return r;
+
+        while ((r = sd_bus_message_enter_container(m, 'e', "sv")) > 0) {
+                const char *name;
+
+                r = sd_bus_message_read_basic(m, 's', &name);
+                if (r < 0)
+                        return r;
+
+                r = proxy_interface_set(p, i, path, name, m);
+                if (r < 0)
+                        return r;
+
+                if (names) {
+                        r = strv_extend(names, name);
+                        if (r < 0)
+                                return r;
+                }
+
+                r = sd_bus_message_exit_container(m);
+                if (r < 0)
+                        return r;
+        }
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_exit_container(m);
+}
+
+/* Replaces an interface of an object wholesale with the a{sv} array the message is positioned at, and
+ * notifies the handler about all of its properties. */
+static int proxy_add_interface(sd_bus_proxy *p, const char *path, const char *interface, sd_bus_message *m) {
+        _cleanup_(proxy_interface_freep) struct proxy_interface *i = NULL;
+        _cleanup_strv_free_ char **names = NULL;
+        struct proxy_object *o;
+        int r;
+
+        assert(p);
+        assert(path);
+        assert(interface);
+        assert(m);
+
+        i = new0(struct proxy_interface, 1);
+        if (!i)
+                return -ENOMEM;
+
+        i->name = strdup(interface);
+        if (!i->name)
+                return -ENOMEM;
+
+        r = proxy_interface_read(p, i, path, m, &names);
+        if (r < 0)
+                return r;
+
+        if (!names) {
+                names = strv_new(NULL);
+                if (!names)
+                        return -ENOMEM;
+        }
+
+        r = proxy_acquire_object(p, path, &o);
+        if (r < 0)
+                return r;
+
+        r = hashmap_ensure_allocated(&o->interfaces, &string_hash_ops);
+        if (r < 0)
+                goto fail;
+
+        proxy_interface_free(hashmap_remove(o->interfaces, interface));
+
+        r = hashmap_put(o->interfaces, i->name, i);
+        if (r < 0)
+                goto fail;
+
+        TAKE_PTR(i);
+
+        proxy_call_handler(p, path, interface, names);
+        return 0;
+
+fail:
+        proxy_remove_object_if_empty(p, path);
+        return r;
+}
+
+/* Reads an a{sa{sv}} array listing the interfaces of one object. */
+static int proxy_add_interfaces(sd_bus_proxy *p, const char *path, sd_bus_message *m) {
+        int r;
+
+        assert(p);
+        assert(path);
+        assert(m);
+
+        r = sd_bus_message_enter_container(m, 'a', "{sa{sv}}");
+        if (r < 0)
+                return r;
+
+        while ((r = sd_bus_message_enter_container(m, 'e', "sa{sv}")) > 0) {
+                const char *interface;
+
+                r = sd_bus_message_read_basic(m, 's', &interface);
+                if (r < 0)
+                        return r;
+
+                r = proxy_add_interface(p, path, interface, m);
+                if (r < 0)
+                        return r;
+
+                r = sd_bus_message_exit_container(m);
+                if (r < 0)
+                        return r;
+        }
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_exit_container(m);
+}
+
+static bool proxy_accept_signal(sd_bus_proxy *p, sd_bus_message *m) {
+        assert(p);
+        assert(m);
+
+        /* Until the initial reply is in, it is the authoritative source and anything that arrives
+         * earlier describes an older state. */
+        if (!p->ready)
+                return false;
+
+        /* Matches on well-known names cannot be checked locally, since signals carry the unique name of
+         * the sender. Hence filter by the owner the initial reply came from. */
+        if (p->owner && m->sender && !streq(p->owner, m->sender))
+                return false;
+
+        /* The name is not owned by anyone right now, whatever claims to be it is not */
+        if (!p->owner && p->match_name_owner_changed)
+                return false;
+
+        return true;
+}
+
+static int proxy_property_fetch_callback(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        struct proxy_property *prop = userdata;
+        _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *p = sd_bus_proxy_ref(prop->proxy);
+        _cleanup_free_ char *path = NULL, *interface = NULL, *name = NULL;
+        struct proxy_interface *i;
+        int r;
+
+        assert(m);
+
+        prop->fetch = sd_bus_slot_unref(prop->fetch);
+
+        path = strdup(prop->path);
+        interface = strdup(prop->interface);
+        name = strdup(prop->name);
+        if (!path || !interface || !name)
+                return -ENOMEM;
+
+        i = proxy_find_interface(p, path, interface);
+        assert(i);
+
+        if (sd_bus_message_is_method_error(m, NULL)) {
+                log_debug_errno(sd_bus_message_get_errno(m),
+                                "Failed to refetch property %s of %s on %s, dropping: %s",
+                                name, interface, path, strna(sd_bus_message_get_error(m)->message));
+                proxy_property_free(hashmap_remove(i->properties, name));
+                return 0;
+        }
+
+        r = proxy_interface_set(p, i, path, name, m);
+        if (r < 0) {
+                log_debug_errno(r, "Failed to store property %s of %s on %s, dropping: %m", name, interface, path);
+                proxy_property_free(hashmap_remove(i->properties, name));
+                return 0;
+        }
+
+        proxy_call_handler(p, path, interface, STRV_MAKE(name));
+        return 0;
+}
+
+static int proxy_property_invalidate(sd_bus_proxy *p, struct proxy_interface *i, const char *path, const char *name) {
+        struct proxy_property *prop;
+        int r;
+
+        assert(p);
+        assert(i);
+        assert(name);
+
+        prop = hashmap_get(i->properties, name);
+        if (!prop)
+                return 0;
+
+        prop->value = sd_bus_message_unref(prop->value);
+        prop->fetch = sd_bus_slot_unref(prop->fetch);
+
+        r = bus_call_method_async_internal(
+                        p->bus,
+                        &prop->fetch,
+                        p->destination,
+                        path,
+                        "org.freedesktop.DBus.Properties",
+                        "Get",
+                        proxy_property_fetch_callback,
+                        prop,
+                        "ss", i->name, name);
+        if (r < 0) {
+                proxy_property_free(hashmap_remove(i->properties, name));
+                return r;
+        }
+
+        return 0;
+}
+
+static int proxy_properties_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *p = sd_bus_proxy_ref(userdata);
+        _cleanup_strv_free_ char **names = NULL, **invalidated = NULL;
+        struct proxy_interface *i;
+        const char *interface, *path;
+        char **n;
+        int r;
+
+        assert(m);
+        assert(p);
+
+        if (!proxy_accept_signal(p, m))
+                return 0;
+
+        path = sd_bus_message_get_path(m);
+
+        r = sd_bus_message_read_basic(m, 's', &interface);
+        if (r < 0)
+                return r;
+
+        /* Properties of interfaces we have not seen appear yet are picked up through InterfacesAdded. */
+        i = proxy_find_interface(p, path, interface);
+        if (!i)
+                return 0;
+
+        r = proxy_interface_read(p, i, path, m, &names);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(m, &invalidated);
+        if (r < 0)
+                return r;
+
+        STRV_FOREACH(n, invalidated) {
+                r = proxy_property_invalidate(p, i, path, *n);
+                if (r < 0)
+                        log_debug_errno(r, "Failed to refetch property %s of %s on %s, dropping: %m", *n, interface, path);
+
+                r = strv_extend(&names, *n);
+                if (r < 0)
+                        return r;
+        }
+
+        if (!strv_isempty(names))
+                proxy_call_handler(p, path, interface, names);
+
+        return 0;
+}
+
+static int proxy_interfaces_added(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *p = sd_bus_proxy_ref(userdata);
+        const char *path;
+        int r;
+
+        assert(m);
+        assert(p);
+
+        if (!proxy_accept_signal(p, m))
+                return 0;
+
+        r = sd_bus_message_read_basic(m, 'o', &path);
+        if (r < 0)
+                return r;
+
+        return proxy_add_interfaces(p, path, m);
+}
+
+static int proxy_interfaces_removed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *p = sd_bus_proxy_ref(userdata);
+        _cleanup_strv_free_ char **interfaces = NULL;
+        struct proxy_object *o;
+        const char *path;
+        char **i;
+        int r;
+
+        assert(m);
+        assert(p);
+
+        if (!proxy_accept_signal(p, m))
+                return 0;
+
+        r = sd_bus_message_read_basic(m, 'o', &path);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_strv(m, &interfaces);
+        if (r < 0)
+                return r;
+
+        o = hashmap_get(p->objects, path);
+        if (!o)
+                return 0;
+
+        STRV_FOREACH(i, interfaces) {
+                struct proxy_interface *x;
+
+                x = hashmap_remove(o->interfaces, *i);
+                if (!x)
+                        continue;
+
+                proxy_interface_free(x);
+                proxy_call_handler(p, path, *i, NULL);
+        }
+
+        proxy_remove_object_if_empty(p, path);
+        return 0;
+}
+
+static int proxy_fetch_callback(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *p = sd_bus_proxy_ref(userdata);
+        int r;
+
+        assert(m);
+        assert(p);
+
+        p->fetch = sd_bus_slot_unref(p->fetch);
+
+        if (sd_bus_message_is_method_error(m, NULL)) {
+                p->error = sd_bus_message_get_errno(m);
+                goto finish;
+        }
+
+        if (m->sender) {
+                r = free_and_strdup(&p->owner, m->sender);
+                if (r < 0) {
+                        p->error = r;
+                        goto finish;
+                }
+        }
+
+        /* The reply is authoritative, start from scratch */
+        proxy_flush(p);
+
+        if (p->interface)
+                r = proxy_add_interface(p, p->path, p->interface, m);
+        else {
+                r = sd_bus_message_enter_container(m, 'a', "{oa{sa{sv}}}");
+                while (r >= 0) {
+                        const char *path;
+
+                        r = sd_bus_message_enter_container(m, 'e', "oa{sa{sv}}");
+                        if (r <= 0)
+                                break;
+
+                        r = sd_bus_message_read_basic(m, 'o', &path);
+                        if (r < 0)
+                                break;
+
+                        r = proxy_add_interfaces(p, path, m);
+                        if (r < 0)
+                                break;
+
+                        r = sd_bus_message_exit_container(m);
+                }
+                if (r >= 0)
+                        r = sd_bus_message_exit_container(m);
+        }
+        if (r < 0) {
+                proxy_flush(p);
+                p->error = r;
+                goto finish;
+        }
+
+        p->ready = true;
+
+finish:
+        if (p->error < 0)
+                log_debug_errno(p->error, "Failed to fetch properties of %s: %m", p->path);
+
+        /* Tell the handler that the initial fetch is complete, whatever its outcome */
+        proxy_call_handler(p, NULL, NULL, NULL);
+        return 0;
+}
+
+static int proxy_fetch(sd_bus_proxy *p, const char *destination) {
+        assert(p);
+
+        p->fetch = sd_bus_slot_unref(p->fetch);
+
+        if (p->interface)
+                return bus_call_method_async_internal(
+                                p->bus,
+                                &p->fetch,
+                                destination,
+                                p->path,
+                                "org.freedesktop.DBus.Properties",
+                                "GetAll",
+                                proxy_fetch_callback,
+                                p,
+                                "s", p->interface);
+
+        return bus_call_method_async_internal(
+                        p->bus,
+                        &p->fetch,
+                        destination,
+                        p->path,
+                        "org.freedesktop.DBus.ObjectManager",
+                        "GetManagedObjects",
+                        proxy_fetch_callback,
+                        p,
+                        NULL);
+}
+
+/* Drops everything mirrored, telling the handler about each interface that goes away. */
+static void proxy_drop(sd_bus_proxy *p) {
+        struct proxy_object *o;
+
+        assert(p);
+
+        while ((o = hashmap_steal_first(p->objects))) {
+                struct proxy_interface *i;
+
+                while ((i = hashmap_steal_first(o->interfaces))) {
+                        proxy_call_handler(p, o->path, i->name, NULL);
+                        proxy_interface_free(i);
+                }
+
+                proxy_object_free(o);
+        }
+}
+
+static int proxy_name_owner_changed(sd_bus_message *m, void *userdata, sd_bus_error *ret_error) {
+        _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *p = sd_bus_proxy_ref(userdata);
+        const char *name, *old_owner, *new_owner;
+        int r;
+
+        assert(m);
+        assert(p);
+
+        r = sd_bus_message_read(m, "sss", &name, &old_owner, &new_owner);
+        if (r < 0)
+                return r;
+
+        if (isempty(new_owner))
+                new_owner = NULL;
+
+        if (streq_ptr(p->owner, new_owner))
+                return 0;
+
+        log_debug("Owner of %s changed from %s to %s, refetching.", name, strna(p->owner), strna(new_owner));
+
+        /* Whatever we learnt from the previous owner is stale now, including any fetch still in flight */
+        p->fetch = sd_bus_slot_unref(p->fetch);
+        proxy_drop(p);
+
+        r = free_and_strdup(&p->owner, new_owner);
+        if (r < 0) {
+                p->error = r;
+                p->ready = false;
+                return r;
+        }
+
+        p->error = 0;
+
+        /* Nobody owns the name, hence the mirror is complete while empty */
+        if (!new_owner) {
+                p->ready = true;
+                return 0;
+        }
+
+        /* Ask the new owner directly, so that the reply is known to come from it */
+        p->ready = false;
+        r = proxy_fetch(p, new_owner);
+        if (r < 0) {
+                p->error = r;
+                return r;
+        }
+
+        return 0;
+}
+
+static int proxy_add_match(sd_bus_proxy *p, sd_bus_slot **slot, const char *match, sd_bus_message_handler_t callback) {
+        assert(p);
+        assert(slot);
+        assert(match);
+
+        return sd_bus_add_match_async(p->bus, slot, match, callback, NULL, p);
+}
+
+_public_ int sd_bus_proxy_new(
+                sd_bus *bus,
+                sd_bus_proxy **ret,
+                const char *destination,
+                const char *path,
+                const char *interface,
+                sd_bus_proxy_handler_t handler,
+                void *userdata) {
+
+        _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *p = NULL;
+        const char *sender_match = "";
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(ret, -EINVAL);
+        assert_return(!destination || service_name_is_valid(destination), -EINVAL);
+        assert_return(object_path_is_valid(path), -EINVAL);
+        assert_return(!interface || interface_name_is_valid(interface), -EINVAL);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (!BUS_IS_OPEN(bus->state))
+                return -ENOTCONN;
+
+        p = new0(sd_bus_proxy, 1);
+        if (!p)
+                return -ENOMEM;
+
+        p->n_ref = 1;
+        p->bus = sd_bus_ref(bus);
+        p->handler = handler;
+        p->userdata = userdata;
+
+        p->path = strdup(path);
+        if (!p->path)
+                return -ENOMEM;
+
+        if (destination) {
+                p->destination = strdup(destination);
+                if (!p->destination)
+                        return -ENOMEM;
+
+                /* Only unique names can be matched on locally, see proxy_accept_signal() */
+                if (bus->bus_client && destination[0] == ':')
+                        sender_match = strjoina("sender='", destination, "',");
+        }
+
+        if (interface) {
+                p->interface = strdup(interface);
+                if (!p->interface)
+                        return -ENOMEM;
+
+                r = proxy_add_match(p, &p->match_properties_changed,
+                                    strjoina("type='signal',", sender_match,
+                                             "path='", path, "',"
+                                             "interface='org.freedesktop.DBus.Properties',"
+                                             "member='PropertiesChanged',"
+                                             "arg0='", interface, "'"),
+                                    proxy_properties_changed);
+                if (r < 0)
+                        return r;
+        } else {
+                r = proxy_add_match(p, &p->match_properties_changed,
+                                    strjoina("type='signal',", sender_match,
+                                             "path_namespace='", path, "',"
+                                             "interface='org.freedesktop.DBus.Properties',"
+                                             "member='PropertiesChanged'"),
+                                    proxy_properties_changed);
+                if (r < 0)
+                        return r;
+
+                r = proxy_add_match(p, &p->match_interfaces_added,
+                                    strjoina("type='signal',", sender_match,
+                                             "path='", path, "',"
+                                             "interface='org.freedesktop.DBus.ObjectManager',"
+                                             "member='InterfacesAdded'"),
+                                    proxy_interfaces_added);
+                if (r < 0)
+                        return r;
+
+                r = proxy_add_match(p, &p->match_interfaces_removed,
+                                    strjoina("type='signal',", sender_match,
+                                             "path='", path, "',"
+                                             "interface='org.freedesktop.DBus.ObjectManager',"
+                                             "member='InterfacesRemoved'"),
+                                    proxy_interfaces_removed);
+                if (r < 0)
+                        return r;
+        }
+
+        /* Follow the owner of the name, so that we start over whenever it is replaced */
+        if (destination && bus->bus_client) {
+                r = proxy_add_match(p, &p->match_name_owner_changed,
+                                    strjoina("type='signal',"
+                                             "sender='org.freedesktop.DBus',"
+                                             "path='/org/freedesktop/DBus',"
+                                             "interface='org.freedesktop.DBus',"
+                                             "member='NameOwnerChanged',"
+                                             "arg0='", destination, "'"),
+                                    proxy_name_owner_changed);
+                if (r < 0)
+                        return r;
+        }
+
+        r = proxy_fetch(p, destination);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(p);
+        return 0;
+}
+
+_public_ sd_bus* sd_bus_proxy_get_bus(sd_bus_proxy *p) {
+        assert_return(p, NULL);
+
+        return p->bus;
+}
+
+_public_ int sd_bus_proxy_is_ready(sd_bus_proxy *p) {
+        assert_return(p, -EINVAL);
+
+        if (p->error < 0)
+                return p->error;
+
+        return p->ready;
+}
+
+static int proxy_find_property(
+                sd_bus_proxy *p,
+                const char *path,
+                const char *interface,
+                const char *member,
+                sd_bus_message **ret) {
+
+        struct proxy_interface *i;
+        struct proxy_property *prop;
+
+        assert(p);
+        assert(member);
+        assert(ret);
+
+        if (p->error < 0)
+                return p->error;
+        if (!p->ready)
+                return -EAGAIN;
+
+        i = proxy_find_interface(p, path ?: p->path, interface ?: p->interface);
+        if (!i)
+                return -ENOENT;
+
+        prop = hashmap_get(i->properties, member);
+        if (!prop)
+                return -ENOENT;
+        if (!prop->value)
+                return -ENODATA;
+
+        *ret = prop->value;
+        return 0;
+}
+
+_public_ int sd_bus_proxy_get_property(
+                sd_bus_proxy *p,
+                const char *path,
+                const char *interface,
+                const char *member,
+                sd_bus_message **ret,
+                const char *type) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *copy = NULL;
+        sd_bus_message *v;
+        int r;
+
+        assert_return(p, -EINVAL);
+        assert_return(!path || object_path_is_valid(path), -EINVAL);
+        assert_return(interface ? interface_name_is_valid(interface) : !!p->interface, -EINVAL);
+        assert_return(member_name_is_valid(member), -EINVAL);
+        assert_return(ret, -EINVAL);
+        assert_return(signature_is_single(type, false), -EINVAL);
+
+        r = proxy_find_property(p, path, interface, member, &v);
+        if (r < 0)
+                return r;
+
+        /* Every caller gets a message of its own, so that nobody moves the read position of anybody else */
+        r = sd_bus_message_rewind(v, true);
+        if (r < 0)
+                return r;
+
+        r = proxy_copy_value(p, v, &copy);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_enter_container(copy, 'v', type);
+        if (r < 0)
+                return r;
+
+        *ret = TAKE_PTR(copy);
+        return 0;
+}
+
+_public_ int sd_bus_proxy_get_property_trivial(
+                sd_bus_proxy *p,
+                const char *path,
+                const char *interface,
+                const char *member,
+                char type, void *ptr) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *v = NULL;
+        int r;
+
+        assert_return(bus_type_is_trivial(type), -EINVAL);
+        assert_return(ptr, -EINVAL);
+
+        r = sd_bus_proxy_get_property(p, path, interface, member, &v, CHAR_TO_STR(type));
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_read_basic(v, type, ptr) < 0 ? -EBADMSG : 0;
+}
+
+_public_ int sd_bus_proxy_get_property_string(
+                sd_bus_proxy *p,
+                const char *path,
+                const char *interface,
+                const char *member,
+                char **ret) {
+
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *v = NULL;
+        const char *s;
+        char *n;
+        int r;
+
+        assert_return(ret, -EINVAL);
+
+        r = sd_bus_proxy_get_property(p, path, interface, member, &v, "s");
+        if (r < 0)
+                return r;
+
+        r = sd_bus_message_read_basic(v, 's', &s);
+        if (r < 0)
+                return r;
+
+        n = strdup(s);
+        if (!n)
+                return -ENOMEM;
+
+        *ret = n;
+        return 0;
+}
+
+_public_ int sd_bus_proxy_get_paths(sd_bus_proxy *p, char ***ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        struct proxy_object *o;
+        Iterator i;
+        int r;
+
+        assert_return(p, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        if (p->error < 0)
+                return p->error;
+        if (!p->ready)
+                return -EAGAIN;
+
+        HASHMAP_FOREACH(o, p->objects, i) {
+                r = strv_extend(&l, o->path);
+                if (r < 0)
+                        return r;
+        }
+
+        strv_sort(l);
+
+        *ret = l ? TAKE_PTR(l) : strv_new(NULL);
+        return *ret ? 0 : -ENOMEM;
+}
+
+_public_ int sd_bus_proxy_get_interfaces(sd_bus_proxy *p, const char *path, char ***ret) {
+        _cleanup_strv_free_ char **l = NULL;
+        struct proxy_interface *x;
+        struct proxy_object *o;
+        Iterator i;
+        int r;
+
+        assert_return(p, -EINVAL);
+        assert_return(!path || object_path_is_valid(path), -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        if (p->error < 0)
+                return p->error;
+        if (!p->ready)
+                return -EAGAIN;
+
+        o = hashmap_get(p->objects, path ?: p->path);
+        if (!o)
+                return -ENOENT;
+
+        HASHMAP_FOREACH(x, o->interfaces, i) {
+                r = strv_extend(&l, x->name);
+                if (r < 0)
+                        return r;
+        }
+
+        strv_sort(l);
+
+        *ret = l ? TAKE_PTR(l) : strv_new(NULL);
+        return *ret ? 0 : -ENOMEM;
+}
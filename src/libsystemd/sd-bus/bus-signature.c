@@ -1,11 +1,37 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <util.h>
 
 #include "sd-bus.h"
 
+#include "alloc-util.h"
+#include "bus-gvariant.h"
 #include "bus-signature.h"
 #include "bus-type.h"
+#include "hashmap.h"
+#include "wyhash.h"
+
+/* Only the signatures of local vtables are added to the table, those of messages are merely looked up, so that
+ * peers can't grow it. Vtables may be built at runtime though, hence still bound it. Once it's full, new
+ * signatures are simply parsed each time, as if there was no table. */
+#define SIGNATURE_INTERN_MAX 4096U
+
+/* Per-thread cache in front of the table, so that the common case takes neither the lock nor siphash */
+#define SIGNATURE_CACHE_SIZE 64U
+
+/* A signature found missing from the table, by hash. Only valid as long as nothing was added to the table
+ * since, i.e. while signatures_generation is unchanged. */
+struct signature_miss {
+        uint64_t hash;
+        unsigned generation;
+};
+
+static Hashmap *signatures = NULL;
+static pthread_mutex_t signatures_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned signatures_generation = 1; /* bumped with the mutex held, read without it */
+static thread_local const struct bus_signature *signature_cache[SIGNATURE_CACHE_SIZE] = {};
+static thread_local struct signature_miss signature_miss_cache[SIGNATURE_CACHE_SIZE] = {};
 
 static int signature_element_length_internal(
                 const char *s,
@@ -146,3 +172,160 @@ bool signature_is_valid(const char *s, bool allow_dict_entry) {
 
         return p - s <= 255;
 }
+
+static struct bus_signature *signature_new(const char *s, size_t l) {
+        struct bus_signature *sig;
+        size_t i;
+        char *p;
+
+        /* Everything in one allocation: the entry, the per-offset tables, and finally the string itself */
+        sig = malloc0(ALIGN(sizeof(struct bus_signature)) + l * (sizeof(int16_t) + 2) + l + 1);
+        if (!sig)
+                return NULL;
+
+        sig->element_size = (int16_t*) ((uint8_t*) sig + ALIGN(sizeof(struct bus_signature)));
+        sig->element_length = (uint8_t*) (sig->element_size + l);
+        sig->element_alignment = sig->element_length + l;
+        p = (char*) (sig->element_alignment + l);
+        sig->string = memcpy(p, s, l + 1);
+        sig->length = l;
+
+        sig->valid_strict = signature_is_valid(s, false);
+        sig->single = signature_is_single(s, true);
+        sig->single_strict = signature_is_single(s, false);
+        sig->pair = signature_is_pair(s);
+        sig->gvariant_alignment = bus_gvariant_get_alignment(s);
+        sig->gvariant_size = bus_gvariant_get_size(s);
+
+        for (i = 0; i < l; i++) {
+                size_t n;
+
+                if (signature_element_length(s + i, &n) < 0)
+                        sig->element_size[i] = -EINVAL;
+                else {
+                        char t[n+1];
+
+                        memcpy(t, s + i, n);
+                        t[n] = 0;
+
+                        sig->element_length[i] = n;
+                        sig->element_alignment[i] = bus_gvariant_get_alignment(t);
+                        sig->element_size[i] = bus_gvariant_get_size(t);
+                }
+        }
+
+        return sig;
+}
+
+static const struct bus_signature *signature_add(const char *s, size_t l) {
+        struct bus_signature *sig;
+
+        /* Must be called with the mutex held */
+
+        sig = hashmap_get(signatures, s);
+        if (sig)
+                return sig;
+
+        if (hashmap_size(signatures) >= SIGNATURE_INTERN_MAX)
+                return NULL;
+
+        if (!signature_is_valid(s, true))
+                return NULL;
+
+        if (hashmap_ensure_allocated(&signatures, &string_hash_ops) < 0)
+                return NULL;
+
+        sig = signature_new(s, l);
+        if (!sig)
+                return NULL;
+
+        if (hashmap_put(signatures, sig->string, sig) < 0)
+                return mfree(sig);
+
+        __atomic_add_fetch(&signatures_generation, 1, __ATOMIC_RELEASE);
+
+        return sig;
+}
+
+const struct bus_signature *bus_signature_intern(const char *s) {
+        const struct bus_signature *sig;
+        size_t i, l;
+
+        if (!s)
+                return NULL;
+
+        l = strlen(s);
+        if (l > 255)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&signatures_mutex) == 0);
+
+        sig = signature_add(s, l);
+
+        /* Containers are entered with their contents as signature, hence add those too */
+        for (i = 0; sig && i < l; i++) {
+                char t[256];
+                size_t n;
+
+                n = sig->element_length[i];
+                if (s[i] == SD_BUS_TYPE_ARRAY && n > 1)
+                        n -= 1;
+                else if (IN_SET(s[i], SD_BUS_TYPE_STRUCT_BEGIN, SD_BUS_TYPE_DICT_ENTRY_BEGIN) && n > 2)
+                        n -= 2;
+                else
+                        continue;
+
+                memcpy(t, s + i + 1, n);
+                t[n] = 0;
+
+                (void) signature_add(t, n);
+        }
+
+        assert_se(pthread_mutex_unlock(&signatures_mutex) == 0);
+
+        return sig;
+}
+
+const struct bus_signature *bus_signature_lookup(const char *s) {
+        const struct bus_signature **slot, *sig;
+        struct signature_miss *miss;
+        unsigned generation;
+        uint64_t h;
+        size_t l;
+
+        if (!s)
+                return NULL;
+
+        l = strlen(s);
+        if (l > 255)
+                return NULL;
+
+        h = wyhash(s, l, 0);
+
+        slot = signature_cache + h % SIGNATURE_CACHE_SIZE;
+        sig = *slot;
+        if (sig && sig->length == l && memcmp(sig->string, s, l) == 0)
+                return sig;
+
+        /* Peers may send signatures we never interned over and over, remember those too. A hash collision
+         * merely makes the caller parse the signature itself. The generation is read before looking at the
+         * table, so that a signature added concurrently invalidates what we remember below. */
+        generation = __atomic_load_n(&signatures_generation, __ATOMIC_ACQUIRE);
+        miss = signature_miss_cache + h % SIGNATURE_CACHE_SIZE;
+        if (miss->hash == h && miss->generation == generation)
+                return NULL;
+
+        assert_se(pthread_mutex_lock(&signatures_mutex) == 0);
+        sig = hashmap_get(signatures, s);
+        assert_se(pthread_mutex_unlock(&signatures_mutex) == 0);
+
+        if (sig)
+                *slot = sig;
+        else
+                *miss = (struct signature_miss) {
+                        .hash = h,
+                        .generation = generation,
+                };
+
+        return sig;
+}
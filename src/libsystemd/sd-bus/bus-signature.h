@@ -2,6 +2,34 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stdint.h>
+
+/* A signature from the per-process intern table, together with everything we'd otherwise keep re-deriving from
+ * it while appending or reading messages. Entries are immutable and never freed, hence may be referenced from
+ * anywhere, by any thread. Only the signatures of local vtables are interned, messages look theirs up. */
+struct bus_signature {
+        const char *string;
+        size_t length;
+
+        /* signature_is_valid(string, true) holds for every entry */
+        bool valid_strict:1;  /* signature_is_valid(string, false) */
+        bool single:1;        /* signature_is_single(string, true) */
+        bool single_strict:1; /* signature_is_single(string, false) */
+        bool pair:1;          /* signature_is_pair(string) */
+
+        /* gvariant alignment of the whole signature, and its size, or -EINVAL if it's not of fixed size */
+        int gvariant_alignment;
+        int gvariant_size;
+
+        /* For each offset into the signature: the length of the complete type starting there, or 0 if none does,
+         * and the gvariant alignment and size of that type, the latter -EINVAL if not of fixed size */
+        uint8_t *element_length;
+        uint8_t *element_alignment;
+        int16_t *element_size;
+};
+
+const struct bus_signature *bus_signature_intern(const char *s);
+const struct bus_signature *bus_signature_lookup(const char *s);
 
 bool signature_is_single(const char *s, bool allow_dict_entry);
 bool signature_is_pair(const char *s);
@@ -4,6 +4,7 @@
 
 #include "alloc-util.h"
 #include "bus-control.h"
+#include "bus-message.h"
 #include "bus-objects.h"
 #include "bus-slot.h"
 #include "string-util.h"
@@ -83,7 +84,7 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
                 if (slot->node_callback.node) {
                         LIST_REMOVE(callbacks, slot->node_callback.node->callbacks, &slot->node_callback);
-                        slot->bus->nodes_modified = true;
+                        bus_node_modified(slot->bus, slot->node_callback.node);
 
                         bus_node_gc(slot->bus, slot->node_callback.node);
                 }
@@ -94,7 +95,7 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
                 if (slot->node_enumerator.node) {
                         LIST_REMOVE(enumerators, slot->node_enumerator.node->enumerators, &slot->node_enumerator);
-                        slot->bus->nodes_modified = true;
+                        bus_node_modified(slot->bus, slot->node_enumerator.node);
 
                         bus_node_gc(slot->bus, slot->node_enumerator.node);
                 }
@@ -105,7 +106,7 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
                 if (slot->node_object_manager.node) {
                         LIST_REMOVE(object_managers, slot->node_object_manager.node->object_managers, &slot->node_object_manager);
-                        slot->bus->nodes_modified = true;
+                        bus_node_modified(slot->bus, slot->node_object_manager.node);
 
                         bus_node_gc(slot->bus, slot->node_object_manager.node);
                 }
@@ -114,46 +115,13 @@ void bus_slot_disconnect(sd_bus_slot *slot, bool unref) {
 
         case BUS_NODE_VTABLE:
 
-                if (slot->node_vtable.node && slot->node_vtable.interface && slot->node_vtable.vtable) {
-                        const sd_bus_vtable *v;
-
-                        for (v = slot->node_vtable.vtable; v->type != _SD_BUS_VTABLE_END; v++) {
-                                struct vtable_member *x = NULL;
-
-                                switch (v->type) {
-
-                                case _SD_BUS_VTABLE_METHOD: {
-                                        struct vtable_member key;
-
-                                        key.path = slot->node_vtable.node->path;
-                                        key.interface = slot->node_vtable.interface;
-                                        key.member = v->x.method.member;
-
-                                        x = hashmap_remove(slot->bus->vtable_methods, &key);
-                                        break;
-                                }
-
-                                case _SD_BUS_VTABLE_PROPERTY:
-                                case _SD_BUS_VTABLE_WRITABLE_PROPERTY: {
-                                        struct vtable_member key;
-
-                                        key.path = slot->node_vtable.node->path;
-                                        key.interface = slot->node_vtable.interface;
-                                        key.member = v->x.method.member;
-
-                                        x = hashmap_remove(slot->bus->vtable_properties, &key);
-                                        break;
-                                }}
-
-                                free(x);
-                        }
-                }
+                bus_node_vtable_done(&slot->node_vtable);
 
                 slot->node_vtable.interface = mfree(slot->node_vtable.interface);
 
                 if (slot->node_vtable.node) {
                         LIST_REMOVE(vtables, slot->node_vtable.node->vtables, &slot->node_vtable);
-                        slot->bus->nodes_modified = true;
+                        bus_node_modified(slot->bus, slot->node_vtable.node);
 
                         bus_node_gc(slot->bus, slot->node_vtable.node);
                 }
@@ -185,11 +153,76 @@ static sd_bus_slot* bus_slot_free(sd_bus_slot *slot) {
                 slot->destroy_callback(slot->userdata);
 
         free(slot->description);
+        free(slot->latency);
         return mfree(slot);
 }
 
 DEFINE_PUBLIC_TRIVIAL_REF_UNREF_FUNC(sd_bus_slot, sd_bus_slot, bus_slot_free);
 
+static void bus_latency_record(sd_bus_latency **latency, usec_t d, int r) {
+        sd_bus_latency *l;
+
+        if (!*latency) {
+                /* Timing is best effort, if we can't allocate, this call simply isn't counted */
+                *latency = new0(sd_bus_latency, 1);
+                if (!*latency)
+                        return;
+        }
+
+        l = *latency;
+
+        l->calls++;
+        if (r < 0)
+                l->errors++;
+        l->usec_total += d;
+        l->usec_max = MAX(l->usec_max, d);
+        l->buckets[d == 0 ? 0 : MIN(64U - __builtin_clzll(d), SD_BUS_LATENCY_BUCKETS - 1)]++;
+}
+
+static void bus_slot_report_slow(sd_bus *bus, sd_bus_slot *slot, sd_bus_message *m, usec_t d) {
+        const char *description = NULL;
+        int r;
+
+        /* This is only called after the callback returned, we have no way to interrupt a callback that is
+         * stuck. m is NULL if the callback didn't run on behalf of a message, e.g. a property getter invoked
+         * while emitting a signal. */
+        bus->stats.slow_callbacks++;
+
+        if (bus->slow_callback) {
+                r = bus->slow_callback(slot, m, d, bus->slow_callback_userdata);
+                if (r < 0)
+                        log_debug_errno(r, "Slow callback handler failed, ignoring: %m");
+                return;
+        }
+
+        (void) sd_bus_slot_get_description(slot, &description);
+        log_debug("Callback %s for path=%s interface=%s member=%s took %" PRIu64 "us",
+                  strna(description),
+                  strna(m ? m->path : NULL), strna(m ? m->interface : NULL), strna(m ? m->member : NULL),
+                  d);
+}
+
+/* Vtable methods are timed individually and bring their own counters, everything else is counted on the slot */
+void bus_latency_end(sd_bus *bus, sd_bus_slot *slot, sd_bus_latency **latency, sd_bus_message *m, usec_t begin, int r) {
+        usec_t d;
+
+        assert(slot);
+        assert(latency);
+
+        if (begin == 0)
+                return;
+
+        assert(bus);
+
+        d = usec_sub_unsigned(now(CLOCK_MONOTONIC), begin);
+
+        if (bus->slot_latency)
+                bus_latency_record(latency, d, r);
+
+        if (d >= bus->slow_callback_usec)
+                bus_slot_report_slow(bus, slot, m, d);
+}
+
 _public_ sd_bus* sd_bus_slot_get_bus(sd_bus_slot *slot) {
         assert_return(slot, NULL);
 
@@ -229,6 +262,56 @@ _public_ int sd_bus_slot_get_destroy_callback(sd_bus_slot *slot, sd_bus_destroy_
         return !!slot->destroy_callback;
 }
 
+static void latency_copy(const sd_bus_latency *latency, sd_bus_latency *ret, size_t size) {
+        sd_bus_latency l = {};
+
+        if (latency)
+                l = *latency;
+
+        /* Same as sd_bus_get_stats(): older callers get the beginning of the structure, newer ones zeroes */
+        memcpy(ret, &l, MIN(size, sizeof(l)));
+        if (size > sizeof(l))
+                memzero((uint8_t*) ret + sizeof(l), size - sizeof(l));
+}
+
+_public_ int sd_bus_slot_get_latency(sd_bus_slot *slot, sd_bus_latency *ret, size_t size) {
+        assert_return(slot, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        latency_copy(slot->latency, ret, size);
+        return 0;
+}
+
+_public_ int sd_bus_slot_get_method_latency(sd_bus_slot *slot, const char *member, sd_bus_latency *ret, size_t size) {
+        struct vtable_member *v;
+
+        assert_return(slot, -EINVAL);
+        assert_return(slot->type == BUS_NODE_VTABLE, -EINVAL);
+        assert_return(member_name_is_valid(member), -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        v = bus_node_vtable_find_method(&slot->node_vtable, member);
+        if (!v)
+                return -ENOENT;
+
+        latency_copy(v->latency, ret, size);
+        return 0;
+}
+
+_public_ int sd_bus_slot_reset_latency(sd_bus_slot *slot) {
+        unsigned i;
+
+        assert_return(slot, -EINVAL);
+
+        slot->latency = mfree(slot->latency);
+
+        if (slot->type == BUS_NODE_VTABLE)
+                for (i = 0; i < slot->node_vtable.methods.n_members; i++)
+                        slot->node_vtable.methods.members[i].latency = mfree(slot->node_vtable.methods.members[i].latency);
+
+        return 0;
+}
+
 _public_ sd_bus_message *sd_bus_slot_get_current_message(sd_bus_slot *slot) {
         assert_return(slot, NULL);
         assert_return(slot->type >= 0, NULL);
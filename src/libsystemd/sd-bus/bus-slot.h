@@ -8,3 +8,14 @@
 sd_bus_slot *bus_slot_allocate(sd_bus *bus, bool floating, BusSlotType type, size_t extra, void *userdata);
 
 void bus_slot_disconnect(sd_bus_slot *slot, bool unref);
+
+static inline usec_t bus_slot_latency_begin(sd_bus *bus) {
+        /* 0 if neither timing nor the slow callback watchdog is on, which bus_slot_latency_end() then ignores */
+        return bus && (bus->slot_latency || bus->slow_callback_usec != USEC_INFINITY) ? now(CLOCK_MONOTONIC) : 0;
+}
+
+void bus_latency_end(sd_bus *bus, sd_bus_slot *slot, sd_bus_latency **latency, sd_bus_message *m, usec_t begin, int r);
+
+static inline void bus_slot_latency_end(sd_bus *bus, sd_bus_slot *slot, sd_bus_message *m, usec_t begin, int r) {
+        bus_latency_end(bus, slot, &slot->latency, m, begin, r);
+}
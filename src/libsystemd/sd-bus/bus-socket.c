@@ -10,6 +10,7 @@
 #include "alloc-util.h"
 #include "bus-internal.h"
 #include "bus-message.h"
+#include "bus-probe.h"
 #include "bus-socket.h"
 #include "fd-util.h"
 #include "hexdecoct.h"
@@ -22,6 +23,10 @@
 
 #define SNDBUF_SIZE (8*1024*1024)
 
+/* How many iovecs to hand to a single sendmsg() at most when writing out several queued messages at once. The
+ * kernel accepts up to 1024, but there's little to gain from more than a handful of messages per call. */
+#define WRITE_BATCH_IOVEC_MAX 64U
+
 static void iovec_advance(struct iovec iov[], unsigned *idx, size_t size) {
 
         while (size > 0) {
@@ -786,51 +791,84 @@ int bus_socket_take_fd(sd_bus *b) {
         return bus_socket_start_auth(b);
 }
 
-int bus_socket_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+int bus_socket_write_message(sd_bus *bus, sd_bus_message **m, unsigned n, size_t *idx) {
         struct iovec *iov;
+        size_t size;
         ssize_t k;
-        size_t n;
-        unsigned j;
+        unsigned i, j, n_iovec = 0;
         int r;
 
         assert(bus);
         assert(m);
+        assert(n > 0);
         assert(idx);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        /* Writes as much of the messages as possible with a single sendmsg(). *idx is the position in their
+         * concatenation, hence always points into the first message. */
+
+        if (*idx >= BUS_MESSAGE_SIZE(m[0]))
                 return 0;
 
-        r = bus_message_setup_iovec(m);
-        if (r < 0)
-                return r;
+        for (i = 0; i < n; i++) {
+                /* File descriptors are attached to the first byte of what we send, hence a message carrying
+                 * some can only start a batch */
+                if (i > 0 && m[i]->n_fds > 0)
+                        break;
+
+                r = bus_message_setup_iovec(m[i]);
+                if (r < 0) {
+                        if (i == 0)
+                                return r;
+
+                        /* We'll get to it when it's first in line */
+                        break;
+                }
 
-        n = m->n_iovec * sizeof(struct iovec);
-        iov = alloca(n);
-        memcpy_safe(iov, m->iovec, n);
+                if (i > 0 && n_iovec + m[i]->n_iovec > WRITE_BATCH_IOVEC_MAX)
+                        break;
+
+                n_iovec += m[i]->n_iovec;
+        }
+        n = i;
+
+        iov = newa(struct iovec, n_iovec);
+        for (i = 0, j = 0; i < n; j += m[i]->n_iovec, i++)
+                memcpy(iov + j, m[i]->iovec, m[i]->n_iovec * sizeof(struct iovec));
 
         j = 0;
         iovec_advance(iov, &j, *idx);
 
         struct msghdr mh = {
-                .msg_iov = iov,
-                .msg_iovlen = m->n_iovec,
+                .msg_iov = iov + j,
+                .msg_iovlen = n_iovec - j,
         };
 
-        if (m->n_fds > 0 && *idx == 0) {
+        if (m[0]->n_fds > 0 && *idx == 0) {
                 struct cmsghdr *control;
 
-                mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * m->n_fds));
-                mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m->n_fds);
+                mh.msg_control = control = alloca(CMSG_SPACE(sizeof(int) * m[0]->n_fds));
+                mh.msg_controllen = control->cmsg_len = CMSG_LEN(sizeof(int) * m[0]->n_fds);
                 control->cmsg_level = SOL_SOCKET;
                 control->cmsg_type = SCM_RIGHTS;
-                memcpy(CMSG_DATA(control), m->fds, sizeof(int) * m->n_fds);
+                memcpy(CMSG_DATA(control), m[0]->fds, sizeof(int) * m[0]->n_fds);
         }
 
         k = sendmsg(bus->output_fd, &mh, MSG_DONTWAIT|MSG_NOSIGNAL);
+        bus->stats.write_calls++;
 
-        if (k < 0)
-                return errno == EAGAIN ? 0 : -errno;
+        if (k < 0) {
+                if (errno != EAGAIN)
+                        return -errno;
+
+                bus->stats.write_eagain++;
+                return 0;
+        }
+
+        for (i = 0, size = 0; i < n; i++)
+                size += BUS_MESSAGE_SIZE(m[i]);
+        if (*idx + (size_t) k < size)
+                bus->stats.partial_writes++;
 
         *idx += (size_t) k;
         return 1;
@@ -890,6 +928,8 @@ static int bus_socket_read_message_need(sd_bus *bus, size_t *need) {
 
 static int bus_socket_make_message(sd_bus *bus, size_t size) {
         sd_bus_message *t;
+        uint8_t header_type, type;
+        bool shed, full;
         void *b;
         int r;
 
@@ -897,9 +937,18 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         assert(bus->rbuffer_size >= size);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        r = bus_rqueue_make_room(bus);
-        if (r < 0)
+        BUS_PROBE_READ(bus, size);
+
+        /* Room in the queue is made before the message is taken off the buffer, so that it isn't lost if that
+         * fails. A message that might be shed doesn't need the room though, a full queue sheds it rather than
+         * refusing to read on. Anything else is left in the buffer until there is room. */
+        header_type = ((const struct bus_header*) bus->rbuffer)->type;
+        shed = bus_rqueue_may_shed(bus, header_type);
+
+        r = bus_rqueue_make_room(bus, header_type, size);
+        if (r < 0 && !(shed && r == -ENOBUFS))
                 return r;
+        full = r < 0;
 
         if (bus->rbuffer_size > size) {
                 b = memdup((const uint8_t*) bus->rbuffer + size,
@@ -925,7 +974,23 @@ static int bus_socket_make_message(sd_bus *bus, size_t size) {
         bus->fds = NULL;
         bus->n_fds = 0;
 
-        bus->rqueue[bus->rqueue_size++] = t;
+        BUS_PROBE_MESSAGE(message_parsed, t);
+
+        type = t->header->type < _SD_BUS_MESSAGE_TYPE_MAX ? t->header->type : _SD_BUS_MESSAGE_TYPE_INVALID;
+        bus->stats.messages_received[type]++;
+        bus->stats.bytes_received[type] += size;
+
+        if (shed) {
+                r = bus_rqueue_shed(bus, t, full);
+                if (r != 0) {
+                        sd_bus_message_unref(t);
+                        return r < 0 ? r : 1;
+                }
+        }
+
+        /* Shedding is decided by type, a message we found no room for was shed above */
+        assert(!full);
+        bus_rqueue_append(bus, t);
 
         return 1;
 }
@@ -968,8 +1033,14 @@ int bus_socket_read_message(sd_bus *bus) {
         mh.msg_controllen = sizeof(control);
 
         k = recvmsg(bus->input_fd, &mh, MSG_DONTWAIT|MSG_CMSG_CLOEXEC);
-        if (k < 0)
-                return errno == EAGAIN ? 0 : -errno;
+        bus->stats.read_calls++;
+        if (k < 0) {
+                if (errno != EAGAIN)
+                        return -errno;
+
+                bus->stats.read_eagain++;
+                return 0;
+        }
         if (k == 0)
                 return -ECONNRESET;
 
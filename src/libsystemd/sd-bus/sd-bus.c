@@ -10,10 +10,12 @@
 
 #include "alloc-util.h"
 #include "bus-control.h"
+#include "bus-creds.h"
 #include "bus-internal.h"
 #include "bus-label.h"
 #include "bus-message.h"
 #include "bus-objects.h"
+#include "bus-probe.h"
 #include "bus-slot.h"
 #include "bus-socket.h"
 #include "bus-track.h"
@@ -43,7 +45,8 @@
                           strna(_mm->error.message));                    \
         } while (false)
 
-static int bus_poll(sd_bus *bus, bool need_more, uint64_t timeout_usec);
+static int bus_poll(sd_bus *bus, bool need_more, bool need_write, uint64_t timeout_usec);
+static void bus_rqueue_insert(sd_bus *bus, unsigned i, sd_bus_message *m);
 
 static thread_local sd_bus *default_system_bus = NULL;
 static thread_local sd_bus *default_user_bus = NULL;
@@ -116,12 +119,19 @@ static void bus_reset_queues(sd_bus *b) {
 
         b->rqueue = mfree(b->rqueue);
         b->rqueue_allocated = 0;
+        b->rqueue_bytes = 0;
+        b->rqueue_changed = 0;
 
-        while (b->wqueue_size > 0)
-                sd_bus_message_unref(b->wqueue[--b->wqueue_size]);
+        while (b->wqueue_size > 0) {
+                b->wqueue[--b->wqueue_size]->deadline = 0;
+                sd_bus_message_unref(b->wqueue[b->wqueue_size]);
+        }
 
         b->wqueue = mfree(b->wqueue);
         b->wqueue_allocated = 0;
+        b->wqueue_bytes = 0;
+        b->wqueue_deadline_next = USEC_INFINITY;
+        b->write_blocked = b->write_drained = false;
 }
 
 static sd_bus* bus_free(sd_bus *b) {
@@ -133,6 +143,9 @@ static sd_bus* bus_free(sd_bus *b) {
 
         b->state = BUS_CLOSED;
 
+        /* Only a weak reference, the slot is freed along with the others below */
+        b->name_owner_slot = NULL;
+
         while ((s = b->slots)) {
                 /* At this point only floating slots can still be
                  * around, because the non-floating ones keep a
@@ -171,11 +184,12 @@ static sd_bus* bus_free(sd_bus *b) {
         assert(b->match_callbacks.type == BUS_MATCH_ROOT);
         bus_match_free(&b->match_callbacks);
 
-        hashmap_free_free(b->vtable_methods);
-        hashmap_free_free(b->vtable_properties);
-
         assert(hashmap_isempty(b->nodes));
         hashmap_free(b->nodes);
+        bus_property_cache_free(b);
+        bus_properties_changed_discard(b);
+        bus_creds_cache_flush(b);
+        bus_name_owner_cache_flush(b);
 
         bus_flush_memfd(b);
 
@@ -205,6 +219,14 @@ _public_ int sd_bus_new(sd_bus **ret) {
                 .original_pid = getpid_cached(),
                 .n_groups = (size_t) -1,
                 .close_on_exit = true,
+                .rqueue_bytes_max = BUS_RQUEUE_SIZE_MAX,
+                .rqueue_shed_size = SIZE_MAX,
+                .rqueue_shed_bytes = SIZE_MAX,
+                .wqueue_bytes_max = BUS_WQUEUE_SIZE_MAX,
+                .wqueue_watermark_low = SIZE_MAX,
+                .wqueue_watermark_high = SIZE_MAX,
+                .wqueue_deadline_next = USEC_INFINITY,
+                .slow_callback_usec = USEC_INFINITY,
         };
 
         assert_se(pthread_mutex_init(&b->memfd_cache_mutex, NULL) == 0);
@@ -331,6 +353,16 @@ _public_ int sd_bus_set_trusted(sd_bus *bus, int b) {
         return 0;
 }
 
+_public_ int sd_bus_set_trusted_wire(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(bus->state == BUS_UNSET, -EPERM);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->trusted_wire = !!b;
+        return 0;
+}
+
 _public_ int sd_bus_set_description(sd_bus *bus, const char *description) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -424,14 +456,12 @@ static int synthesize_connected_signal(sd_bus *bus) {
         if (r < 0)
                 return r;
 
-        r = bus_rqueue_make_room(bus);
+        r = bus_rqueue_make_room(bus, m->header->type, BUS_MESSAGE_SIZE(m));
         if (r < 0)
                 return r;
 
-        /* Insert at the very front */
-        memmove(bus->rqueue + 1, bus->rqueue, sizeof(sd_bus_message*) * bus->rqueue_size);
-        bus->rqueue[0] = TAKE_PTR(m);
-        bus->rqueue_size++;
+        /* Account for it like for any other message, but insert at the very front */
+        bus_rqueue_insert(bus, 0, TAKE_PTR(m));
 
         return 0;
 }
@@ -513,12 +543,13 @@ static int bus_send_hello(sd_bus *bus) {
         if (r < 0)
                 return r;
 
-        return sd_bus_call_async(bus, NULL, m, hello_callback, NULL, 0);
+        return bus_call_async_internal(bus, NULL, m, hello_callback, NULL, 0, false);
 }
 
 int bus_start_running(sd_bus *bus) {
         struct reply_callback *c;
         Iterator i;
+        unsigned j;
         usec_t n;
         int r;
 
@@ -537,6 +568,14 @@ int bus_start_running(sd_bus *bus) {
                 c->timeout_usec = usec_add(n, c->timeout_usec);
         }
 
+        /* Same for the calls waiting in the write queue */
+        for (j = 0; j < bus->wqueue_size; j++)
+                if (bus->wqueue[j]->deadline != 0)
+                        bus->wqueue[j]->deadline = usec_add(n, bus->wqueue[j]->deadline);
+
+        if (bus->wqueue_deadline_next != USEC_INFINITY)
+                bus->wqueue_deadline_next = usec_add(n, bus->wqueue_deadline_next);
+
         if (bus->bus_client) {
                 bus_set_state(bus, BUS_HELLO);
                 return 1;
@@ -1264,17 +1303,37 @@ int bus_seal_synthetic_message(sd_bus *b, sd_bus_message *m) {
         return sd_bus_message_seal(m, 0xFFFFFFFFULL, 0);
 }
 
-static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
+static int bus_write_message(sd_bus *bus, sd_bus_message **messages, unsigned n, size_t *idx) {
+        size_t before, end = 0;
+        unsigned i;
         int r;
 
         assert(bus);
-        assert(m);
+        assert(messages);
 
-        r = bus_socket_write_message(bus, m, idx);
+        before = *idx;
+
+        r = bus_socket_write_message(bus, messages, n, idx);
         if (r <= 0)
                 return r;
 
-        if (*idx >= BUS_MESSAGE_SIZE(m))
+        /* Log and count every message this write completed */
+        for (i = 0; i < n; i++) {
+                sd_bus_message *m = messages[i];
+                uint8_t type;
+
+                end += BUS_MESSAGE_SIZE(m);
+                if (end > *idx)
+                        break;
+                if (end <= before)
+                        continue;
+
+                BUS_PROBE_MESSAGE(message_written, m);
+
+                type = m->header->type < _SD_BUS_MESSAGE_TYPE_MAX ? m->header->type : _SD_BUS_MESSAGE_TYPE_INVALID;
+                bus->stats.messages_sent[type]++;
+                bus->stats.bytes_sent[type] += BUS_MESSAGE_SIZE(m);
+
                 log_debug("Sent message type=%s sender=%s destination=%s path=%s interface=%s member=%s cookie=%" PRIu64 " reply_cookie=%" PRIu64 " signature=%s error-name=%s error-message=%s",
                           bus_message_type_to_string(m->header->type),
                           strna(sd_bus_message_get_sender(m)),
@@ -1287,40 +1346,112 @@ static int bus_write_message(sd_bus *bus, sd_bus_message *m, size_t *idx) {
                           strna(m->root_container.signature),
                           strna(m->error.name),
                           strna(m->error.message));
+        }
 
         return r;
 }
 
+static void bus_update_write_blocked(sd_bus *bus) {
+        assert(bus);
+
+        /* Once the queue grew beyond the high watermark producers are told to back off, until it drained
+         * to the low watermark again. The drained callback is then invoked from sd_bus_process(), so that
+         * it doesn't run in the middle of whatever happened to write the queue out. */
+        if (!bus->write_blocked) {
+                if (bus->wqueue_bytes > bus->wqueue_watermark_high)
+                        bus->write_blocked = true;
+        } else if (bus->wqueue_bytes <= bus->wqueue_watermark_low) {
+                bus->write_blocked = false;
+                bus->write_drained = true;
+        }
+}
+
+static int bus_wqueue_drop_expired(sd_bus *bus) {
+        usec_t n, next = USEC_INFINITY;
+        unsigned i, j;
+        int ret = 0;
+
+        assert(bus);
+
+        if (bus->wqueue_deadline_next == USEC_INFINITY)
+                return 0;
+
+        n = now(CLOCK_MONOTONIC);
+        if (n < bus->wqueue_deadline_next)
+                return 0;
+
+        /* Calls whose caller gave up already would only keep the peer busy for nothing, hence don't send
+         * them at all. The first message might be partially written already however, and has to be
+         * completed. */
+        for (i = j = bus->windex > 0; i < bus->wqueue_size; i++) {
+                sd_bus_message *m = bus->wqueue[i];
+
+                if (m->deadline != 0) {
+                        if (m->deadline <= n) {
+                                log_debug("Dropping expired method call cookie=%" PRIu64 " member=%s",
+                                          BUS_MESSAGE_COOKIE(m), strna(m->member));
+
+                                bus->wqueue_bytes -= BUS_MESSAGE_SIZE(m);
+                                bus->wqueue_n_expired++;
+                                bus->stats.expired_writes++;
+                                m->deadline = 0;
+                                sd_bus_message_unref(m);
+                                ret = 1;
+                                continue;
+                        }
+
+                        next = MIN(next, m->deadline);
+                }
+
+                bus->wqueue[j++] = m;
+        }
+
+        bus->wqueue_size = j;
+        bus->wqueue_deadline_next = next;
+
+        if (ret > 0)
+                bus_update_write_blocked(bus);
+
+        return ret;
+}
+
 static int dispatch_wqueue(sd_bus *bus) {
-        int r, ret = 0;
+        int r, ret;
 
         assert(bus);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
+        ret = bus_wqueue_drop_expired(bus);
+
         while (bus->wqueue_size > 0) {
+                unsigned n = 0;
 
-                r = bus_write_message(bus, bus->wqueue[0], &bus->windex);
+                r = bus_write_message(bus, bus->wqueue, bus->wqueue_size, &bus->windex);
                 if (r < 0)
                         return r;
                 else if (r == 0)
                         /* Didn't do anything this time */
                         return ret;
-                else if (bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[0])) {
-                        /* Fully written. Let's drop the entry from
-                         * the queue.
-                         *
-                         * This isn't particularly optimized, but
-                         * well, this is supposed to be our worst-case
-                         * buffer only, and the socket buffer is
-                         * supposed to be our primary buffer, and if
-                         * it got full, then all bets are off
-                         * anyway. */
-
-                        bus->wqueue_size--;
-                        sd_bus_message_unref(bus->wqueue[0]);
-                        memmove(bus->wqueue, bus->wqueue + 1, sizeof(sd_bus_message*) * bus->wqueue_size);
-                        bus->windex = 0;
 
+                /* Drop whatever was fully written from the queue.
+                 *
+                 * This isn't particularly optimized, but well, this
+                 * is supposed to be our worst-case buffer only, and
+                 * the socket buffer is supposed to be our primary
+                 * buffer, and if it got full, then all bets are off
+                 * anyway. */
+                while (n < bus->wqueue_size && bus->windex >= BUS_MESSAGE_SIZE(bus->wqueue[n])) {
+                        bus->windex -= BUS_MESSAGE_SIZE(bus->wqueue[n]);
+                        bus->wqueue_bytes -= BUS_MESSAGE_SIZE(bus->wqueue[n]);
+                        bus->wqueue[n]->deadline = 0;
+                        sd_bus_message_unref(bus->wqueue[n]);
+                        n++;
+                }
+
+                if (n > 0) {
+                        bus->wqueue_size -= n;
+                        memmove(bus->wqueue, bus->wqueue + n, sizeof(sd_bus_message*) * bus->wqueue_size);
+                        bus_update_write_blocked(bus);
                         ret = 1;
                 }
         }
@@ -1328,47 +1459,182 @@ static int dispatch_wqueue(sd_bus *bus) {
         return ret;
 }
 
+static bool bus_write_corked(sd_bus *bus) {
+        assert(bus);
+
+        return bus->cork || bus->auto_corked;
+}
+
 static int bus_read_message(sd_bus *bus, bool hint_priority, int64_t priority) {
         assert(bus);
 
         return bus_socket_read_message(bus);
 }
 
-int bus_rqueue_make_room(sd_bus *bus) {
+int bus_rqueue_make_room(sd_bus *bus, uint8_t type, size_t size) {
         assert(bus);
 
         if (bus->rqueue_size >= BUS_RQUEUE_MAX)
                 return -ENOBUFS;
 
+        /* Replies are let past the byte limit, since somebody is waiting for them and they would otherwise
+         * be stuck behind whatever filled up the queue */
+        if (bus->rqueue_size > 0 &&
+            !IN_SET(type, SD_BUS_MESSAGE_METHOD_RETURN, SD_BUS_MESSAGE_METHOD_ERROR) &&
+            size > bus->rqueue_bytes_max - MIN(bus->rqueue_bytes, bus->rqueue_bytes_max))
+                return -ENOBUFS;
+
         if (!GREEDY_REALLOC(bus->rqueue, bus->rqueue_allocated, bus->rqueue_size + 1))
                 return -ENOMEM;
 
         return 0;
 }
 
+static bool bus_rqueue_shedding(sd_bus *bus) {
+        assert(bus);
+
+        if (bus->rqueue_size < bus->rqueue_shed_size && bus->rqueue_bytes < bus->rqueue_shed_bytes)
+                return false;
+
+        return bus->state == BUS_RUNNING;
+}
+
+bool bus_rqueue_may_shed(sd_bus *bus, uint8_t type) {
+        assert(bus);
+
+        /* While the read queue is backed up beyond the threshold, incoming calls are answered right away
+         * with an error instead of being queued, and signals are dropped. The handler picks which, by
+         * default all calls are shed and all signals kept. Replies are never shed, they are what we are
+         * waiting for. This only looks at the type, so that it can be decided before the message is taken
+         * off the socket whether it needs room in the queue. */
+
+        if (!bus_rqueue_shedding(bus))
+                return false;
+
+        if (type == SD_BUS_MESSAGE_SIGNAL)
+                return !!bus->shed_callback;
+
+        return type == SD_BUS_MESSAGE_METHOD_CALL;
+}
+
+int bus_rqueue_shed(sd_bus *bus, sd_bus_message *m, bool full) {
+        int r;
+
+        assert(bus);
+        assert(m);
+
+        /* If the queue is full, a message the handler would rather keep is shed anyway, since it could not
+         * be queued */
+
+        if (!bus_rqueue_may_shed(bus, m->header->type))
+                return 0;
+
+        if (bus->shed_callback) {
+                r = bus->shed_callback(m, bus->shed_userdata);
+                if (r < 0)
+                        log_debug_errno(r, "Shed callback failed, queueing message: %m");
+                if (r <= 0 && !full)
+                        return 0;
+        }
+
+        bus->rqueue_n_shed++;
+        bus->stats.shed_reads++;
+
+        if (m->header->type == SD_BUS_MESSAGE_METHOD_CALL) {
+                log_debug("Shedding method call sender=%s interface=%s member=%s",
+                          strna(m->sender), strna(m->interface), strna(m->member));
+
+                r = sd_bus_reply_method_error(
+                                m,
+                                &SD_BUS_ERROR_MAKE_CONST(SD_BUS_ERROR_LIMITS_EXCEEDED, "Too many queued messages, try again later."));
+                if (r == -ECONNRESET)
+                        return r;
+                if (r < 0)
+                        log_debug_errno(r, "Failed to reply to shed method call, ignoring: %m");
+        }
+
+        return 1;
+}
+
+static void bus_rqueue_insert(sd_bus *bus, unsigned i, sd_bus_message *m) {
+        assert(bus);
+        assert(m);
+        assert(i <= bus->rqueue_size);
+        assert(bus->rqueue_size < bus->rqueue_allocated);
+
+        /* Takes over the reference */
+        memmove(bus->rqueue + i + 1, bus->rqueue + i, sizeof(sd_bus_message*) * (bus->rqueue_size - i));
+        bus->rqueue[i] = m;
+        bus->rqueue_size++;
+        bus->rqueue_changed = MIN(bus->rqueue_changed, i);
+        bus->stats.rqueue_peak = MAX(bus->stats.rqueue_peak, (uint64_t) bus->rqueue_size);
+        bus->rqueue_bytes += BUS_MESSAGE_SIZE(m);
+        bus->rqueue_bytes_high = MAX(bus->rqueue_bytes_high, bus->rqueue_bytes);
+        bus->stats.rqueue_bytes_peak = MAX(bus->stats.rqueue_bytes_peak, (uint64_t) bus->rqueue_bytes);
+}
+
+void bus_rqueue_append(sd_bus *bus, sd_bus_message *m) {
+        unsigned i;
+
+        assert(bus);
+        assert(m);
+
+        /* The queue is kept sorted by priority, and in order of arrival within the same priority. Usually
+         * everything has the same priority, and this doesn't need to look further than the last entry. */
+        i = bus->rqueue_size;
+        while (i > 0 && bus->rqueue[i-1]->priority > m->priority)
+                i--;
+
+        bus_name_owner_cache_queued(bus, m);
+        bus_rqueue_insert(bus, i, m);
+}
+
+static sd_bus_message *bus_rqueue_take(sd_bus *bus, unsigned i) {
+        sd_bus_message *m;
+
+        assert(bus);
+        assert(i < bus->rqueue_size);
+
+        m = bus->rqueue[i];
+        memmove(bus->rqueue + i, bus->rqueue + i + 1, sizeof(sd_bus_message*) * (bus->rqueue_size - i - 1));
+        bus->rqueue_size--;
+        bus->rqueue_changed = MIN(bus->rqueue_changed, i);
+        bus->rqueue_bytes -= BUS_MESSAGE_SIZE(m);
+
+        return m;
+}
+
 static int dispatch_rqueue(sd_bus *bus, bool hint_priority, int64_t priority, sd_bus_message **m) {
+        bool full;
         int r, ret = 0;
 
         assert(bus);
         assert(m);
         assert(IN_SET(bus->state, BUS_RUNNING, BUS_HELLO));
 
-        /* Note that the priority logic is only available on kdbus,
-         * where the rqueue is unused. We check the rqueue here
-         * anyway, because it's simple... */
+        /* The rqueue is sorted by priority, hence the first entry is the most urgent one. If only messages up
+         * to some priority shall be dispatched, the others are left queued, and we read further until the
+         * queue is full. */
 
         for (;;) {
-                if (bus->rqueue_size > 0) {
+                if (bus->rqueue_size > 0 && (!hint_priority || bus->rqueue[0]->priority <= priority)) {
                         /* Dispatch a queued message */
 
-                        *m = bus->rqueue[0];
-                        bus->rqueue_size--;
-                        memmove(bus->rqueue, bus->rqueue + 1, sizeof(sd_bus_message*) * bus->rqueue_size);
+                        *m = bus_rqueue_take(bus, 0);
                         return 1;
                 }
 
+                /* Once the queue is full, we only read on if what comes next might be shed, or, if only the
+                 * byte limit is reached, be a reply. If it turns out it is neither, it is left unread. */
+                full = bus->rqueue_size > 0 &&
+                        (bus->rqueue_size >= BUS_RQUEUE_MAX || bus->rqueue_bytes >= bus->rqueue_bytes_max);
+                if (bus->rqueue_size >= BUS_RQUEUE_MAX && !bus_rqueue_shedding(bus))
+                        return ret;
+
                 /* Try to read a new message */
                 r = bus_read_message(bus, hint_priority, priority);
+                if (r == -ENOBUFS && full)
+                        return ret;
                 if (r < 0)
                         return r;
                 if (r == 0)
@@ -1378,7 +1644,7 @@ static int dispatch_rqueue(sd_bus *bus, bool hint_priority, int64_t priority, sd
         }
 }
 
-_public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
+int bus_send_internal(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie, usec_t deadline, bool throttle) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = sd_bus_message_ref(_m);
         int r;
 
@@ -1400,6 +1666,12 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
                         return -EOPNOTSUPP;
         }
 
+        /* Above the write watermark new calls and signals of the application would only pile up further.
+         * Replies are still queued, the peer is waiting for them and they don't lead to more traffic. */
+        if (throttle && bus->write_blocked &&
+            !IN_SET(m->header->type, SD_BUS_MESSAGE_METHOD_RETURN, SD_BUS_MESSAGE_METHOD_ERROR))
+                return -EAGAIN;
+
         /* If the cookie number isn't kept, then we know that no reply
          * is expected */
         if (!cookie && !m->sealed)
@@ -1420,10 +1692,10 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
         if (m->dont_send)
                 goto finish;
 
-        if (IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) && bus->wqueue_size <= 0) {
+        if (IN_SET(bus->state, BUS_RUNNING, BUS_HELLO) && bus->wqueue_size <= 0 && !bus_write_corked(bus)) {
                 size_t idx = 0;
 
-                r = bus_write_message(bus, m, &idx);
+                r = bus_write_message(bus, &m, 1, &idx);
                 if (r < 0) {
                         if (IN_SET(r, -ENOTCONN, -ECONNRESET, -EPIPE, -ESHUTDOWN)) {
                                 bus_enter_closing(bus);
@@ -1439,21 +1711,70 @@ _public_ int sd_bus_send(sd_bus *bus, sd_bus_message *_m, uint64_t *cookie) {
                          * of the wqueue array is always allocated so
                          * that we always can remember how much was
                          * written. */
+                        BUS_PROBE_MESSAGE(message_enqueued, m);
+
                         bus->wqueue[0] = sd_bus_message_ref(m);
                         bus->wqueue_size = 1;
+                        bus->stats.wqueue_peak = MAX(bus->stats.wqueue_peak, 1U);
+                        bus->wqueue_bytes = BUS_MESSAGE_SIZE(m);
+                        bus->wqueue_bytes_high = MAX(bus->wqueue_bytes_high, bus->wqueue_bytes);
+                        bus->stats.wqueue_bytes_peak = MAX(bus->stats.wqueue_bytes_peak, (uint64_t) bus->wqueue_bytes);
                         bus->windex = idx;
+                        bus_update_write_blocked(bus);
                 }
 
         } else {
+                unsigned i;
+
                 /* Just append it to the queue. */
 
                 if (bus->wqueue_size >= BUS_WQUEUE_MAX)
                         return -ENOBUFS;
 
+                if (bus->wqueue_size > 0 &&
+                    BUS_MESSAGE_SIZE(m) > bus->wqueue_bytes_max - MIN(bus->wqueue_bytes, bus->wqueue_bytes_max))
+                        return -ENOBUFS;
+
                 if (!GREEDY_REALLOC(bus->wqueue, bus->wqueue_allocated, bus->wqueue_size + 1))
                         return -ENOMEM;
 
-                bus->wqueue[bus->wqueue_size++] = sd_bus_message_ref(m);
+                /* Let it overtake anything of a less urgent priority. A partially written message stays
+                 * first of course, and nothing is reordered before we said Hello. */
+                i = bus->wqueue_size;
+                if (bus->state == BUS_RUNNING)
+                        while (i > (bus->windex > 0) && bus->wqueue[i-1]->priority > m->priority)
+                                i--;
+
+                BUS_PROBE_MESSAGE(message_enqueued, m);
+
+                memmove(bus->wqueue + i + 1, bus->wqueue + i, sizeof(sd_bus_message*) * (bus->wqueue_size - i));
+                bus->wqueue[i] = sd_bus_message_ref(m);
+                bus->wqueue_size++;
+                bus->stats.wqueue_peak = MAX(bus->stats.wqueue_peak, (uint64_t) bus->wqueue_size);
+                bus->wqueue_bytes += BUS_MESSAGE_SIZE(m);
+                bus->wqueue_bytes_high = MAX(bus->wqueue_bytes_high, bus->wqueue_bytes);
+                bus->stats.wqueue_bytes_peak = MAX(bus->stats.wqueue_bytes_peak, (uint64_t) bus->wqueue_bytes);
+                bus_update_write_blocked(bus);
+
+                m->deadline = deadline;
+                if (m->deadline != 0)
+                        bus->wqueue_deadline_next = MIN(bus->wqueue_deadline_next, m->deadline);
+
+                /* While corked, write out once enough has piled up to be worth it anyway */
+                if (bus_write_corked(bus) &&
+                    bus->wqueue_bytes >= BUS_CORK_SIZE_MAX &&
+                    IN_SET(bus->state, BUS_RUNNING, BUS_HELLO)) {
+
+                        r = dispatch_wqueue(bus);
+                        if (r < 0) {
+                                if (IN_SET(r, -ENOTCONN, -ECONNRESET, -EPIPE, -ESHUTDOWN)) {
+                                        bus_enter_closing(bus);
+                                        return -ECONNRESET;
+                                }
+
+                                return r;
+                        }
+                }
         }
 
 finish:
@@ -1463,6 +1784,10 @@ finish:
         return 1;
 }
 
+_public_ int sd_bus_send(sd_bus *bus, sd_bus_message *m, uint64_t *cookie) {
+        return bus_send_internal(bus, m, cookie, 0, true);
+}
+
 _public_ int sd_bus_send_to(sd_bus *bus, sd_bus_message *m, const char *destination, uint64_t *cookie) {
         int r;
 
@@ -1517,13 +1842,14 @@ static int timeout_compare(const void *a, const void *b) {
         return CMP(x->timeout_usec, y->timeout_usec);
 }
 
-_public_ int sd_bus_call_async(
+int bus_call_async_internal(
                 sd_bus *bus,
                 sd_bus_slot **slot,
                 sd_bus_message *_m,
                 sd_bus_message_handler_t callback,
                 void *userdata,
-                uint64_t usec) {
+                uint64_t usec,
+                bool throttle) {
 
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = sd_bus_message_ref(_m);
         _cleanup_(sd_bus_slot_unrefp) sd_bus_slot *s = NULL;
@@ -1545,7 +1871,7 @@ _public_ int sd_bus_call_async(
         if (!callback && !slot && !m->sealed)
                 m->header->flags |= BUS_MESSAGE_NO_REPLY_EXPECTED;
 
-        r = ordered_hashmap_ensure_allocated(&bus->reply_callbacks, &uint64_hash_ops);
+        r = ordered_hashmap_ensure_allocated(&bus->reply_callbacks, &trusted_uint64_hash_ops);
         if (r < 0)
                 return r;
 
@@ -1585,7 +1911,7 @@ _public_ int sd_bus_call_async(
                 }
         }
 
-        r = sd_bus_send(bus, m, s ? &s->reply_callback.cookie : NULL);
+        r = bus_send_internal(bus, m, s ? &s->reply_callback.cookie : NULL, s ? s->reply_callback.timeout_usec : 0, throttle);
         if (r < 0)
                 return r;
 
@@ -1596,6 +1922,17 @@ _public_ int sd_bus_call_async(
         return r;
 }
 
+_public_ int sd_bus_call_async(
+                sd_bus *bus,
+                sd_bus_slot **slot,
+                sd_bus_message *m,
+                sd_bus_message_handler_t callback,
+                void *userdata,
+                uint64_t usec) {
+
+        return bus_call_async_internal(bus, slot, m, callback, userdata, usec, true);
+}
+
 int bus_ensure_running(sd_bus *bus) {
         int r;
 
@@ -1621,58 +1958,28 @@ int bus_ensure_running(sd_bus *bus) {
         }
 }
 
-_public_ int sd_bus_call(
+/* Waits for the reply to the specified cookie. Everything else read meanwhile is left in the rqueue. The
+ * whole queue is searched each time, since the reply is sorted in by priority and might end up in front of
+ * messages that were already queued when the call was sent. */
+static int bus_wait_for_reply(
                 sd_bus *bus,
-                sd_bus_message *_m,
-                uint64_t usec,
+                uint64_t cookie,
+                usec_t timeout,
                 sd_bus_error *error,
                 sd_bus_message **reply) {
 
-        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = sd_bus_message_ref(_m);
-        usec_t timeout;
-        uint64_t cookie;
-        unsigned i;
+        unsigned i = 0;
         int r;
 
-        bus_assert_return(m, -EINVAL, error);
-        bus_assert_return(m->header->type == SD_BUS_MESSAGE_METHOD_CALL, -EINVAL, error);
-        bus_assert_return(!(m->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED), -EINVAL, error);
-        bus_assert_return(!bus_error_is_dirty(error), -EINVAL, error);
-
-        if (!bus)
-                bus = m->bus;
-
-        bus_assert_return(!bus_pid_changed(bus), -ECHILD, error);
-
-        if (!BUS_IS_OPEN(bus->state)) {
-                r = -ENOTCONN;
-                goto fail;
-        }
-
-        r = bus_ensure_running(bus);
-        if (r < 0)
-                goto fail;
-
-        i = bus->rqueue_size;
-
-        r = bus_seal_message(bus, m, usec);
-        if (r < 0)
-                goto fail;
-
-        r = bus_remarshal_message(bus, &m);
-        if (r < 0)
-                goto fail;
-
-        r = sd_bus_send(bus, m, &cookie);
-        if (r < 0)
-                goto fail;
-
-        timeout = calc_elapse(bus, m->timeout);
-
         for (;;) {
                 usec_t left;
 
-                while (i < bus->rqueue_size) {
+                /* Only look at what changed since the last pass. New messages are usually appended, but a
+                 * higher priority puts them further up. */
+                i = MIN(i, bus->rqueue_changed);
+                bus->rqueue_changed = UINT_MAX;
+
+                for (; i < bus->rqueue_size; i++) {
                         sd_bus_message *incoming = NULL;
 
                         incoming = bus->rqueue[i];
@@ -1680,8 +1987,7 @@ _public_ int sd_bus_call(
                         if (incoming->reply_cookie == cookie) {
                                 /* Found a match! */
 
-                                memmove(bus->rqueue + i, bus->rqueue + i + 1, sizeof(sd_bus_message*) * (bus->rqueue_size - i - 1));
-                                bus->rqueue_size--;
+                                bus_rqueue_take(bus, i);
                                 log_debug_bus_message(incoming);
 
                                 if (incoming->header->type == SD_BUS_MESSAGE_METHOD_RETURN) {
@@ -1713,8 +2019,7 @@ _public_ int sd_bus_call(
                                    incoming->sender &&
                                    streq(bus->unique_name, incoming->sender)) {
 
-                                memmove(bus->rqueue + i, bus->rqueue + i + 1, sizeof(sd_bus_message*) * (bus->rqueue_size - i - 1));
-                                bus->rqueue_size--;
+                                bus_rqueue_take(bus, i);
 
                                 /* Our own message? Somebody is trying
                                  * to send its own client a message,
@@ -1725,9 +2030,6 @@ _public_ int sd_bus_call(
                                 r = -ELOOP;
                                 goto fail;
                         }
-
-                        /* Try to read more, right-away */
-                        i++;
                 }
 
                 r = bus_read_message(bus, false, 0);
@@ -1747,6 +2049,7 @@ _public_ int sd_bus_call(
 
                         n = now(CLOCK_MONOTONIC);
                         if (n >= timeout) {
+                                bus->stats.reply_timeouts++;
                                 r = -ETIMEDOUT;
                                 goto fail;
                         }
@@ -1755,10 +2058,11 @@ _public_ int sd_bus_call(
                 } else
                         left = (uint64_t) -1;
 
-                r = bus_poll(bus, true, left);
+                r = bus_poll(bus, true, true, left);
                 if (r < 0)
                         goto fail;
                 if (r == 0) {
+                        bus->stats.reply_timeouts++;
                         r = -ETIMEDOUT;
                         goto fail;
                 }
@@ -1778,52 +2082,171 @@ fail:
         return sd_bus_error_set_errno(error, r);
 }
 
-_public_ int sd_bus_get_fd(sd_bus *bus) {
+_public_ int sd_bus_call(
+                sd_bus *bus,
+                sd_bus_message *_m,
+                uint64_t usec,
+                sd_bus_error *error,
+                sd_bus_message **reply) {
 
-        assert_return(bus, -EINVAL);
-        assert_return(bus = bus_resolve(bus), -ENOPKG);
-        assert_return(bus->input_fd == bus->output_fd, -EPERM);
-        assert_return(!bus_pid_changed(bus), -ECHILD);
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = sd_bus_message_ref(_m);
+        usec_t timeout;
+        uint64_t cookie;
+        int r;
 
-        if (bus->state == BUS_CLOSED)
-                return -ENOTCONN;
+        bus_assert_return(m, -EINVAL, error);
+        bus_assert_return(m->header->type == SD_BUS_MESSAGE_METHOD_CALL, -EINVAL, error);
+        bus_assert_return(!(m->header->flags & BUS_MESSAGE_NO_REPLY_EXPECTED), -EINVAL, error);
+        bus_assert_return(!bus_error_is_dirty(error), -EINVAL, error);
 
-        if (bus->input_fd >= 0)
-                return bus->input_fd;
+        if (!bus)
+                bus = m->bus;
 
-        return -ENOTCONN;
-}
+        bus_assert_return(!bus_pid_changed(bus), -ECHILD, error);
 
-_public_ int sd_bus_get_events(sd_bus *bus) {
-        int flags = 0;
+        if (!BUS_IS_OPEN(bus->state)) {
+                r = -ENOTCONN;
+                goto fail;
+        }
 
-        assert_return(bus, -EINVAL);
-        assert_return(bus = bus_resolve(bus), -ENOPKG);
-        assert_return(!bus_pid_changed(bus), -ECHILD);
+        r = bus_ensure_running(bus);
+        if (r < 0)
+                goto fail;
 
-        switch (bus->state) {
+        r = bus_seal_message(bus, m, usec);
+        if (r < 0)
+                goto fail;
 
-        case BUS_UNSET:
-        case BUS_CLOSED:
-                return -ENOTCONN;
+        r = bus_remarshal_message(bus, &m);
+        if (r < 0)
+                goto fail;
 
-        case BUS_OPENING:
-                flags |= POLLOUT;
-                break;
+        timeout = calc_elapse(bus, m->timeout);
 
-        case BUS_AUTHENTICATING:
-                if (bus_socket_auth_needs_write(bus))
-                        flags |= POLLOUT;
+        /* Not held back by the write watermark, we are going to wait for the queue to be written anyway */
+        r = bus_send_internal(bus, m, &cookie, timeout, false);
+        if (r < 0)
+                goto fail;
 
-                flags |= POLLIN;
-                break;
+        return bus_wait_for_reply(bus, cookie, timeout, error, reply);
 
-        case BUS_RUNNING:
-        case BUS_HELLO:
-                if (bus->rqueue_size <= 0)
-                        flags |= POLLIN;
-                if (bus->wqueue_size > 0)
-                        flags |= POLLOUT;
+fail:
+        return sd_bus_error_set_errno(error, r);
+}
+
+int bus_call_many(
+                sd_bus *bus,
+                sd_bus_message **m,
+                size_t n,
+                sd_bus_error *errors,
+                sd_bus_message **replies,
+                int *results) {
+
+        uint64_t *cookies;
+        usec_t *deadlines;
+        size_t j;
+        int r;
+
+        assert(bus);
+        assert(m || n == 0);
+        assert(errors || n == 0);
+        assert(replies || n == 0);
+        assert(results || n == 0);
+
+        /* Like sd_bus_call(), but sends all calls first, and only then collects the replies, so that the
+         * round trips overlap. The outcome of each call is stored in results[], the function itself only
+         * fails if the calls could not be sent or the connection broke. */
+
+        if (!BUS_IS_OPEN(bus->state))
+                return -ENOTCONN;
+
+        r = bus_ensure_running(bus);
+        if (r < 0)
+                return r;
+
+        cookies = newa(uint64_t, n);
+        deadlines = newa(usec_t, n);
+
+        for (j = 0; j < n; j++) {
+                assert(m[j]->header->type == SD_BUS_MESSAGE_METHOD_CALL);
+
+                r = bus_seal_message(bus, m[j], 0);
+                if (r < 0)
+                        return r;
+
+                r = bus_remarshal_message(bus, &m[j]);
+                if (r < 0)
+                        return r;
+
+                deadlines[j] = calc_elapse(bus, m[j]->timeout);
+
+                r = bus_send_internal(bus, m[j], &cookies[j], deadlines[j], false);
+                if (r < 0)
+                        return r;
+        }
+
+        for (j = 0; j < n; j++) {
+                r = bus_wait_for_reply(bus, cookies[j], deadlines[j], &errors[j], &replies[j]);
+                results[j] = r;
+
+                /* If the connection is gone, there's no point in waiting for the rest */
+                if (IN_SET(r, -ECONNRESET, -ENOTCONN)) {
+                        for (j++; j < n; j++)
+                                results[j] = r;
+
+                        return r;
+                }
+        }
+
+        return 0;
+}
+
+_public_ int sd_bus_get_fd(sd_bus *bus) {
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(bus->input_fd == bus->output_fd, -EPERM);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (bus->state == BUS_CLOSED)
+                return -ENOTCONN;
+
+        if (bus->input_fd >= 0)
+                return bus->input_fd;
+
+        return -ENOTCONN;
+}
+
+_public_ int sd_bus_get_events(sd_bus *bus) {
+        int flags = 0;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        switch (bus->state) {
+
+        case BUS_UNSET:
+        case BUS_CLOSED:
+                return -ENOTCONN;
+
+        case BUS_OPENING:
+                flags |= POLLOUT;
+                break;
+
+        case BUS_AUTHENTICATING:
+                if (bus_socket_auth_needs_write(bus))
+                        flags |= POLLOUT;
+
+                flags |= POLLIN;
+                break;
+
+        case BUS_RUNNING:
+        case BUS_HELLO:
+                if (bus->rqueue_size <= 0)
+                        flags |= POLLIN;
+                if (bus->wqueue_size > 0 && !bus->cork)
+                        flags |= POLLOUT;
                 break;
 
         case BUS_CLOSING:
@@ -1838,6 +2261,7 @@ _public_ int sd_bus_get_events(sd_bus *bus) {
 
 _public_ int sd_bus_get_timeout(sd_bus *bus, uint64_t *timeout_usec) {
         struct reply_callback *c;
+        usec_t until;
 
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -1847,7 +2271,7 @@ _public_ int sd_bus_get_timeout(sd_bus *bus, uint64_t *timeout_usec) {
         if (!BUS_IS_OPEN(bus->state) && bus->state != BUS_CLOSING)
                 return -ENOTCONN;
 
-        if (bus->track_queue) {
+        if (bus->track_queue || bus->write_drained) {
                 *timeout_usec = 0;
                 return 1;
         }
@@ -1865,18 +2289,19 @@ _public_ int sd_bus_get_timeout(sd_bus *bus, uint64_t *timeout_usec) {
                         return 1;
                 }
 
+                /* Deferred PropertiesChanged signals need to be sent at some point, too */
+                until = bus_properties_changed_next(bus);
+
                 c = prioq_peek(bus->reply_callbacks_prioq);
-                if (!c) {
-                        *timeout_usec = (uint64_t) -1;
-                        return 0;
-                }
+                if (c && c->timeout_usec != 0)
+                        until = MIN(until, c->timeout_usec);
 
-                if (c->timeout_usec == 0) {
+                if (until == USEC_INFINITY) {
                         *timeout_usec = (uint64_t) -1;
                         return 0;
                 }
 
-                *timeout_usec = c->timeout_usec;
+                *timeout_usec = until;
                 return 1;
 
         case BUS_CLOSING:
@@ -1898,7 +2323,7 @@ static int process_timeout(sd_bus *bus) {
         struct reply_callback *c;
         sd_bus_slot *slot;
         bool is_hello;
-        usec_t n;
+        usec_t begin, n;
         int r;
 
         assert(bus);
@@ -1926,6 +2351,7 @@ static int process_timeout(sd_bus *bus) {
 
         assert_se(prioq_pop(bus->reply_callbacks_prioq) == c);
         c->timeout_usec = 0;
+        bus->stats.reply_timeouts++;
 
         ordered_hashmap_remove(bus->reply_callbacks, &c->cookie);
         c->cookie = 0;
@@ -1940,7 +2366,11 @@ static int process_timeout(sd_bus *bus) {
         bus->current_slot = sd_bus_slot_ref(slot);
         bus->current_handler = c->callback;
         bus->current_userdata = slot->userdata;
+        BUS_PROBE_MESSAGE(dispatch_reply, m);
+        begin = bus_slot_latency_begin(bus);
         r = c->callback(m, slot->userdata, &error_buffer);
+        bus_slot_latency_end(bus, slot, m, begin, r);
+        BUS_PROBE_HANDLER_RETURN(m, r);
         bus->current_userdata = NULL;
         bus->current_handler = NULL;
         bus->current_slot = NULL;
@@ -1986,6 +2416,7 @@ static int process_reply(sd_bus *bus, sd_bus_message *m) {
         struct reply_callback *c;
         sd_bus_slot *slot;
         bool is_hello;
+        usec_t begin;
         int r;
 
         assert(bus);
@@ -2044,7 +2475,11 @@ static int process_reply(sd_bus *bus, sd_bus_message *m) {
         bus->current_slot = sd_bus_slot_ref(slot);
         bus->current_handler = c->callback;
         bus->current_userdata = slot->userdata;
+        BUS_PROBE_MESSAGE(dispatch_reply, m);
+        begin = bus_slot_latency_begin(bus);
         r = c->callback(m, slot->userdata, &error_buffer);
+        bus_slot_latency_end(bus, slot, m, begin, r);
+        BUS_PROBE_HANDLER_RETURN(m, r);
         bus->current_userdata = NULL;
         bus->current_handler = NULL;
         bus->current_slot = NULL;
@@ -2075,6 +2510,7 @@ static int process_filter(sd_bus *bus, sd_bus_message *m) {
 
                 LIST_FOREACH(callbacks, l, bus->filter_callbacks) {
                         sd_bus_slot *slot;
+                        usec_t begin;
 
                         if (bus->filter_callbacks_modified)
                                 break;
@@ -2094,7 +2530,11 @@ static int process_filter(sd_bus *bus, sd_bus_message *m) {
                         bus->current_slot = sd_bus_slot_ref(slot);
                         bus->current_handler = l->callback;
                         bus->current_userdata = slot->userdata;
+                        BUS_PROBE_MESSAGE(dispatch_filter, m);
+                        begin = bus_slot_latency_begin(bus);
                         r = l->callback(m, slot->userdata, &error_buffer);
+                        bus_slot_latency_end(bus, slot, m, begin, r);
+                        BUS_PROBE_HANDLER_RETURN(m, r);
                         bus->current_userdata = NULL;
                         bus->current_handler = NULL;
                         bus->current_slot = sd_bus_slot_unref(slot);
@@ -2260,6 +2700,32 @@ static int dispatch_track(sd_bus *bus) {
         return 1;
 }
 
+static int dispatch_write_drained(sd_bus *bus) {
+        int r;
+
+        assert(bus);
+
+        if (!bus->write_drained)
+                return 0;
+
+        bus->write_drained = false;
+
+        if (!bus->write_drained_callback)
+                return 0;
+
+        r = bus->write_drained_callback(bus, bus->write_drained_userdata);
+        if (r < 0)
+                log_debug_errno(r, "Write drained callback failed, ignoring: %m");
+
+        return 1;
+}
+
+static int dispatch_properties_changed(sd_bus *bus) {
+        assert(bus);
+
+        return bus_properties_changed_dispatch(bus, false);
+}
+
 static int process_running(sd_bus *bus, bool hint_priority, int64_t priority, sd_bus_message **ret) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         int r;
@@ -2271,7 +2737,13 @@ static int process_running(sd_bus *bus, bool hint_priority, int64_t priority, sd
         if (r != 0)
                 goto null_message;
 
-        r = dispatch_wqueue(bus);
+        if (!bus->cork) {
+                r = dispatch_wqueue(bus);
+                if (r != 0)
+                        goto null_message;
+        }
+
+        r = dispatch_write_drained(bus);
         if (r != 0)
                 goto null_message;
 
@@ -2279,6 +2751,10 @@ static int process_running(sd_bus *bus, bool hint_priority, int64_t priority, sd
         if (r != 0)
                 goto null_message;
 
+        r = dispatch_properties_changed(bus);
+        if (r != 0)
+                goto null_message;
+
         r = dispatch_rqueue(bus, hint_priority, priority, &m);
         if (r < 0)
                 return r;
@@ -2349,6 +2825,7 @@ static int process_closing_reply_callback(sd_bus *bus, struct reply_callback *c)
         _cleanup_(sd_bus_error_free) sd_bus_error error_buffer = SD_BUS_ERROR_NULL;
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
         sd_bus_slot *slot;
+        usec_t begin;
         int r;
 
         assert(bus);
@@ -2382,7 +2859,11 @@ static int process_closing_reply_callback(sd_bus *bus, struct reply_callback *c)
         bus->current_slot = sd_bus_slot_ref(slot);
         bus->current_handler = c->callback;
         bus->current_userdata = slot->userdata;
+        BUS_PROBE_MESSAGE(dispatch_reply, m);
+        begin = bus_slot_latency_begin(bus);
         r = c->callback(m, slot->userdata, &error_buffer);
+        bus_slot_latency_end(bus, slot, m, begin, r);
+        BUS_PROBE_HANDLER_RETURN(m, r);
         bus->current_userdata = NULL;
         bus->current_handler = NULL;
         bus->current_slot = NULL;
@@ -2495,7 +2976,23 @@ static int bus_process_internal(sd_bus *bus, bool hint_priority, int64_t priorit
 
         case BUS_RUNNING:
         case BUS_HELLO:
+                /* In auto-cork mode whatever the callbacks send is held back, and written out in one go
+                 * once they are done */
+                bus->auto_corked = bus->auto_cork;
                 r = process_running(bus, hint_priority, priority, ret);
+
+                if (bus->auto_corked && !bus->cork && bus->wqueue_size > 0 && IN_SET(bus->state, BUS_RUNNING, BUS_HELLO)) {
+                        int k;
+
+                        /* Other failures are left to the next iteration, which dispatches the queue again */
+                        bus->auto_corked = false;
+                        k = dispatch_wqueue(bus);
+                        if (IN_SET(k, -ENOTCONN, -ECONNRESET, -EPIPE, -ESHUTDOWN))
+                                bus_enter_closing(bus);
+                }
+
+                bus->auto_corked = false;
+
                 if (r >= 0)
                         return r;
 
@@ -2529,7 +3026,7 @@ _public_ int sd_bus_process_priority(sd_bus *bus, int64_t priority, sd_bus_messa
         return bus_process_internal(bus, true, priority, ret);
 }
 
-static int bus_poll(sd_bus *bus, bool need_more, uint64_t timeout_usec) {
+static int bus_poll(sd_bus *bus, bool need_more, bool need_write, uint64_t timeout_usec) {
         struct pollfd p[2] = {};
         int r, n, e;
         struct timespec ts;
@@ -2547,6 +3044,10 @@ static int bus_poll(sd_bus *bus, bool need_more, uint64_t timeout_usec) {
         if (e < 0)
                 return e;
 
+        /* A corked bus doesn't ask for POLLOUT, but those waiting for a reply or a flush need the queue written */
+        if (need_write && bus->wqueue_size > 0 && IN_SET(bus->state, BUS_RUNNING, BUS_HELLO))
+                e |= POLLOUT;
+
         if (need_more)
                 /* The caller really needs some more data, he doesn't
                  * care about what's already read, or any timeouts
@@ -2600,7 +3101,7 @@ _public_ int sd_bus_wait(sd_bus *bus, uint64_t timeout_usec) {
         if (bus->rqueue_size > 0)
                 return 0;
 
-        return bus_poll(bus, false, timeout_usec);
+        return bus_poll(bus, false, false, timeout_usec);
 }
 
 _public_ int sd_bus_flush(sd_bus *bus) {
@@ -2620,6 +3121,12 @@ _public_ int sd_bus_flush(sd_bus *bus) {
         if (r < 0)
                 return r;
 
+        /* Flushing means sending everything out, including deferred PropertiesChanged signals still subject to
+         * their rate limit */
+        r = bus_properties_changed_dispatch(bus, true);
+        if (r < 0)
+                return r;
+
         if (bus->wqueue_size <= 0)
                 return 0;
 
@@ -2637,12 +3144,63 @@ _public_ int sd_bus_flush(sd_bus *bus) {
                 if (bus->wqueue_size <= 0)
                         return 0;
 
-                r = bus_poll(bus, false, (uint64_t) -1);
+                r = bus_poll(bus, false, true, (uint64_t) -1);
                 if (r < 0)
                         return r;
         }
 }
 
+_public_ int sd_bus_set_cork(sd_bus *bus, int b) {
+        int r;
+
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->cork = !!b;
+
+        if (b || bus->wqueue_size <= 0 || !IN_SET(bus->state, BUS_RUNNING, BUS_HELLO))
+                return 0;
+
+        /* Uncorking writes out what was held back, as far as that's possible without blocking */
+        r = dispatch_wqueue(bus);
+        if (r < 0) {
+                if (IN_SET(r, -ENOTCONN, -ECONNRESET, -EPIPE, -ESHUTDOWN)) {
+                        bus_enter_closing(bus);
+                        return -ECONNRESET;
+                }
+
+                return r;
+        }
+
+        return 0;
+}
+
+_public_ int sd_bus_get_cork(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        return bus->cork;
+}
+
+_public_ int sd_bus_set_auto_cork(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->auto_cork = !!b;
+        return 0;
+}
+
+_public_ int sd_bus_get_auto_cork(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        return bus->auto_cork;
+}
+
 _public_ int sd_bus_add_filter(
                 sd_bus *bus,
                 sd_bus_slot **slot,
@@ -3226,6 +3784,14 @@ _public_ int sd_bus_is_trusted(sd_bus *bus) {
         return bus->trusted;
 }
 
+_public_ int sd_bus_get_trusted_wire(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        return bus->trusted_wire;
+}
+
 _public_ int sd_bus_is_monitor(sd_bus *bus) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -3312,6 +3878,265 @@ _public_ int sd_bus_get_n_queued_write(sd_bus *bus, uint64_t *ret) {
         return 0;
 }
 
+_public_ int sd_bus_get_n_expired_write(sd_bus *bus, uint64_t *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(ret, -EINVAL);
+
+        *ret = bus->wqueue_n_expired;
+        return 0;
+}
+
+_public_ int sd_bus_get_n_shed_read(sd_bus *bus, uint64_t *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(ret, -EINVAL);
+
+        *ret = bus->rqueue_n_shed;
+        return 0;
+}
+
+_public_ int sd_bus_get_stats(sd_bus *bus, sd_bus_stats *ret, size_t size) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(ret, -EINVAL);
+
+        /* Callers built against an older version of the structure get its beginning, newer ones get zeroes
+         * for whatever we don't know about */
+        memcpy(ret, &bus->stats, MIN(size, sizeof(bus->stats)));
+        if (size > sizeof(bus->stats))
+                memzero((uint8_t*) ret + sizeof(bus->stats), size - sizeof(bus->stats));
+
+        return 0;
+}
+
+_public_ int sd_bus_reset_stats(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        /* The peaks start over from what is queued right now. The counters sd_bus_get_n_expired_write() and
+         * friends report are kept separately, and not affected. */
+        bus->stats = (sd_bus_stats) {
+                .rqueue_peak = bus->rqueue_size,
+                .rqueue_bytes_peak = bus->rqueue_bytes,
+                .wqueue_peak = bus->wqueue_size,
+                .wqueue_bytes_peak = bus->wqueue_bytes,
+        };
+
+        return 0;
+}
+
+_public_ int sd_bus_set_slot_latency(sd_bus *bus, int b) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        /* Times every callback from here on, see sd_bus_slot_get_latency(), and for the methods of a vtable
+         * sd_bus_slot_get_method_latency(). What was recorded so far stays around when this is turned off
+         * again. */
+        bus->slot_latency = b;
+        return 0;
+}
+
+_public_ int sd_bus_get_slot_latency(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        return bus->slot_latency;
+}
+
+_public_ int sd_bus_set_slow_callback_threshold(sd_bus *bus, uint64_t usec) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->slow_callback_usec = usec;
+        return 0;
+}
+
+_public_ int sd_bus_get_slow_callback_threshold(sd_bus *bus, uint64_t *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(ret, -EINVAL);
+
+        *ret = bus->slow_callback_usec;
+        return 0;
+}
+
+_public_ int sd_bus_set_slow_callback_handler(sd_bus *bus, sd_bus_slow_callback_handler_t callback, void *userdata) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->slow_callback = callback;
+        bus->slow_callback_userdata = userdata;
+        return 0;
+}
+
+_public_ int sd_bus_get_queued_read_bytes(sd_bus *bus, uint64_t *ret, uint64_t *ret_high) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (ret)
+                *ret = bus->rqueue_bytes;
+        if (ret_high)
+                *ret_high = bus->rqueue_bytes_high;
+        return 0;
+}
+
+_public_ int sd_bus_get_queued_write_bytes(sd_bus *bus, uint64_t *ret, uint64_t *ret_high) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (ret)
+                *ret = bus->wqueue_bytes;
+        if (ret_high)
+                *ret_high = bus->wqueue_bytes_high;
+        return 0;
+}
+
+_public_ int sd_bus_set_max_queued_read_bytes(sd_bus *bus, uint64_t bytes) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->rqueue_bytes_max = MIN(bytes, (uint64_t) SIZE_MAX);
+        return 0;
+}
+
+_public_ int sd_bus_get_max_queued_read_bytes(sd_bus *bus, uint64_t *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(ret, -EINVAL);
+
+        *ret = bus->rqueue_bytes_max;
+        return 0;
+}
+
+_public_ int sd_bus_set_max_queued_write_bytes(sd_bus *bus, uint64_t bytes) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->wqueue_bytes_max = MIN(bytes, (uint64_t) SIZE_MAX);
+        return 0;
+}
+
+_public_ int sd_bus_get_max_queued_write_bytes(sd_bus *bus, uint64_t *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(ret, -EINVAL);
+
+        *ret = bus->wqueue_bytes_max;
+        return 0;
+}
+
+_public_ int sd_bus_set_write_watermarks(sd_bus *bus, uint64_t low, uint64_t high) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(low <= high, -EINVAL);
+
+        bus->wqueue_watermark_low = MIN(low, (uint64_t) SIZE_MAX);
+        bus->wqueue_watermark_high = MIN(high, (uint64_t) SIZE_MAX);
+
+        bus_update_write_blocked(bus);
+        return 0;
+}
+
+_public_ int sd_bus_get_write_watermarks(sd_bus *bus, uint64_t *ret_low, uint64_t *ret_high) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (ret_low)
+                *ret_low = bus->wqueue_watermark_low == SIZE_MAX ? UINT64_MAX : bus->wqueue_watermark_low;
+        if (ret_high)
+                *ret_high = bus->wqueue_watermark_high == SIZE_MAX ? UINT64_MAX : bus->wqueue_watermark_high;
+        return 0;
+}
+
+_public_ int sd_bus_set_write_drained_handler(sd_bus *bus, sd_bus_write_drained_handler_t callback, void *userdata) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->write_drained_callback = callback;
+        bus->write_drained_userdata = userdata;
+        return 0;
+}
+
+_public_ int sd_bus_set_message_type_priority(sd_bus *bus, uint8_t type, int64_t priority) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(type > _SD_BUS_MESSAGE_TYPE_INVALID && type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
+
+        bus->message_type_priority[type] = priority;
+        return 0;
+}
+
+_public_ int sd_bus_get_message_type_priority(sd_bus *bus, uint8_t type, int64_t *ret) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+        assert_return(type > _SD_BUS_MESSAGE_TYPE_INVALID && type < _SD_BUS_MESSAGE_TYPE_MAX, -EINVAL);
+        assert_return(ret, -EINVAL);
+
+        *ret = bus->message_type_priority[type];
+        return 0;
+}
+
+_public_ int sd_bus_set_shed_threshold(sd_bus *bus, uint64_t n_messages, uint64_t bytes) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->rqueue_shed_size = MIN(n_messages, (uint64_t) SIZE_MAX);
+        bus->rqueue_shed_bytes = MIN(bytes, (uint64_t) SIZE_MAX);
+        return 0;
+}
+
+_public_ int sd_bus_get_shed_threshold(sd_bus *bus, uint64_t *ret_n_messages, uint64_t *ret_bytes) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        if (ret_n_messages)
+                *ret_n_messages = bus->rqueue_shed_size == SIZE_MAX ? UINT64_MAX : bus->rqueue_shed_size;
+        if (ret_bytes)
+                *ret_bytes = bus->rqueue_shed_bytes == SIZE_MAX ? UINT64_MAX : bus->rqueue_shed_bytes;
+        return 0;
+}
+
+_public_ int sd_bus_set_shed_handler(sd_bus *bus, sd_bus_shed_handler_t callback, void *userdata) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        bus->shed_callback = callback;
+        bus->shed_userdata = userdata;
+        return 0;
+}
+
+_public_ int sd_bus_is_write_blocked(sd_bus *bus) {
+        assert_return(bus, -EINVAL);
+        assert_return(bus = bus_resolve(bus), -ENOPKG);
+        assert_return(!bus_pid_changed(bus), -ECHILD);
+
+        return bus->write_blocked;
+}
+
 _public_ int sd_bus_set_method_call_timeout(sd_bus *bus, uint64_t usec) {
         assert_return(bus, -EINVAL);
         assert_return(bus = bus_resolve(bus), -ENOPKG);
@@ -499,6 +499,99 @@ finish:
         return INT_TO_PTR(r);
 }
 
+static int proxy_owner_get(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        const char *unique;
+        int r;
+
+        r = sd_bus_get_unique_name(bus, &unique);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_append(reply, "s", unique);
+}
+
+static const sd_bus_vtable proxy_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Owner", "s", proxy_owner_get, 0, 0),
+        SD_BUS_VTABLE_END
+};
+
+static int proxy_handler(sd_bus_proxy *proxy, const char *path, const char *interface, char **properties, void *userdata) {
+        unsigned *n_removed = userdata;
+
+        if (path && !properties)
+                (*n_removed)++;
+
+        return 0;
+}
+
+static void proxy_process(sd_bus *a, sd_bus *b, sd_bus *client) {
+        int r;
+
+        assert_se((r = sd_bus_process(a, NULL)) >= 0);
+        if (r > 0)
+                return;
+        assert_se((r = sd_bus_process(b, NULL)) >= 0);
+        if (r > 0)
+                return;
+        assert_se((r = sd_bus_process(client, NULL)) >= 0);
+        if (r > 0)
+                return;
+
+        assert_se(sd_bus_wait(client, 10 * USEC_PER_MSEC) >= 0);
+}
+
+/* A proxy on a well-known name forgets what it learnt from the previous owner and refetches from the new one */
+static void test_proxy_owner_change(void) {
+        _cleanup_(sd_bus_unrefp) sd_bus *a = NULL, *b = NULL, *client = NULL;
+        _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *proxy = NULL;
+        const char *unique_a, *unique_b;
+        unsigned n_removed = 0;
+        char *v = NULL;
+        int r;
+
+        assert_se(sd_bus_open_user(&a) >= 0);
+        assert_se(sd_bus_open_user(&b) >= 0);
+        assert_se(sd_bus_open_user(&client) >= 0);
+
+        assert_se(sd_bus_add_object_vtable(a, NULL, "/proxy", "org.freedesktop.systemd.ProxyTest", proxy_vtable, NULL) >= 0);
+        assert_se(sd_bus_add_object_vtable(b, NULL, "/proxy", "org.freedesktop.systemd.ProxyTest", proxy_vtable, NULL) >= 0);
+        assert_se(sd_bus_get_unique_name(a, &unique_a) >= 0);
+        assert_se(sd_bus_get_unique_name(b, &unique_b) >= 0);
+
+        assert_se(sd_bus_request_name(a, "org.freedesktop.systemd.test.proxy", 0) >= 0);
+
+        assert_se(sd_bus_proxy_new(client, &proxy, "org.freedesktop.systemd.test.proxy", "/proxy",
+                                   "org.freedesktop.systemd.ProxyTest", proxy_handler, &n_removed) >= 0);
+
+        while (sd_bus_proxy_is_ready(proxy) == 0)
+                proxy_process(a, b, client);
+
+        assert_se(sd_bus_proxy_get_property_string(proxy, NULL, NULL, "Owner", &v) >= 0);
+        assert_se(streq(v, unique_a));
+        v = mfree(v);
+
+        /* Once the name is gone, so are its properties */
+        assert_se(sd_bus_release_name(a, "org.freedesktop.systemd.test.proxy") >= 0);
+
+        while ((r = sd_bus_proxy_get_property_string(proxy, NULL, NULL, "Owner", &v)) >= 0) {
+                v = mfree(v);
+                proxy_process(a, b, client);
+        }
+        assert_se(r == -ENOENT);
+        assert_se(sd_bus_proxy_is_ready(proxy) > 0);
+        assert_se(n_removed == 1);
+
+        assert_se(sd_bus_request_name(b, "org.freedesktop.systemd.test.proxy", 0) >= 0);
+
+        while ((r = sd_bus_proxy_get_property_string(proxy, NULL, NULL, "Owner", &v)) < 0) {
+                assert_se(IN_SET(r, -ENOENT, -EAGAIN));
+                proxy_process(a, b, client);
+        }
+        assert_se(streq(v, unique_b));
+        free(v);
+}
+
 int main(int argc, char *argv[]) {
         pthread_t c1, c2;
         sd_bus *bus;
@@ -538,5 +631,7 @@ int main(int argc, char *argv[]) {
         if (r < 0)
                 return EXIT_FAILURE;
 
+        test_proxy_owner_change();
+
         return EXIT_SUCCESS;
 }
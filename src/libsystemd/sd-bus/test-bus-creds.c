@@ -1,11 +1,519 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+
 #include "sd-bus.h"
 
+#include "alloc-util.h"
+#include "bus-creds.h"
 #include "bus-dump.h"
+#include "bus-internal.h"
+#include "fd-util.h"
+#include "format-util.h"
 #include "tests.h"
 #include "errno.h"
 #include "log.h"
+#include "missing.h"
+#include "stdio-util.h"
+#include "string-util.h"
+#include "strv.h"
+
+/* Connects to a listening socket of our own, so that the peer is a local process: us */
+static int listen_and_connect(sd_bus **ret) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        union {
+                struct sockaddr sa;
+                struct sockaddr_un un;
+        } sa = {
+                .un.sun_family = AF_UNIX,
+        };
+        char name[sizeof(sa.un.sun_path) - 1];
+        static unsigned counter = 0;
+        int fd;
+
+        xsprintf(name, "basu-test-creds-" PID_FMT "-%u", getpid(), counter++);
+        strcpy(sa.un.sun_path + 1, name);
+
+        fd = socket(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0);
+        assert_se(fd >= 0);
+        assert_se(bind(fd, &sa.sa, offsetof(struct sockaddr_un, sun_path) + 1 + strlen(name)) >= 0);
+        assert_se(listen(fd, 1) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_address(bus, strjoina("unix:abstract=", name)) >= 0);
+
+        *ret = TAKE_PTR(bus);
+        return fd;
+}
+
+static void test_creds_cache(void) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_ int fd = -1, pidfd = -1;
+        uint64_t hits, misses;
+        unsigned i;
+
+        fd = listen_and_connect(&bus);
+        assert_se(sd_bus_set_creds_cache(bus, true) >= 0);
+        assert_se(sd_bus_get_creds_cache(bus) > 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (i = 0; i < 3; i++) {
+                _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
+                const char *comm;
+                uid_t uid;
+
+                assert_se(sd_bus_get_owner_creds(bus, SD_BUS_CREDS_PID|SD_BUS_CREDS_UID|SD_BUS_CREDS_COMM|SD_BUS_CREDS_AUGMENT, &creds) >= 0);
+                assert_se(sd_bus_creds_get_uid(creds, &uid) >= 0);
+                assert_se(uid == getuid());
+                assert_se(sd_bus_creds_get_comm(creds, &comm) >= 0);
+                assert_se(sd_bus_creds_get_augmented_mask(creds) & SD_BUS_CREDS_COMM);
+        }
+
+        assert_se(sd_bus_get_creds_cache_stats(bus, &hits, &misses) >= 0);
+        log_info("creds cache: %" PRIu64 " hits, %" PRIu64 " misses", hits, misses);
+        assert_se(hits + misses == 3);
+
+        /* Without pidfd support everything is read directly */
+        pidfd = pidfd_open(getpid(), 0);
+        if (pidfd >= 0)
+                assert_se(hits == 2);
+        else
+                assert_se(hits == 0);
+
+        assert_se(sd_bus_set_creds_cache(bus, false) >= 0);
+        assert_se(sd_bus_get_creds_cache(bus) == 0);
+}
+
+static void test_creds_lazy(void) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_ int fd = -1, pidfd = -1;
+        const char *comm;
+        uid_t uid;
+
+        fd = listen_and_connect(&bus);
+        assert_se(sd_bus_set_creds_lazy(bus, true) >= 0);
+        assert_se(sd_bus_get_creds_lazy(bus) > 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(sd_bus_get_owner_creds(bus, SD_BUS_CREDS_PID|SD_BUS_CREDS_UID|SD_BUS_CREDS_GID|SD_BUS_CREDS_COMM|SD_BUS_CREDS_AUGMENT, &creds) >= 0);
+
+        /* Without pidfd support everything is read right away */
+        pidfd = pidfd_open(getpid(), 0);
+        if (pidfd < 0) {
+                assert_se(creds->lazy == 0);
+                return;
+        }
+
+        assert_se(creds->lazy == (SD_BUS_CREDS_UID|SD_BUS_CREDS_GID|SD_BUS_CREDS_COMM));
+        assert_se(!(creds->mask & (SD_BUS_CREDS_UID|SD_BUS_CREDS_GID|SD_BUS_CREDS_COMM)));
+
+        /* Asking for the uid reads /proc/PID/status, which provides the gid too */
+        assert_se(sd_bus_creds_get_uid(creds, &uid) >= 0);
+        assert_se(uid == getuid());
+        assert_se(creds->lazy == SD_BUS_CREDS_COMM);
+        assert_se(creds->mask & SD_BUS_CREDS_GID);
+
+        /* The masks still report everything that was requested and could be read, without reading it */
+        assert_se((sd_bus_creds_get_mask(creds) & (SD_BUS_CREDS_UID|SD_BUS_CREDS_GID|SD_BUS_CREDS_COMM)) == (SD_BUS_CREDS_UID|SD_BUS_CREDS_GID|SD_BUS_CREDS_COMM));
+        assert_se(sd_bus_creds_get_augmented_mask(creds) & SD_BUS_CREDS_COMM);
+        assert_se(creds->lazy == SD_BUS_CREDS_COMM);
+
+        assert_se(sd_bus_creds_get_comm(creds, &comm) >= 0);
+        assert_se(creds->lazy == 0);
+}
+
+/* A stand-in for the bus driver, answering just what sd_bus_get_name_creds() asks. The uid of a peer is
+ * the number after the dot of its unique name, so that it is visible whom the credentials came from. */
+
+#define TEST_NAME "org.freedesktop.systemd.test.owner"
+
+struct driver {
+        int fd;
+        char *owner;
+        bool no_credentials;
+
+        unsigned n_name_owner;
+        unsigned n_credentials;
+        unsigned n_individual;
+        char **targets; /* the names credentials were asked for by */
+};
+
+static int driver_resolve(struct driver *d, sd_bus_message *m, const char **ret, sd_bus_error *error) {
+        const char *name;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &name);
+        if (r < 0)
+                return r;
+
+        if (streq(name, TEST_NAME))
+                name = d->owner;
+        else if (!streq_ptr(name, d->owner))
+                name = NULL;
+
+        if (!name)
+                return sd_bus_error_setf(error, "org.freedesktop.DBus.Error.NameHasNoOwner", "No such name");
+
+        *ret = name;
+        return 0;
+}
+
+static int driver_hello(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return sd_bus_reply_method_return(m, "s", ":1.1");
+}
+
+static int driver_match(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int driver_get_name_owner(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct driver *d = userdata;
+        const char *unique;
+        int r;
+
+        d->n_name_owner++;
+
+        r = driver_resolve(d, m, &unique, error);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "s", unique);
+}
+
+static int driver_record(struct driver *d, sd_bus_message *m) {
+        const char *name;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &name);
+        if (r < 0)
+                return r;
+
+        r = strv_extend(&d->targets, name);
+        if (r < 0)
+                return r;
+
+        return sd_bus_message_rewind(m, true);
+}
+
+static int driver_get_credentials(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct driver *d = userdata;
+        const char *unique;
+        int r;
+
+        d->n_credentials++;
+
+        if (d->no_credentials)
+                return sd_bus_error_set(error, SD_BUS_ERROR_UNKNOWN_METHOD, "Not here");
+
+        r = driver_record(d, m);
+        if (r < 0)
+                return r;
+
+        r = driver_resolve(d, m, &unique, error);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "a{sv}", 2,
+                                          "UnixUserID", "u", (uint32_t) atoi(strchr(unique, '.') + 1),
+                                          "ProcessID", "u", (uint32_t) getpid());
+}
+
+static int driver_get_process_id(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct driver *d = userdata;
+        const char *unique;
+        int r;
+
+        d->n_individual++;
+
+        r = driver_record(d, m);
+        if (r < 0)
+                return r;
+
+        r = driver_resolve(d, m, &unique, error);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "u", (uint32_t) getpid());
+}
+
+static int driver_get_user(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct driver *d = userdata;
+        const char *unique;
+        int r;
+
+        d->n_individual++;
+
+        r = driver_record(d, m);
+        if (r < 0)
+                return r;
+
+        r = driver_resolve(d, m, &unique, error);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "u", (uint32_t) atoi(strchr(unique, '.') + 1));
+}
+
+/* Hands the name over, announcing it like the real driver does before answering */
+static int driver_set_owner(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct driver *d = userdata;
+        const char *owner;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &owner);
+        if (r < 0)
+                return r;
+
+        r = sd_bus_emit_signal(sd_bus_message_get_bus(m), "/org/freedesktop/DBus", "org.freedesktop.DBus", "NameOwnerChanged",
+                               "sss", TEST_NAME, strempty(d->owner), owner);
+        if (r < 0)
+                return r;
+
+        r = free_and_strdup(&d->owner, owner);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable driver_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Hello", NULL, "s", driver_hello, 0),
+        SD_BUS_METHOD("AddMatch", "s", NULL, driver_match, 0),
+        SD_BUS_METHOD("RemoveMatch", "s", NULL, driver_match, 0),
+        SD_BUS_METHOD("GetNameOwner", "s", "s", driver_get_name_owner, 0),
+        SD_BUS_METHOD("GetConnectionCredentials", "s", "a{sv}", driver_get_credentials, 0),
+        SD_BUS_METHOD("GetConnectionUnixProcessID", "s", "u", driver_get_process_id, 0),
+        SD_BUS_METHOD("GetConnectionUnixUser", "s", "u", driver_get_user, 0),
+        SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable driver_test_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("SetOwner", "s", NULL, driver_set_owner, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void *driver_thread(void *p) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        struct driver *d = p;
+        sd_id128_t id;
+        int r;
+
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, d->fd, d->fd) >= 0);
+        assert_se(sd_bus_set_server(bus, true, id) >= 0);
+        assert_se(sd_bus_set_sender(bus, "org.freedesktop.DBus") >= 0);
+        assert_se(sd_bus_set_trusted(bus, true) >= 0);
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/DBus", "org.freedesktop.DBus", driver_vtable, d) >= 0);
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/freedesktop/DBus", "org.freedesktop.systemd.test", driver_test_vtable, d) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        for (;;) {
+                r = sd_bus_process(bus, NULL);
+                if (r < 0)
+                        break;
+                if (r > 0)
+                        continue;
+
+                if (sd_bus_wait(bus, (uint64_t) -1) < 0)
+                        break;
+        }
+
+        return NULL;
+}
+
+static void driver_start(struct driver *d, pthread_t *t, sd_bus **ret) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        int fds[2];
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM|SOCK_CLOEXEC, 0, fds) >= 0);
+
+        d->fd = fds[0];
+        assert_se(free_and_strdup(&d->owner, ":1.2") >= 0);
+        assert_se(pthread_create(t, NULL, driver_thread, d) == 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, fds[1], fds[1]) >= 0);
+        assert_se(sd_bus_set_bus_client(bus, true) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        *ret = TAKE_PTR(bus);
+}
+
+static void driver_stop(struct driver *d, pthread_t t, sd_bus *bus) {
+        sd_bus_flush_close_unref(bus);
+        assert_se(pthread_join(t, NULL) == 0);
+
+        free(d->owner);
+        strv_free(d->targets);
+}
+
+static void assert_creds(sd_bus_creds *c, const char *unique, uid_t euid) {
+        const char *u;
+        uid_t uid;
+        pid_t pid;
+
+        assert_se(sd_bus_creds_get_unique_name(c, &u) >= 0);
+        assert_se(streq(u, unique));
+        assert_se(sd_bus_creds_get_euid(c, &uid) >= 0);
+        assert_se(uid == euid);
+        assert_se(sd_bus_creds_get_pid(c, &pid) >= 0);
+        assert_se(pid == getpid());
+}
+
+#define CREDS_MASK (SD_BUS_CREDS_UNIQUE_NAME|SD_BUS_CREDS_PID|SD_BUS_CREDS_EUID)
+
+static void test_call_many(void) {
+        sd_bus_error errors[3] = {};
+        sd_bus_message *m[3] = {}, *replies[3] = {};
+        struct driver d = {};
+        const char *unique;
+        int results[3];
+        uint32_t uid;
+        pthread_t t;
+        sd_bus *bus;
+        unsigned i;
+
+        driver_start(&d, &t, &bus);
+
+        assert_se(sd_bus_message_new_method_call(bus, &m[0], "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "GetNameOwner") >= 0);
+        assert_se(sd_bus_message_append(m[0], "s", TEST_NAME) >= 0);
+        assert_se(sd_bus_message_new_method_call(bus, &m[1], "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "GetNameOwner") >= 0);
+        assert_se(sd_bus_message_append(m[1], "s", "org.freedesktop.systemd.test.nobody") >= 0);
+        assert_se(sd_bus_message_new_method_call(bus, &m[2], "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.DBus", "GetConnectionUnixUser") >= 0);
+        assert_se(sd_bus_message_append(m[2], "s", ":1.2") >= 0);
+
+        /* All outcomes are collected, a failing call doesn't fail the others */
+        assert_se(bus_call_many(bus, m, 3, errors, replies, results) >= 0);
+        assert_se(results[0] >= 0);
+        assert_se(sd_bus_message_read(replies[0], "s", &unique) >= 0);
+        assert_se(streq(unique, ":1.2"));
+        assert_se(results[1] < 0);
+        assert_se(sd_bus_error_has_name(&errors[1], "org.freedesktop.DBus.Error.NameHasNoOwner"));
+        assert_se(!replies[1]);
+        assert_se(results[2] >= 0);
+        assert_se(sd_bus_message_read(replies[2], "u", &uid) >= 0);
+        assert_se(uid == 2);
+
+        for (i = 0; i < 3; i++) {
+                sd_bus_message_unref(m[i]);
+                sd_bus_message_unref(replies[i]);
+                sd_bus_error_free(&errors[i]);
+        }
+
+        driver_stop(&d, t, bus);
+}
+
+static void test_name_creds(void) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL;
+        struct driver d = {};
+        pthread_t t;
+        sd_bus *bus;
+
+        driver_start(&d, &t, &bus);
+
+        /* The owner and its credentials are asked for at once, with one call each */
+        assert_se(sd_bus_get_name_creds(bus, TEST_NAME, CREDS_MASK, &c) >= 0);
+        assert_creds(c, ":1.2", 2);
+        assert_se(d.n_name_owner == 1);
+        assert_se(d.n_credentials == 1);
+        assert_se(d.n_individual == 0);
+        c = sd_bus_creds_unref(c);
+
+        /* Without the cache, every lookup goes to the driver */
+        assert_se(sd_bus_get_name_creds(bus, TEST_NAME, CREDS_MASK, &c) >= 0);
+        assert_se(d.n_name_owner == 2);
+        assert_se(d.n_credentials == 2);
+
+        assert_se(sd_bus_get_name_creds(bus, "org.freedesktop.systemd.test.nobody", 0, NULL) == -ENXIO);
+
+        driver_stop(&d, t, bus);
+}
+
+static void test_name_creds_fallback(void) {
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL;
+        struct driver d = {
+                .no_credentials = true,
+        };
+        char **i;
+        pthread_t t;
+        sd_bus *bus;
+
+        driver_start(&d, &t, &bus);
+
+        /* If the driver doesn't know GetConnectionCredentials(), the fields are asked for one by one, by
+         * the unique name learnt in the first round */
+        assert_se(sd_bus_get_name_creds(bus, TEST_NAME, CREDS_MASK, &c) >= 0);
+        assert_creds(c, ":1.2", 2);
+        assert_se(d.n_name_owner == 1);
+        assert_se(d.n_credentials == 1);
+        assert_se(d.n_individual == 2);
+
+        assert_se(strv_length(d.targets) == 2);
+        STRV_FOREACH(i, d.targets)
+                assert_se(streq(*i, ":1.2"));
+
+        driver_stop(&d, t, bus);
+}
+
+static void test_name_owner_cache(void) {
+        _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
+        _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *c = NULL;
+        struct driver d = {};
+        pid_t pid;
+        pthread_t t;
+        sd_bus *bus;
+
+        driver_start(&d, &t, &bus);
+
+        assert_se(sd_bus_get_name_owner_cache(bus) == 0);
+        assert_se(sd_bus_set_name_owner_cache(bus, true) >= 0);
+        assert_se(sd_bus_get_name_owner_cache(bus) > 0);
+
+        assert_se(sd_bus_get_name_creds(bus, TEST_NAME, SD_BUS_CREDS_UNIQUE_NAME|SD_BUS_CREDS_EUID, &c) >= 0);
+        assert_se(d.n_name_owner == 1);
+        assert_se(d.n_individual == 1);
+        c = sd_bus_creds_unref(c);
+
+        /* Served from the cache */
+        assert_se(sd_bus_get_name_creds(bus, TEST_NAME, SD_BUS_CREDS_UNIQUE_NAME|SD_BUS_CREDS_EUID, &c) >= 0);
+        assert_se(d.n_name_owner == 1);
+        assert_se(d.n_individual == 1);
+        c = sd_bus_creds_unref(c);
+
+        /* Fields not cached yet are asked for by the unique name */
+        assert_se(sd_bus_get_name_creds(bus, TEST_NAME, SD_BUS_CREDS_PID, &c) >= 0);
+        assert_se(sd_bus_creds_get_pid(c, &pid) >= 0);
+        assert_se(pid == getpid());
+        assert_se(d.n_name_owner == 1);
+        assert_se(d.n_individual == 2);
+        assert_se(streq(d.targets[strv_length(d.targets) - 1], ":1.2"));
+        c = sd_bus_creds_unref(c);
+
+        /* NameOwnerChanged drops the entry, even before it was dispatched */
+        assert_se(sd_bus_call_method(bus, "org.freedesktop.DBus", "/org/freedesktop/DBus", "org.freedesktop.systemd.test", "SetOwner", &error, NULL, "s", ":1.3") >= 0);
+
+        assert_se(sd_bus_get_name_creds(bus, TEST_NAME, CREDS_MASK, &c) >= 0);
+        assert_creds(c, ":1.3", 3);
+        assert_se(d.n_name_owner == 2);
+        assert_se(d.n_credentials == 1);
+        c = sd_bus_creds_unref(c);
+
+        assert_se(sd_bus_get_name_creds(bus, TEST_NAME, CREDS_MASK, &c) >= 0);
+        assert_creds(c, ":1.3", 3);
+        assert_se(d.n_name_owner == 2);
+        assert_se(d.n_credentials == 1);
+
+        assert_se(sd_bus_set_name_owner_cache(bus, false) >= 0);
+
+        driver_stop(&d, t, bus);
+}
 
 int main(int argc, char *argv[]) {
         _cleanup_(sd_bus_creds_unrefp) sd_bus_creds *creds = NULL;
@@ -28,5 +536,12 @@ int main(int argc, char *argv[]) {
                 bus_creds_dump(creds, NULL, true);
         }
 
+        test_creds_cache();
+        test_creds_lazy();
+        test_call_many();
+        test_name_creds();
+        test_name_creds_fallback();
+        test_name_owner_cache();
+
         return 0;
 }
@@ -0,0 +1,84 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <errno.h>
+#include <stdio.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-common-errors.h"
+#include "bus-error.h"
+#include "parse-util.h"
+#include "string-util.h"
+#include "time-util.h"
+
+/* Registers a number of large error maps, as a service with many error names of its own would, and measures
+ * how fast error names are translated to errno values: names from the runtime maps, from the ELF section
+ * (which is searched last), and names nobody knows about. */
+
+#define N_MAPS 16U
+
+static unsigned arg_n_errors = 4096;
+static usec_t arg_loop_usec = 1 * USEC_PER_SEC;
+
+static void benchmark(const char *title, char **names, unsigned n, int expected) {
+        unsigned i, j = 0, n_done = 0;
+        usec_t t, elapsed;
+
+        t = now(CLOCK_MONOTONIC);
+        do {
+                /* Check the clock only now and then, it's more expensive than a lookup */
+                for (i = 0; i < 1024; i++, j = (j + 7919) % n)
+                        assert_se(sd_bus_error_set_const(NULL, names[j], NULL) == (expected ?: -(int) (j % 1000 + 1)));
+
+                n_done += i;
+                elapsed = now(CLOCK_MONOTONIC) - t;
+        } while (elapsed < arg_loop_usec);
+
+        printf("%-24s %9.1f ns/lookup\n", title, (double) elapsed * NSEC_PER_USEC / n_done);
+}
+
+int main(int argc, char *argv[]) {
+        sd_bus_error_map *maps[N_MAPS];
+        char **names, **misses;
+        char *elf[] = { (char*) BUS_ERROR_NO_SUCH_UNIT };
+        unsigned per_map, i, k;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_errors) >= 0);
+
+        per_map = MAX(1U, arg_n_errors / N_MAPS);
+
+        assert_se(names = new(char*, N_MAPS * per_map));
+        assert_se(misses = new(char*, N_MAPS * per_map));
+
+        for (k = 0; k < N_MAPS; k++) {
+                assert_se(maps[k] = new0(sd_bus_error_map, per_map + 1));
+
+                for (i = 0; i < per_map; i++) {
+                        unsigned n = k * per_map + i;
+
+                        assert_se(asprintf(&names[n], "org.example.Service%u.Error.Failure%u", k, i) >= 0);
+                        assert_se(asprintf(&misses[n], "org.example.Other%u.Error.Failure%u", k, i) >= 0);
+
+                        maps[k][i] = (sd_bus_error_map) SD_BUS_ERROR_MAP(names[n], (int) (n % 1000 + 1));
+                }
+
+                maps[k][per_map] = (sd_bus_error_map) SD_BUS_ERROR_MAP_END;
+                assert_se(sd_bus_error_add_map(maps[k]) > 0);
+        }
+
+        printf("%u error maps with %u names each\n", N_MAPS, per_map);
+
+        benchmark("registered names", names, N_MAPS * per_map, 0);
+        benchmark("ELF section name", elf, ELEMENTSOF(elf), -ENOENT);
+        benchmark("unknown names", misses, N_MAPS * per_map, -EIO);
+
+        /* The maps and the names in them have to stay around, the library keeps pointing to them */
+        for (i = 0; i < N_MAPS * per_map; i++)
+                free(misses[i]);
+        free(names);
+        free(misses);
+
+        return 0;
+}
@@ -1,5 +1,6 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include <pthread.h>
 #include <stdio.h>
 
 #include "sd-bus.h"
@@ -172,6 +173,14 @@ static const sd_bus_error_map test_errors4[] = {
         SD_BUS_ERROR_MAP_END
 };
 
+/* Shadows an entry of test_errors, and has a duplicate of its own */
+static const sd_bus_error_map test_errors5[] = {
+        SD_BUS_ERROR_MAP("org.freedesktop.custom-dbus-error-2", 53),
+        SD_BUS_ERROR_MAP("org.freedesktop.custom-dbus-error-79", 779),
+        SD_BUS_ERROR_MAP("org.freedesktop.custom-dbus-error-79", 780),
+        SD_BUS_ERROR_MAP_END
+};
+
 static const sd_bus_error_map test_errors_bad1[] = {
         SD_BUS_ERROR_MAP("org.freedesktop.custom-dbus-error-1", 0),
         SD_BUS_ERROR_MAP_END
@@ -206,16 +215,75 @@ static void test_errno_mapping_custom(void) {
 
         assert_se(sd_bus_error_set(NULL, BUS_ERROR_NO_SUCH_UNIT, NULL) == -ENOENT);
 
+        /* Maps registered at runtime take precedence over the ELF section, earlier entries over later ones */
+        assert_se(sd_bus_error_add_map(test_errors5) > 0);
+        assert_se(sd_bus_error_set(NULL, "org.freedesktop.custom-dbus-error-2", NULL) == -53);
+        assert_se(sd_bus_error_set(NULL, "org.freedesktop.custom-dbus-error-79", NULL) == -779);
+        assert_se(sd_bus_error_set(NULL, "org.freedesktop.custom-dbus-error-77", NULL) == -777);
+
         assert_se(sd_bus_error_add_map(test_errors_bad1) == -EINVAL);
         assert_se(sd_bus_error_add_map(test_errors_bad2) == -EINVAL);
 }
 
+static const char* const concurrent_error_names[] = {
+        "org.freedesktop.custom-dbus-error-c0",
+        "org.freedesktop.custom-dbus-error-c1",
+        "org.freedesktop.custom-dbus-error-c2",
+        "org.freedesktop.custom-dbus-error-c3",
+        "org.freedesktop.custom-dbus-error-c4",
+        "org.freedesktop.custom-dbus-error-c5",
+        "org.freedesktop.custom-dbus-error-c6",
+        "org.freedesktop.custom-dbus-error-c7",
+};
+
+static sd_bus_error_map concurrent_errors[ELEMENTSOF(concurrent_error_names)][2];
+static unsigned n_concurrent_lookups = 0;
+static bool concurrent_done = false;
+
+static void *concurrent_lookup(void *p) {
+        while (!__atomic_load_n(&concurrent_done, __ATOMIC_ACQUIRE)) {
+                assert_se(sd_bus_error_set(NULL, "org.freedesktop.custom-dbus-error-33", NULL) == -333);
+                __atomic_add_fetch(&n_concurrent_lookups, 1, __ATOMIC_RELAXED);
+        }
+
+        return NULL;
+}
+
+static void test_add_map_concurrent(void) {
+        pthread_t threads[4];
+        unsigned i, n;
+
+        /* Names are translated while maps are added, the index they are looked up in must stay valid */
+        for (i = 0; i < ELEMENTSOF(threads); i++)
+                assert_se(pthread_create(&threads[i], NULL, concurrent_lookup, NULL) == 0);
+
+        for (i = 0; i < ELEMENTSOF(concurrent_error_names); i++) {
+                concurrent_errors[i][0] = (sd_bus_error_map) SD_BUS_ERROR_MAP(concurrent_error_names[i], 1000 + i);
+                concurrent_errors[i][1] = (sd_bus_error_map) SD_BUS_ERROR_MAP_END;
+
+                n = __atomic_load_n(&n_concurrent_lookups, __ATOMIC_RELAXED);
+                assert_se(sd_bus_error_add_map(concurrent_errors[i]) > 0);
+
+                /* Let the readers rebuild the index before replacing it again */
+                while (__atomic_load_n(&n_concurrent_lookups, __ATOMIC_RELAXED) < n + 100)
+                        ;
+        }
+
+        __atomic_store_n(&concurrent_done, true, __ATOMIC_RELEASE);
+        for (i = 0; i < ELEMENTSOF(threads); i++)
+                assert_se(pthread_join(threads[i], NULL) == 0);
+
+        for (i = 0; i < ELEMENTSOF(concurrent_error_names); i++)
+                assert_se(sd_bus_error_set(NULL, concurrent_error_names[i], NULL) == -(int) (1000 + i));
+}
+
 int main(int argc, char *argv[]) {
         dump_mapping_table();
 
         test_error();
         test_errno_mapping_standard();
         test_errno_mapping_custom();
+        test_add_map_concurrent();
 
         return 0;
 }
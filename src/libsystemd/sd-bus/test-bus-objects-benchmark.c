@@ -0,0 +1,163 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-objects.h"
+#include "fd-util.h"
+#include "parse-util.h"
+#include "string-util.h"
+#include "time-util.h"
+
+/* Registers a large number of objects (plus a fallback and a few vtables) and measures how fast incoming method calls
+ * can be routed to them. Calls are dispatched via bus_process_object() directly, so that only the object tree lookup
+ * and handler invocation are measured, not the socket I/O. */
+
+#define N_DIRS 1000U
+
+static unsigned arg_n_objects = 1000000;
+static usec_t arg_loop_usec = 1 * USEC_PER_SEC;
+
+static unsigned n_handled = 0;
+
+static int object_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        n_handled++;
+        return 1;
+}
+
+static int fallback_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        n_handled++;
+        return 1;
+}
+
+static int method_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        n_handled++;
+        return 1;
+}
+
+static const char *const methods[] = {
+        "Start", "Stop", "Reload", "Restart", "TryRestart", "ReloadOrRestart", "Kill", "ResetFailed",
+        "SetProperties", "Ref", "Unref", "Clean", "Freeze", "Thaw", "Attach", "Ping",
+};
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Start", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Stop", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Reload", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Restart", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("TryRestart", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("ReloadOrRestart", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Kill", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("ResetFailed", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("SetProperties", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Ref", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Unref", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Clean", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Freeze", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Thaw", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Attach", NULL, NULL, method_handler, 0),
+        SD_BUS_METHOD("Ping", NULL, NULL, method_handler, 0),
+        SD_BUS_VTABLE_END
+};
+
+static sd_bus_message *make_call(sd_bus *bus, const char *path, const char *member) {
+        static uint64_t cookie = 0;
+        sd_bus_message *m;
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, NULL, path, "org.freedesktop.systemd.test", member) >= 0);
+        assert_se(sd_bus_message_set_expect_reply(m, false) >= 0);
+        assert_se(sd_bus_message_seal(m, ++cookie, 0) >= 0);
+
+        return m;
+}
+
+static void run(sd_bus *bus, const char *title, char **paths, unsigned n_paths) {
+        unsigned i = 0, n = 0;
+        usec_t t;
+
+        n_handled = 0;
+
+        t = now(CLOCK_MONOTONIC);
+        do {
+                _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+
+                m = make_call(bus, paths[i], methods[n % ELEMENTSOF(methods)]);
+
+                /* Every handler runs at most once per iteration, see process_message() */
+                bus->iteration_counter++;
+                assert_se(bus_process_object(bus, m) > 0);
+
+                i = (i + 1) % n_paths;
+                n++;
+        } while (now(CLOCK_MONOTONIC) < t + arg_loop_usec);
+
+        t = now(CLOCK_MONOTONIC) - t;
+        assert_se(n_handled == n);
+
+        printf("%-24s %10u calls %10.0f calls/s\n", title, n, (double) n * USEC_PER_SEC / t);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        char **exact, **fallback, **dirs;
+        unsigned i;
+        usec_t t;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_objects) >= 0);
+        if (argc > 2)
+                assert_se(parse_sec(argv[2], &arg_loop_usec) >= 0);
+
+        assert_se(arg_n_objects > 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) >= 0);
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_fd(bus, pair[0], pair[0]) >= 0);
+        pair[0] = -1;
+        assert_se(sd_bus_start(bus) >= 0);
+
+        exact = new(char*, arg_n_objects);
+        fallback = new(char*, arg_n_objects);
+        dirs = new(char*, N_DIRS);
+        assert_se(exact && fallback && dirs);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = 0; i < arg_n_objects; i++) {
+                assert_se(asprintf(&exact[i], "/org/freedesktop/systemd/test/dir%u/object%u", i % N_DIRS, i) >= 0);
+                assert_se(asprintf(&fallback[i], "/org/freedesktop/systemd/test/dir%u/object%u/sub/leaf", i % N_DIRS, i) >= 0);
+
+                assert_se(sd_bus_add_object(bus, NULL, exact[i], object_handler, NULL) >= 0);
+        }
+        assert_se(sd_bus_add_fallback(bus, NULL, "/org/freedesktop/systemd/test", fallback_handler, NULL) >= 0);
+
+        for (i = 0; i < N_DIRS; i++) {
+                assert_se(asprintf(&dirs[i], "/org/freedesktop/systemd/test/dir%u", i) >= 0);
+                assert_se(sd_bus_add_object_vtable(bus, NULL, dirs[i], "org.freedesktop.systemd.test", vtable, NULL) >= 0);
+        }
+
+        printf("Registered %u objects in %" PRIu64 " ms\n", arg_n_objects, (now(CLOCK_MONOTONIC) - t) / USEC_PER_MSEC);
+
+        run(bus, "exact object", exact, arg_n_objects);
+        run(bus, "fallback below object", fallback, arg_n_objects);
+        run(bus, "vtable method", dirs, N_DIRS);
+
+        for (i = 0; i < arg_n_objects; i++) {
+                free(exact[i]);
+                free(fallback[i]);
+        }
+        for (i = 0; i < N_DIRS; i++)
+                free(dirs[i]);
+        free(exact);
+        free(fallback);
+        free(dirs);
+
+        return 0;
+}
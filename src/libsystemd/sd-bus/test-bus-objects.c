@@ -17,6 +17,10 @@ struct context {
         char *something;
         char *automatic_string_property;
         uint32_t automatic_integer_property;
+        unsigned n_cached_gets;
+        sd_bus_slot *extra_slot;
+        unsigned n_expensive_gets;
+        bool hidden;
 };
 
 static int something_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
@@ -129,6 +133,56 @@ static int notify_test2(sd_bus_message *m, void *userdata, sd_bus_error *error)
         return 1;
 }
 
+static int notify_test_deferred(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        int r;
+
+        /* All changes are merged into one signal, which is sent when deferring is turned off again */
+        assert_se(sd_bus_set_properties_changed_deferred(bus, true) >= 0);
+        assert_se(sd_bus_emit_properties_changed(bus, m->path, "org.freedesktop.systemd.ValueTest", "Value", NULL) >= 0);
+        assert_se(sd_bus_emit_properties_changed(bus, m->path, "org.freedesktop.systemd.ValueTest", "Value2", "Value", NULL) >= 0);
+        assert_se(sd_bus_emit_properties_changed(bus, m->path, "org.freedesktop.systemd.ValueTest", "Value", "Value2", NULL) >= 0);
+        assert_se(sd_bus_set_properties_changed_deferred(bus, false) >= 0);
+
+        r = sd_bus_reply_method_return(m, NULL);
+        assert_se(r >= 0);
+
+        return 1;
+}
+
+static int notify_test_rate_limited(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        const char *name;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &name);
+        assert_se(r >= 0);
+
+        /* The first change goes out right away, the ones following within the interval are merged and sent once
+         * it passed */
+        assert_se(sd_bus_set_properties_changed_deferred(bus, true) >= 0);
+        assert_se(sd_bus_set_properties_changed_interval(bus, 100 * USEC_PER_MSEC) >= 0);
+        assert_se(sd_bus_emit_properties_changed(bus, m->path, "org.freedesktop.systemd.ValueTest", name, NULL) >= 0);
+
+        r = sd_bus_reply_method_return(m, NULL);
+        assert_se(r >= 0);
+
+        return 1;
+}
+
+static int notify_test_rate_limited_done(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        int r;
+
+        assert_se(sd_bus_set_properties_changed_interval(bus, 0) >= 0);
+        assert_se(sd_bus_set_properties_changed_deferred(bus, false) >= 0);
+
+        r = sd_bus_reply_method_return(m, NULL);
+        assert_se(r >= 0);
+
+        return 1;
+}
+
 static int emit_interfaces_added(sd_bus_message *m, void *userdata, sd_bus_error *error) {
         int r;
 
@@ -173,6 +227,24 @@ static int emit_object_removed(sd_bus_message *m, void *userdata, sd_bus_error *
         return 1;
 }
 
+static const sd_bus_vtable vtable3[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("NoOperation", NULL, NULL, NULL, 0),
+        SD_BUS_VTABLE_END
+};
+
+static int add_interface_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        int r;
+
+        r = sd_bus_add_object_vtable(sd_bus_message_get_bus(m), NULL, "/foo", "org.freedesktop.systemd.test3", vtable3, userdata);
+        assert_se(r >= 0);
+
+        r = sd_bus_reply_method_return(m, NULL);
+        assert_se(r >= 0);
+
+        return 1;
+}
+
 static const sd_bus_vtable vtable[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_METHOD("AlterSomething", "s", "s", something_handler, 0),
@@ -185,6 +257,7 @@ static const sd_bus_vtable vtable[] = {
         SD_BUS_METHOD("EmitInterfacesRemoved", NULL, NULL, emit_interfaces_removed, 0),
         SD_BUS_METHOD("EmitObjectAdded", NULL, NULL, emit_object_added, 0),
         SD_BUS_METHOD("EmitObjectRemoved", NULL, NULL, emit_object_removed, 0),
+        SD_BUS_METHOD("AddInterface", NULL, NULL, add_interface_handler, 0),
         SD_BUS_VTABLE_END
 };
 
@@ -192,6 +265,9 @@ static const sd_bus_vtable vtable2[] = {
         SD_BUS_VTABLE_START(0),
         SD_BUS_METHOD("NotifyTest", "", "", notify_test, 0),
         SD_BUS_METHOD("NotifyTest2", "", "", notify_test2, 0),
+        SD_BUS_METHOD("NotifyTestDeferred", "", "", notify_test_deferred, 0),
+        SD_BUS_METHOD("NotifyTestRateLimited", "s", "", notify_test_rate_limited, 0),
+        SD_BUS_METHOD("NotifyTestRateLimitedDone", "", "", notify_test_rate_limited_done, 0),
         SD_BUS_PROPERTY("Value", "s", value_handler, 10, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
         SD_BUS_PROPERTY("Value2", "s", value_handler, 10, SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION),
         SD_BUS_PROPERTY("Value3", "s", value_handler, 10, SD_BUS_VTABLE_PROPERTY_CONST),
@@ -200,6 +276,137 @@ static const sd_bus_vtable vtable2[] = {
         SD_BUS_VTABLE_END
 };
 
+static int cached_get_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        c->n_cached_gets++;
+
+        return sd_bus_message_append(reply, "s", path);
+}
+
+static int cached_set_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *value, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_skip(value, "s");
+}
+
+static int expensive_get_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        c->n_expensive_gets++;
+
+        return sd_bus_message_append(reply, "a{st}", 2, "a", UINT64_C(1), "b", UINT64_C(2));
+}
+
+static int expensive_set_handler(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *value, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_skip(value, "a{st}");
+}
+
+static int touch_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        int r;
+
+        r = sd_bus_emit_properties_changed(sd_bus_message_get_bus(m), sd_bus_message_get_path(m), "org.freedesktop.systemd.CachedTest", "Value", NULL);
+        assert_se(r >= 0);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int replace_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        const char *path = sd_bus_message_get_path(m);
+
+        /* A new object takes the place of the old one, nothing cached for the old one may be served */
+        assert_se(sd_bus_emit_object_removed(bus, path) >= 0);
+        assert_se(sd_bus_emit_object_added(bus, path) >= 0);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int replace_interface_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        const char *path = sd_bus_message_get_path(m);
+
+        assert_se(sd_bus_emit_interfaces_removed(bus, path, "org.freedesktop.systemd.CachedTest", NULL) >= 0);
+        assert_se(sd_bus_emit_interfaces_added(bus, path, "org.freedesktop.systemd.CachedTest", NULL) >= 0);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable vtable5[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Value", "s", cached_get_handler, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_VTABLE_END
+};
+
+static int add_vtable_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        assert_se(sd_bus_add_object_vtable(sd_bus_message_get_bus(m), &c->extra_slot, sd_bus_message_get_path(m), "org.freedesktop.systemd.CachedTest2", vtable5, c) >= 0);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int remove_vtable_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        c->extra_slot = sd_bus_slot_unref(c->extra_slot);
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable vtable4[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Touch", "", "", touch_handler, 0),
+        SD_BUS_METHOD("Replace", "", "", replace_handler, 0),
+        SD_BUS_METHOD("ReplaceInterface", "", "", replace_interface_handler, 0),
+        SD_BUS_METHOD("AddVtable", "", "", add_vtable_handler, 0),
+        SD_BUS_METHOD("RemoveVtable", "", "", remove_vtable_handler, 0),
+        SD_BUS_WRITABLE_PROPERTY("Value", "s", cached_get_handler, cached_set_handler, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_PROPERTY("Value2", "s", cached_get_handler, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_WRITABLE_PROPERTY("Expensive", "a{st}", expensive_get_handler, expensive_set_handler, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE|SD_BUS_VTABLE_PROPERTY_CACHED),
+        SD_BUS_VTABLE_END
+};
+
+static int found_find(sd_bus *bus, const char *path, const char *interface, void *userdata, void **found, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        /* /found/a goes away without anybody being told */
+        if (c->hidden && streq(path, "/found/a"))
+                return 0;
+
+        *found = c;
+        return 1;
+}
+
+static int hide_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct context *c = userdata;
+
+        c->hidden = true;
+
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable vtable6[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Hide", "", "", hide_handler, 0),
+        SD_BUS_PROPERTY("Value", "s", cached_get_handler, 0, SD_BUS_VTABLE_PROPERTY_CONST),
+        SD_BUS_VTABLE_END
+};
+
+static int found_enumerator_callback(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
+
+        if (streq(path, "/found"))
+                assert_se(*nodes = strv_new("/found/a", "/found/b"));
+
+        return 1;
+}
+
+static int cached_enumerator_callback(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
+
+        if (streq(path, "/cached"))
+                assert_se(*nodes = strv_new("/cached/a", "/cached/b"));
+
+        return 1;
+}
+
 static int enumerator_callback(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
 
         if (object_path_startswith("/value", path))
@@ -237,6 +444,12 @@ static void *server(void *p) {
         assert_se(sd_bus_add_node_enumerator(bus, NULL, "/value/a", enumerator2_callback, NULL) >= 0);
         assert_se(sd_bus_add_object_manager(bus, NULL, "/value") >= 0);
         assert_se(sd_bus_add_object_manager(bus, NULL, "/value/a") >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/cached", "org.freedesktop.systemd.CachedTest", vtable4, NULL, c) >= 0);
+        assert_se(sd_bus_add_node_enumerator(bus, NULL, "/cached", cached_enumerator_callback, NULL) >= 0);
+        assert_se(sd_bus_add_object_manager(bus, NULL, "/cached") >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/found", "org.freedesktop.systemd.FoundTest", vtable6, found_find, c) >= 0);
+        assert_se(sd_bus_add_node_enumerator(bus, NULL, "/found", found_enumerator_callback, NULL) >= 0);
+        assert_se(sd_bus_add_object_manager(bus, NULL, "/found") >= 0);
 
         assert_se(sd_bus_start(bus) >= 0);
 
@@ -273,11 +486,76 @@ fail:
         return INT_TO_PTR(r);
 }
 
+struct proxy_context {
+        unsigned n_ready;
+        unsigned n_changes;
+        char **last_changed;
+};
+
+static int proxy_handler(sd_bus_proxy *proxy, const char *path, const char *interface, char **properties, void *userdata) {
+        struct proxy_context *pc = userdata;
+
+        log_info("Proxy change on %s %s", strna(path), strna(interface));
+
+        if (!path) {
+                pc->n_ready++;
+                return 0;
+        }
+
+        if (!streq(interface, "org.freedesktop.systemd.CachedTest"))
+                return 0;
+
+        pc->n_changes++;
+        strv_free(pc->last_changed);
+        assert_se(pc->last_changed = strv_copy(properties));
+
+        return 0;
+}
+
+static unsigned count_managed_objects(sd_bus_message *reply) {
+        unsigned n = 0;
+        int r;
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{oa{sa{sv}}}") > 0);
+
+        while ((r = sd_bus_message_enter_container(reply, 'e', "oa{sa{sv}}")) > 0) {
+                assert_se(sd_bus_message_skip(reply, "oa{sa{sv}}") >= 0);
+                assert_se(sd_bus_message_exit_container(reply) >= 0);
+                n++;
+        }
+        assert_se(r == 0);
+
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+
+        return n;
+}
+
+static sd_bus_message *wait_properties_changed(sd_bus *bus) {
+        sd_bus_message *m = NULL;
+        int r;
+
+        for (;;) {
+                r = sd_bus_process(bus, &m);
+                assert_se(r >= 0);
+
+                if (m && sd_bus_message_is_signal(m, "org.freedesktop.DBus.Properties", "PropertiesChanged"))
+                        return m;
+
+                m = sd_bus_message_unref(m);
+
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+}
+
 static int client(struct context *c) {
         _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
         _cleanup_(sd_bus_unrefp) sd_bus *bus = NULL;
         _cleanup_(sd_bus_error_free) sd_bus_error error = SD_BUS_ERROR_NULL;
         const char *s;
+        uint64_t u64;
+        usec_t t;
+        unsigned n;
         int r;
 
         assert_se(sd_bus_new(&bus) >= 0);
@@ -348,6 +626,21 @@ static int client(struct context *c) {
         r = sd_bus_message_read(reply, "s", &s);
         assert_se(r >= 0);
         fputs(s, stdout);
+        assert_se(!strstr(s, "org.freedesktop.systemd.test3"));
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        /* The introspection data is cached now, make sure registering another interface invalidates it */
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "AddInterface", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.DBus.Introspectable", "Introspect", &error, &reply, "");
+        assert_se(r >= 0);
+
+        r = sd_bus_message_read(reply, "s", &s);
+        assert_se(r >= 0);
+        assert_se(strstr(s, "<interface name=\"org.freedesktop.systemd.test3\">"));
 
         sd_bus_message_unref(reply);
         reply = NULL;
@@ -442,6 +735,75 @@ static int client(struct context *c) {
         sd_bus_message_unref(reply);
         reply = NULL;
 
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/value/a", "org.freedesktop.systemd.ValueTest", "NotifyTestDeferred", &error, NULL, "");
+        assert_se(r >= 0);
+
+        r = sd_bus_process(bus, &reply);
+        assert_se(r > 0);
+
+        assert_se(sd_bus_message_is_signal(reply, "org.freedesktop.DBus.Properties", "PropertiesChanged"));
+        bus_message_dump(reply, stdout, BUS_MESSAGE_DUMP_WITH_HEADER);
+
+        assert_se(sd_bus_message_rewind(reply, true) >= 0);
+        assert_se(sd_bus_message_read(reply, "s", &s) >= 0);
+        assert_se(streq(s, "org.freedesktop.systemd.ValueTest"));
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+        assert_se(sd_bus_message_read(reply, "{sv}", &s, "s", NULL) > 0);
+        assert_se(streq(s, "Value"));
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+        assert_se(sd_bus_message_read(reply, "as", 1, &s) > 0);
+        assert_se(streq(s, "Value2"));
+        assert_se(sd_bus_message_at_end(reply, true) > 0);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        /* Nothing else was sent for the three changes */
+        r = sd_bus_process(bus, &reply);
+        assert_se(r == 0);
+        assert_se(!reply);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/value/a", "org.freedesktop.systemd.ValueTest", "NotifyTestRateLimited", &error, NULL, "s", "Value");
+        assert_se(r >= 0);
+
+        reply = wait_properties_changed(bus);
+        t = now(CLOCK_MONOTONIC);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/value/a", "org.freedesktop.systemd.ValueTest", "NotifyTestRateLimited", &error, NULL, "s", "Value2");
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/value/a", "org.freedesktop.systemd.ValueTest", "NotifyTestRateLimited", &error, NULL, "s", "Value");
+        assert_se(r >= 0);
+
+        /* The server sends the merged changes on its own once the interval passed */
+        reply = wait_properties_changed(bus);
+        assert_se(now(CLOCK_MONOTONIC) - t >= 50 * USEC_PER_MSEC);
+
+        bus_message_dump(reply, stdout, BUS_MESSAGE_DUMP_WITH_HEADER);
+
+        assert_se(sd_bus_message_rewind(reply, true) >= 0);
+        assert_se(sd_bus_message_read(reply, "s", &s) >= 0);
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{sv}") > 0);
+        assert_se(sd_bus_message_read(reply, "{sv}", &s, "s", NULL) > 0);
+        assert_se(streq(s, "Value"));
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+        assert_se(sd_bus_message_read(reply, "as", 1, &s) > 0);
+        assert_se(streq(s, "Value2"));
+        assert_se(sd_bus_message_at_end(reply, true) > 0);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/value/a", "org.freedesktop.systemd.ValueTest", "NotifyTestRateLimitedDone", &error, NULL, "");
+        assert_se(r >= 0);
+
+        r = sd_bus_process(bus, &reply);
+        assert_se(r == 0);
+        assert_se(!reply);
+
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "EmitInterfacesAdded", &error, NULL, "");
         assert_se(r >= 0);
 
@@ -490,6 +852,233 @@ static int client(struct context *c) {
         sd_bus_message_unref(reply);
         reply = NULL;
 
+        /* All properties on /cached announce their changes, hence GetManagedObjects() is answered from the
+         * snapshots after the first call, until a property is set */
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
+        assert_se(r >= 0);
+        assert_se(c->n_cached_gets == 4);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
+        assert_se(r >= 0);
+        assert_se(c->n_cached_gets == 4);
+
+        bus_message_dump(reply, stdout, BUS_MESSAGE_DUMP_WITH_HEADER);
+        assert_se(sd_bus_message_rewind(reply, true) >= 0);
+        assert_se(sd_bus_message_skip(reply, "a{oa{sa{sv}}}") >= 0);
+        assert_se(sd_bus_message_at_end(reply, true) > 0);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_set_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Value", &error, "s", "foo");
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
+        assert_se(r >= 0);
+        assert_se(c->n_cached_gets == 6);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        /* Registering and freeing a vtable only affects the snapshot of the object it is registered on */
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "AddVtable", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
+        assert_se(r >= 0);
+        assert_se(c->n_cached_gets == 9);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "RemoveVtable", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
+        assert_se(r >= 0);
+        assert_se(c->n_cached_gets == 11);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
+        assert_se(r >= 0);
+        assert_se(c->n_cached_gets == 11);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        /* Objects behind a find callback may vanish without notice, they are never served from snapshots */
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/found", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
+        assert_se(r >= 0);
+        assert_se(count_managed_objects(reply) == 2);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/found/b", "org.freedesktop.systemd.FoundTest", "Hide", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/found", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", &error, &reply, "");
+        assert_se(r >= 0);
+        assert_se(count_managed_objects(reply) == 1);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        /* Cached property values are served without calling the getter, until the property is set */
+        r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &error, &reply, "a{st}");
+        assert_se(r >= 0);
+        n = c->n_expensive_gets;
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &error, &reply, "a{st}");
+        assert_se(r >= 0);
+        assert_se(c->n_expensive_gets == n);
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "{st}") > 0);
+        assert_se(sd_bus_message_read(reply, "{st}", &s, &u64) > 0);
+        assert_se(streq(s, "a") && u64 == 1);
+        assert_se(sd_bus_message_read(reply, "{st}", &s, &u64) > 0);
+        assert_se(streq(s, "b") && u64 == 2);
+        assert_se(sd_bus_message_read(reply, "{st}", &s, &u64) == 0);
+        assert_se(sd_bus_message_exit_container(reply) >= 0);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_set_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &error, "a{st}", 0);
+        assert_se(r >= 0);
+
+        r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &error, &reply, "a{st}");
+        assert_se(r >= 0);
+        assert_se(c->n_expensive_gets == n + 1);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        /* Same when the object or its interface is removed and added again */
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Replace", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &error, &reply, "a{st}");
+        assert_se(r >= 0);
+        assert_se(c->n_expensive_gets == n + 2);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "ReplaceInterface", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &error, &reply, "a{st}");
+        assert_se(r >= 0);
+        assert_se(c->n_expensive_gets == n + 3);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        /* Registering a vtable only affects the cached values of the objects at and below it */
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/b", "org.freedesktop.systemd.CachedTest", "AddVtable", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &error, &reply, "a{st}");
+        assert_se(r >= 0);
+        assert_se(c->n_expensive_gets == n + 3);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/b", "org.freedesktop.systemd.CachedTest", "RemoveVtable", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "AddVtable", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        r = sd_bus_get_property(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &error, &reply, "a{st}");
+        assert_se(r >= 0);
+        assert_se(c->n_expensive_gets == n + 4);
+
+        sd_bus_message_unref(reply);
+        reply = NULL;
+
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/a", "org.freedesktop.systemd.CachedTest", "RemoveVtable", &error, NULL, NULL);
+        assert_se(r >= 0);
+
+        /* Get rid of the signals the above sent */
+        while ((r = sd_bus_process(bus, NULL)) > 0)
+                ;
+        assert_se(r == 0);
+
+        /* A proxy mirrors the whole tree locally and follows the change signals */
+        {
+                _cleanup_(sd_bus_proxy_unrefp) sd_bus_proxy *proxy = NULL;
+                _cleanup_strv_free_ char **paths = NULL, **interfaces = NULL;
+                struct proxy_context pc = {};
+                _cleanup_free_ char *v = NULL;
+
+                assert_se(sd_bus_proxy_new(bus, &proxy, "org.freedesktop.systemd.test", "/cached", NULL, proxy_handler, &pc) >= 0);
+                assert_se(sd_bus_proxy_is_ready(proxy) == 0);
+                assert_se(sd_bus_proxy_get_paths(proxy, &paths) == -EAGAIN);
+
+                while (sd_bus_proxy_is_ready(proxy) == 0) {
+                        r = sd_bus_process(bus, NULL);
+                        assert_se(r >= 0);
+                        if (r == 0)
+                                assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+                }
+                assert_se(sd_bus_proxy_is_ready(proxy) > 0);
+                assert_se(pc.n_ready == 1);
+                assert_se(pc.n_changes == 2);
+
+                assert_se(sd_bus_proxy_get_paths(proxy, &paths) >= 0);
+                assert_se(strv_length(paths) == 2);
+                assert_se(streq(paths[0], "/cached/a") && streq(paths[1], "/cached/b"));
+                assert_se(sd_bus_proxy_get_interfaces(proxy, "/cached/b", &interfaces) >= 0);
+                assert_se(strv_contains(interfaces, "org.freedesktop.systemd.CachedTest"));
+
+                n = c->n_cached_gets;
+                assert_se(sd_bus_proxy_get_property_string(proxy, "/cached/a", "org.freedesktop.systemd.CachedTest", "Value", &v) >= 0);
+                assert_se(streq(v, "/cached/a"));
+                assert_se(c->n_cached_gets == n);
+                assert_se(sd_bus_proxy_get_property(proxy, "/cached/a", "org.freedesktop.systemd.CachedTest", "Expensive", &reply, "a{st}") >= 0);
+                assert_se(sd_bus_message_skip(reply, "a{st}") >= 0);
+                reply = sd_bus_message_unref(reply);
+
+                {
+                        _cleanup_(sd_bus_message_unrefp) sd_bus_message *first = NULL, *second = NULL;
+                        const char *s1, *s2;
+
+                        /* Two readers of the same property don't share a read position */
+                        assert_se(sd_bus_proxy_get_property(proxy, "/cached/a", "org.freedesktop.systemd.CachedTest", "Value", &first, "s") >= 0);
+                        assert_se(sd_bus_proxy_get_property(proxy, "/cached/a", "org.freedesktop.systemd.CachedTest", "Value", &second, "s") >= 0);
+                        assert_se(first != second);
+                        assert_se(sd_bus_message_read_basic(first, 's', &s1) > 0);
+                        assert_se(sd_bus_message_read_basic(second, 's', &s2) > 0);
+                        assert_se(streq(s1, "/cached/a") && streq(s2, "/cached/a"));
+                }
+                assert_se(sd_bus_proxy_get_property_string(proxy, "/cached/a", "org.freedesktop.systemd.CachedTest", "Nope", &v) == -ENOENT);
+
+                r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/cached/b", "org.freedesktop.systemd.CachedTest", "Touch", &error, NULL, NULL);
+                assert_se(r >= 0);
+
+                while (pc.n_changes < 3) {
+                        r = sd_bus_process(bus, NULL);
+                        assert_se(r >= 0);
+                        if (r == 0)
+                                assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+                }
+                assert_se(strv_length(pc.last_changed) == 1);
+                assert_se(streq(pc.last_changed[0], "Value"));
+
+                strv_free(pc.last_changed);
+        }
+
         r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Exit", &error, NULL, "");
         assert_se(r >= 0);
 
@@ -0,0 +1,1015 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "string-util.h"
+
+/* Queueing, flow control, statistics and callback timing. Each test runs on a fresh pair of connections
+ * from bus_pair_new(). Tests that make synchronous calls run the server side in a thread of its own, see
+ * server_start(). */
+
+struct server {
+        sd_bus *bus;
+        pthread_t thread;
+        bool quit;
+};
+
+static void bus_pair_new(sd_bus **ret_server, sd_bus **ret_client) {
+        sd_bus *a, *b;
+        int pair[2];
+        sd_id128_t id;
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) >= 0);
+        assert_se(sd_id128_randomize(&id) >= 0);
+
+        assert_se(sd_bus_new(&a) >= 0);
+        assert_se(sd_bus_set_fd(a, pair[0], pair[0]) >= 0);
+        assert_se(sd_bus_set_server(a, 1, id) >= 0);
+        assert_se(sd_bus_start(a) >= 0);
+
+        assert_se(sd_bus_new(&b) >= 0);
+        assert_se(sd_bus_set_fd(b, pair[1], pair[1]) >= 0);
+        assert_se(sd_bus_start(b) >= 0);
+
+        *ret_server = a;
+        *ret_client = b;
+}
+
+static int burst_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus *bus = sd_bus_message_get_bus(m);
+        uint64_t n_queued, q;
+        uint32_t i, n;
+        int r;
+
+        r = sd_bus_message_read(m, "u", &n);
+        assert_se(r > 0);
+
+        /* With auto-cork on nothing is written while we are being dispatched */
+        assert_se(sd_bus_get_n_queued_write(bus, &n_queued) >= 0);
+
+        for (i = 0; i < n; i++) {
+                assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Burst", "u", i) >= 0);
+                assert_se(sd_bus_get_n_queued_write(bus, &q) >= 0);
+                if (sd_bus_get_auto_cork(bus) > 0)
+                        assert_se(q == n_queued + i + 1);
+        }
+
+        r = sd_bus_reply_method_return(m, NULL);
+        assert_se(r >= 0);
+
+        return 1;
+}
+
+static int exit_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        struct server *s = userdata;
+
+        s->quit = true;
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static const sd_bus_vtable server_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("NoOperation", NULL, NULL, NULL, 0),
+        SD_BUS_METHOD("Burst", "u", NULL, burst_handler, 0),
+        SD_BUS_METHOD("Exit", NULL, NULL, exit_handler, 0),
+        SD_BUS_VTABLE_END
+};
+
+static void *server_loop(void *p) {
+        struct server *s = p;
+        int r;
+
+        while (!s->quit) {
+                r = sd_bus_process(s->bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(s->bus, (uint64_t) -1) >= 0);
+        }
+
+        assert_se(sd_bus_flush(s->bus) >= 0);
+        return NULL;
+}
+
+static sd_bus *server_start(struct server *s, bool auto_cork) {
+        sd_bus *client;
+
+        *s = (struct server) {};
+        bus_pair_new(&s->bus, &client);
+
+        assert_se(sd_bus_set_auto_cork(s->bus, auto_cork) >= 0);
+        assert_se(sd_bus_add_object_vtable(s->bus, NULL, "/foo", "org.freedesktop.systemd.test", server_vtable, s) >= 0);
+        assert_se(pthread_create(&s->thread, NULL, server_loop, s) == 0);
+
+        /* Finish authentication first, the tests want to look at queues of a running connection */
+        assert_se(sd_bus_call_method(client, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", NULL, NULL, NULL) >= 0);
+
+        return client;
+}
+
+static void server_stop(struct server *s, sd_bus *client) {
+        assert_se(sd_bus_call_method(client, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Exit", NULL, NULL, NULL) >= 0);
+        assert_se(pthread_join(s->thread, NULL) == 0);
+
+        sd_bus_flush_close_unref(s->bus);
+        sd_bus_flush_close_unref(client);
+}
+
+static int burst_signal_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n = userdata;
+        uint32_t i;
+
+        /* Bursts are always ten signals */
+        assert_se(sd_bus_message_read(m, "u", &i) > 0);
+        assert_se(i == *n % 10);
+        (*n)++;
+
+        return 1;
+}
+
+static int count_reply_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n = userdata;
+
+        assert_se(!sd_bus_message_is_method_error(m, NULL));
+        (*n)++;
+
+        return 1;
+}
+
+static void test_cork(void) {
+        struct server s;
+        sd_bus *bus;
+        _cleanup_(sd_bus_slot_unrefp) sd_bus_slot *slot = NULL;
+        _cleanup_free_ char *big = NULL;
+        unsigned n_signals = 0, n_replies = 0, i;
+        uint64_t q;
+        int r;
+
+        bus = server_start(&s, true);
+
+        /* Signals sent from a dispatched method call arrive in order, and before the reply */
+        assert_se(sd_bus_match_signal(bus, &slot, NULL, "/foo", "org.freedesktop.systemd.test", "Burst", burst_signal_handler, &n_signals) >= 0);
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Burst", NULL, NULL, "u", 10);
+        assert_se(r >= 0);
+
+        while (n_signals < 10) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        /* Explicitly corked, messages stay queued until we uncork */
+        assert_se(sd_bus_get_cork(bus) == 0);
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        assert_se(sd_bus_get_cork(bus) > 0);
+
+        for (i = 0; i < 3; i++)
+                assert_se(sd_bus_call_method_async(bus, NULL, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", count_reply_handler, &n_replies, NULL) >= 0);
+
+        assert_se(sd_bus_get_n_queued_write(bus, &q) >= 0);
+        assert_se(q == 3);
+        assert_se(!(sd_bus_get_events(bus) & POLLOUT));
+        assert_se(sd_bus_process(bus, NULL) >= 0);
+        assert_se(sd_bus_get_n_queued_write(bus, &q) >= 0);
+        assert_se(q == 3);
+
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+        assert_se(sd_bus_get_n_queued_write(bus, &q) >= 0);
+        assert_se(q == 0);
+
+        while (n_replies < 3) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        /* A corked queue doesn't grow without bounds */
+        assert_se(big = malloc(16 * 1024));
+        memset(big, 'x', 16 * 1024 - 1);
+        big[16 * 1024 - 1] = 0;
+
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        for (i = 0; i < 8; i++) {
+                assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "s", big) >= 0);
+                assert_se(bus->wqueue_bytes < BUS_CORK_SIZE_MAX);
+        }
+
+        /* Flushing doesn't care about the cork */
+        assert_se(sd_bus_flush(bus) >= 0);
+        assert_se(sd_bus_get_n_queued_write(bus, &q) >= 0);
+        assert_se(q == 0);
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+
+        server_stop(&s, bus);
+}
+
+static int late_reply_filter(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        uint64_t *cookie = userdata, reply_cookie;
+
+        if (sd_bus_message_get_reply_cookie(m, &reply_cookie) >= 0 && reply_cookie == *cookie)
+                *cookie = 0;
+
+        return 0;
+}
+
+static void test_queue_bytes(void) {
+        struct server s;
+        sd_bus *bus;
+        _cleanup_(sd_bus_slot_unrefp) sd_bus_slot *slot = NULL, *filter = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_free_ char *big = NULL;
+        unsigned n_signals = 0;
+        uint64_t u, high, cookie;
+        int r;
+
+        bus = server_start(&s, false);
+
+        assert_se(sd_bus_get_max_queued_read_bytes(bus, &u) >= 0);
+        assert_se(u == BUS_RQUEUE_SIZE_MAX);
+        assert_se(sd_bus_get_max_queued_write_bytes(bus, &u) >= 0);
+        assert_se(u == BUS_WQUEUE_SIZE_MAX);
+
+        /* Whatever arrives while we wait for a reply is queued and accounted for */
+        assert_se(sd_bus_match_signal(bus, &slot, NULL, "/foo", "org.freedesktop.systemd.test", "Burst", burst_signal_handler, &n_signals) >= 0);
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Burst", NULL, NULL, "u", 10);
+        assert_se(r >= 0);
+
+        assert_se(sd_bus_get_queued_read_bytes(bus, &u, &high) >= 0);
+        assert_se(u > 0);
+        assert_se(high >= u);
+
+        /* Replies are accepted even over budget */
+        assert_se(sd_bus_set_max_queued_read_bytes(bus, 1) >= 0);
+        r = sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", NULL, NULL, NULL);
+        assert_se(r >= 0);
+        assert_se(sd_bus_set_max_queued_read_bytes(bus, BUS_RQUEUE_SIZE_MAX) >= 0);
+
+        while (n_signals < 10) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        assert_se(sd_bus_get_queued_read_bytes(bus, &u, NULL) >= 0);
+        assert_se(u == 0);
+
+        /* Over budget, only a single message is accepted */
+        assert_se(sd_bus_set_max_queued_read_bytes(bus, 1) >= 0);
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Burst") >= 0);
+        assert_se(sd_bus_message_append(m, "u", 10) >= 0);
+        r = sd_bus_call(bus, m, 0, NULL, NULL);
+        assert_se(r == -ENOBUFS);
+
+        /* Read the rest, including the reply nobody waits for anymore */
+        assert_se(sd_bus_message_get_cookie(m, &cookie) >= 0);
+        assert_se(sd_bus_add_filter(bus, &filter, late_reply_filter, &cookie) >= 0);
+
+        assert_se(sd_bus_set_max_queued_read_bytes(bus, BUS_RQUEUE_SIZE_MAX) >= 0);
+        while (n_signals < 20 || cookie != 0) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        /* Same for writing */
+        assert_se(big = malloc(16 * 1024));
+        memset(big, 'x', 16 * 1024 - 1);
+        big[16 * 1024 - 1] = 0;
+
+        assert_se(sd_bus_set_max_queued_write_bytes(bus, 40 * 1024) >= 0);
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+
+        assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "s", big) >= 0);
+        assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "s", big) >= 0);
+        assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "s", big) == -ENOBUFS);
+
+        assert_se(sd_bus_get_queued_write_bytes(bus, &u, &high) >= 0);
+        assert_se(u > 32 * 1024 && u <= 40 * 1024);
+        assert_se(high >= u);
+
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+        assert_se(sd_bus_get_queued_write_bytes(bus, &u, &high) >= 0);
+        assert_se(u == 0);
+        assert_se(high > 32 * 1024);
+
+        assert_se(sd_bus_set_max_queued_write_bytes(bus, 1) >= 0);
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "s", big) >= 0);
+        assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "s", big) == -ENOBUFS);
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+
+        assert_se(sd_bus_set_max_queued_write_bytes(bus, BUS_WQUEUE_SIZE_MAX) >= 0);
+
+        server_stop(&s, bus);
+}
+
+static int write_drained_handler(sd_bus *bus, void *userdata) {
+        unsigned *n = userdata;
+
+        assert_se(!sd_bus_is_write_blocked(bus));
+        (*n)++;
+        return 0;
+}
+
+static void test_write_watermarks(void) {
+        struct server s;
+        sd_bus *bus;
+        unsigned n_drained = 0, i;
+        uint64_t low, high;
+        int r;
+
+        bus = server_start(&s, false);
+
+        assert_se(sd_bus_get_write_watermarks(bus, &low, &high) >= 0);
+        assert_se(low == UINT64_MAX && high == UINT64_MAX);
+        assert_se(sd_bus_set_write_watermarks(bus, 2, 1) == -EINVAL);
+
+        assert_se(sd_bus_set_write_watermarks(bus, 0, 1024) >= 0);
+        assert_se(sd_bus_get_write_watermarks(bus, &low, &high) >= 0);
+        assert_se(low == 0 && high == 1024);
+        assert_se(sd_bus_set_write_drained_handler(bus, write_drained_handler, &n_drained) >= 0);
+
+        /* The signal that crosses the high mark is still taken, the ones after it aren't */
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        for (i = 0; sd_bus_is_write_blocked(bus) == 0; i++) {
+                assert_se(i < 1024);
+                assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "u", i) >= 0);
+        }
+        assert_se(i > 1);
+        assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "u", i) == -EAGAIN);
+
+        /* Writing it out unblocks, but the callback is left to sd_bus_process() */
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+        assert_se(sd_bus_is_write_blocked(bus) == 0);
+        assert_se(n_drained == 0);
+
+        r = sd_bus_process(bus, NULL);
+        assert_se(r > 0);
+        assert_se(n_drained == 1);
+        assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "u", i) >= 0);
+
+        /* Synchronous calls aren't held back, they write out the queue while waiting anyway */
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        for (i = 0; sd_bus_is_write_blocked(bus) == 0; i++) {
+                assert_se(i < 1024);
+                assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "u", i) >= 0);
+        }
+        assert_se(sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", NULL, NULL, NULL) >= 0);
+        assert_se(sd_bus_is_write_blocked(bus) == 0);
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+
+        assert_se(sd_bus_set_write_drained_handler(bus, NULL, NULL) >= 0);
+        assert_se(sd_bus_set_write_watermarks(bus, UINT64_MAX, UINT64_MAX) >= 0);
+        assert_se(sd_bus_flush(bus) >= 0);
+        assert_se(n_drained == 1);
+
+        server_stop(&s, bus);
+}
+
+static int watermark_value_get(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_append(reply, "u", 4711);
+}
+
+static const sd_bus_vtable watermark_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_PROPERTY("Value", "u", watermark_value_get, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_VTABLE_END
+};
+
+static int watermark_changed_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n = userdata;
+
+        (*n)++;
+        return 0;
+}
+
+static void test_write_watermarks_deferred(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        unsigned n_changed = 0, i;
+        size_t n_queued;
+
+        bus_pair_new(&a, &b);
+
+        assert_se(sd_bus_match_signal(a, NULL, NULL, "/watermark", "org.freedesktop.DBus.Properties", "PropertiesChanged", watermark_changed_handler, &n_changed) >= 0);
+        assert_se(sd_bus_add_object_vtable(b, NULL, "/watermark", "org.freedesktop.systemd.test", watermark_vtable, NULL) >= 0);
+        assert_se(sd_bus_set_properties_changed_deferred(b, true) >= 0);
+        assert_se(sd_bus_set_write_watermarks(b, 0, 1024) >= 0);
+
+        while (sd_bus_is_ready(b) <= 0) {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process(a, NULL) >= 0);
+        }
+
+        /* A change that was accepted before the queue backed up is still sent when it is flushed */
+        assert_se(sd_bus_emit_properties_changed(b, "/watermark", "org.freedesktop.systemd.test", "Value", NULL) >= 0);
+
+        assert_se(sd_bus_set_cork(b, true) >= 0);
+        for (i = 0; sd_bus_is_write_blocked(b) == 0; i++) {
+                assert_se(i < 1024);
+                assert_se(sd_bus_emit_signal(b, "/watermark", "org.freedesktop.systemd.test", "Big", "u", i) >= 0);
+        }
+
+        n_queued = b->wqueue_size;
+        while (sd_bus_process(b, NULL) > 0)
+                ;
+        assert_se(b->wqueue_size == n_queued + 1);
+        assert_se(sd_bus_set_cork(b, false) >= 0);
+
+        while (n_changed < 1) {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process(a, NULL) >= 0);
+        }
+}
+
+static void test_priorities(void) {
+        struct server s;
+        sd_bus *bus;
+        _cleanup_(sd_bus_slot_unrefp) sd_bus_slot *slot = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        unsigned n_signals = 0, n_replies = 0, i;
+        int64_t p;
+        int r;
+
+        bus = server_start(&s, false);
+
+        assert_se(sd_bus_get_message_type_priority(bus, SD_BUS_MESSAGE_SIGNAL, &p) >= 0);
+        assert_se(p == 0);
+        assert_se(sd_bus_set_message_type_priority(bus, _SD_BUS_MESSAGE_TYPE_INVALID, 1) == -EINVAL);
+        assert_se(sd_bus_set_message_type_priority(bus, SD_BUS_MESSAGE_SIGNAL, 10) >= 0);
+        assert_se(sd_bus_get_message_type_priority(bus, SD_BUS_MESSAGE_SIGNAL, &p) >= 0);
+        assert_se(p == 10);
+
+        /* Calls overtake queued signals, but stay in order among themselves */
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        for (i = 0; i < 3; i++)
+                assert_se(sd_bus_emit_signal(bus, "/foo", "org.freedesktop.systemd.test", "Big", "u", i) >= 0);
+        for (i = 0; i < 2; i++)
+                assert_se(sd_bus_call_method_async(bus, NULL, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", count_reply_handler, &n_replies, NULL) >= 0);
+
+        assert_se(bus->wqueue_size == 5);
+        for (i = 0; i < 5; i++)
+                assert_se(bus->wqueue[i]->priority == (i < 2 ? 0 : 10));
+        assert_se(BUS_MESSAGE_COOKIE(bus->wqueue[0]) < BUS_MESSAGE_COOKIE(bus->wqueue[1]));
+        assert_se(BUS_MESSAGE_COOKIE(bus->wqueue[2]) < BUS_MESSAGE_COOKIE(bus->wqueue[3]));
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+
+        /* The reply is dispatched ahead of the signals sent before it, which are kept queued for later */
+        assert_se(sd_bus_match_signal(bus, &slot, NULL, "/foo", "org.freedesktop.systemd.test", "Burst", burst_signal_handler, &n_signals) >= 0);
+        assert_se(sd_bus_call_method_async(bus, NULL, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Burst", count_reply_handler, &n_replies, "u", 10) >= 0);
+
+        while (n_replies < 3) {
+                r = sd_bus_process_priority(bus, 0, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        assert_se(n_signals == 0);
+        assert_se(bus->rqueue_size == 10);
+
+        /* A synchronous call finds its reply even though it is sorted in ahead of the queued signals */
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Burst") >= 0);
+        assert_se(sd_bus_message_append(m, "u", 10) >= 0);
+        assert_se(sd_bus_call(bus, m, 5 * USEC_PER_SEC, NULL, NULL) >= 0);
+        assert_se(bus->rqueue_size == 20);
+
+        while (n_signals < 20)
+                assert_se(sd_bus_process(bus, NULL) > 0);
+
+        assert_se(sd_bus_set_message_type_priority(bus, SD_BUS_MESSAGE_SIGNAL, 0) >= 0);
+
+        server_stop(&s, bus);
+}
+
+static int timeout_reply_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n = userdata;
+
+        assert_se(sd_bus_message_is_method_error(m, SD_BUS_ERROR_NO_REPLY));
+        (*n)++;
+
+        return 1;
+}
+
+static void test_expired_calls(void) {
+        struct server s;
+        sd_bus *bus;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        unsigned n_timeouts = 0, n_replies = 0;
+        uint64_t q;
+        int r;
+
+        bus = server_start(&s, false);
+
+        /* A call that timed out while still queued is never sent, the one behind it is */
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation") >= 0);
+        assert_se(sd_bus_call_async(bus, NULL, m, timeout_reply_handler, &n_timeouts, 1) >= 0);
+        assert_se(sd_bus_call_method_async(bus, NULL, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", count_reply_handler, &n_replies, NULL) >= 0);
+
+        assert_se(sd_bus_get_n_queued_write(bus, &q) >= 0);
+        assert_se(q == 2);
+        assert_se(sd_bus_get_n_expired_write(bus, &q) >= 0);
+        assert_se(q == 0);
+
+        assert_se(usleep(2000) >= 0);
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+
+        assert_se(sd_bus_get_n_queued_write(bus, &q) >= 0);
+        assert_se(q == 0);
+        assert_se(sd_bus_get_n_expired_write(bus, &q) >= 0);
+        assert_se(q == 1);
+
+        while (n_timeouts < 1 || n_replies < 1) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        assert_se(n_timeouts == 1);
+        assert_se(n_replies == 1);
+
+        /* The deadline of a call is not left behind on the caller's message, sending it again later on
+         * doesn't drop it as expired */
+        m = sd_bus_message_unref(m);
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation") >= 0);
+        (void) sd_bus_call(bus, m, 1, NULL, NULL);
+        assert_se(m->deadline == 0);
+
+        assert_se(usleep(2000) >= 0);
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        assert_se(sd_bus_send(bus, m, NULL) >= 0);
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+        assert_se(sd_bus_get_n_expired_write(bus, &q) >= 0);
+        assert_se(q == 1);
+
+        server_stop(&s, bus);
+}
+
+static void test_stats(void) {
+        _cleanup_(sd_bus_slot_unrefp) sd_bus_slot *slot = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        unsigned n_signals = 0, n_timeouts = 0;
+        uint64_t n_expired, high;
+        sd_bus_stats a, b;
+        struct server s;
+        sd_bus *bus;
+        int r;
+
+        bus = server_start(&s, false);
+
+        /* The signals arrive while we wait for the reply, and pile up in the read queue */
+        assert_se(sd_bus_match_signal(bus, &slot, NULL, "/foo", "org.freedesktop.systemd.test", "Burst", burst_signal_handler, &n_signals) >= 0);
+        assert_se(sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "Burst", NULL, NULL, "u", 10) >= 0);
+
+        while (n_signals < 10) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        /* And a call that times out before it is written */
+        assert_se(sd_bus_set_cork(bus, true) >= 0);
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation") >= 0);
+        assert_se(sd_bus_call_async(bus, NULL, m, timeout_reply_handler, &n_timeouts, 1) >= 0);
+        assert_se(usleep(2000) >= 0);
+        assert_se(sd_bus_set_cork(bus, false) >= 0);
+
+        while (n_timeouts < 1) {
+                r = sd_bus_process(bus, NULL);
+                assert_se(r >= 0);
+                if (r == 0)
+                        assert_se(sd_bus_wait(bus, (uint64_t) -1) >= 0);
+        }
+
+        assert_se(sd_bus_get_stats(bus, &a, sizeof(a)) >= 0);
+        assert_se(a.messages_sent[SD_BUS_MESSAGE_METHOD_CALL] > 0);
+        assert_se(a.bytes_sent[SD_BUS_MESSAGE_METHOD_CALL] > a.messages_sent[SD_BUS_MESSAGE_METHOD_CALL] * sizeof(struct bus_header));
+        assert_se(a.messages_received[SD_BUS_MESSAGE_METHOD_RETURN] > 0);
+        assert_se(a.messages_received[SD_BUS_MESSAGE_SIGNAL] > 0);
+        assert_se(a.read_calls > 0);
+        assert_se(a.write_calls > 0);
+        assert_se(a.wqueue_peak > 0);
+        assert_se(a.rqueue_peak >= 10);
+        assert_se(a.match_callbacks > 0);
+        assert_se(a.reply_timeouts > 0);
+        assert_se(a.expired_writes == 1);
+        assert_se(a.messages_allocated > 0);
+
+        assert_se(sd_bus_reset_stats(bus) >= 0);
+        assert_se(sd_bus_get_stats(bus, &a, sizeof(a)) >= 0);
+        assert_se(a.messages_sent[SD_BUS_MESSAGE_METHOD_CALL] == 0);
+        assert_se(a.reply_timeouts == 0);
+        assert_se(a.rqueue_peak == 0);
+        assert_se(a.rqueue_bytes_peak == 0);
+        assert_se(a.expired_writes == 0);
+        assert_se(a.shed_reads == 0);
+
+        /* What the other getters report stays untouched */
+        assert_se(sd_bus_get_n_expired_write(bus, &n_expired) >= 0);
+        assert_se(n_expired == 1);
+        assert_se(sd_bus_get_queued_read_bytes(bus, NULL, &high) >= 0);
+        assert_se(high > 0);
+
+        assert_se(sd_bus_call_method(bus, "org.freedesktop.systemd.test", "/foo", "org.freedesktop.systemd.test", "NoOperation", NULL, NULL, NULL) >= 0);
+
+        assert_se(sd_bus_get_stats(bus, &b, sizeof(b)) >= 0);
+        assert_se(b.messages_sent[SD_BUS_MESSAGE_METHOD_CALL] == 1);
+        assert_se(b.messages_received[SD_BUS_MESSAGE_METHOD_RETURN] == 1);
+        assert_se(b.bytes_received[SD_BUS_MESSAGE_METHOD_RETURN] > sizeof(struct bus_header));
+        assert_se(b.messages_allocated >= 2);
+        assert_se(b.read_calls > 0);
+
+        /* Callers that know about fewer fields only get those */
+        memset(&a, 0xff, sizeof(a));
+        assert_se(sd_bus_get_stats(bus, &a, offsetof(sd_bus_stats, read_calls)) >= 0);
+        assert_se(a.messages_sent[SD_BUS_MESSAGE_METHOD_CALL] == 1);
+        assert_se(a.read_calls == UINT64_MAX);
+
+        server_stop(&s, bus);
+}
+
+static int shed_handler(sd_bus_message *m, void *userdata) {
+        return sd_bus_message_is_method_call(m, NULL, "Expensive") ||
+               sd_bus_message_is_signal(m, NULL, "Telemetry");
+}
+
+static int shed_reply_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n = userdata;
+
+        if (sd_bus_message_is_method_error(m, SD_BUS_ERROR_LIMITS_EXCEEDED))
+                n[0]++;
+        else
+                n[1]++;
+
+        return 1;
+}
+
+static void test_shedding(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        int r;
+        unsigned n_replies[2] = {}, i;
+        uint64_t u, bytes;
+        sd_bus_stats stats;
+
+        bus_pair_new(&a, &b);
+
+        assert_se(sd_bus_get_shed_threshold(a, &u, &bytes) >= 0);
+        assert_se(u == UINT64_MAX && bytes == UINT64_MAX);
+        assert_se(sd_bus_set_shed_threshold(a, 2, UINT64_MAX) >= 0);
+        assert_se(sd_bus_set_shed_handler(a, shed_handler, NULL) >= 0);
+
+        /* Hold back everything that arrives on the server, so that its read queue fills up */
+        assert_se(sd_bus_set_message_type_priority(a, SD_BUS_MESSAGE_METHOD_CALL, 10) >= 0);
+        assert_se(sd_bus_set_message_type_priority(a, SD_BUS_MESSAGE_SIGNAL, 10) >= 0);
+
+        for (i = 0; i < 2; i++)
+                assert_se(sd_bus_call_method_async(b, NULL, NULL, "/shed", "org.freedesktop.systemd.test", "Cheap", shed_reply_handler, n_replies, NULL) >= 0);
+        for (i = 0; i < 3; i++)
+                assert_se(sd_bus_call_method_async(b, NULL, NULL, "/shed", "org.freedesktop.systemd.test", "Expensive", shed_reply_handler, n_replies, NULL) >= 0);
+        for (i = 0; i < 2; i++)
+                assert_se(sd_bus_emit_signal(b, "/shed", "org.freedesktop.systemd.test", "Telemetry", NULL) >= 0);
+        assert_se(sd_bus_emit_signal(b, "/shed", "org.freedesktop.systemd.test", "Status", NULL) >= 0);
+
+        /* The expensive calls fail right away, without ever being dispatched */
+        do {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process_priority(a, 0, NULL) >= 0);
+                assert_se(sd_bus_get_n_shed_read(a, &u) >= 0);
+        } while (n_replies[0] < 3 || u < 5 || a->rqueue_size < 3);
+
+        assert_se(u == 5);
+        assert_se(a->rqueue_size == 3);
+        assert_se(n_replies[1] == 0);
+        assert_se(sd_bus_get_stats(a, &stats, sizeof(stats)) >= 0);
+        assert_se(stats.shed_reads == 5);
+
+        /* Below the threshold again, everything is queued */
+        assert_se(sd_bus_set_message_type_priority(a, SD_BUS_MESSAGE_METHOD_CALL, 0) >= 0);
+        assert_se(sd_bus_set_message_type_priority(a, SD_BUS_MESSAGE_SIGNAL, 0) >= 0);
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/shed", "org.freedesktop.systemd.test", "Expensive", shed_reply_handler, n_replies, NULL) >= 0);
+
+        while (n_replies[1] < 3) {
+                r = sd_bus_process(b, NULL);
+                assert_se(r >= 0);
+                r = sd_bus_process(a, NULL);
+                assert_se(r >= 0);
+        }
+
+        assert_se(n_replies[0] == 3);
+        assert_se(sd_bus_get_n_shed_read(a, &u) >= 0);
+        assert_se(u == 5);
+}
+
+static void test_shedding_full(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        unsigned n_replies[2] = {}, i;
+        uint64_t u;
+
+        bus_pair_new(&a, &b);
+
+        while (sd_bus_is_ready(b) <= 0) {
+                assert_se(sd_bus_process(a, NULL) >= 0);
+                assert_se(sd_bus_process(b, NULL) >= 0);
+        }
+
+        /* A single message fills the read queue, and calls are shed from then on */
+        assert_se(sd_bus_set_max_queued_read_bytes(a, 1) >= 0);
+        assert_se(sd_bus_set_shed_threshold(a, 1, UINT64_MAX) >= 0);
+        assert_se(sd_bus_set_message_type_priority(a, SD_BUS_MESSAGE_METHOD_CALL, 10) >= 0);
+        assert_se(sd_bus_set_message_type_priority(a, SD_BUS_MESSAGE_SIGNAL, 10) >= 0);
+
+        assert_se(sd_bus_emit_signal(b, "/shed", "org.freedesktop.systemd.test", "Status", NULL) >= 0);
+        for (i = 0; i < 3; i++)
+                assert_se(sd_bus_call_method_async(b, NULL, NULL, "/shed", "org.freedesktop.systemd.test", "Cheap", shed_reply_handler, n_replies, NULL) >= 0);
+        assert_se(sd_bus_emit_signal(b, "/shed", "org.freedesktop.systemd.test", "Status", NULL) >= 0);
+
+        /* The calls are still read and shed although the queue is full, the signal after them is left
+         * unread instead */
+        do {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process_priority(a, 0, NULL) >= 0);
+        } while (n_replies[0] < 3);
+
+        assert_se(sd_bus_get_n_shed_read(a, &u) >= 0);
+        assert_se(u == 3);
+        assert_se(a->rqueue_size == 1);
+        assert_se(n_replies[1] == 0);
+
+        /* Once there is room, it is queued */
+        assert_se(sd_bus_set_max_queued_read_bytes(a, UINT64_MAX) >= 0);
+        assert_se(sd_bus_process_priority(a, 0, NULL) >= 0);
+        assert_se(a->rqueue_size == 2);
+}
+
+static int latency_slow_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        usleep(2000);
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int latency_fail_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return -EINVAL;
+}
+
+static int latency_stall_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        usleep(50 * USEC_PER_MSEC);
+        return sd_bus_reply_method_return(m, NULL);
+}
+
+static int latency_stalled_get(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        usleep(50 * USEC_PER_MSEC);
+        return sd_bus_message_append(reply, "b", true);
+}
+
+static const sd_bus_vtable latency_vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Slow", NULL, NULL, latency_slow_handler, 0),
+        SD_BUS_METHOD("Fail", NULL, NULL, latency_fail_handler, 0),
+        SD_BUS_METHOD("Stall", NULL, NULL, latency_stall_handler, 0),
+        SD_BUS_PROPERTY("Stalled", "b", latency_stalled_get, 0, 0),
+        SD_BUS_VTABLE_END
+};
+
+static int latency_count_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        unsigned *n = userdata;
+
+        (*n)++;
+        return 1;
+}
+
+static int latency_reply_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        sd_bus_message **reply = userdata;
+
+        *reply = sd_bus_message_ref(m);
+        return 1;
+}
+
+static void test_slot_latency(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *reply = NULL;
+        _cleanup_(sd_bus_slot_unrefp) sd_bus_slot *vtable_slot = NULL, *match_slot = NULL, *reply_slot = NULL;
+        sd_bus_latency l;
+        const char *kind, *description, *path, *interface, *member;
+        uint64_t calls, errors, total, max, sum;
+        const uint64_t *buckets;
+        size_t n_buckets;
+        unsigned n = 0, n_found = 0, i;
+
+        bus_pair_new(&a, &b);
+
+        assert_se(sd_bus_add_object_vtable(a, &vtable_slot, "/latency", "org.freedesktop.systemd.test", latency_vtable, NULL) >= 0);
+        assert_se(sd_bus_match_signal(a, &match_slot, NULL, "/latency", "org.freedesktop.systemd.test", "Tick", latency_count_handler, &n) >= 0);
+        assert_se(sd_bus_add_latency_object(a, NULL, "/debug") >= 0);
+
+        assert_se(sd_bus_get_slot_latency(a) == 0);
+        assert_se(sd_bus_set_slot_latency(a, true) >= 0);
+        assert_se(sd_bus_get_slot_latency(a) > 0);
+        assert_se(sd_bus_set_slot_latency(b, true) >= 0);
+
+        assert_se(sd_bus_call_method_async(b, &reply_slot, NULL, "/latency", "org.freedesktop.systemd.test", "Slow", latency_count_handler, &n, NULL) >= 0);
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/latency", "org.freedesktop.systemd.test", "Slow", latency_count_handler, &n, NULL) >= 0);
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/latency", "org.freedesktop.systemd.test", "Fail", latency_count_handler, &n, NULL) >= 0);
+        assert_se(sd_bus_emit_signal(b, "/latency", "org.freedesktop.systemd.test", "Tick", NULL) >= 0);
+
+        while (n < 4) {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process(a, NULL) >= 0);
+        }
+
+        /* Methods are counted each on their own, the vtable slot itself only has its property callbacks */
+        assert_se(sd_bus_slot_get_latency(vtable_slot, &l, sizeof(l)) >= 0);
+        assert_se(l.calls == 0);
+
+        assert_se(sd_bus_slot_get_method_latency(vtable_slot, "Slow", &l, sizeof(l)) >= 0);
+        assert_se(l.calls == 2);
+        assert_se(l.errors == 0);
+        assert_se(l.usec_max >= 2000);
+        assert_se(l.usec_total >= 4000);
+        for (i = 0, sum = 0; i < SD_BUS_LATENCY_BUCKETS; i++)
+                sum += l.buckets[i];
+        assert_se(sum == 2);
+        for (i = 11, sum = 0; i < SD_BUS_LATENCY_BUCKETS; i++)
+                sum += l.buckets[i];
+        assert_se(sum == 2);
+
+        assert_se(sd_bus_slot_get_method_latency(vtable_slot, "Fail", &l, sizeof(l)) >= 0);
+        assert_se(l.calls == 1);
+        assert_se(l.errors == 1);
+
+        assert_se(sd_bus_slot_get_method_latency(vtable_slot, "Stall", &l, sizeof(l)) >= 0);
+        assert_se(l.calls == 0);
+        assert_se(sd_bus_slot_get_method_latency(vtable_slot, "Nope", &l, sizeof(l)) == -ENOENT);
+        assert_se(sd_bus_slot_get_method_latency(match_slot, "Tick", &l, sizeof(l)) == -EINVAL);
+
+        assert_se(sd_bus_slot_get_latency(match_slot, &l, sizeof(l)) >= 0);
+        assert_se(l.calls == 1);
+        assert_se(l.errors == 0);
+
+        assert_se(sd_bus_slot_get_latency(reply_slot, &l, sizeof(l)) >= 0);
+        assert_se(l.calls == 1);
+
+        /* The same, as seen over the bus */
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/debug", "org.basu.Debug.Latency1", "GetLatency", latency_reply_handler, &reply, NULL) >= 0);
+        while (!reply) {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process(a, NULL) >= 0);
+        }
+
+        assert_se(sd_bus_message_enter_container(reply, 'a', "(sssssttttat)") > 0);
+        while (sd_bus_message_enter_container(reply, 'r', "sssssttttat") > 0) {
+                assert_se(sd_bus_message_read(reply, "ssssstttt", &kind, &description, &path, &interface, &member, &calls, &errors, &total, &max) > 0);
+                assert_se(sd_bus_message_read_array(reply, 't', (const void**) &buckets, &n_buckets) > 0);
+                assert_se(n_buckets == SD_BUS_LATENCY_BUCKETS * sizeof(uint64_t));
+                assert_se(sd_bus_message_exit_container(reply) > 0);
+
+                n_found++;
+
+                if (streq(kind, "vtable")) {
+                        assert_se(streq(path, "/latency"));
+                        assert_se(streq(interface, "org.freedesktop.systemd.test"));
+
+                        if (streq(member, "Slow"))
+                                assert_se(calls == 2 && errors == 0 && max >= 2000);
+                        else
+                                assert_se(streq(member, "Fail") && calls == 1 && errors == 1);
+                } else
+                        assert_se(streq(kind, "match") && isempty(member) && calls == 1);
+        }
+        assert_se(sd_bus_message_exit_container(reply) > 0);
+        assert_se(n_found == 3);
+
+        /* Callers that know about fewer fields only get those */
+        memset(&l, 0xff, sizeof(l));
+        assert_se(sd_bus_slot_get_method_latency(vtable_slot, "Slow", &l, offsetof(sd_bus_latency, usec_total)) >= 0);
+        assert_se(l.calls == 2);
+        assert_se(l.usec_total == UINT64_MAX);
+
+        /* Nothing is recorded while timing is off, resetting starts over */
+        assert_se(sd_bus_set_slot_latency(a, false) >= 0);
+        assert_se(sd_bus_slot_reset_latency(vtable_slot) >= 0);
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/latency", "org.freedesktop.systemd.test", "Slow", latency_count_handler, &n, NULL) >= 0);
+        while (n < 5) {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process(a, NULL) >= 0);
+        }
+
+        assert_se(sd_bus_slot_get_method_latency(vtable_slot, "Slow", &l, sizeof(l)) >= 0);
+        assert_se(l.calls == 0 && l.usec_max == 0);
+}
+
+struct slow_context {
+        unsigned n_slow;
+        char *description;
+        char *member;
+        char *path;
+        uint64_t usec;
+};
+
+static int slow_callback_handler(sd_bus_slot *slot, sd_bus_message *m, uint64_t usec, void *userdata) {
+        struct slow_context *c = userdata;
+        const char *description;
+
+        assert_se(sd_bus_slot_get_description(slot, &description) >= 0);
+        assert_se(sd_bus_slot_get_current_message(slot) == m);
+
+        c->n_slow++;
+        assert_se(free_and_strdup(&c->description, description) >= 0);
+        assert_se(free_and_strdup(&c->member, sd_bus_message_get_member(m)) >= 0);
+        assert_se(free_and_strdup(&c->path, sd_bus_message_get_path(m)) >= 0);
+        c->usec = usec;
+
+        return 0;
+}
+
+static void test_slow_callbacks(void) {
+        _cleanup_(sd_bus_flush_close_unrefp) sd_bus *a = NULL, *b = NULL;
+        _cleanup_(sd_bus_slot_unrefp) sd_bus_slot *vtable_slot = NULL;
+        struct slow_context c = {};
+        sd_bus_latency l;
+        sd_bus_stats stats;
+        unsigned n = 0;
+        uint64_t u;
+
+        bus_pair_new(&a, &b);
+
+        assert_se(sd_bus_add_object_vtable(a, &vtable_slot, "/latency", "org.freedesktop.systemd.test", latency_vtable, NULL) >= 0);
+        assert_se(sd_bus_slot_set_description(vtable_slot, "latency-vtable") >= 0);
+
+        assert_se(sd_bus_get_slow_callback_threshold(a, &u) >= 0);
+        assert_se(u == UINT64_MAX);
+        assert_se(sd_bus_set_slow_callback_threshold(a, 20 * USEC_PER_MSEC) >= 0);
+        assert_se(sd_bus_get_slow_callback_threshold(a, &u) >= 0);
+        assert_se(u == 20 * USEC_PER_MSEC);
+        assert_se(sd_bus_set_slow_callback_handler(a, slow_callback_handler, &c) >= 0);
+
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/latency", "org.freedesktop.systemd.test", "Fail", latency_count_handler, &n, NULL) >= 0);
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/latency", "org.freedesktop.systemd.test", "Stall", latency_count_handler, &n, NULL) >= 0);
+
+        while (n < 2) {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process(a, NULL) >= 0);
+        }
+
+        /* Only the slow one is reported, and the watchdog alone doesn't make the latency be recorded */
+        assert_se(c.n_slow == 1);
+        assert_se(streq(c.description, "latency-vtable"));
+        assert_se(streq(c.member, "Stall"));
+        assert_se(streq(c.path, "/latency"));
+        assert_se(c.usec >= 50 * USEC_PER_MSEC);
+
+        assert_se(sd_bus_get_stats(a, &stats, sizeof(stats)) >= 0);
+        assert_se(stats.slow_callbacks == 1);
+        assert_se(sd_bus_slot_get_method_latency(vtable_slot, "Stall", &l, sizeof(l)) >= 0);
+        assert_se(l.calls == 0);
+
+        /* Property getters are watched too, on behalf of the call that asked for the property */
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/latency", "org.freedesktop.DBus.Properties", "Get", latency_count_handler, &n,
+                                           "ss", "org.freedesktop.systemd.test", "Stalled") >= 0);
+        while (n < 3) {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process(a, NULL) >= 0);
+        }
+        assert_se(c.n_slow == 2);
+        assert_se(streq(c.member, "Get"));
+        assert_se(c.usec >= 50 * USEC_PER_MSEC);
+
+        /* Turned off again */
+        assert_se(sd_bus_set_slow_callback_threshold(a, UINT64_MAX) >= 0);
+        assert_se(sd_bus_call_method_async(b, NULL, NULL, "/latency", "org.freedesktop.systemd.test", "Stall", latency_count_handler, &n, NULL) >= 0);
+        while (n < 4) {
+                assert_se(sd_bus_process(b, NULL) >= 0);
+                assert_se(sd_bus_process(a, NULL) >= 0);
+        }
+        assert_se(c.n_slow == 2);
+
+        free(c.description);
+        free(c.member);
+        free(c.path);
+}
+
+int main(int argc, char *argv[]) {
+        test_cork();
+        test_queue_bytes();
+        test_write_watermarks();
+        test_write_watermarks_deferred();
+        test_priorities();
+        test_expired_calls();
+        test_stats();
+        test_shedding();
+        test_shedding_full();
+        test_slot_latency();
+        test_slow_callbacks();
+
+        return 0;
+}
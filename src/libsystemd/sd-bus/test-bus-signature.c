@@ -1,9 +1,70 @@
 /* SPDX-License-Identifier: LGPL-2.1+ */
 
+#include "bus-gvariant.h"
 #include "bus-internal.h"
 #include "bus-signature.h"
 #include "string-util.h"
 
+static void test_intern_one(const char *s) {
+        const struct bus_signature *sig;
+        char copy[256];
+        size_t i, n;
+
+        log_info("intern: \"%s\"", s);
+
+        sig = bus_signature_intern(s);
+        if (!signature_is_valid(s, true)) {
+                assert_se(!sig);
+                assert_se(!bus_signature_lookup(s));
+                return;
+        }
+
+        /* Equal strings map to the same entry, wherever they live */
+        assert_se(sig);
+        assert_se(strlen(s) < sizeof(copy));
+        assert_se(bus_signature_intern(strcpy(copy, s)) == sig);
+        assert_se(bus_signature_lookup(copy) == sig);
+        assert_se(streq(sig->string, s));
+        assert_se(sig->length == strlen(s));
+
+        assert_se(sig->valid_strict == signature_is_valid(s, false));
+        assert_se(sig->single == signature_is_single(s, true));
+        assert_se(sig->single_strict == signature_is_single(s, false));
+        assert_se(sig->pair == signature_is_pair(s));
+        assert_se(sig->gvariant_alignment == bus_gvariant_get_alignment(s));
+        assert_se(sig->gvariant_size == bus_gvariant_get_size(s));
+
+        for (i = 0; i < sig->length; i++) {
+                if (signature_element_length(s + i, &n) < 0) {
+                        assert_se(sig->element_length[i] == 0);
+                        continue;
+                }
+
+                assert_se(sig->element_length[i] == n);
+
+                strncpy(copy, s + i, n);
+                copy[n] = 0;
+                assert_se(sig->element_alignment[i] == bus_gvariant_get_alignment(copy));
+                assert_se(sig->element_size[i] == bus_gvariant_get_size(copy));
+        }
+}
+
+static void test_lookup(void) {
+        /* Looking a signature up never adds it, as that's what is done for the signatures of messages */
+        assert_se(!bus_signature_lookup("a(ua{s(xq)})"));
+        assert_se(!bus_signature_lookup("a(ua{s(xq)})"));
+
+        /* Interning one makes the contents of its containers known too */
+        assert_se(bus_signature_intern("a(ua{s(xq)})"));
+        assert_se(bus_signature_lookup("a(ua{s(xq)})"));
+        assert_se(bus_signature_lookup("(ua{s(xq)})"));
+        assert_se(bus_signature_lookup("ua{s(xq)}"));
+        assert_se(bus_signature_lookup("{s(xq)}"));
+        assert_se(bus_signature_lookup("s(xq)"));
+        assert_se(bus_signature_lookup("xq"));
+        assert_se(!bus_signature_lookup("a{s(xq)}"));
+}
+
 int main(int argc, char *argv[]) {
         char prefix[256];
         int r;
@@ -63,6 +124,24 @@ int main(int argc, char *argv[]) {
         assert_se(signature_is_valid("((((((((((((((((((((((((((((((((s))))))))))))))))))))))))))))))))", false));
         assert_se(!signature_is_valid("((((((((((((((((((((((((((((((((()))))))))))))))))))))))))))))))))", false));
 
+        test_lookup();
+
+        test_intern_one("");
+        test_intern_one("y");
+        test_intern_one("sv");
+        test_intern_one("{sv}");
+        test_intern_one("a{sv}");
+        test_intern_one("(yqut)");
+        test_intern_one("(yqutas)");
+        test_intern_one("a(tt)");
+        test_intern_one("ssa{ss}sssub");
+        test_intern_one("sssusa(uuubbba(uu)uuuu)a{u(uuuvas)}");
+        test_intern_one("aaaaaaaaaaaaaaaaaaaaaaaaaaaaaaaas");
+        test_intern_one("((((((((((((((((((((((((((((((((s))))))))))))))))))))))))))))))))");
+        test_intern_one("()");
+        test_intern_one("a");
+        test_intern_one("{ss");
+
         assert_se(namespace_complex_pattern("", ""));
         assert_se(namespace_complex_pattern("foobar", "foobar"));
         assert_se(namespace_complex_pattern("foobar.waldo", "foobar.waldo"));
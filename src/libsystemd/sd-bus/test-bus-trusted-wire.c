@@ -0,0 +1,406 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdarg.h>
+#include <stdio.h>
+#include <sys/socket.h>
+
+#include "sd-bus.h"
+
+#include "alloc-util.h"
+#include "bus-dump.h"
+#include "bus-internal.h"
+#include "bus-message.h"
+#include "bus-objects.h"
+#include "fd-util.h"
+#include "fileio.h"
+#include "parse-util.h"
+#include "string-util.h"
+#include "strv.h"
+#include "tests.h"
+
+/* On a trusted wire strings and object paths are not checked for their contents anymore, only for being
+ * in bounds and NUL terminated, and object paths for being absolute without empty components. Check that
+ * the contents really aren't looked at, and then throw randomly mutated messages at both a trusted and an
+ * untrusted bus, and through their object tree and match code, so that the sanitizers notice if anything
+ * reads past the end of the message. Files given on the command line are used as additional seeds, and
+ * $BUS_FUZZ_ITERATIONS sets the number of mutations per seed. */
+
+static unsigned arg_n_iterations = 20000;
+
+static uint64_t next_random(void) {
+        static uint64_t state = 0x2545f4914f6cdd1dULL;
+
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 33;
+}
+
+static sd_bus *bus_new(bool trusted_wire, int fd) {
+        sd_bus *bus;
+
+        assert_se(sd_bus_new(&bus) >= 0);
+        assert_se(sd_bus_set_trusted_wire(bus, trusted_wire) >= 0);
+        /* So that the object code runs the handlers without asking for the sender's credentials */
+        assert_se(sd_bus_set_trusted(bus, true) >= 0);
+        assert_se(sd_bus_set_fd(bus, fd, fd) >= 0);
+        assert_se(sd_bus_start(bus) >= 0);
+
+        assert_se(sd_bus_get_trusted_wire(bus) == trusted_wire);
+        assert_se(sd_bus_set_trusted_wire(bus, !trusted_wire) == -EPERM);
+
+        return bus;
+}
+
+static int method_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        const char *s;
+        int r;
+
+        r = sd_bus_message_read(m, "s", &s);
+        if (r < 0)
+                return r;
+
+        return sd_bus_reply_method_return(m, "s", s);
+}
+
+static int property_get(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *reply, void *userdata, sd_bus_error *error) {
+        return sd_bus_message_append(reply, "s", path);
+}
+
+static int property_set(sd_bus *bus, const char *path, const char *interface, const char *property, sd_bus_message *value, void *userdata, sd_bus_error *error) {
+        const char *s;
+
+        return sd_bus_message_read(value, "s", &s);
+}
+
+static const sd_bus_vtable vtable[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Method", "s", "s", method_handler, 0),
+        SD_BUS_PROPERTY("Value", "s", property_get, 0, SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE),
+        SD_BUS_WRITABLE_PROPERTY("Writable", "s", property_get, property_set, 0, 0),
+        SD_BUS_VTABLE_END
+};
+
+static int enumerator(sd_bus *bus, const char *path, void *userdata, char ***nodes, sd_bus_error *error) {
+        assert_se(*nodes = strv_new("/org/test/a", "/org/test/b"));
+        return 1;
+}
+
+static int ignore_handler(sd_bus_message *m, void *userdata, sd_bus_error *error) {
+        return 0;
+}
+
+static void add_objects(sd_bus *bus) {
+        assert_se(sd_bus_add_object_vtable(bus, NULL, "/org/test", "org.test", vtable, NULL) >= 0);
+        assert_se(sd_bus_add_fallback_vtable(bus, NULL, "/org", "org.test.Fallback", vtable, NULL, NULL) >= 0);
+        assert_se(sd_bus_add_fallback(bus, NULL, "/", ignore_handler, NULL) >= 0);
+        assert_se(sd_bus_add_node_enumerator(bus, NULL, "/org", enumerator, NULL) >= 0);
+        assert_se(sd_bus_add_object_manager(bus, NULL, "/") >= 0);
+
+        assert_se(sd_bus_add_match(bus, NULL, "type='method_call',path_namespace='/org',arg0='a string'", ignore_handler, NULL) >= 0);
+        assert_se(sd_bus_add_match(bus, NULL, "interface='org.test',member='Method',arg1path='/an/object/'", ignore_handler, NULL) >= 0);
+        assert_se(sd_bus_add_match(bus, NULL, "sender='org.test',path='/org/test',arg0namespace='a'", ignore_handler, NULL) >= 0);
+}
+
+static void seal_and_save(sd_bus_message *m, void **ret, size_t *ret_size) {
+        assert_se(sd_bus_message_seal(m, 4711, 0) >= 0);
+        assert_se(bus_message_get_blob(m, ret, ret_size) >= 0);
+}
+
+static void *patch(const void *blob, size_t size, const char *needle, const char *replacement) {
+        uint8_t *p, *q;
+
+        assert_se(strlen(needle) == strlen(replacement));
+
+        assert_se(p = memdup(blob, size));
+        assert_se(q = memmem(p, size, needle, strlen(needle)));
+        memcpy(q, replacement, strlen(replacement));
+
+        return p;
+}
+
+static void test_contents_not_validated(sd_bus *trusted, sd_bus *untrusted) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        _cleanup_free_ void *blob = NULL;
+        const char *s, *o;
+        size_t size;
+        void *p;
+
+        assert_se(sd_bus_message_new_method_call(trusted, &m, "org.test", "/org/test/header", "org.test", "Method") >= 0);
+        assert_se(sd_bus_message_append(m, "so", "valid-string", "/valid/path") >= 0);
+        seal_and_save(m, &blob, &size);
+        m = sd_bus_message_unref(m);
+
+        /* Invalid UTF-8 in a string */
+        p = patch(blob, size, "valid-string", "valid\xff" "string");
+        assert_se(bus_message_from_malloc(untrusted, p, size, NULL, 0, NULL, &m) >= 0);
+        assert_se(sd_bus_message_read(m, "s", &s) == -EBADMSG);
+        m = sd_bus_message_unref(m);
+
+        p = patch(blob, size, "valid-string", "valid\xff" "string");
+        assert_se(bus_message_from_malloc(trusted, p, size, NULL, 0, NULL, &m) >= 0);
+        assert_se(sd_bus_message_read(m, "so", &s, &o) >= 0);
+        assert_se(streq(s, "valid\xff" "string"));
+        assert_se(streq(o, "/valid/path"));
+        m = sd_bus_message_unref(m);
+
+        /* An object path with characters that aren't allowed */
+        p = patch(blob, size, "/valid/path", "/valid/pa-h");
+        assert_se(bus_message_from_malloc(untrusted, p, size, NULL, 0, NULL, &m) >= 0);
+        assert_se(sd_bus_message_read(m, "so", &s, &o) == -EBADMSG);
+        m = sd_bus_message_unref(m);
+
+        p = patch(blob, size, "/valid/path", "/valid/pa-h");
+        assert_se(bus_message_from_malloc(trusted, p, size, NULL, 0, NULL, &m) >= 0);
+        assert_se(sd_bus_message_read(m, "so", &s, &o) >= 0);
+        assert_se(streq(o, "/valid/pa-h"));
+        m = sd_bus_message_unref(m);
+
+        /* Same in the header, which is parsed right away */
+        p = patch(blob, size, "/org/test/header", "/org/test/he-der");
+        assert_se(bus_message_from_malloc(untrusted, p, size, NULL, 0, NULL, &m) == -EBADMSG);
+        free(p);
+
+        p = patch(blob, size, "/org/test/header", "/org/test/he-der");
+        assert_se(bus_message_from_malloc(trusted, p, size, NULL, 0, NULL, &m) >= 0);
+        assert_se(streq(m->path, "/org/test/he-der"));
+        m = sd_bus_message_unref(m);
+
+        /* But paths the object tree can't look up are refused even on a trusted wire */
+        p = patch(blob, size, "/valid/path", "/valid//ath");
+        assert_se(bus_message_from_malloc(trusted, p, size, NULL, 0, NULL, &m) >= 0);
+        assert_se(sd_bus_message_read(m, "so", &s, &o) == -EBADMSG);
+        m = sd_bus_message_unref(m);
+
+        p = patch(blob, size, "/org/test/header", "/org/test//eader");
+        assert_se(bus_message_from_malloc(trusted, p, size, NULL, 0, NULL, &m) == -EBADMSG);
+        free(p);
+
+        p = patch(blob, size, "/org/test/header", "org/test/header/");
+        assert_se(bus_message_from_malloc(trusted, p, size, NULL, 0, NULL, &m) == -EBADMSG);
+        free(p);
+
+        /* Strings still have to be NUL terminated where the length says they end */
+        p = patch(blob, size, "valid-string", "valid-strin\xff");
+        ((uint8_t*) memmem(p, size, "valid-strin\xff", 12))[12] = 'x';
+        assert_se(bus_message_from_malloc(trusted, p, size, NULL, 0, NULL, &m) >= 0);
+        assert_se(sd_bus_message_read(m, "s", &s) == -EBADMSG);
+        m = sd_bus_message_unref(m);
+}
+
+static void fuzz_one(sd_bus *bus, FILE *f, const void *data, size_t size) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        void *buffer;
+
+        if (size < sizeof(struct bus_header))
+                return;
+
+        /* Exactly as large as the input, so that reads past the end hit the redzone */
+        assert_se(buffer = memdup(data, size));
+
+        if (bus_message_from_malloc(bus, buffer, size, NULL, 0, NULL, &m) < 0) {
+                free(buffer);
+                return;
+        }
+
+        (void) bus_message_dump(m, f, BUS_MESSAGE_DUMP_WITH_HEADER);
+
+        /* Both look at the header fields before any callback gets to see the message. Set up like
+         * process_message() does, so that the callbacks aren't skipped as already run. */
+        bus->current_message = m;
+        bus->iteration_counter++;
+        bus->match_callbacks_modified = false;
+        (void) bus_match_run(bus, &bus->match_callbacks, m);
+        (void) bus_process_object(bus, m);
+        bus->current_message = NULL;
+}
+
+static void mutate(uint8_t *p, size_t *size) {
+        static const uint32_t interesting[] = { 0, 1, 2, 3, 7, 8, 0x7f, 0x80, 0xff, 0xffff, 0x7fffffff, 0xffffffff };
+        unsigned n;
+
+        for (n = 1 + next_random() % 4; n > 0; n--) {
+                size_t i;
+                uint32_t v;
+
+                if (*size == 0)
+                        return;
+
+                i = next_random() % *size;
+
+                switch (next_random() % 5) {
+
+                case 0:
+                        p[i] ^= 1U << (next_random() % 8);
+                        break;
+
+                case 1:
+                        p[i] = interesting[next_random() % ELEMENTSOF(interesting)];
+                        break;
+
+                case 2:
+                        /* Lengths and offsets are 32bit aligned on the wire */
+                        i = ALIGN_TO(i, 4);
+                        if (i + 4 > *size)
+                                break;
+                        v = interesting[next_random() % ELEMENTSOF(interesting)];
+                        if (next_random() % 2)
+                                v = next_random() % (*size + 8);
+                        memcpy(p + i, &v, sizeof(v));
+                        break;
+
+                case 3:
+                        p[i] = "sogvayb(){}\0"[next_random() % 12];
+                        break;
+
+                case 4:
+                        *size = i;
+                        break;
+                }
+        }
+}
+
+static void fuzz(sd_bus *trusted, sd_bus *untrusted, FILE *f, const void *seed, size_t size) {
+        _cleanup_free_ uint8_t *p = NULL;
+        unsigned i;
+
+        assert_se(p = malloc(size));
+
+        fuzz_one(trusted, f, seed, size);
+        fuzz_one(untrusted, f, seed, size);
+
+        for (i = 0; i < arg_n_iterations; i++) {
+                size_t n = size;
+
+                memcpy(p, seed, size);
+                mutate(p, &n);
+
+                fuzz_one(trusted, f, p, n);
+                fuzz_one(untrusted, f, p, n);
+        }
+}
+
+static void add_seed(void ***seeds, size_t **sizes, unsigned *n_seeds, void *blob, size_t size) {
+        assert_se(*seeds = reallocarray(*seeds, *n_seeds + 1, sizeof(void*)));
+        assert_se(*sizes = reallocarray(*sizes, *n_seeds + 1, sizeof(size_t)));
+
+        (*seeds)[*n_seeds] = blob;
+        (*sizes)[*n_seeds] = size;
+        (*n_seeds)++;
+}
+
+static void make_seed(sd_bus *bus, unsigned version, const char *signature, void ***seeds, size_t **sizes, unsigned *n_seeds, ...) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        va_list ap;
+        void *blob;
+        size_t size;
+
+        bus->message_version = version; /* dirty hack to enable gvariant */
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.test", "/org/test", "org.test", "Method") >= 0);
+
+        va_start(ap, n_seeds);
+        assert_se(sd_bus_message_appendv(m, signature, ap) >= 0);
+        va_end(ap);
+
+        seal_and_save(m, &blob, &size);
+        add_seed(seeds, sizes, n_seeds, blob, size);
+
+        bus->message_version = 1;
+}
+
+static void make_call_seed(sd_bus *bus, const char *path, const char *interface, const char *member, const char *signature, void ***seeds, size_t **sizes, unsigned *n_seeds, ...) {
+        _cleanup_(sd_bus_message_unrefp) sd_bus_message *m = NULL;
+        va_list ap;
+        void *blob;
+        size_t size;
+
+        assert_se(sd_bus_message_new_method_call(bus, &m, "org.test", path, interface, member) >= 0);
+
+        va_start(ap, n_seeds);
+        assert_se(sd_bus_message_appendv(m, signature, ap) >= 0);
+        va_end(ap);
+
+        seal_and_save(m, &blob, &size);
+        add_seed(seeds, sizes, n_seeds, blob, size);
+}
+
+static void make_seeds(sd_bus *bus, void ***seeds, size_t **sizes, unsigned *n_seeds) {
+        unsigned version;
+
+        for (version = 1; version <= 2; version++)
+                make_seed(bus, version, "sogybnqiuxtd", seeds, sizes, n_seeds,
+                          "a string", "/an/object/path", "a(sv)", 1, true,
+                          -2, 3, -4, 5, (int64_t) -6, (uint64_t) 7, 8.5);
+
+        /* The gvariant code can't read back variants and nested arrays, so these are dbus1 only */
+        make_seed(bus, 1, "a{sv}a(usv)as", seeds, sizes, n_seeds,
+                  3,
+                  "first", "s", "one",
+                  "second", "(st)", "two", (uint64_t) 2,
+                  "third", "ao", 2, "/a", "/a/b",
+                  2,
+                  4711, "x", "v", "s", "nested",
+                  4712, "y", "a{us}", 1, 1, "z",
+                  3, "a", "bb", "ccc");
+
+        make_seed(bus, 1, "ayaaiv", seeds, sizes, n_seeds,
+                  0, 2, 1, 1, 0, "ay", 3, 1, 2, 3);
+
+        /* Calls that make it all the way to the objects added by add_objects() */
+        make_call_seed(bus, "/org/test/a", "org.test.Fallback", "Method", "s", seeds, sizes, n_seeds, "a string");
+        make_call_seed(bus, "/org/test", "org.freedesktop.DBus.Introspectable", "Introspect", "", seeds, sizes, n_seeds);
+        make_call_seed(bus, "/org/test", "org.freedesktop.DBus.Properties", "Set", "ssv", seeds, sizes, n_seeds, "org.test", "Writable", "s", "value");
+        make_call_seed(bus, "/org/test/b", "org.freedesktop.DBus.Properties", "GetAll", "s", seeds, sizes, n_seeds, "org.test.Fallback");
+        make_call_seed(bus, "/", "org.freedesktop.DBus.ObjectManager", "GetManagedObjects", "", seeds, sizes, n_seeds);
+}
+
+int main(int argc, char *argv[]) {
+        _cleanup_(sd_bus_unrefp) sd_bus *trusted = NULL, *untrusted = NULL;
+        _cleanup_close_pair_ int pair[2] = { -1, -1 };
+        _cleanup_fclose_ FILE *f = NULL;
+        void **seeds = NULL;
+        size_t *sizes = NULL;
+        unsigned n_seeds = 0, i;
+        const char *e;
+
+        /* The dump complains loudly about every broken message */
+        test_setup_logging(LOG_CRIT);
+
+        e = getenv("BUS_FUZZ_ITERATIONS");
+        if (e)
+                assert_se(safe_atou(e, &arg_n_iterations) >= 0);
+
+        assert_se(socketpair(AF_UNIX, SOCK_STREAM, 0, pair) >= 0);
+        trusted = bus_new(true, pair[0]);
+        untrusted = bus_new(false, pair[1]);
+        pair[0] = pair[1] = -1;
+
+        test_contents_not_validated(trusted, untrusted);
+
+        /* Closed, so that whatever the object code replies is built but never queued */
+        add_objects(trusted);
+        add_objects(untrusted);
+        sd_bus_close(trusted);
+        sd_bus_close(untrusted);
+
+        make_seeds(trusted, &seeds, &sizes, &n_seeds);
+
+        for (i = 1; i < (unsigned) argc; i++) {
+                char *blob;
+                size_t size;
+
+                assert_se(read_full_file(argv[i], &blob, &size) >= 0);
+                add_seed(&seeds, &sizes, &n_seeds, blob, size);
+        }
+
+        assert_se(f = fopen("/dev/null", "we"));
+
+        for (i = 0; i < n_seeds; i++) {
+                fuzz(trusted, untrusted, f, seeds[i], sizes[i]);
+                free(seeds[i]);
+        }
+
+        free(seeds);
+        free(sizes);
+
+        return 0;
+}
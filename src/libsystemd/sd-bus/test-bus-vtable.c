@@ -56,6 +56,19 @@ static const sd_bus_vtable vtable[] = {
         SD_BUS_VTABLE_END
 };
 
+static const sd_bus_vtable vtable_exit[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Exit", "", "", handler, 0),
+        SD_BUS_VTABLE_END
+};
+
+static const sd_bus_vtable vtable_duplicate[] = {
+        SD_BUS_VTABLE_START(0),
+        SD_BUS_METHOD("Exit", "", "", handler, 0),
+        SD_BUS_METHOD("Exit", "", "", handler, 0),
+        SD_BUS_VTABLE_END
+};
+
 static void test_vtable(void) {
         sd_bus *bus = NULL;
         struct context c = {};
@@ -66,6 +79,10 @@ static void test_vtable(void) {
         assert(sd_bus_add_object_vtable(bus, NULL, "/foo", "org.freedesktop.systemd.testVtable", vtable, &c) >= 0);
         assert(sd_bus_add_object_vtable(bus, NULL, "/foo", "org.freedesktop.systemd.testVtable2", vtable, &c) >= 0);
 
+        /* Member names must be unique within an interface, also across vtables */
+        assert(sd_bus_add_object_vtable(bus, NULL, "/foo", "org.freedesktop.systemd.testVtable3", vtable_duplicate, &c) == -EEXIST);
+        assert(sd_bus_add_object_vtable(bus, NULL, "/foo", "org.freedesktop.systemd.testVtable", vtable_exit, &c) == -EEXIST);
+
         assert(sd_bus_set_address(bus, DEFAULT_BUS_PATH) >= 0);
         r = sd_bus_start(bus);
         assert(r == 0 ||     /* success */
@@ -43,6 +43,9 @@ enum {
         SD_BUS_VTABLE_PROPERTY_EMITS_CHANGE        = 1ULL << 5,
         SD_BUS_VTABLE_PROPERTY_EMITS_INVALIDATION  = 1ULL << 6,
         SD_BUS_VTABLE_PROPERTY_EXPLICIT            = 1ULL << 7,
+        /* Not in libsystemd. Allocated from the top of the free range, so that it won't collide with
+         * flags adopted from there. */
+        SD_BUS_VTABLE_PROPERTY_CACHED              = 1ULL << 39,
         _SD_BUS_VTABLE_CAPABILITY_MASK             = 0xFFFFULL << 40
 };
 
@@ -39,6 +39,7 @@ typedef struct sd_bus_message sd_bus_message;
 typedef struct sd_bus_slot sd_bus_slot;
 typedef struct sd_bus_creds sd_bus_creds;
 typedef struct sd_bus_track sd_bus_track;
+typedef struct sd_bus_proxy sd_bus_proxy;
 
 typedef struct {
         const char *name;
@@ -106,11 +107,58 @@ typedef int (*sd_bus_property_set_t) (sd_bus *bus, const char *path, const char
 typedef int (*sd_bus_object_find_t) (sd_bus *bus, const char *path, const char *interface, void *userdata, void **ret_found, sd_bus_error *ret_error);
 typedef int (*sd_bus_node_enumerator_t) (sd_bus *bus, const char *prefix, void *userdata, char ***ret_nodes, sd_bus_error *ret_error);
 typedef int (*sd_bus_track_handler_t) (sd_bus_track *track, void *userdata);
+typedef int (*sd_bus_proxy_handler_t) (sd_bus_proxy *proxy, const char *path, const char *interface, char **properties, void *userdata);
 typedef void (*sd_bus_destroy_t)(void *userdata);
+typedef int (*sd_bus_write_drained_handler_t)(sd_bus *bus, void *userdata);
+typedef int (*sd_bus_shed_handler_t)(sd_bus_message *m, void *userdata);
+typedef int (*sd_bus_slow_callback_handler_t)(sd_bus_slot *slot, sd_bus_message *m, uint64_t usec, void *userdata);
 
 #include "sd-bus-protocol.h"
 #include "sd-bus-vtable.h"
 
+/* Statistics */
+
+typedef struct {
+        /* Indexed by message type, messages of unknown types are counted at index 0 */
+        uint64_t messages_sent[_SD_BUS_MESSAGE_TYPE_MAX];
+        uint64_t bytes_sent[_SD_BUS_MESSAGE_TYPE_MAX];
+        uint64_t messages_received[_SD_BUS_MESSAGE_TYPE_MAX];
+        uint64_t bytes_received[_SD_BUS_MESSAGE_TYPE_MAX];
+
+        uint64_t read_calls;
+        uint64_t read_eagain;
+        uint64_t write_calls;
+        uint64_t write_eagain;
+        uint64_t partial_writes;
+
+        /* Like everything here, these count from the last sd_bus_reset_stats(), unlike the values
+         * sd_bus_get_queued_read_bytes() and friends report */
+        uint64_t rqueue_peak;
+        uint64_t rqueue_bytes_peak;
+        uint64_t wqueue_peak;
+        uint64_t wqueue_bytes_peak;
+
+        uint64_t match_callbacks;
+        uint64_t method_dispatches;
+        uint64_t reply_timeouts;
+        uint64_t expired_writes;
+        uint64_t shed_reads;
+        uint64_t messages_allocated;
+        uint64_t slow_callbacks;
+} sd_bus_stats;
+
+#define SD_BUS_LATENCY_BUCKETS 32
+
+typedef struct {
+        uint64_t calls;
+        uint64_t errors;
+        uint64_t usec_total;
+        uint64_t usec_max;
+        /* buckets[0] counts calls that took less than 1µs, buckets[i] those that took at least 2^(i-1)µs but
+         * less than 2^iµs, and the last one everything longer */
+        uint64_t buckets[SD_BUS_LATENCY_BUCKETS];
+} sd_bus_latency;
+
 /* Connections */
 
 int sd_bus_default(sd_bus **ret);
@@ -197,10 +245,57 @@ void* sd_bus_get_current_userdata(sd_bus *bus);
 
 int sd_bus_get_n_queued_read(sd_bus *bus, uint64_t *ret);
 int sd_bus_get_n_queued_write(sd_bus *bus, uint64_t *ret);
+int sd_bus_get_n_expired_write(sd_bus *bus, uint64_t *ret);
+int sd_bus_get_n_shed_read(sd_bus *bus, uint64_t *ret);
+int sd_bus_get_stats(sd_bus *bus, sd_bus_stats *ret, size_t size);
+int sd_bus_reset_stats(sd_bus *bus);
+int sd_bus_set_slot_latency(sd_bus *bus, int b);
+int sd_bus_get_slot_latency(sd_bus *bus);
+/* Slow callbacks are reported once they returned, a callback that never returns is never reported */
+int sd_bus_set_slow_callback_threshold(sd_bus *bus, uint64_t usec);
+int sd_bus_get_slow_callback_threshold(sd_bus *bus, uint64_t *ret);
+int sd_bus_set_slow_callback_handler(sd_bus *bus, sd_bus_slow_callback_handler_t callback, void *userdata);
+int sd_bus_get_queued_read_bytes(sd_bus *bus, uint64_t *ret, uint64_t *ret_high);
+int sd_bus_get_queued_write_bytes(sd_bus *bus, uint64_t *ret, uint64_t *ret_high);
+int sd_bus_set_max_queued_read_bytes(sd_bus *bus, uint64_t bytes);
+int sd_bus_get_max_queued_read_bytes(sd_bus *bus, uint64_t *ret);
+int sd_bus_set_max_queued_write_bytes(sd_bus *bus, uint64_t bytes);
+int sd_bus_get_max_queued_write_bytes(sd_bus *bus, uint64_t *ret);
+int sd_bus_set_write_watermarks(sd_bus *bus, uint64_t low, uint64_t high);
+int sd_bus_get_write_watermarks(sd_bus *bus, uint64_t *ret_low, uint64_t *ret_high);
+int sd_bus_set_write_drained_handler(sd_bus *bus, sd_bus_write_drained_handler_t callback, void *userdata);
+int sd_bus_is_write_blocked(sd_bus *bus);
+int sd_bus_set_message_type_priority(sd_bus *bus, uint8_t type, int64_t priority);
+int sd_bus_get_message_type_priority(sd_bus *bus, uint8_t type, int64_t *ret);
+int sd_bus_set_shed_threshold(sd_bus *bus, uint64_t n_messages, uint64_t bytes);
+int sd_bus_get_shed_threshold(sd_bus *bus, uint64_t *ret_n_messages, uint64_t *ret_bytes);
+int sd_bus_set_shed_handler(sd_bus *bus, sd_bus_shed_handler_t callback, void *userdata);
 
 int sd_bus_set_method_call_timeout(sd_bus *bus, uint64_t usec);
 int sd_bus_get_method_call_timeout(sd_bus *bus, uint64_t *ret);
 
+int sd_bus_set_introspection_cache_ttl(sd_bus *bus, uint64_t usec);
+int sd_bus_get_introspection_cache_ttl(sd_bus *bus, uint64_t *ret);
+
+int sd_bus_set_properties_changed_deferred(sd_bus *bus, int b);
+int sd_bus_get_properties_changed_deferred(sd_bus *bus);
+int sd_bus_set_properties_changed_interval(sd_bus *bus, uint64_t usec);
+int sd_bus_get_properties_changed_interval(sd_bus *bus, uint64_t *ret);
+
+int sd_bus_set_creds_cache(sd_bus *bus, int b);
+int sd_bus_get_creds_cache(sd_bus *bus);
+int sd_bus_get_creds_cache_stats(sd_bus *bus, uint64_t *ret_hits, uint64_t *ret_misses);
+int sd_bus_set_creds_lazy(sd_bus *bus, int b);
+int sd_bus_get_creds_lazy(sd_bus *bus);
+int sd_bus_set_name_owner_cache(sd_bus *bus, int b);
+int sd_bus_get_name_owner_cache(sd_bus *bus);
+int sd_bus_set_trusted_wire(sd_bus *bus, int b);
+int sd_bus_get_trusted_wire(sd_bus *bus);
+int sd_bus_set_cork(sd_bus *bus, int b);
+int sd_bus_get_cork(sd_bus *bus);
+int sd_bus_set_auto_cork(sd_bus *bus, int b);
+int sd_bus_get_auto_cork(sd_bus *bus);
+
 int sd_bus_add_filter(sd_bus *bus, sd_bus_slot **slot, sd_bus_message_handler_t callback, void *userdata);
 int sd_bus_add_match(sd_bus *bus, sd_bus_slot **slot, const char *match, sd_bus_message_handler_t callback, void *userdata);
 int sd_bus_add_match_async(sd_bus *bus, sd_bus_slot **slot, const char *match, sd_bus_message_handler_t callback, sd_bus_message_handler_t install_callback, void *userdata);
@@ -210,6 +305,7 @@ int sd_bus_add_object_vtable(sd_bus *bus, sd_bus_slot **slot, const char *path,
 int sd_bus_add_fallback_vtable(sd_bus *bus, sd_bus_slot **slot, const char *prefix, const char *interface, const sd_bus_vtable *vtable, sd_bus_object_find_t find, void *userdata);
 int sd_bus_add_node_enumerator(sd_bus *bus, sd_bus_slot **slot, const char *path, sd_bus_node_enumerator_t callback, void *userdata);
 int sd_bus_add_object_manager(sd_bus *bus, sd_bus_slot **slot, const char *path);
+int sd_bus_add_latency_object(sd_bus *bus, sd_bus_slot **slot, const char *path);
 
 /* Slot object */
 
@@ -225,6 +321,9 @@ int sd_bus_slot_get_floating(sd_bus_slot *slot);
 int sd_bus_slot_set_floating(sd_bus_slot *slot, int b);
 int sd_bus_slot_set_destroy_callback(sd_bus_slot *s, sd_bus_destroy_t callback);
 int sd_bus_slot_get_destroy_callback(sd_bus_slot *s, sd_bus_destroy_t *callback);
+int sd_bus_slot_get_latency(sd_bus_slot *slot, sd_bus_latency *ret, size_t size);
+int sd_bus_slot_get_method_latency(sd_bus_slot *slot, const char *member, sd_bus_latency *ret, size_t size);
+int sd_bus_slot_reset_latency(sd_bus_slot *slot);
 
 sd_bus_message* sd_bus_slot_get_current_message(sd_bus_slot *slot);
 sd_bus_message_handler_t sd_bus_slot_get_current_handler(sd_bus_slot *slot);
@@ -344,6 +443,7 @@ int sd_bus_emit_signal(sd_bus *bus, const char *path, const char *interface, con
 
 int sd_bus_emit_properties_changed_strv(sd_bus *bus, const char *path, const char *interface, char **names);
 int sd_bus_emit_properties_changed(sd_bus *bus, const char *path, const char *interface, const char *name, ...) _sd_sentinel_;
+int sd_bus_invalidate_cached_properties_strv(sd_bus *bus, const char *path, const char *interface, char **names);
 
 int sd_bus_emit_object_added(sd_bus *bus, const char *path);
 int sd_bus_emit_object_removed(sd_bus *bus, const char *path);
@@ -482,6 +582,22 @@ const char* sd_bus_track_next(sd_bus_track *track);
 int sd_bus_track_set_destroy_callback(sd_bus_track *s, sd_bus_destroy_t callback);
 int sd_bus_track_get_destroy_callback(sd_bus_track *s, sd_bus_destroy_t *ret);
 
+/* Mirroring remote objects */
+
+int sd_bus_proxy_new(sd_bus *bus, sd_bus_proxy **proxy, const char *destination, const char *path, const char *interface, sd_bus_proxy_handler_t handler, void *userdata);
+sd_bus_proxy* sd_bus_proxy_ref(sd_bus_proxy *proxy);
+sd_bus_proxy* sd_bus_proxy_unref(sd_bus_proxy *proxy);
+
+sd_bus* sd_bus_proxy_get_bus(sd_bus_proxy *proxy);
+int sd_bus_proxy_is_ready(sd_bus_proxy *proxy);
+
+int sd_bus_proxy_get_property(sd_bus_proxy *proxy, const char *path, const char *interface, const char *member, sd_bus_message **reply, const char *type);
+int sd_bus_proxy_get_property_trivial(sd_bus_proxy *proxy, const char *path, const char *interface, const char *member, char type, void *ptr);
+int sd_bus_proxy_get_property_string(sd_bus_proxy *proxy, const char *path, const char *interface, const char *member, char **ret);
+
+int sd_bus_proxy_get_paths(sd_bus_proxy *proxy, char ***ret);
+int sd_bus_proxy_get_interfaces(sd_bus_proxy *proxy, const char *path, char ***ret);
+
 /* Define helpers so that __attribute__((cleanup(sd_bus_unrefp))) and similar may be used. */
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_bus, sd_bus_unref);
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_bus, sd_bus_flush_close_unref);
@@ -489,6 +605,7 @@ _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_bus_slot, sd_bus_slot_unref);
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_bus_message, sd_bus_message_unref);
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_bus_creds, sd_bus_creds_unref);
 _SD_DEFINE_POINTER_CLEANUP_FUNC(sd_bus_track, sd_bus_track_unref);
+_SD_DEFINE_POINTER_CLEANUP_FUNC(sd_bus_proxy, sd_bus_proxy_unref);
 
 _SD_END_DECLARATIONS;
 
@@ -0,0 +1,231 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include <stdio.h>
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "macro.h"
+#include "parse-util.h"
+#include "string-util.h"
+#include "time-util.h"
+
+/* Measures insertion, lookup, iteration and removal with the key shapes sd-bus uses: object paths (nodes,
+ * managed objects), path components (children of a node), unique names (tracks), pids (creds cache), and
+ * uint64_t reply cookies in an OrderedHashmap, which sees a steady stream of insertions and removals. Each
+ * shape is measured with siphash and with the fast hash of the trusted_* hash_ops. Run it once for each
+ * hashmap implementation to compare them. */
+
+static unsigned arg_n_ops = 2000000;
+
+static const unsigned sizes[] = { 4, 64, 4096, 262144 };
+
+struct shape {
+        const char *name;
+        const struct hash_ops *hash_ops;
+        bool ordered;
+        const void **keys;
+        const void **misses;
+};
+
+static uint64_t *cookies;
+
+static const void *make_key(const char *name, unsigned i) {
+        char *s;
+
+        if (streq(name, "object path"))
+                assert_se(asprintf(&s, "/org/freedesktop/systemd/test/dir%u/object%u", i % 1000, i) >= 0);
+        else if (streq(name, "path component"))
+                assert_se(asprintf(&s, "object%u", i) >= 0);
+        else if (streq(name, "unique name"))
+                assert_se(asprintf(&s, ":1.%u", i) >= 0);
+        else if (streq(name, "pid"))
+                return UINT_TO_PTR(i + 1);
+        else
+                return &cookies[i];
+
+        return s;
+}
+
+static void *map_new(const struct shape *s) {
+        OrderedHashmap *o = NULL;
+
+        if (!s->ordered)
+                return hashmap_new(s->hash_ops);
+
+        assert_se(ordered_hashmap_ensure_allocated(&o, s->hash_ops) >= 0);
+        return o;
+}
+
+static void map_put(const struct shape *s, void *h, const void *key) {
+        if (s->ordered)
+                assert_se(ordered_hashmap_put((OrderedHashmap*) h, key, (void*) key) == 1);
+        else
+                assert_se(hashmap_put((Hashmap*) h, key, (void*) key) == 1);
+}
+
+static void *map_remove(const struct shape *s, void *h, const void *key) {
+        return s->ordered ? ordered_hashmap_remove((OrderedHashmap*) h, key) : hashmap_remove((Hashmap*) h, key);
+}
+
+static unsigned map_iterate(const struct shape *s, void *h) {
+        Iterator i;
+        void *v;
+        unsigned n = 0;
+
+        if (s->ordered)
+                ORDERED_HASHMAP_FOREACH(v, (OrderedHashmap*) h, i)
+                        n++;
+        else
+                HASHMAP_FOREACH(v, (Hashmap*) h, i)
+                        n++;
+
+        return n;
+}
+
+static const char *hash_name(const struct shape *s) {
+        return s->hash_ops->fast_hash ? "wyhash" : "siphash";
+}
+
+static double ns_per_op(usec_t t, unsigned n) {
+        return (double) t * NSEC_PER_USEC / n;
+}
+
+static void run(const struct shape *s, unsigned n) {
+        unsigned rounds, r, i, j, lookups, n_ops = 0;
+        usec_t t, t_insert = 0, t_hit = 0, t_miss = 0, t_iterate = 0, t_remove = 0;
+
+        /* Repeat everything often enough that small tables get measured over a similar number of operations */
+        rounds = MAX(1U, arg_n_ops / n);
+        lookups = MAX(n, arg_n_ops / rounds);
+
+        for (r = 0; r < rounds; r++) {
+                void *h;
+
+                assert_se(h = map_new(s));
+
+                t = now(CLOCK_MONOTONIC);
+                for (i = 0; i < n; i++)
+                        map_put(s, h, s->keys[i]);
+                t_insert += now(CLOCK_MONOTONIC) - t;
+
+                /* Visit the keys in an order unrelated to the insertion order */
+                t = now(CLOCK_MONOTONIC);
+                for (i = 0, j = 0; i < lookups; i++, j = (j + 7919) % n)
+                        assert_se(internal_hashmap_get(h, s->keys[j]) == s->keys[j]);
+                t_hit += now(CLOCK_MONOTONIC) - t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (i = 0, j = 0; i < lookups; i++, j = (j + 7919) % n)
+                        assert_se(!internal_hashmap_get(h, s->misses[j]));
+                t_miss += now(CLOCK_MONOTONIC) - t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (i = 0; i < MAX(1U, lookups / n); i++)
+                        assert_se(map_iterate(s, h) == n);
+                t_iterate += now(CLOCK_MONOTONIC) - t;
+
+                t = now(CLOCK_MONOTONIC);
+                for (i = 0, j = 0; i < n; i++, j = (j + 7919) % n)
+                        assert_se(map_remove(s, h, s->keys[j]) == s->keys[j]);
+                t_remove += now(CLOCK_MONOTONIC) - t;
+
+                assert_se(internal_hashmap_size(h) == 0);
+                internal_hashmap_free(h);
+
+                n_ops += n;
+        }
+
+        printf("%-16s %-8s %7u keys  insert %6.1f  hit %6.1f  miss %6.1f  iterate %6.1f  remove %6.1f ns/op\n",
+               s->name, hash_name(s), n,
+               ns_per_op(t_insert, n_ops),
+               ns_per_op(t_hit, lookups * rounds),
+               ns_per_op(t_miss, lookups * rounds),
+               ns_per_op(t_iterate, MAX(1U, lookups / n) * n_ops),
+               ns_per_op(t_remove, n_ops));
+}
+
+/* Like reply callbacks: every call adds a cookie, and its reply removes the oldest outstanding one */
+static void run_churn(const struct shape *s, unsigned n) {
+        void *h;
+        unsigned i;
+        usec_t t;
+
+        assert_se(h = map_new(s));
+
+        for (i = 0; i < 2 * n; i++)
+                cookies[i] = i;
+
+        for (i = 0; i < n; i++)
+                map_put(s, h, &cookies[i]);
+
+        t = now(CLOCK_MONOTONIC);
+        for (i = n; i < n + arg_n_ops; i++) {
+                cookies[i % (2 * n)] = i;
+                map_put(s, h, &cookies[i % (2 * n)]);
+                assert_se(map_remove(s, h, &cookies[(i - n) % (2 * n)]));
+        }
+        t = now(CLOCK_MONOTONIC) - t;
+
+        printf("%-16s %-8s %7u keys  put+remove %6.1f ns/op\n", "cookie churn", hash_name(s), n, ns_per_op(t, arg_n_ops));
+
+        internal_hashmap_free(h);
+}
+
+int main(int argc, char *argv[]) {
+        struct shape shapes[] = {
+                { "object path",    &string_hash_ops,          false },
+                { "object path",    &trusted_string_hash_ops,  false },
+                { "path component", &string_hash_ops,          false },
+                { "path component", &trusted_string_hash_ops,  false },
+                { "unique name",    &string_hash_ops,          false },
+                { "unique name",    &trusted_string_hash_ops,  false },
+                { "pid",            &trivial_hash_ops,         false },
+                { "pid",            &trusted_trivial_hash_ops, false },
+                { "cookie",         &uint64_hash_ops,          true  },
+                { "cookie",         &trusted_uint64_hash_ops,  true  },
+        };
+        unsigned max_size = sizes[ELEMENTSOF(sizes) - 1], i, k;
+
+        if (argc > 1)
+                assert_se(safe_atou(argv[1], &arg_n_ops) >= 0);
+
+        assert_se(arg_n_ops > 0);
+
+        printf("Hashmap implementation: %s\n", ENABLE_SWISS_HASHMAP ? "swiss" : "robin-hood");
+
+        assert_se(cookies = new(uint64_t, 4 * max_size));
+        for (i = 0; i < 4 * max_size; i++)
+                cookies[i] = i;
+
+        for (k = 0; k < ELEMENTSOF(shapes); k++) {
+                struct shape *s = &shapes[k];
+
+                assert_se(s->keys = new(const void*, max_size));
+                assert_se(s->misses = new(const void*, max_size));
+
+                for (i = 0; i < max_size; i++) {
+                        s->keys[i] = make_key(s->name, i);
+                        s->misses[i] = make_key(s->name, max_size + i);
+                }
+
+                for (i = 0; i < ELEMENTSOF(sizes); i++)
+                        run(s, sizes[i]);
+
+                if (s->hash_ops->compare == string_compare_func)
+                        for (i = 0; i < max_size; i++) {
+                                free((void*) s->keys[i]);
+                                free((void*) s->misses[i]);
+                        }
+
+                free(s->keys);
+                free(s->misses);
+        }
+
+        for (k = ELEMENTSOF(shapes) - 2; k < ELEMENTSOF(shapes); k++)
+                for (i = 0; i < ELEMENTSOF(sizes); i++)
+                        run_churn(&shapes[k], sizes[i]);
+
+        free(cookies);
+
+        return 0;
+}
@@ -0,0 +1,205 @@
+/* SPDX-License-Identifier: LGPL-2.1+ */
+
+#include "alloc-util.h"
+#include "hashmap.h"
+#include "macro.h"
+#include "set.h"
+
+/* Checks the hashmap implementation, whichever one is built, against a plain array. The number of keys is
+ * small compared to the number of operations, so that the tables go through a lot of growth, removal and
+ * tombstone cleanup. */
+
+#define N_KEYS 4096U
+#define N_OPS (64U * N_KEYS)
+
+static uint64_t keys[N_KEYS];
+static uint64_t seq[N_KEYS]; /* insertion sequence number, or 0 if not present */
+
+static unsigned next_random(void) {
+        static uint64_t state = 0x2545f4914f6cdd1dULL;
+
+        state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+        return state >> 33;
+}
+
+static unsigned pick(unsigned op) {
+        /* Work on a window of keys that moves along, so that the table size varies */
+        unsigned window = 1 + (op / 1024) % N_KEYS;
+
+        return next_random() % window;
+}
+
+static void check_hashmap(Hashmap *h, unsigned n) {
+        Iterator i;
+        uint64_t *v;
+        unsigned k, n_seen = 0;
+
+        assert_se(hashmap_size(h) == n);
+
+        for (k = 0; k < N_KEYS; k++)
+                assert_se(hashmap_get(h, &keys[k]) == (seq[k] > 0 ? &seq[k] : NULL));
+
+        HASHMAP_FOREACH(v, h, i) {
+                assert_se(*v > 0);
+                n_seen++;
+        }
+        assert_se(n_seen == n);
+}
+
+static void test_hashmap(const struct hash_ops *ops) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        uint64_t counter = 0;
+        Iterator i;
+        uint64_t *v;
+        unsigned op, k, n = 0;
+
+        memzero(seq, sizeof(seq));
+        assert_se(h = hashmap_new(ops));
+
+        for (op = 0; op < N_OPS; op++) {
+                k = pick(op);
+
+                if (next_random() % 3 == 0) {
+                        assert_se(hashmap_remove(h, &keys[k]) == (seq[k] > 0 ? &seq[k] : NULL));
+                        if (seq[k] > 0)
+                                n--;
+                        seq[k] = 0;
+                } else if (seq[k] > 0)
+                        assert_se(hashmap_put(h, &keys[k], &seq[k]) == 0);
+                else {
+                        seq[k] = ++counter;
+                        assert_se(hashmap_put(h, &keys[k], &seq[k]) == 1);
+                        n++;
+                }
+
+                if (op % 8192 == 0)
+                        check_hashmap(h, n);
+        }
+
+        check_hashmap(h, n);
+
+        /* Removing the current entry while iterating is allowed */
+        HASHMAP_FOREACH(v, h, i) {
+                assert_se(hashmap_remove(h, &keys[v - seq]) == v);
+                *v = 0;
+                n--;
+        }
+        assert_se(n == 0);
+        check_hashmap(h, 0);
+}
+
+static void test_ordered_hashmap(void) {
+        _cleanup_(ordered_hashmap_freep) OrderedHashmap *h = NULL;
+        uint64_t counter = 0, last;
+        Iterator i;
+        uint64_t *v;
+        unsigned op, k, n = 0, n_seen;
+
+        memzero(seq, sizeof(seq));
+        assert_se(ordered_hashmap_ensure_allocated(&h, &uint64_hash_ops) >= 0);
+
+        for (op = 0; op < N_OPS; op++) {
+                k = pick(op);
+
+                if (next_random() % 3 == 0) {
+                        assert_se(ordered_hashmap_remove(h, &keys[k]) == (seq[k] > 0 ? &seq[k] : NULL));
+                        if (seq[k] > 0)
+                                n--;
+                        seq[k] = 0;
+                } else if (seq[k] == 0) {
+                        seq[k] = ++counter;
+                        assert_se(ordered_hashmap_put(h, &keys[k], &seq[k]) == 1);
+                        n++;
+                }
+
+                if (op % 8192 != 0)
+                        continue;
+
+                /* Entries come in insertion order */
+                last = 0;
+                n_seen = 0;
+                ORDERED_HASHMAP_FOREACH(v, h, i) {
+                        assert_se(*v > last);
+                        last = *v;
+                        n_seen++;
+                }
+                assert_se(n_seen == n);
+        }
+
+        last = 0;
+        while ((v = ordered_hashmap_first(h))) {
+                assert_se(*v > last);
+                last = *v;
+                assert_se(ordered_hashmap_remove(h, &keys[v - seq]) == v);
+        }
+}
+
+static void test_set(void) {
+        _cleanup_(set_freep) Set *s = NULL;
+        unsigned op, k, n = 0;
+
+        memzero(seq, sizeof(seq));
+        assert_se(s = set_new(&uint64_hash_ops));
+
+        for (op = 0; op < N_OPS; op++) {
+                k = pick(op);
+
+                if (next_random() % 3 == 0) {
+                        assert_se(internal_hashmap_remove(HASHMAP_BASE(s), &keys[k]) == (seq[k] > 0 ? &keys[k] : NULL));
+                        if (seq[k] > 0)
+                                n--;
+                        seq[k] = 0;
+                } else {
+                        assert_se(set_put(s, &keys[k]) == (seq[k] > 0 ? 0 : 1));
+                        if (seq[k] == 0)
+                                n++;
+                        seq[k] = 1;
+                }
+        }
+
+        assert_se(set_size(s) == n);
+        for (k = 0; k < N_KEYS; k++)
+                assert_se(set_contains(s, &keys[k]) == (seq[k] > 0));
+
+        while (set_steal_first(s))
+                n--;
+        assert_se(n == 0);
+}
+
+static void test_small(void) {
+        _cleanup_hashmap_free_ Hashmap *h = NULL;
+        unsigned k;
+
+        /* Grows from direct storage, and shrinks back when cleared */
+        assert_se(h = hashmap_new(&uint64_hash_ops));
+
+        for (k = 0; k < 40; k++) {
+                assert_se(hashmap_put(h, &keys[k], &keys[k]) == 1);
+                assert_se(hashmap_get(h, &keys[k]) == &keys[k]);
+                assert_se(hashmap_size(h) == k + 1);
+        }
+
+        internal_hashmap_clear(HASHMAP_BASE(h));
+        assert_se(hashmap_isempty(h));
+
+        for (k = 0; k < 3; k++)
+                assert_se(hashmap_put(h, &keys[k], &keys[k]) == 1);
+        assert_se(hashmap_put(h, &keys[0], &keys[1]) == -EEXIST);
+        assert_se(hashmap_steal_first(h));
+        assert_se(hashmap_size(h) == 2);
+}
+
+int main(int argc, char *argv[]) {
+        unsigned k;
+
+        for (k = 0; k < N_KEYS; k++)
+                keys[k] = (uint64_t) k * 0x9e3779b97f4a7c15ULL;
+
+        test_small();
+        test_hashmap(&uint64_hash_ops);
+        test_hashmap(&trusted_uint64_hash_ops);
+        test_ordered_hashmap();
+        test_set();
+
+        return 0;
+}